@@ -0,0 +1,59 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// Bump-pointer arena: allocating moves a pointer forward, everything is
+// given back at once by resetting it or by ending a scope. For large
+// temporaries that would otherwise sit on the boot stack.
+#include "types.h"
+
+#define SCRATCH_ARENA_SIZE (64 * 1024)
+
+typedef struct {
+    uint8 *base;
+    uint32 size;
+    uint32 used;
+    uint32 peak;     // highest used since boot
+    uint32 failures; // allocations that did not fit
+} ARENA;
+
+// Marks where a scope began, see arena_scope_begin()
+typedef struct {
+    ARENA *arena;
+    uint32 mark;
+} ARENA_SCOPE;
+
+// Scratch memory of a shell command, reset after each command
+extern ARENA g_scratch_arena;
+
+/**
+ * an arena over size bytes of memory
+ */
+void arena_init(ARENA *arena, void *memory, uint32 size);
+
+/**
+ * size bytes aligned to 8, NULL if the arena is full
+ */
+void *arena_alloc(ARENA *arena, uint32 size);
+
+/**
+ * arena_alloc() with the memory zeroed
+ */
+void *arena_zalloc(ARENA *arena, uint32 size);
+
+/**
+ * give back everything allocated from the arena
+ */
+void arena_reset(ARENA *arena);
+
+/**
+ * start a scope: arena_scope_end() gives back what was allocated since.
+ * Scopes nest and must end in reverse order.
+ */
+ARENA_SCOPE arena_scope_begin(ARENA *arena);
+
+/**
+ * give back what was allocated since the scope began
+ */
+void arena_scope_end(ARENA_SCOPE scope);
+
+#endif
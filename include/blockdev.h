@@ -0,0 +1,59 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include "types.h"
+#include <stddef.h> // Для NULL
+
+#define BLOCKDEV_SECTOR_SIZE 512
+#define BLOCKDEV_MAX_DEVICES 8
+#define BLOCKDEV_NAME_LENGTH 16
+
+// MBR partition table, see https://wiki.osdev.org/MBR_(x86)
+#define MBR_PARTITION_TABLE_OFFSET 0x1BE
+#define MBR_SIGNATURE_OFFSET 0x1FE
+#define MBR_SIGNATURE 0xAA55
+#define MBR_MAX_PARTITIONS 4
+
+typedef struct {
+    uint8 status;
+    uint8 chs_first[3];
+    uint8 type;
+    uint8 chs_last[3];
+    uint32 lba_first;
+    uint32 sector_count;
+} __attribute__((packed)) MBR_PARTITION;
+
+struct BLOCK_DEVICE;
+
+// read/write count sectors starting at lba, relative to the device start
+typedef int (*BLOCKDEV_IO)(struct BLOCK_DEVICE *dev, uint32 lba, uint32 count, void *buffer);
+
+typedef struct BLOCK_DEVICE {
+    char name[BLOCKDEV_NAME_LENGTH];
+    uint8 drive;          // ide drive number, when backed by a disk
+    uint32 start_lba;     // first sector of the device on the drive
+    uint32 sector_count;  // size of the device in sectors
+    BLOCKDEV_IO read;
+    BLOCKDEV_IO write;
+    void *private_data;
+} BLOCK_DEVICE;
+
+/*
+ open a whole ide drive (partition = 0) or one of its MBR partitions (1-4)
+ returns NULL if the drive or the partition does not exist
+*/
+BLOCK_DEVICE *blockdev_open_ide(uint8 drive, uint8 partition);
+
+// register a device provided by another driver, returns NULL if the table is full
+BLOCK_DEVICE *blockdev_register(const char *name, uint32 sector_count,
+                                BLOCKDEV_IO read, BLOCKDEV_IO write, void *private_data);
+
+BLOCK_DEVICE *blockdev_find(const char *name);
+
+// 1 if dev is a drive or partition from blockdev_open_ide()
+int blockdev_is_ide(const BLOCK_DEVICE *dev);
+
+int blockdev_read(BLOCK_DEVICE *dev, uint32 lba, uint32 count, void *buffer);
+int blockdev_write(BLOCK_DEVICE *dev, uint32 lba, uint32 count, const void *buffer);
+
+#endif
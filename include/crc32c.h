@@ -0,0 +1,21 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+// CRC-32C (Castagnoli, reflected polynomial 0x82F63B78), as used by
+// iSCSI, ext4 and btrfs. crc32c(0, "123456789", 9) == 0xE3069283.
+#include "types.h"
+
+// Continue crc over len more bytes, start with 0. The SSE4.2 crc32
+// instruction is used when CPUID reports it, slice-by-8 tables otherwise;
+// the first call probes the CPU and builds the tables.
+uint32 crc32c(uint32 crc, const void *data, uint32 len);
+
+// 1 if crc32c() runs on the SSE4.2 instruction
+int crc32c_hw();
+
+// The two implementations, to measure them against each other.
+// crc32c_sse42() must only be called when crc32c_hw() is 1.
+uint32 crc32c_sse42(uint32 crc, const void *data, uint32 len);
+uint32 crc32c_slice8(uint32 crc, const void *data, uint32 len);
+
+#endif
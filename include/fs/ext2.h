@@ -0,0 +1,185 @@
+#ifndef EXT2_H
+#define EXT2_H
+
+// Second extended file system, see https://www.nongnu.org/ext2-doc/ext2.html
+#include "../types.h"
+#include "../blockdev.h"
+#include "vfs.h"
+
+#define EXT2_SUPER_MAGIC        0xEF53
+#define EXT2_SUPERBLOCK_OFFSET  1024
+#define EXT2_ROOT_INO           2
+#define EXT2_GOOD_OLD_FIRST_INO 11
+#define EXT2_GOOD_OLD_INODE_SIZE 128
+#define EXT2_NAME_LEN           255
+
+#define EXT2_MIN_BLOCK_SIZE     1024
+#define EXT2_MAX_BLOCK_SIZE     4096
+#define EXT2_MAX_GROUPS         128
+#define EXT2_MAX_MOUNTS         2
+
+// block pointers in an inode
+#define EXT2_NDIR_BLOCKS        12
+#define EXT2_IND_BLOCK          12
+#define EXT2_DIND_BLOCK         13
+#define EXT2_TIND_BLOCK         14
+#define EXT2_N_BLOCKS           15
+
+// feature flags
+#define EXT2_FEATURE_COMPAT_DIR_INDEX       0x0020
+#define EXT2_FEATURE_INCOMPAT_FILETYPE      0x0002
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE   0x0002
+
+#define EXT2_SUPPORTED_INCOMPAT  (EXT2_FEATURE_INCOMPAT_FILETYPE)
+#define EXT2_SUPPORTED_RO_COMPAT (EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+
+// i_mode
+#define EXT2_S_IFMT   0xF000
+#define EXT2_S_IFREG  0x8000
+#define EXT2_S_IFDIR  0x4000
+
+// i_flags
+#define EXT2_INDEX_FL 0x00001000
+
+// directory entry file types
+#define EXT2_FT_UNKNOWN  0
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR      2
+
+// error codes returned by the driver, same values as VFS_ERR_*
+#define EXT2_ERR_IO        -1
+#define EXT2_ERR_NOT_FOUND -2
+#define EXT2_ERR_EXISTS    -3
+#define EXT2_ERR_NO_SPACE  -4
+#define EXT2_ERR_NOT_DIR   -5
+#define EXT2_ERR_IS_DIR    -6
+#define EXT2_ERR_NOT_EMPTY -7
+#define EXT2_ERR_READ_ONLY -8
+#define EXT2_ERR_INVALID   -9
+
+typedef struct {
+    uint32 s_inodes_count;
+    uint32 s_blocks_count;
+    uint32 s_r_blocks_count;
+    uint32 s_free_blocks_count;
+    uint32 s_free_inodes_count;
+    uint32 s_first_data_block;
+    uint32 s_log_block_size;
+    uint32 s_log_frag_size;
+    uint32 s_blocks_per_group;
+    uint32 s_frags_per_group;
+    uint32 s_inodes_per_group;
+    uint32 s_mtime;
+    uint32 s_wtime;
+    uint16 s_mnt_count;
+    uint16 s_max_mnt_count;
+    uint16 s_magic;
+    uint16 s_state;
+    uint16 s_errors;
+    uint16 s_minor_rev_level;
+    uint32 s_lastcheck;
+    uint32 s_checkinterval;
+    uint32 s_creator_os;
+    uint32 s_rev_level;
+    uint16 s_def_resuid;
+    uint16 s_def_resgid;
+    // EXT2_DYNAMIC_REV
+    uint32 s_first_ino;
+    uint16 s_inode_size;
+    uint16 s_block_group_nr;
+    uint32 s_feature_compat;
+    uint32 s_feature_incompat;
+    uint32 s_feature_ro_compat;
+    uint8 s_uuid[16];
+    char s_volume_name[16];
+    char s_last_mounted[64];
+    uint32 s_algo_bitmap;
+    uint8 s_reserved[820];
+} __attribute__((packed)) EXT2_SUPERBLOCK;
+
+typedef struct {
+    uint32 bg_block_bitmap;
+    uint32 bg_inode_bitmap;
+    uint32 bg_inode_table;
+    uint16 bg_free_blocks_count;
+    uint16 bg_free_inodes_count;
+    uint16 bg_used_dirs_count;
+    uint16 bg_pad;
+    uint8 bg_reserved[12];
+} __attribute__((packed)) EXT2_GROUP_DESC;
+
+typedef struct {
+    uint16 i_mode;
+    uint16 i_uid;
+    uint32 i_size;
+    uint32 i_atime;
+    uint32 i_ctime;
+    uint32 i_mtime;
+    uint32 i_dtime;
+    uint16 i_gid;
+    uint16 i_links_count;
+    uint32 i_blocks;      // in 512-byte sectors
+    uint32 i_flags;
+    uint32 i_osd1;
+    uint32 i_block[EXT2_N_BLOCKS];
+    uint32 i_generation;
+    uint32 i_file_acl;
+    uint32 i_dir_acl;     // high 32 bits of the size for regular files
+    uint32 i_faddr;
+    uint8 i_osd2[12];
+} __attribute__((packed)) EXT2_INODE;
+
+typedef struct {
+    uint32 inode;
+    uint16 rec_len;
+    uint8 name_len;
+    uint8 file_type;
+    char name[];
+} __attribute__((packed)) EXT2_DIR_ENTRY;
+
+typedef struct {
+    BLOCK_DEVICE *dev;
+    EXT2_SUPERBLOCK sb;
+    EXT2_GROUP_DESC groups[EXT2_MAX_GROUPS];
+    uint32 block_size;
+    uint32 sectors_per_block;
+    uint32 group_count;
+    uint32 gdt_block;        // first block of the group descriptor table
+    uint32 inode_size;
+    uint32 first_ino;
+    uint32 addr_per_block;   // block numbers per indirect block
+    uint8 read_only;
+    uint8 sb_dirty;
+    uint8 mounted;
+} EXT2_FS;
+
+// called for every entry by ext2_readdir, return non zero to stop
+typedef int (*EXT2_DIR_CALLBACK)(const char *name, uint32 ino, uint8 file_type, void *arg);
+
+EXT2_FS *ext2_mount(BLOCK_DEVICE *dev);
+void ext2_unmount(EXT2_FS *fs);
+int ext2_sync(EXT2_FS *fs);
+
+// resolve an absolute path inside the file system, 0 if not found
+uint32 ext2_lookup(EXT2_FS *fs, const char *path);
+int ext2_read_inode(EXT2_FS *fs, uint32 ino, EXT2_INODE *inode);
+
+// file data, returns bytes transferred or a negative EXT2_ERR_*
+int ext2_read(EXT2_FS *fs, uint32 ino, uint32 offset, void *buffer, uint32 length);
+int ext2_write(EXT2_FS *fs, uint32 ino, uint32 offset, const void *buffer, uint32 length);
+int ext2_truncate(EXT2_FS *fs, uint32 ino, uint32 size);
+
+int ext2_readdir(EXT2_FS *fs, uint32 dir_ino, EXT2_DIR_CALLBACK callback, void *arg);
+
+// create a regular file or a directory (mode & EXT2_S_IFDIR), returns the new inode or an error
+int ext2_create(EXT2_FS *fs, const char *path, uint16 mode);
+// remove a file or an empty directory
+int ext2_unlink(EXT2_FS *fs, const char *path);
+// move a file or directory to a path that does not exist yet
+int ext2_rename(EXT2_FS *fs, const char *from, const char *to);
+
+// driver for vfs_register_driver(), mounts take a block device
+extern VFS_DRIVER ext2_driver;
+
+#endif
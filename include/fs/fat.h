@@ -0,0 +1,151 @@
+#ifndef FAT_H
+#define FAT_H
+
+// FAT12/16/32 with long file names (VFAT), see Microsoft's
+// "FAT32 File System Specification" (fatgen103)
+#include "../types.h"
+#include "../blockdev.h"
+#include "vfs.h"
+
+#define FAT_SECTOR_SIZE         512
+#define FAT_MAX_MOUNTS          2
+#define FAT_ROOT_NODE           0
+#define FAT_NAME_LEN            255   // UCS-2 characters of a long name
+#define FAT_SFN_LEN             11    // 8.3 name as stored, space padded
+#define FAT_ENTRY_SIZE          32
+#define FAT_ENTRIES_PER_SECTOR  (FAT_SECTOR_SIZE / FAT_ENTRY_SIZE)
+#define FAT_MAX_DIR_ENTRIES     65536 // a directory is at most 2 MiB
+
+// below these cluster counts a volume is FAT12 or FAT16, FAT32 otherwise
+#define FAT12_MAX_CLUSTERS      4084
+#define FAT16_MAX_CLUSTERS      65524
+
+// FAT entries: 0 is free, fat_get() reports every end of chain,
+// bad cluster or out of range value as FAT_EOC
+#define FAT_FREE                0
+#define FAT_EOC                 0x0FFFFFFF
+#define FAT_UNKNOWN             0xFFFFFFFF
+
+// attributes
+#define FAT_ATTR_READ_ONLY      0x01
+#define FAT_ATTR_HIDDEN         0x02
+#define FAT_ATTR_SYSTEM         0x04
+#define FAT_ATTR_VOLUME_ID      0x08
+#define FAT_ATTR_DIRECTORY      0x10
+#define FAT_ATTR_ARCHIVE        0x20
+#define FAT_ATTR_LFN            0x0F
+#define FAT_ATTR_LFN_MASK       0x3F
+
+// first byte of a directory entry name
+#define FAT_DIR_END             0x00  // this and all following entries are free
+#define FAT_DIR_DELETED         0xE5
+#define FAT_DIR_KANJI_E5        0x05  // a name really starting with 0xE5
+
+// long name entries, stored in reverse order before the short entry
+#define FAT_LFN_LAST            0x40
+#define FAT_LFN_SEQ_MASK        0x1F
+#define FAT_LFN_CHARS           13
+#define FAT_LFN_MAX_ENTRIES     20
+
+// case of a short name as shown, in nt_res (Windows NT and Linux)
+#define FAT_NT_LOWER_BASE       0x08
+#define FAT_NT_LOWER_EXT        0x10
+
+#define FAT_FSINFO_LEAD_SIG     0x41615252
+#define FAT_FSINFO_STRUCT_SIG   0x61417272
+#define FAT_FSINFO_TRAIL_SIG    0xAA550000
+#define FAT_BOOT_SIGNATURE      0xAA55
+
+// BPB_ExtFlags of FAT32: only the FAT in the low bits is active
+#define FAT32_NO_MIRROR         0x0080
+#define FAT32_ACTIVE_FAT_MASK   0x000F
+
+typedef struct {
+    uint8 jump[3];
+    char oem_name[8];
+    uint16 bytes_per_sector;
+    uint8 sectors_per_cluster;
+    uint16 reserved_sectors;
+    uint8 fat_count;
+    uint16 root_entries;        // 0 on FAT32
+    uint16 total_sectors_16;
+    uint8 media;
+    uint16 fat_size_16;         // 0 on FAT32
+    uint16 sectors_per_track;
+    uint16 heads;
+    uint32 hidden_sectors;
+    uint32 total_sectors_32;
+    // FAT32 only from here on
+    uint32 fat_size_32;
+    uint16 ext_flags;
+    uint16 fs_version;
+    uint32 root_cluster;
+    uint16 fs_info;
+    uint16 backup_boot;
+    uint8 reserved[12];
+} __attribute__((packed)) FAT_BOOT_SECTOR;
+
+typedef struct {
+    uint32 lead_sig;
+    uint8 reserved1[480];
+    uint32 struct_sig;
+    uint32 free_count;          // FAT_UNKNOWN if not known
+    uint32 next_free;           // hint where to look for free clusters
+    uint8 reserved2[12];
+    uint32 trail_sig;
+} __attribute__((packed)) FAT_FSINFO;
+
+typedef struct {
+    uint8 name[FAT_SFN_LEN];
+    uint8 attr;
+    uint8 nt_res;
+    uint8 create_time_tenth;
+    uint16 create_time;
+    uint16 create_date;
+    uint16 access_date;
+    uint16 cluster_high;        // FAT32 only
+    uint16 write_time;
+    uint16 write_date;
+    uint16 cluster_low;
+    uint32 size;
+} __attribute__((packed)) FAT_DIR_ENTRY;
+
+typedef struct {
+    uint8 order;                // sequence number, FAT_LFN_LAST on the first stored
+    uint8 name1[10];            // characters 1-5
+    uint8 attr;                 // FAT_ATTR_LFN
+    uint8 type;
+    uint8 checksum;             // of the short name
+    uint8 name2[12];            // characters 6-11
+    uint16 cluster;             // always 0
+    uint8 name3[4];             // characters 12-13
+} __attribute__((packed)) FAT_LFN_ENTRY;
+
+typedef struct {
+    BLOCK_DEVICE *dev;
+    uint32 type;                // 12, 16 or 32
+    uint32 sectors_per_cluster;
+    uint32 cluster_size;        // in bytes
+    uint32 fat_start;           // first sector of the (active) FAT
+    uint32 fat_sectors;         // size of one FAT
+    uint32 fat_count;
+    uint8 fat_mirror;           // FAT sectors are written to every copy
+    uint32 root_start;          // FAT12/16: fixed size root directory
+    uint32 root_sectors;
+    uint32 root_cluster;        // FAT32: root directory cluster chain
+    uint32 data_start;          // sector of cluster 2
+    uint32 cluster_count;       // clusters 2 .. cluster_count + 1 exist
+    uint32 fsinfo_sector;       // FAT32, 0 if there is none
+    uint32 free_count;          // FAT_UNKNOWN if not known
+    uint32 next_free;           // where alloc_cluster() starts looking
+    uint8 fsinfo_dirty;
+    uint8 mounted;
+} FAT_FS;
+
+// driver for vfs_register_driver(), mounts take a block device.
+// Nodes are the position of a file's short directory entry,
+// sector * FAT_ENTRIES_PER_SECTOR + index, FAT_ROOT_NODE for the root;
+// a rename moves the entry and reports it with vfs_node_moved().
+extern VFS_DRIVER fat_driver;
+
+#endif
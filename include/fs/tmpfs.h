@@ -0,0 +1,42 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+// File system in kernel memory. Contents live in 4 KiB frames taken from
+// the frame allocator (pmm.h) as files grow and given back as they
+// shrink; nothing is ever written to a disk. A clone shares the pages of its original, a
+// page is copied when either file first writes to it.
+#include "../types.h"
+#include "vfs.h"
+
+#define TMPFS_PAGE_SIZE     4096
+#define TMPFS_MAX_MOUNTS    2
+#define TMPFS_MAX_NODES     1024  // per volume, the root included
+#define TMPFS_NAME_LENGTH   32
+#define TMPFS_ROOT_NODE     0
+
+// pages of a node are physical addresses, 0 is a hole (reads as zeros)
+#define TMPFS_DIRECT_PAGES  8
+#define TMPFS_INDIRECT_ORDER 1 // the table past the direct pages is 2 frames
+#define TMPFS_INDIRECT_PAGES ((TMPFS_PAGE_SIZE << TMPFS_INDIRECT_ORDER) / sizeof(uint32))
+#define TMPFS_MAX_FILE_PAGES (TMPFS_DIRECT_PAGES + TMPFS_INDIRECT_PAGES)
+
+typedef struct {
+    char name[TMPFS_NAME_LENGTH];
+    uint32 parent;
+    uint32 size;
+    uint16 permissions;
+    uint8 is_directory;
+    uint32 direct[TMPFS_DIRECT_PAGES];
+    uint32 indirect;    // table of the pages past the direct ones
+} TMPFS_NODE;
+
+typedef struct {
+    TMPFS_NODE *nodes[TMPFS_MAX_NODES]; // from a slab cache, NULL for a free slot
+    uint32 max_pages;   // size cap, "size=<KB>" mount option
+    uint32 used_pages;  // data and indirect pages
+    uint8 mounted;
+} TMPFS;
+
+extern VFS_DRIVER tmpfs_driver;
+
+#endif
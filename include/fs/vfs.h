@@ -0,0 +1,136 @@
+#ifndef VFS_H
+#define VFS_H
+
+// Virtual file system: mount table, open-file table and path routing
+// on top of pluggable file system drivers
+#include "../types.h"
+#include "../blockdev.h"
+
+#define VFS_MAX_DRIVERS     8
+#define VFS_MAX_MOUNTS      8
+#define VFS_MAX_OPEN        32
+#define VFS_PATH_LENGTH     256
+#define VFS_TYPE_LENGTH     16
+
+// vfs_open() flags
+#define VFS_O_READ   0x01
+#define VFS_O_WRITE  0x02
+#define VFS_O_CREAT  0x04
+#define VFS_O_TRUNC  0x08
+#define VFS_O_APPEND 0x10
+
+// vfs_lseek() origins
+#define VFS_SEEK_SET 0
+#define VFS_SEEK_CUR 1
+#define VFS_SEEK_END 2
+
+// error codes, drivers return them as well
+#define VFS_ERR_IO        -1
+#define VFS_ERR_NOT_FOUND -2
+#define VFS_ERR_EXISTS    -3
+#define VFS_ERR_NO_SPACE  -4
+#define VFS_ERR_NOT_DIR   -5
+#define VFS_ERR_IS_DIR    -6
+#define VFS_ERR_NOT_EMPTY -7
+#define VFS_ERR_READ_ONLY -8
+#define VFS_ERR_INVALID   -9
+#define VFS_ERR_TOO_BIG   -10
+#define VFS_ERR_BAD_FD    -11
+#define VFS_ERR_TOO_MANY  -12
+#define VFS_ERR_BUSY      -13
+#define VFS_ERR_NO_DRIVER -14
+#define VFS_ERR_CROSS_DEVICE -15
+#define VFS_ERR_NOT_SUPPORTED -16
+
+typedef struct {
+    uint32 node;        // driver specific file id (inode, table index, ...)
+    uint32 size;
+    uint32 allocated;   // bytes of storage behind it, less than size when sparse
+    uint32 permissions;
+    uint8 is_directory;
+} VFS_STAT;
+
+// called for every entry by vfs_readdir, return non zero to stop
+typedef int (*VFS_DIR_CALLBACK)(const char *name, const VFS_STAT *st, void *arg);
+
+// A file system driver. Paths handed to it are relative to the root of
+// the mounted volume and always start with '/'. All functions return 0
+// or a byte count on success and a negative VFS_ERR_* on failure.
+typedef struct {
+    const char *name;
+    // private state of a mounted volume, NULL if it cannot be mounted
+    void *(*mount)(BLOCK_DEVICE *dev, const char *options);
+    void (*unmount)(void *fs);
+    int (*sync)(void *fs);
+    // optional: write out what write() kept back for node, on vfs_fsync()
+    // and when a file opened for writing is closed
+    int (*flush)(void *fs, uint32 node);
+    int (*lookup)(void *fs, const char *path, VFS_STAT *st);
+    int (*stat)(void *fs, uint32 node, VFS_STAT *st);
+    int (*read)(void *fs, uint32 node, uint32 offset, void *buffer, uint32 length);
+    int (*write)(void *fs, uint32 node, uint32 offset, const void *buffer, uint32 length);
+    int (*truncate)(void *fs, uint32 node, uint32 size);
+    int (*create)(void *fs, const char *path, uint8 is_directory, uint32 permissions, VFS_STAT *st);
+    int (*unlink)(void *fs, const char *path);
+    // move from to the path to, which must not exist yet; nodes keep their number
+    int (*rename)(void *fs, const char *from, const char *to);
+    int (*readdir)(void *fs, uint32 node, VFS_DIR_CALLBACK callback, void *arg);
+    // optional: replace the contents of file to with those of file from,
+    // sharing the data copy-on-write instead of copying it
+    int (*clone)(void *fs, uint32 from, uint32 to);
+    // optional: 0 if file node certainly does not contain the text, 1 if
+    // it may, from an index and without reading the contents
+    int (*might_contain)(void *fs, uint32 node, const char *text, uint32 length);
+} VFS_DRIVER;
+
+typedef struct {
+    char path[VFS_PATH_LENGTH];   // normalized mount point
+    VFS_DRIVER *driver;
+    BLOCK_DEVICE *dev;            // NULL for volumes without a device
+    void *fs;
+    uint8 in_use;
+} VFS_MOUNT;
+
+int vfs_register_driver(VFS_DRIVER *driver);
+
+// mount point must be an existing directory, "/" only for the first mount;
+// VFS_ERR_INVALID if the driver cannot mount what dev holds
+int vfs_mount(const char *type, BLOCK_DEVICE *dev, const char *path, const char *options);
+int vfs_umount(const char *path);
+// i-th mount table slot, NULL past the end or if unused
+VFS_MOUNT *vfs_get_mount(int index);
+int vfs_sync();
+
+// collapse "//", "." and ".." of an absolute path, 0 on success
+int vfs_normalize_path(const char *path, char *out);
+
+int vfs_stat(const char *path, VFS_STAT *st);
+int vfs_create(const char *path, uint8 is_directory, uint32 permissions);
+int vfs_unlink(const char *path);
+// both paths on the same volume, to must not exist
+int vfs_rename(const char *from, const char *to);
+// create the file to sharing the contents of from copy-on-write, same
+// volume only; VFS_ERR_NOT_SUPPORTED if the driver cannot
+int vfs_clone(const char *from, const char *to);
+int vfs_readdir(const char *path, VFS_DIR_CALLBACK callback, void *arg);
+// whether the file node listed by vfs_readdir(dir) may contain the text;
+// 1 when the driver keeps no index
+int vfs_might_contain(const char *dir, uint32 node, const char *text, uint32 length);
+
+// returns a file descriptor
+int vfs_open(const char *path, uint32 flags);
+int vfs_read(int fd, void *buffer, uint32 length);
+int vfs_write(int fd, const void *buffer, uint32 length);
+// returns the new offset
+int vfs_lseek(int fd, int offset, int whence);
+// write out what the driver keeps back for the file: its flush hook,
+// else a sync of the whole volume
+int vfs_fsync(int fd);
+// the descriptor is freed even if writing out buffered data fails
+int vfs_close(int fd);
+
+// for drivers that renumber nodes (e.g. when compacting a table):
+// open files on node from now refer to node to
+void vfs_node_moved(void *fs, uint32 from, uint32 to);
+
+#endif
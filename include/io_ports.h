@@ -38,4 +38,14 @@ void outportl(uint16 port, uint32 data);
  */
 void outportw(unsigned short port, unsigned short value);
 
+/**
+ * disable interrupts, returning EFLAGS from before for irq_restore()
+ */
+uint32 irq_save();
+
+/**
+ * enable interrupts again if they were enabled when flags was saved
+ */
+void irq_restore(uint32 flags);
+
 #endif
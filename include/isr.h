@@ -42,6 +42,12 @@ void isr_end_interrupt(int num);
  */
 void isr_exception_handler(REGISTERS reg);
 
+/**
+ * report an exception nobody handles and stop,
+ * for handlers that cannot resolve theirs
+ */
+void isr_panic(REGISTERS *reg);
+
 /**
  * invoke isr routine and send eoi to pic,
  * being called in irq.asm
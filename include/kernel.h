@@ -14,6 +14,8 @@ extern uint8 __kernel_rodata_section_start;
 extern uint8 __kernel_rodata_section_end;
 extern uint8 __kernel_bss_section_start;
 extern uint8 __kernel_bss_section_end;
+extern uint8 __kernel_stack_start; // boot stack, part of bss
+extern uint8 __kernel_stack_end;
 
 #endif
 
@@ -0,0 +1,111 @@
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+// Kernel heap on top of the frame allocator (pmm.h). Objects of one size
+// come from a slab cache: blocks of frames cut into equal slots with a
+// free list per slab, so allocating and freeing are a few pointer moves.
+// kmalloc() routes a request to the cache of the smallest size class
+// that holds it, and takes whole frames for anything above the largest.
+// Safe to call with interrupts enabled or from an interrupt handler.
+#include "types.h"
+
+#define KMEM_NAME_LENGTH 16
+#define KMEM_MAX_CACHES 16
+#define KMALLOC_MIN_SIZE 16
+#define KMALLOC_MAX_SLAB_SIZE 2048 // larger requests get whole frames
+#define KMALLOC_TRACK_SITES 64     // callsites the tracking mode tells apart
+#define KMALLOC_TRACK_LIVE 2048    // allocations it follows at once
+
+struct KMEM_SLAB;
+
+typedef struct {
+    char name[KMEM_NAME_LENGTH];
+    uint32 object_size;    // requested size rounded up to 8
+    uint32 order;          // a slab is 2^order frames
+    uint32 per_slab;       // objects in one slab
+    struct KMEM_SLAB *partial; // slabs with free and used objects
+    struct KMEM_SLAB *full;
+    struct KMEM_SLAB *empty;   // at most one is kept, the rest go back to pmm
+    uint32 slabs;
+    uint32 in_use;         // objects handed out and not freed
+    uint32 allocations;    // since boot
+    uint32 frees;
+} KMEM_CACHE;
+
+typedef struct {
+    uint32 large_allocations; // requests above KMALLOC_MAX_SLAB_SIZE
+    uint32 large_frames;      // frames they hold now
+    uint32 failures;          // allocations that found no memory
+    uint32 untracked;         // allocations the tracking tables had no room for
+} KMALLOC_STATS;
+
+// Allocations of one callsite, recorded while tracking is on
+typedef struct {
+    uint32 site;        // return address of the allocating call
+    uint32 live_bytes;  // requested and not freed yet
+    uint32 live_count;
+    uint32 allocations; // since tracking started
+} KMALLOC_SITE;
+
+extern KMALLOC_STATS kmalloc_stats;
+
+/**
+ * set up the size class caches, after pmm_init()
+ */
+void kmalloc_init();
+
+/**
+ * a cache of objects of size bytes, NULL if the cache table is full or
+ * size is 0 or larger than KMALLOC_MAX_SLAB_SIZE
+ */
+KMEM_CACHE *kmem_cache_create(const char *name, uint32 size);
+
+/**
+ * an object of the cache, NULL if memory is exhausted
+ */
+void *kmem_cache_alloc(KMEM_CACHE *cache);
+
+/**
+ * give back an object of the cache; NULL is ignored
+ */
+void kmem_cache_free(KMEM_CACHE *cache, void *object);
+
+/**
+ * i-th cache, NULL past the last one
+ */
+KMEM_CACHE *kmem_cache_get(int index);
+
+/**
+ * size bytes, aligned to 8 (to a frame above KMALLOC_MAX_SLAB_SIZE);
+ * NULL if size is 0 or memory is exhausted
+ */
+void *kmalloc(uint32 size);
+
+/**
+ * kmalloc() with the memory zeroed
+ */
+void *kzalloc(uint32 size);
+
+/**
+ * give back memory from kmalloc(); NULL is ignored
+ */
+void kfree(void *ptr);
+
+/**
+ * start or stop recording allocations per callsite. Starting clears
+ * what was recorded before; memory allocated while tracking was off is
+ * not counted when it is freed.
+ */
+void kmalloc_track(int on);
+
+/**
+ * 1 while allocations are recorded
+ */
+int kmalloc_tracking();
+
+/**
+ * i-th callsite seen by the tracking mode, NULL past the last one
+ */
+const KMALLOC_SITE *kmalloc_site_get(int index);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+// LZ4 block format, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+#include "types.h"
+
+#define LZ4_MAX_INPUT 0xFFFF // match offsets and the hash table use 16 bits
+
+// Compress len bytes of src into at most capacity bytes of dst.
+// Returns the compressed size, or 0 if the result would not fit
+// (the caller then stores the block uncompressed).
+uint32 lz4_compress(const uint8 *src, uint32 len, uint8 *dst, uint32 capacity);
+
+// Decompress a block of len bytes, returns the decompressed size or -1
+// if the block is corrupt or would overflow capacity.
+int lz4_decompress(const uint8 *src, uint32 len, uint8 *dst, uint32 capacity);
+
+#endif
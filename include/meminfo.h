@@ -0,0 +1,22 @@
+#ifndef MEMINFO_H
+#define MEMINFO_H
+
+// Large static tables are registered with MEMINFO_STATIC() next to their
+// definition, so the meminfo command can list what the image holds.
+// link.ld gathers the descriptors between __meminfo_statics_start and
+// __meminfo_statics_end.
+#include "types.h"
+
+typedef struct {
+    const char *name;
+    uint32 size;
+} MEMINFO_STATIC_ENTRY;
+
+#define MEMINFO_STATIC(var) \
+    static const MEMINFO_STATIC_ENTRY meminfo_##var \
+    __attribute__((section(".meminfo_statics"), used)) = { #var, sizeof(var) }
+
+extern const MEMINFO_STATIC_ENTRY __meminfo_statics_start[];
+extern const MEMINFO_STATIC_ENTRY __meminfo_statics_end[];
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include "types.h"
+
+// Multiboot 1 boot information, handed over in ebx (entry.asm).
+// Only the fields up to the memory map are used.
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002 // in eax at entry
+
+// MULTIBOOT_INFO.flags
+#define MULTIBOOT_INFO_MEMORY  0x001 // mem_lower, mem_upper valid
+#define MULTIBOOT_INFO_MEM_MAP 0x040 // mmap_length, mmap_addr valid
+
+// MULTIBOOT_MMAP_ENTRY.type
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+typedef struct {
+    uint32 flags;
+    uint32 mem_lower;   // KB below 1 MiB
+    uint32 mem_upper;   // KB from 1 MiB to the first hole
+    uint32 boot_device;
+    uint32 cmdline;
+    uint32 mods_count;
+    uint32 mods_addr;
+    uint32 syms[4];
+    uint32 mmap_length; // bytes of memory map
+    uint32 mmap_addr;
+} __attribute__((packed)) MULTIBOOT_INFO;
+
+// 64-bit address and length as halves, the kernel does no 64-bit math.
+// size does not count itself: the next entry is size + 4 bytes on.
+typedef struct {
+    uint32 size;
+    uint32 addr_low;
+    uint32 addr_high;
+    uint32 len_low;
+    uint32 len_high;
+    uint32 type;
+} __attribute__((packed)) MULTIBOOT_MMAP_ENTRY;
+
+#endif
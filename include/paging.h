@@ -0,0 +1,119 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+// x86 paging. The kernel is linked at KERNEL_VIRTUAL_BASE + 1 MiB and
+// physical memory up to PAGING_DIRECT_SIZE is mapped there with 4 MiB
+// pages, so kernel code and data take few TLB entries:
+//
+//   0x00000000 - 0x003FFFFF  low memory, identity mapped for BIOS calls
+//   0xC0000000 - 0xDFFFFFFF  physical memory from 0 (PHYS_TO_VIRT)
+//   0xE0000000 - 0xE3FFFFFF  window of 4 KiB pages mapped on demand (mmap)
+//   0xE4000000 - 0xEFFFFFFF  anonymous memory backed by swap (swap)
+//   0xF0000000 - 0xFFBFFFFF  framebuffer and MMIO, 4 MiB pages
+//
+// Everything else is unmapped until paging_map() puts 4 KiB pages there.
+#include "types.h"
+#include "isr.h"
+
+#define PAGE_SIZE 4096
+#define LARGE_PAGE_SIZE (4 * 1024 * 1024)
+
+#define KERNEL_VIRTUAL_BASE 0xC0000000 // also in link.ld and entry.asm
+#define PAGING_DIRECT_SIZE  0x20000000 // 512 MiB, RAM above is not used
+#define PHYS_TO_VIRT(addr)  ((void *)((uint32)(addr) + KERNEL_VIRTUAL_BASE))
+#define VIRT_TO_PHYS(addr)  ((uint32)(addr) - KERNEL_VIRTUAL_BASE)
+
+// page table entry bits
+#define PAGE_PRESENT       0x001
+#define PAGE_WRITE         0x002
+#define PAGE_USER          0x004
+#define PAGE_WRITE_THROUGH 0x008
+#define PAGE_CACHE_DISABLE 0x010 // for device registers
+#define PAGE_ACCESSED      0x020 // set by the CPU on any access
+#define PAGE_DIRTY         0x040 // set by the CPU on a write
+#define PAGE_LARGE         0x080 // directory entry maps 4 MiB (PSE)
+#define PAGE_GLOBAL        0x100 // kept in the TLB across CR3 loads
+#define PAGE_FRAME         0xFFFFF000
+
+// page fault error code bits
+#define PAGE_FAULT_PRESENT 0x01 // protection violation, not a missing page
+#define PAGE_FAULT_WRITE   0x02
+
+// Addresses of the window
+#define PAGING_WINDOW_BASE 0xE0000000
+#define PAGING_WINDOW_SIZE (64 * 1024 * 1024)
+
+// Addresses of anonymous memory
+#define PAGING_ANON_BASE 0xE4000000
+#define PAGING_ANON_SIZE (192 * 1024 * 1024)
+
+// Addresses handed out by paging_map_mmio()
+#define PAGING_MMIO_BASE 0xF0000000
+#define PAGING_MMIO_END  0xFFC00000
+
+/**
+ * replace the boot page directory of entry.asm with the kernel's own.
+ * Paging with 4 MiB pages is on from the first instruction, so a CPU
+ * without PSE never gets here.
+ */
+void paging_init();
+
+/**
+ * 1 once paging_init() ran
+ */
+int paging_enabled();
+
+/**
+ * map the 4 KiB page at virt to the frame at phys with flags
+ * (PAGE_WRITE, PAGE_USER, ...), taking a page table from pmm when the
+ * 4 MiB around virt has none. -1 if a 4 MiB page covers virt or no
+ * frame is left for the table.
+ */
+int paging_map(uint32 virt, uint32 phys, uint32 flags);
+
+/**
+ * remove the 4 KiB page at virt, if mapped. The frame is not freed.
+ */
+void paging_unmap(uint32 virt);
+
+/**
+ * physical address behind virt, 0 if nothing is mapped there
+ */
+uint32 paging_translate(uint32 virt);
+
+/**
+ * page table entry of a 4 KiB page, NULL if no page table covers virt.
+ * Changing a present entry needs paging_invalidate() afterwards.
+ */
+uint32 *paging_pte(uint32 virt);
+
+/**
+ * map size bytes of device memory at phys with 4 MiB pages, flags as
+ * for paging_map(). A range that is mapped already is reused. Returns
+ * the address of phys, 0 if the MMIO region is full.
+ */
+uint32 paging_map_mmio(uint32 phys, uint32 size, uint32 flags);
+
+/**
+ * drop the TLB entry of one page
+ */
+void paging_invalidate(uint32 virt);
+
+/**
+ * the address whose access raised the last page fault (CR2)
+ */
+uint32 paging_fault_address();
+
+/**
+ * resolves a page fault at addr and returns to retry the access, or
+ * calls isr_panic()
+ */
+typedef void (*PAGE_FAULT_HANDLER)(REGISTERS *reg, uint32 addr);
+
+/**
+ * let handler resolve the page faults in [start, end). A fault outside
+ * every range stops the kernel. -1 if the table of ranges is full.
+ */
+int paging_set_fault_handler(uint32 start, uint32 end, PAGE_FAULT_HANDLER handler);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PMM_H
+#define PMM_H
+
+// Physical memory: 4 KiB frames handed out by a buddy allocator. A block
+// of order k is 2^k contiguous frames aligned to its size, so multi-page
+// allocations are physically contiguous and usable for DMA. Addresses
+// are physical, the kernel reaches them through PHYS_TO_VIRT() (paging.h).
+// Allocating and freeing may happen in interrupt handlers.
+#include "types.h"
+#include "multiboot.h"
+
+#define PMM_FRAME_SIZE 4096
+#define PMM_MAX_ORDER 10 // largest block: 4 MiB
+
+typedef struct {
+    uint32 total_frames;    // usable RAM in the direct map, per the memory map
+    uint32 free_frames;
+    uint32 reserved_frames; // usable but taken at boot: kernel image, frame table
+    uint32 free_blocks[PMM_MAX_ORDER + 1]; // free blocks of each order
+    uint32 allocations;     // since boot
+    uint32 frees;
+} PMM_STATS;
+
+extern PMM_STATS pmm_stats;
+
+/**
+ * build the free lists from the memory map of the boot loader, or from
+ * mem_upper without a map; mbi is a kernel address. Memory below 1 MiB
+ * and the kernel image stay reserved, RAM above PAGING_DIRECT_SIZE is
+ * left out. -1 if no memory could be found.
+ */
+int pmm_init(uint32 magic, const MULTIBOOT_INFO *mbi);
+
+/**
+ * physical address of a block of 2^order frames, 0 if none is free
+ */
+uint32 pmm_alloc_order(uint32 order);
+
+/**
+ * physical address of count contiguous frames, rounded up to a whole
+ * block; 0 if count is 0, too large or no such block is free
+ */
+uint32 pmm_alloc_pages(uint32 count);
+
+/**
+ * one frame, 0 if memory is exhausted
+ */
+uint32 pmm_alloc_frame();
+
+/**
+ * give back a block from any of the allocation functions, merging it
+ * with its free buddies. A block shared with pmm_share() only loses one
+ * owner. Addresses that were not allocated are ignored.
+ */
+void pmm_free(uint32 addr);
+
+/**
+ * one more owner of the block allocated at addr, who gives it back with
+ * pmm_free() like the first. -1 if addr is not allocated or the count
+ * is at its limit.
+ */
+int pmm_share(uint32 addr);
+
+/**
+ * 1 if the block at addr has more than one owner
+ */
+int pmm_shared(uint32 addr);
+
+/**
+ * frames in the block allocated at addr, 0 if addr is not allocated
+ */
+uint32 pmm_block_frames(uint32 addr);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+// Block device in memory, to run a file system without disk latency
+#include "types.h"
+#include "blockdev.h"
+
+#define RAMDISK_NAME         "ram0"
+#define RAMDISK_MAX_SECTORS  8192 // 4 MiB, the largest block of the frame allocator
+
+// (re)create ram0 as a copy of src in kernel heap memory, NULL if src is
+// too large or unreadable or memory is short
+BLOCK_DEVICE *ramdisk_load(BLOCK_DEVICE *src);
+
+#endif
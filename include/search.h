@@ -0,0 +1,19 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// Substring search, four candidate positions per step: the first and
+// the last byte of the pattern are compared against a word of the text
+// at once (SWAR, no SSE: the kernel does not enable the XMM registers)
+// and only positions where both match are compared in full.
+#include "types.h"
+
+// Offset of the first occurrence of pattern in text, -1 if there is none
+int mem_find(const void *text, uint32 len, const void *pattern, uint32 pattern_len);
+
+// The same, one position at a time, to measure against
+int mem_find_bytewise(const void *text, uint32 len, const void *pattern, uint32 pattern_len);
+
+// Number of bytes equal to c, four per step
+uint32 mem_count(const void *text, uint32 len, uint8 c);
+
+#endif
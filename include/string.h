@@ -9,6 +9,9 @@ void *memcpy(void *dst, const void *src, uint32 n);
 
 int memcmp(uint8 *s1, uint8 *s2, uint32 n);
 
+// 1 if all n bytes are zero
+int mem_is_zero(const void *buf, uint32 n);
+
 int strlen(const char *s);
 
 int strcmp(const char *s1, const char *s2);
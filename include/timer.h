@@ -0,0 +1,27 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// System timer: PIT channel 0 on IRQ 0
+#include "types.h"
+
+#define TIMER_HZ 100
+
+// called from the interrupt on every tick, must not touch the disk
+typedef void (*TIMER_CALLBACK)(uint32 ticks);
+
+/**
+ * program channel 0 for TIMER_HZ interrupts and start counting
+ */
+void timer_init();
+
+/**
+ * ticks since timer_init()
+ */
+uint32 timer_ticks();
+
+/**
+ * call callback on every tick, -1 if all slots are taken
+ */
+int timer_add_callback(TIMER_CALLBACK callback);
+
+#endif
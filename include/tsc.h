@@ -0,0 +1,43 @@
+#ifndef TSC_H
+#define TSC_H
+
+// Time stamp counter, calibrated against PIT channel 2
+#include "types.h"
+
+/**
+ * measure the TSC frequency over a 10 ms PIT one-shot,
+ * call once before the other functions
+ */
+void tsc_calibrate();
+
+/**
+ * current TSC in units of 1024 cycles, wraps after a few hours at GHz rates
+ */
+uint32 tsc_kcycles();
+
+/**
+ * full 64-bit TSC, for measuring short intervals with tsc_elapsed()
+ */
+void tsc_read(uint32 *low, uint32 *high);
+
+/**
+ * cycles since a tsc_read(), saturated at 0xFFFFFFFF
+ */
+uint32 tsc_elapsed(uint32 low, uint32 high);
+
+/**
+ * TSC frequency in kHz, 0 if not calibrated
+ */
+uint32 tsc_khz();
+
+/**
+ * convert a tsc_kcycles() difference to microseconds
+ */
+uint32 tsc_kcycles_to_us(uint32 kcycles);
+
+/**
+ * bytes moved in kcycles as KB/s (1 KB = 1000 bytes), 0 if nothing was timed
+ */
+uint32 tsc_rate_kbs(uint32 bytes, uint32 kcycles);
+
+#endif
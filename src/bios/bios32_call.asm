@@ -21,10 +21,12 @@ BIOS32_START:use32
     ; jumping to 16 bit protected mode
     ; disable interrupts
     cli
-    ; clear cr3 by saving cr3 data in ebx register
-    xor ecx, ecx
+    ; turn paging off, this copy runs from identity mapped low memory;
+    ; cr3 is kept in ebx for the way back
     mov ebx, cr3
-    mov cr3, ecx
+    mov ecx, cr0
+    and ecx, 0x7FFFFFFF
+    mov cr0, ecx
     ; load new empty GDT
     lgdt [REBASE_ADDRESS(bios32_gdt_ptr)]
     ; load new empty IDT
@@ -137,8 +139,11 @@ __protected_mode_32:use32
     mov fs, ax
     mov gs, ax
     mov ss, ax
-    ; restore cr3
+    ; restore cr3 and paging, the kernel stack is mapped again
     mov cr3, ebx
+    mov eax, cr0
+    or eax, 0x80000000
+    mov cr0, eax
     ; restore esp
     mov esp, edx
     sti
@@ -0,0 +1,119 @@
+#include "blockdev.h"
+#include "console.h"
+#include "ide.h"
+#include "string.h"
+
+// ide_*_sectors take a uint8 sector count
+#define IDE_MAX_IO_SECTORS 255
+
+extern IDE_DEVICE g_ide_devices[MAXIMUM_IDE_DEVICES];
+
+static BLOCK_DEVICE g_block_devices[BLOCKDEV_MAX_DEVICES];
+static int g_block_device_count = 0;
+
+static uint8 g_mbr_buffer[BLOCKDEV_SECTOR_SIZE];
+
+static int ide_blockdev_io(BLOCK_DEVICE *dev, uint32 lba, uint32 count, void *buffer, uint8 direction) {
+    uint8 *buf = (uint8 *)buffer;
+    while (count > 0) {
+        uint32 chunk = count > IDE_MAX_IO_SECTORS ? IDE_MAX_IO_SECTORS : count;
+        int res;
+        if (direction == ATA_WRITE)
+            res = ide_write_sectors(dev->drive, chunk, dev->start_lba + lba, (uint32)buf);
+        else
+            res = ide_read_sectors(dev->drive, chunk, dev->start_lba + lba, (uint32)buf);
+        if (res != 0)
+            return res;
+        lba += chunk;
+        count -= chunk;
+        buf += chunk * BLOCKDEV_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+static int ide_blockdev_read(BLOCK_DEVICE *dev, uint32 lba, uint32 count, void *buffer) {
+    return ide_blockdev_io(dev, lba, count, buffer, ATA_READ);
+}
+
+static int ide_blockdev_write(BLOCK_DEVICE *dev, uint32 lba, uint32 count, void *buffer) {
+    return ide_blockdev_io(dev, lba, count, buffer, ATA_WRITE);
+}
+
+BLOCK_DEVICE *blockdev_register(const char *name, uint32 sector_count,
+                                BLOCKDEV_IO read, BLOCKDEV_IO write, void *private_data) {
+    BLOCK_DEVICE *dev = blockdev_find(name);
+    if (dev == NULL) {
+        if (g_block_device_count >= BLOCKDEV_MAX_DEVICES)
+            return NULL;
+        dev = &g_block_devices[g_block_device_count++];
+    }
+    memset(dev, 0, sizeof(BLOCK_DEVICE));
+    strncpy(dev->name, name, BLOCKDEV_NAME_LENGTH - 1);
+    dev->sector_count = sector_count;
+    dev->read = read;
+    dev->write = write;
+    dev->private_data = private_data;
+    return dev;
+}
+
+BLOCK_DEVICE *blockdev_open_ide(uint8 drive, uint8 partition) {
+    char name[BLOCKDEV_NAME_LENGTH];
+    uint32 start = 0, count;
+
+    if (drive >= MAXIMUM_IDE_DEVICES || g_ide_devices[drive].reserved == 0 ||
+        g_ide_devices[drive].type != IDE_ATA || partition > MBR_MAX_PARTITIONS)
+        return NULL;
+    count = g_ide_devices[drive].size;
+
+    if (partition > 0) {
+        if (ide_read_sectors(drive, 1, 0, (uint32)g_mbr_buffer) != 0)
+            return NULL;
+        if (*(uint16 *)(g_mbr_buffer + MBR_SIGNATURE_OFFSET) != MBR_SIGNATURE)
+            return NULL;
+        MBR_PARTITION *part = (MBR_PARTITION *)(g_mbr_buffer + MBR_PARTITION_TABLE_OFFSET) + (partition - 1);
+        if (part->type == 0 || part->sector_count == 0)
+            return NULL;
+        start = part->lba_first;
+        count = part->sector_count;
+    }
+
+    // hd<drive>, or hd<drive>p<partition>
+    strcpy(name, "hd");
+    itoa(name + 2, 'd', drive);
+    if (partition > 0) {
+        strcat(name, "p");
+        itoa(name + strlen(name), 'd', partition);
+    }
+
+    BLOCK_DEVICE *dev = blockdev_register(name, count, ide_blockdev_read, ide_blockdev_write, NULL);
+    if (dev == NULL)
+        return NULL;
+    dev->drive = drive;
+    dev->start_lba = start;
+    return dev;
+}
+
+BLOCK_DEVICE *blockdev_find(const char *name) {
+    int i;
+    for (i = 0; i < g_block_device_count; i++) {
+        if (strcmp(g_block_devices[i].name, name) == 0)
+            return &g_block_devices[i];
+    }
+    return NULL;
+}
+
+int blockdev_is_ide(const BLOCK_DEVICE *dev) {
+    return dev->read == ide_blockdev_read;
+}
+
+int blockdev_read(BLOCK_DEVICE *dev, uint32 lba, uint32 count, void *buffer) {
+    if (lba + count > dev->sector_count)
+        return -1;
+    return dev->read(dev, lba, count, buffer);
+}
+
+int blockdev_write(BLOCK_DEVICE *dev, uint32 lba, uint32 count, const void *buffer) {
+    if (lba + count > dev->sector_count)
+        return -1;
+    return dev->write(dev, lba, count, (void *)buffer);
+}
@@ -2,6 +2,8 @@
 #include "console.h"
 #include "io_ports.h"
 #include "string.h"
+#include "arena.h"
+#include <stddef.h> // Для NULL
 
 // https://wiki.osdev.org/PCI_IDE_Controller
 // https://datacadamia.com/io/drive/lba
@@ -225,7 +227,11 @@ void ide_init(uint32 prim_channel_base_addr, uint32 prim_channel_control_base_ad
               uint32 sec_channel_base_addr, uint32 sec_channel_control_addr,
               uint32 bus_master_addr) {
     int i, j, k, count = 0;
-    unsigned char ide_buf[2048] = {0};
+    ARENA_SCOPE scope = arena_scope_begin(&g_scratch_arena);
+    unsigned char *ide_buf = (unsigned char *)arena_zalloc(&g_scratch_arena, 2048);
+
+    if (ide_buf == NULL)
+        return;
 
     // 1- Detect I/O Ports which interface IDE Controller:
     // (checking the addr is removed for simplicity, just assigning all ports)
@@ -323,6 +329,8 @@ void ide_init(uint32 prim_channel_base_addr, uint32 prim_channel_control_base_ad
         }
     }
 
+    arena_scope_end(scope);
+
     // 4- Print Summary:
     for (i = 0; i < 4; i++)
         if (g_ide_devices[i].reserved == 1) {
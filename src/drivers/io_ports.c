@@ -52,3 +52,16 @@ void outportw(unsigned short port, unsigned short value) {
     __asm__ __volatile__ ("outw %0, %1" : : "a"(value), "Nd"(port));
 }
 
+
+#define EFLAGS_IF 0x200
+
+uint32 irq_save() {
+    uint32 flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+void irq_restore(uint32 flags) {
+    if (flags & EFLAGS_IF)
+        asm volatile("sti" : : : "memory");
+}
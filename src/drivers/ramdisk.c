@@ -0,0 +1,41 @@
+#include "ramdisk.h"
+#include "string.h"
+#include "kmalloc.h"
+
+#define RAMDISK_COPY_SECTORS 64
+
+static uint8 *g_ramdisk = NULL; // sized to the disk it copies
+
+static int ramdisk_read(BLOCK_DEVICE *dev, uint32 lba, uint32 count, void *buffer) {
+    memcpy(buffer, g_ramdisk + lba * BLOCKDEV_SECTOR_SIZE, count * BLOCKDEV_SECTOR_SIZE);
+    return 0;
+}
+
+static int ramdisk_write(BLOCK_DEVICE *dev, uint32 lba, uint32 count, void *buffer) {
+    memcpy(g_ramdisk + lba * BLOCKDEV_SECTOR_SIZE, buffer, count * BLOCKDEV_SECTOR_SIZE);
+    return 0;
+}
+
+BLOCK_DEVICE *ramdisk_load(BLOCK_DEVICE *src) {
+    uint8 *data;
+    uint32 lba;
+
+    if (src == NULL || src->sector_count == 0 || src->sector_count > RAMDISK_MAX_SECTORS)
+        return NULL;
+    // the old copy stays in place until the new one is complete
+    data = (uint8 *)kmalloc(src->sector_count * BLOCKDEV_SECTOR_SIZE);
+    if (data == NULL)
+        return NULL;
+    for (lba = 0; lba < src->sector_count; lba += RAMDISK_COPY_SECTORS) {
+        uint32 count = src->sector_count - lba;
+        if (count > RAMDISK_COPY_SECTORS)
+            count = RAMDISK_COPY_SECTORS;
+        if (blockdev_read(src, lba, count, data + lba * BLOCKDEV_SECTOR_SIZE) != 0) {
+            kfree(data);
+            return NULL;
+        }
+    }
+    kfree(g_ramdisk);
+    g_ramdisk = data;
+    return blockdev_register(RAMDISK_NAME, src->sector_count, ramdisk_read, ramdisk_write, NULL);
+}
@@ -0,0 +1,45 @@
+#include "timer.h"
+#include "isr.h"
+#include "io_ports.h"
+#include <stddef.h> // Для NULL
+
+#define PIT_FREQUENCY 1193182
+#define PIT_CHANNEL0  0x40
+#define PIT_COMMAND   0x43
+#define TIMER_MAX_CALLBACKS 4
+
+static volatile uint32 g_ticks = 0;
+static TIMER_CALLBACK g_callbacks[TIMER_MAX_CALLBACKS];
+
+static void timer_handler(REGISTERS *reg) {
+    g_ticks++;
+    for (int i = 0; i < TIMER_MAX_CALLBACKS; i++) {
+        if (g_callbacks[i] != NULL) {
+            g_callbacks[i](g_ticks);
+        }
+    }
+}
+
+void timer_init() {
+    uint16 divisor = PIT_FREQUENCY / TIMER_HZ;
+
+    // channel 0, lobyte/hibyte, mode 2 (rate generator)
+    outportb(PIT_COMMAND, 0x34);
+    outportb(PIT_CHANNEL0, divisor & 0xFF);
+    outportb(PIT_CHANNEL0, divisor >> 8);
+    isr_register_interrupt_handler(IRQ_BASE, timer_handler);
+}
+
+uint32 timer_ticks() {
+    return g_ticks;
+}
+
+int timer_add_callback(TIMER_CALLBACK callback) {
+    for (int i = 0; i < TIMER_MAX_CALLBACKS; i++) {
+        if (g_callbacks[i] == NULL) {
+            g_callbacks[i] = callback;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,86 @@
+#include "tsc.h"
+#include "io_ports.h"
+
+#define PIT_FREQUENCY       1193182
+#define PIT_CHANNEL2        0x42
+#define PIT_COMMAND         0x43
+#define PIT_GATE_PORT       0x61 // bit 0 gates channel 2, bit 5 is its output
+#define TSC_CALIBRATE_MS    10
+
+static uint32 g_tsc_khz = 0;
+
+static uint32 rdtsc_low() {
+    uint32 low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return low;
+}
+
+void tsc_calibrate() {
+    uint16 count = PIT_FREQUENCY * TSC_CALIBRATE_MS / 1000;
+    uint8 gate = inportb(PIT_GATE_PORT);
+
+    // gate on, speaker off; channel 2, lobyte/hibyte, mode 0 (output rises at terminal count)
+    outportb(PIT_GATE_PORT, (gate & ~0x02) | 0x01);
+    outportb(PIT_COMMAND, 0xB0);
+    outportb(PIT_CHANNEL2, count & 0xFF);
+    outportb(PIT_CHANNEL2, count >> 8);
+
+    // 10 ms is below 2^32 cycles for any CPU clocked under 400 GHz
+    uint32 start = rdtsc_low();
+    uint32 spins = 0;
+    while (!(inportb(PIT_GATE_PORT) & 0x20)) {
+        if (++spins == 0x10000000) {
+            break; // no PIT, leave the TSC uncalibrated
+        }
+    }
+    uint32 cycles = rdtsc_low() - start;
+    outportb(PIT_GATE_PORT, gate);
+
+    g_tsc_khz = (spins == 0x10000000) ? 0 : cycles / TSC_CALIBRATE_MS;
+}
+
+uint32 tsc_kcycles() {
+    uint32 low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return (high << 22) | (low >> 10);
+}
+
+void tsc_read(uint32 *low, uint32 *high) {
+    asm volatile("rdtsc" : "=a"(*low), "=d"(*high));
+}
+
+uint32 tsc_elapsed(uint32 low, uint32 high) {
+    uint32 now_low, now_high;
+    tsc_read(&now_low, &now_high);
+    // borrow from the high half when the low half wrapped
+    now_high -= high + (now_low < low);
+    return now_high != 0 ? 0xFFFFFFFF : now_low - low;
+}
+
+uint32 tsc_khz() {
+    return g_tsc_khz;
+}
+
+uint32 tsc_kcycles_to_us(uint32 kcycles) {
+    // kcycles per ms, kept in 32 bits: multiply first while it cannot overflow
+    uint32 per_ms = g_tsc_khz >> 10;
+    if (per_ms == 0) {
+        return 0;
+    }
+    if (kcycles < 0xFFFFFFFF / 1000) {
+        return kcycles * 1000 / per_ms;
+    }
+    return kcycles / per_ms * 1000;
+}
+
+uint32 tsc_rate_kbs(uint32 bytes, uint32 kcycles) {
+    uint32 us = tsc_kcycles_to_us(kcycles);
+    if (us == 0) {
+        return 0;
+    }
+    // bytes per ms is KB/s
+    if (bytes < 0xFFFFFFFF / 1000) {
+        return bytes * 1000 / us;
+    }
+    return bytes / (us / 1000 ? us / 1000 : 1);
+}
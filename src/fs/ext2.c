@@ -0,0 +1,1264 @@
+#include "fs/ext2.h"
+#include "console.h"
+#include "string.h"
+#include "meminfo.h"
+
+// https://www.nongnu.org/ext2-doc/ext2.html
+
+#define EXT2_BLOCK_CACHE_SIZE 16
+#define EXT2_INODE_CACHE_SIZE 32
+
+// metadata blocks (bitmaps, inode tables, directories, indirect blocks)
+// are cached and written through, so the disk is always up to date
+typedef struct {
+    EXT2_FS *fs;
+    uint32 block;
+    uint32 last_used;
+    uint8 data[EXT2_MAX_BLOCK_SIZE];
+} EXT2_CACHED_BLOCK;
+
+typedef struct {
+    EXT2_FS *fs;
+    uint32 ino;
+    uint32 last_used;
+    EXT2_INODE inode;
+} EXT2_CACHED_INODE;
+
+static EXT2_FS g_ext2_mounts[EXT2_MAX_MOUNTS];
+static EXT2_CACHED_BLOCK g_block_cache[EXT2_BLOCK_CACHE_SIZE];
+MEMINFO_STATIC(g_block_cache);
+static EXT2_CACHED_INODE g_inode_cache[EXT2_INODE_CACHE_SIZE];
+static uint32 g_cache_clock = 0;
+
+static uint8 g_zero_block[EXT2_MAX_BLOCK_SIZE];
+
+/*
+ block i/o
+*/
+static int read_block_raw(EXT2_FS *fs, uint32 block, void *buffer) {
+    return blockdev_read(fs->dev, block * fs->sectors_per_block, fs->sectors_per_block, buffer);
+}
+
+static int write_block_raw(EXT2_FS *fs, uint32 block, const void *buffer) {
+    return blockdev_write(fs->dev, block * fs->sectors_per_block, fs->sectors_per_block, buffer);
+}
+
+static EXT2_CACHED_BLOCK *cache_lookup(EXT2_FS *fs, uint32 block) {
+    int i;
+    for (i = 0; i < EXT2_BLOCK_CACHE_SIZE; i++) {
+        if (g_block_cache[i].fs == fs && g_block_cache[i].block == block) {
+            g_block_cache[i].last_used = ++g_cache_clock;
+            return &g_block_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static EXT2_CACHED_BLOCK *cache_victim() {
+    EXT2_CACHED_BLOCK *entry = &g_block_cache[0];
+    int i;
+    for (i = 1; i < EXT2_BLOCK_CACHE_SIZE; i++) {
+        if (g_block_cache[i].last_used < entry->last_used)
+            entry = &g_block_cache[i];
+    }
+    entry->fs = NULL;
+    return entry;
+}
+
+/*
+ returns the cached copy of a block, valid until the next call into the cache
+*/
+static uint8 *get_block(EXT2_FS *fs, uint32 block) {
+    EXT2_CACHED_BLOCK *entry = cache_lookup(fs, block);
+    if (entry != NULL)
+        return entry->data;
+
+    entry = cache_victim();
+    if (read_block_raw(fs, block, entry->data) != 0)
+        return NULL;
+    entry->fs = fs;
+    entry->block = block;
+    entry->last_used = ++g_cache_clock;
+    return entry->data;
+}
+
+// same as get_block() for a freshly allocated block: zero filled instead of read
+static uint8 *get_new_block(EXT2_FS *fs, uint32 block) {
+    EXT2_CACHED_BLOCK *entry = cache_lookup(fs, block);
+    if (entry == NULL) {
+        entry = cache_victim();
+        entry->fs = fs;
+        entry->block = block;
+        entry->last_used = ++g_cache_clock;
+    }
+    memset(entry->data, 0, fs->block_size);
+    return entry->data;
+}
+
+// write a block obtained by get_block() back to disk
+static int put_block(EXT2_FS *fs, uint32 block, uint8 *data) {
+    return write_block_raw(fs, block, data) == 0 ? 0 : EXT2_ERR_IO;
+}
+
+// write a full block that did not come from the cache, keeping any cached copy coherent
+static int write_block(EXT2_FS *fs, uint32 block, const void *data) {
+    EXT2_CACHED_BLOCK *entry = cache_lookup(fs, block);
+    if (entry != NULL)
+        memcpy(entry->data, data, fs->block_size);
+    return write_block_raw(fs, block, data) == 0 ? 0 : EXT2_ERR_IO;
+}
+
+static uint32 get_block_entry(EXT2_FS *fs, uint32 block, uint32 index) {
+    uint32 *table = (uint32 *)get_block(fs, block);
+    return table != NULL ? table[index] : 0;
+}
+
+static int set_block_entry(EXT2_FS *fs, uint32 block, uint32 index, uint32 value) {
+    uint32 *table = (uint32 *)get_block(fs, block);
+    if (table == NULL)
+        return EXT2_ERR_IO;
+    table[index] = value;
+    return put_block(fs, block, (uint8 *)table);
+}
+
+/*
+ superblock and group descriptors
+*/
+static int write_superblock(EXT2_FS *fs) {
+    if (blockdev_write(fs->dev, EXT2_SUPERBLOCK_OFFSET / BLOCKDEV_SECTOR_SIZE,
+                       sizeof(EXT2_SUPERBLOCK) / BLOCKDEV_SECTOR_SIZE, &fs->sb) != 0)
+        return EXT2_ERR_IO;
+    fs->sb_dirty = 0;
+    return 0;
+}
+
+// write back the descriptor table block holding the given group
+static int write_group_desc(EXT2_FS *fs, uint32 group) {
+    uint32 per_block = fs->block_size / sizeof(EXT2_GROUP_DESC);
+    uint32 index = group / per_block;
+    return write_block(fs, fs->gdt_block + index, (uint8 *)fs->groups + index * fs->block_size);
+}
+
+/*
+ inodes
+*/
+static EXT2_CACHED_INODE *inode_cache_slot(EXT2_FS *fs, uint32 ino, int *hit) {
+    EXT2_CACHED_INODE *victim = &g_inode_cache[0];
+    int i;
+    for (i = 0; i < EXT2_INODE_CACHE_SIZE; i++) {
+        if (g_inode_cache[i].fs == fs && g_inode_cache[i].ino == ino) {
+            *hit = 1;
+            g_inode_cache[i].last_used = ++g_cache_clock;
+            return &g_inode_cache[i];
+        }
+        if (g_inode_cache[i].last_used < victim->last_used)
+            victim = &g_inode_cache[i];
+    }
+    *hit = 0;
+    victim->fs = NULL;
+    return victim;
+}
+
+// locate an inode in its group's inode table
+static void inode_location(EXT2_FS *fs, uint32 ino, uint32 *block, uint32 *offset) {
+    uint32 group = (ino - 1) / fs->sb.s_inodes_per_group;
+    uint32 index = (ino - 1) % fs->sb.s_inodes_per_group;
+    uint32 byte = index * fs->inode_size;
+    *block = fs->groups[group].bg_inode_table + byte / fs->block_size;
+    *offset = byte % fs->block_size;
+}
+
+int ext2_read_inode(EXT2_FS *fs, uint32 ino, EXT2_INODE *inode) {
+    uint32 block, offset;
+    int hit;
+    if (ino == 0 || ino > fs->sb.s_inodes_count)
+        return EXT2_ERR_INVALID;
+
+    EXT2_CACHED_INODE *slot = inode_cache_slot(fs, ino, &hit);
+    if (!hit) {
+        inode_location(fs, ino, &block, &offset);
+        uint8 *data = get_block(fs, block);
+        if (data == NULL)
+            return EXT2_ERR_IO;
+        memcpy(&slot->inode, data + offset, sizeof(EXT2_INODE));
+        slot->fs = fs;
+        slot->ino = ino;
+        slot->last_used = ++g_cache_clock;
+    }
+    memcpy(inode, &slot->inode, sizeof(EXT2_INODE));
+    return 0;
+}
+
+// only the first 128 bytes are touched, extra fields of larger inodes are preserved
+static int write_inode(EXT2_FS *fs, uint32 ino, const EXT2_INODE *inode) {
+    uint32 block, offset;
+    int hit;
+
+    EXT2_CACHED_INODE *slot = inode_cache_slot(fs, ino, &hit);
+    memcpy(&slot->inode, inode, sizeof(EXT2_INODE));
+    slot->fs = fs;
+    slot->ino = ino;
+    slot->last_used = ++g_cache_clock;
+
+    inode_location(fs, ino, &block, &offset);
+    uint8 *data = get_block(fs, block);
+    if (data == NULL)
+        return EXT2_ERR_IO;
+    memcpy(data + offset, inode, sizeof(EXT2_INODE));
+    return put_block(fs, block, data);
+}
+
+/*
+ bitmap allocation
+*/
+static uint32 group_block_count(EXT2_FS *fs, uint32 group) {
+    if (group == fs->group_count - 1)
+        return fs->sb.s_blocks_count - fs->sb.s_first_data_block - group * fs->sb.s_blocks_per_group;
+    return fs->sb.s_blocks_per_group;
+}
+
+// find and set a clear bit in a bitmap block, starting at start, -1 if none
+static int bitmap_alloc(EXT2_FS *fs, uint32 bitmap_block, uint32 bits, uint32 start) {
+    uint8 *bitmap = get_block(fs, bitmap_block);
+    uint32 i, bit;
+    if (bitmap == NULL)
+        return -1;
+    if (start >= bits)
+        start = 0;
+    for (i = 0; i < bits; i++) {
+        bit = (start + i) % bits;
+        if (bitmap[bit / 8] == 0xFF) {
+            // skip full bytes quickly
+            i += 7 - (bit % 8);
+            continue;
+        }
+        if (!(bitmap[bit / 8] & (1 << (bit % 8)))) {
+            bitmap[bit / 8] |= 1 << (bit % 8);
+            if (put_block(fs, bitmap_block, bitmap) != 0)
+                return -1;
+            return bit;
+        }
+    }
+    return -1;
+}
+
+static int bitmap_free(EXT2_FS *fs, uint32 bitmap_block, uint32 bit) {
+    uint8 *bitmap = get_block(fs, bitmap_block);
+    if (bitmap == NULL)
+        return EXT2_ERR_IO;
+    bitmap[bit / 8] &= ~(1 << (bit % 8));
+    return put_block(fs, bitmap_block, bitmap);
+}
+
+/*
+ allocate a block as close as possible to goal, so that files stay
+ inside their block group and mostly contiguous. returns 0 if full
+*/
+static uint32 alloc_block(EXT2_FS *fs, uint32 goal) {
+    uint32 first = fs->sb.s_first_data_block;
+    uint32 group, i;
+    int bit;
+
+    if (fs->sb.s_free_blocks_count == 0)
+        return 0;
+    if (goal < first || goal >= fs->sb.s_blocks_count)
+        goal = first;
+    group = (goal - first) / fs->sb.s_blocks_per_group;
+
+    for (i = 0; i < fs->group_count; i++) {
+        uint32 g = (group + i) % fs->group_count;
+        EXT2_GROUP_DESC *desc = &fs->groups[g];
+        if (desc->bg_free_blocks_count == 0)
+            continue;
+        uint32 start = (g == group) ? (goal - first) % fs->sb.s_blocks_per_group : 0;
+        bit = bitmap_alloc(fs, desc->bg_block_bitmap, group_block_count(fs, g), start);
+        if (bit < 0)
+            continue;
+        desc->bg_free_blocks_count--;
+        fs->sb.s_free_blocks_count--;
+        fs->sb_dirty = 1;
+        write_group_desc(fs, g);
+        return first + g * fs->sb.s_blocks_per_group + bit;
+    }
+    return 0;
+}
+
+static void free_block(EXT2_FS *fs, uint32 block) {
+    uint32 rel = block - fs->sb.s_first_data_block;
+    uint32 group = rel / fs->sb.s_blocks_per_group;
+    if (block < fs->sb.s_first_data_block || block >= fs->sb.s_blocks_count)
+        return;
+    if (bitmap_free(fs, fs->groups[group].bg_block_bitmap, rel % fs->sb.s_blocks_per_group) != 0)
+        return;
+    fs->groups[group].bg_free_blocks_count++;
+    fs->sb.s_free_blocks_count++;
+    fs->sb_dirty = 1;
+    write_group_desc(fs, group);
+}
+
+/*
+ directories are spread over groups with few directories and enough
+ free inodes, files are kept in the group of their parent directory
+*/
+static uint32 alloc_inode(EXT2_FS *fs, uint32 parent, int is_dir) {
+    uint32 group = (parent - 1) / fs->sb.s_inodes_per_group;
+    uint32 i;
+    int bit;
+
+    if (fs->sb.s_free_inodes_count == 0)
+        return 0;
+
+    if (is_dir) {
+        uint32 average = fs->sb.s_free_inodes_count / fs->group_count;
+        int best = -1;
+        for (i = 0; i < fs->group_count; i++) {
+            EXT2_GROUP_DESC *desc = &fs->groups[i];
+            if (desc->bg_free_inodes_count == 0 || desc->bg_free_inodes_count < average)
+                continue;
+            if (best < 0 || desc->bg_used_dirs_count < fs->groups[best].bg_used_dirs_count)
+                best = i;
+        }
+        if (best >= 0)
+            group = best;
+    }
+
+    for (i = 0; i < fs->group_count; i++) {
+        uint32 g = (group + i) % fs->group_count;
+        EXT2_GROUP_DESC *desc = &fs->groups[g];
+        if (desc->bg_free_inodes_count == 0)
+            continue;
+        bit = bitmap_alloc(fs, desc->bg_inode_bitmap, fs->sb.s_inodes_per_group, 0);
+        if (bit < 0)
+            continue;
+        desc->bg_free_inodes_count--;
+        if (is_dir)
+            desc->bg_used_dirs_count++;
+        fs->sb.s_free_inodes_count--;
+        fs->sb_dirty = 1;
+        write_group_desc(fs, g);
+        return g * fs->sb.s_inodes_per_group + bit + 1;
+    }
+    return 0;
+}
+
+static void free_inode(EXT2_FS *fs, uint32 ino, int is_dir) {
+    uint32 group = (ino - 1) / fs->sb.s_inodes_per_group;
+    if (bitmap_free(fs, fs->groups[group].bg_inode_bitmap, (ino - 1) % fs->sb.s_inodes_per_group) != 0)
+        return;
+    fs->groups[group].bg_free_inodes_count++;
+    if (is_dir && fs->groups[group].bg_used_dirs_count > 0)
+        fs->groups[group].bg_used_dirs_count--;
+    fs->sb.s_free_inodes_count++;
+    fs->sb_dirty = 1;
+    write_group_desc(fs, group);
+}
+
+/*
+ there is no wall clock yet, use the last time the file system was written.
+ i_dtime must look like a time, small values are taken for orphan list links
+*/
+static uint32 ext2_now(EXT2_FS *fs) {
+    return fs->sb.s_wtime;
+}
+
+// first block of the inode's group, where its data should preferably go
+static uint32 inode_goal(EXT2_FS *fs, uint32 ino) {
+    return fs->sb.s_first_data_block + ((ino - 1) / fs->sb.s_inodes_per_group) * fs->sb.s_blocks_per_group;
+}
+
+/*
+ block mapping through direct, indirect, double and triple indirect blocks
+*/
+
+// allocate a zeroed indirect block
+static uint32 alloc_indirect(EXT2_FS *fs, EXT2_INODE *inode, uint32 goal) {
+    uint32 block = alloc_block(fs, goal);
+    if (block == 0)
+        return 0;
+    if (write_block(fs, block, g_zero_block) != 0) {
+        free_block(fs, block);
+        return 0;
+    }
+    inode->i_blocks += fs->sectors_per_block;
+    return block;
+}
+
+/*
+ map file block index to a disk block. with create set, missing blocks
+ (and the indirect blocks leading to them) are allocated near goal and
+ *created is set for a new data block. returns 0 for a hole
+*/
+static uint32 bmap(EXT2_FS *fs, EXT2_INODE *inode, uint32 index, int create, uint32 goal, int *created) {
+    uint32 apb = fs->addr_per_block;
+    uint32 path[4];
+    uint32 depth, slot, level, block;
+
+    if (created)
+        *created = 0;
+
+    if (index < EXT2_NDIR_BLOCKS) {
+        if (inode->i_block[index] == 0 && create) {
+            inode->i_block[index] = alloc_block(fs, goal);
+            if (inode->i_block[index] != 0) {
+                inode->i_blocks += fs->sectors_per_block;
+                if (created)
+                    *created = 1;
+            }
+        }
+        return inode->i_block[index];
+    }
+
+    index -= EXT2_NDIR_BLOCKS;
+    if (index < apb) {
+        depth = 1;
+        slot = EXT2_IND_BLOCK;
+        path[0] = index;
+    } else if ((index -= apb) < apb * apb) {
+        depth = 2;
+        slot = EXT2_DIND_BLOCK;
+        path[0] = index / apb;
+        path[1] = index % apb;
+    } else {
+        index -= apb * apb;
+        depth = 3;
+        slot = EXT2_TIND_BLOCK;
+        path[0] = index / (apb * apb);
+        path[1] = (index / apb) % apb;
+        path[2] = index % apb;
+    }
+
+    block = inode->i_block[slot];
+    if (block == 0) {
+        if (!create)
+            return 0;
+        block = alloc_indirect(fs, inode, goal);
+        if (block == 0)
+            return 0;
+        inode->i_block[slot] = block;
+    }
+
+    for (level = 0; level < depth; level++) {
+        uint32 next = get_block_entry(fs, block, path[level]);
+        if (next == 0) {
+            if (!create)
+                return 0;
+            if (level + 1 < depth)
+                next = alloc_indirect(fs, inode, block + 1);
+            else
+                next = alloc_block(fs, goal);
+            if (next == 0)
+                return 0;
+            if (level + 1 == depth) {
+                inode->i_blocks += fs->sectors_per_block;
+                if (created)
+                    *created = 1;
+            }
+            if (set_block_entry(fs, block, path[level], next) != 0)
+                return 0;
+        }
+        block = next;
+    }
+    return block;
+}
+
+/*
+ free everything in an indirect subtree from file block 'from' (relative
+ to the subtree) onwards. returns non zero if the whole subtree is gone
+*/
+static int free_tree(EXT2_FS *fs, EXT2_INODE *inode, uint32 block, uint32 level, uint32 from) {
+    uint32 apb = fs->addr_per_block;
+    uint32 span = 1, i, first, keep;
+    for (i = 1; i < level; i++)
+        span *= apb;
+
+    first = from / span;
+    // a child the cut goes through keeps its first blocks and stays referenced
+    keep = (level > 1 && from % span != 0) ? first + 1 : first;
+    for (i = first; i < apb; i++) {
+        uint32 child = get_block_entry(fs, block, i);
+        if (child == 0)
+            continue;
+        if (level > 1) {
+            free_tree(fs, inode, child, level - 1, i == first ? from % span : 0);
+        } else {
+            free_block(fs, child);
+            inode->i_blocks -= fs->sectors_per_block;
+        }
+    }
+
+    if (from == 0) {
+        free_block(fs, block);
+        inode->i_blocks -= fs->sectors_per_block;
+        return 1;
+    }
+    uint32 *table = (uint32 *)get_block(fs, block);
+    if (table != NULL) {
+        memset(table + keep, 0, (apb - keep) * sizeof(uint32));
+        put_block(fs, block, (uint8 *)table);
+    }
+    return 0;
+}
+
+// release all blocks of an inode from file block 'from' onwards
+static void free_blocks_from(EXT2_FS *fs, EXT2_INODE *inode, uint32 from) {
+    uint32 apb = fs->addr_per_block;
+    uint32 start = EXT2_NDIR_BLOCKS, span = apb, level, i;
+
+    for (i = from; i < EXT2_NDIR_BLOCKS; i++) {
+        if (inode->i_block[i] != 0) {
+            free_block(fs, inode->i_block[i]);
+            inode->i_blocks -= fs->sectors_per_block;
+            inode->i_block[i] = 0;
+        }
+    }
+
+    for (level = 1; level <= 3; level++) {
+        uint32 slot = EXT2_IND_BLOCK + level - 1;
+        if (inode->i_block[slot] != 0 && from < start + span) {
+            uint32 rel = from > start ? from - start : 0;
+            if (free_tree(fs, inode, inode->i_block[slot], level, rel))
+                inode->i_block[slot] = 0;
+        }
+        start += span;
+        span *= apb;
+    }
+}
+
+/*
+ file data
+*/
+int ext2_read(EXT2_FS *fs, uint32 ino, uint32 offset, void *buffer, uint32 length) {
+    EXT2_INODE inode;
+    uint8 *out = (uint8 *)buffer;
+    uint32 done = 0;
+
+    if (ext2_read_inode(fs, ino, &inode) != 0)
+        return EXT2_ERR_IO;
+    if (offset >= inode.i_size)
+        return 0;
+    if (length > inode.i_size - offset)
+        length = inode.i_size - offset;
+
+    while (done < length) {
+        uint32 index = (offset + done) / fs->block_size;
+        uint32 within = (offset + done) % fs->block_size;
+        uint32 chunk = fs->block_size - within;
+        if (chunk > length - done)
+            chunk = length - done;
+
+        uint32 block = bmap(fs, &inode, index, 0, 0, NULL);
+        if (block == 0) {
+            // hole
+            memset(out + done, 0, chunk);
+        } else if (chunk == fs->block_size && cache_lookup(fs, block) == NULL) {
+            // whole blocks bypass the metadata cache
+            if (read_block_raw(fs, block, out + done) != 0)
+                return EXT2_ERR_IO;
+        } else {
+            uint8 *data = get_block(fs, block);
+            if (data == NULL)
+                return EXT2_ERR_IO;
+            memcpy(out + done, data + within, chunk);
+        }
+        done += chunk;
+    }
+    return done;
+}
+
+int ext2_write(EXT2_FS *fs, uint32 ino, uint32 offset, const void *buffer, uint32 length) {
+    EXT2_INODE inode;
+    const uint8 *in = (const uint8 *)buffer;
+    uint32 done = 0, goal;
+    int res = 0;
+
+    if (fs->read_only)
+        return EXT2_ERR_READ_ONLY;
+    if (ext2_read_inode(fs, ino, &inode) != 0)
+        return EXT2_ERR_IO;
+
+    // start next to the inode's group, or right after the data before offset
+    goal = inode_goal(fs, ino);
+    if (offset >= fs->block_size) {
+        uint32 prev = bmap(fs, &inode, offset / fs->block_size - 1, 0, 0, NULL);
+        if (prev != 0)
+            goal = prev + 1;
+    }
+
+    while (done < length) {
+        uint32 index = (offset + done) / fs->block_size;
+        uint32 within = (offset + done) % fs->block_size;
+        uint32 chunk = fs->block_size - within;
+        int created;
+        if (chunk > length - done)
+            chunk = length - done;
+
+        // zeros over a hole stay a hole, reads return zeros for it
+        if (mem_is_zero(in + done, chunk) && bmap(fs, &inode, index, 0, 0, NULL) == 0) {
+            done += chunk;
+            continue;
+        }
+        uint32 block = bmap(fs, &inode, index, 1, goal, &created);
+        if (block == 0) {
+            res = EXT2_ERR_NO_SPACE;
+            break;
+        }
+        goal = block + 1;
+
+        if (chunk == fs->block_size) {
+            res = write_block(fs, block, in + done);
+        } else {
+            uint8 *data = created ? get_new_block(fs, block) : get_block(fs, block);
+            if (data == NULL) {
+                res = EXT2_ERR_IO;
+                break;
+            }
+            memcpy(data + within, in + done, chunk);
+            res = put_block(fs, block, data);
+        }
+        if (res != 0)
+            break;
+        done += chunk;
+    }
+
+    if (offset + done > inode.i_size)
+        inode.i_size = offset + done;
+    if (write_inode(fs, ino, &inode) != 0)
+        return EXT2_ERR_IO;
+    return done > 0 ? (int)done : res;
+}
+
+int ext2_truncate(EXT2_FS *fs, uint32 ino, uint32 size) {
+    EXT2_INODE inode;
+    if (fs->read_only)
+        return EXT2_ERR_READ_ONLY;
+    if (ext2_read_inode(fs, ino, &inode) != 0)
+        return EXT2_ERR_IO;
+    if (size < inode.i_size) {
+        free_blocks_from(fs, &inode, (size + fs->block_size - 1) / fs->block_size);
+        // clear the tail of a partial last block, it would show up when the file grows again
+        if (size % fs->block_size != 0) {
+            uint32 block = bmap(fs, &inode, size / fs->block_size, 0, 0, NULL);
+            uint8 *data = block != 0 ? get_block(fs, block) : NULL;
+            if (data != NULL) {
+                memset(data + size % fs->block_size, 0, fs->block_size - size % fs->block_size);
+                put_block(fs, block, data);
+            }
+        }
+    }
+    inode.i_size = size;
+    return write_inode(fs, ino, &inode);
+}
+
+/*
+ directories
+*/
+#define DIR_REC_LEN(name_len) (((name_len) + 8 + 3) & ~3)
+
+static uint8 dir_file_type(EXT2_FS *fs, uint16 mode) {
+    if (!(fs->sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE))
+        return EXT2_FT_UNKNOWN;
+    return (mode & EXT2_S_IFMT) == EXT2_S_IFDIR ? EXT2_FT_DIR : EXT2_FT_REG_FILE;
+}
+
+int ext2_readdir(EXT2_FS *fs, uint32 dir_ino, EXT2_DIR_CALLBACK callback, void *arg) {
+    EXT2_INODE dir;
+    char name[EXT2_NAME_LEN + 1];
+    uint32 b, pos;
+
+    if (ext2_read_inode(fs, dir_ino, &dir) != 0)
+        return EXT2_ERR_IO;
+    if ((dir.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR)
+        return EXT2_ERR_NOT_DIR;
+
+    for (b = 0; b < dir.i_size / fs->block_size; b++) {
+        uint32 block = bmap(fs, &dir, b, 0, 0, NULL);
+        if (block == 0)
+            continue;
+        for (pos = 0; pos < fs->block_size;) {
+            uint8 *data = get_block(fs, block);
+            if (data == NULL)
+                return EXT2_ERR_IO;
+            EXT2_DIR_ENTRY *entry = (EXT2_DIR_ENTRY *)(data + pos);
+            if (entry->rec_len < 8 || pos + entry->rec_len > fs->block_size)
+                break;
+            pos += entry->rec_len;
+            if (entry->inode == 0)
+                continue;
+            uint32 ino = entry->inode;
+            uint8 type = entry->file_type;
+            memcpy(name, entry->name, entry->name_len);
+            name[entry->name_len] = '\0';
+            // the callback may use the cache, data is re-fetched on the next iteration
+            if (callback(name, ino, type, arg))
+                return 0;
+        }
+    }
+    return 0;
+}
+
+// find name in a directory, returns the inode and where the entry lives
+static uint32 dir_find(EXT2_FS *fs, EXT2_INODE *dir, const char *name, uint32 *found_block, uint32 *found_pos) {
+    uint32 len = strlen(name), b, pos;
+
+    for (b = 0; b < dir->i_size / fs->block_size; b++) {
+        uint32 block = bmap(fs, dir, b, 0, 0, NULL);
+        uint8 *data = block != 0 ? get_block(fs, block) : NULL;
+        if (data == NULL)
+            continue;
+        for (pos = 0; pos < fs->block_size;) {
+            EXT2_DIR_ENTRY *entry = (EXT2_DIR_ENTRY *)(data + pos);
+            if (entry->rec_len < 8 || pos + entry->rec_len > fs->block_size)
+                break;
+            if (entry->inode != 0 && entry->name_len == len &&
+                memcmp((uint8 *)entry->name, (uint8 *)name, len)) {
+                if (found_block)
+                    *found_block = block;
+                if (found_pos)
+                    *found_pos = pos;
+                return entry->inode;
+            }
+            pos += entry->rec_len;
+        }
+    }
+    return 0;
+}
+
+static int dir_add(EXT2_FS *fs, uint32 dir_ino, EXT2_INODE *dir, const char *name, uint32 ino, uint8 type) {
+    uint32 len = strlen(name);
+    uint32 needed = DIR_REC_LEN(len);
+    uint32 b, pos;
+    int appended = 0;
+
+    // the driver only keeps linear directories, drop a hashed index if present
+    dir->i_flags &= ~EXT2_INDEX_FL;
+
+    for (b = 0; b <= dir->i_size / fs->block_size; b++) {
+        uint32 block;
+        uint8 *data;
+        EXT2_DIR_ENTRY *entry;
+
+        if (b == dir->i_size / fs->block_size) {
+            // no room in the existing blocks, append one
+            block = bmap(fs, dir, b, 1, dir->i_block[0], NULL);
+            if (block == 0)
+                return EXT2_ERR_NO_SPACE;
+            data = get_new_block(fs, block);
+            entry = (EXT2_DIR_ENTRY *)data;
+            entry->rec_len = fs->block_size;
+            dir->i_size += fs->block_size;
+            appended = 1;
+        } else {
+            block = bmap(fs, dir, b, 0, 0, NULL);
+            data = block != 0 ? get_block(fs, block) : NULL;
+            if (data == NULL)
+                continue;
+            for (pos = 0; pos < fs->block_size;) {
+                entry = (EXT2_DIR_ENTRY *)(data + pos);
+                if (entry->rec_len < 8 || pos + entry->rec_len > fs->block_size)
+                    break;
+                uint32 used = entry->inode != 0 ? DIR_REC_LEN(entry->name_len) : 0;
+                if (entry->rec_len >= used + needed) {
+                    if (used > 0) {
+                        // split the entry, the new one takes its slack
+                        EXT2_DIR_ENTRY *next = (EXT2_DIR_ENTRY *)(data + pos + used);
+                        next->rec_len = entry->rec_len - used;
+                        entry->rec_len = used;
+                        entry = next;
+                    }
+                    goto fill;
+                }
+                pos += entry->rec_len;
+            }
+            continue;
+        }
+
+    fill:
+        entry->inode = ino;
+        entry->name_len = len;
+        entry->file_type = type;
+        memcpy(entry->name, name, len);
+        if (put_block(fs, block, data) != 0) {
+            // give back a block appended above, with any indirect block it took
+            if (appended) {
+                free_blocks_from(fs, dir, b);
+                dir->i_size -= fs->block_size;
+            }
+            return EXT2_ERR_IO;
+        }
+        return write_inode(fs, dir_ino, dir);
+    }
+    return EXT2_ERR_NO_SPACE;
+}
+
+static int dir_remove(EXT2_FS *fs, EXT2_INODE *dir, const char *name) {
+    uint32 block, pos, prev = 0, at;
+    if (dir_find(fs, dir, name, &block, &pos) == 0)
+        return EXT2_ERR_NOT_FOUND;
+
+    uint8 *data = get_block(fs, block);
+    if (data == NULL)
+        return EXT2_ERR_IO;
+    EXT2_DIR_ENTRY *entry = (EXT2_DIR_ENTRY *)(data + pos);
+
+    if (pos == 0) {
+        entry->inode = 0;
+    } else {
+        // merge into the previous entry of the same block
+        for (at = 0; at < pos; at += ((EXT2_DIR_ENTRY *)(data + at))->rec_len)
+            prev = at;
+        ((EXT2_DIR_ENTRY *)(data + prev))->rec_len += entry->rec_len;
+    }
+    return put_block(fs, block, data);
+}
+
+static int dir_is_empty(EXT2_FS *fs, EXT2_INODE *dir) {
+    uint32 b, pos;
+    for (b = 0; b < dir->i_size / fs->block_size; b++) {
+        uint32 block = bmap(fs, dir, b, 0, 0, NULL);
+        uint8 *data = block != 0 ? get_block(fs, block) : NULL;
+        if (data == NULL)
+            continue;
+        for (pos = 0; pos < fs->block_size;) {
+            EXT2_DIR_ENTRY *entry = (EXT2_DIR_ENTRY *)(data + pos);
+            if (entry->rec_len < 8 || pos + entry->rec_len > fs->block_size)
+                break;
+            if (entry->inode != 0 &&
+                !(entry->name_len == 1 && entry->name[0] == '.') &&
+                !(entry->name_len == 2 && entry->name[0] == '.' && entry->name[1] == '.'))
+                return 0;
+            pos += entry->rec_len;
+        }
+    }
+    return 1;
+}
+
+/*
+ paths
+*/
+
+// copy the next path component into name, returns the rest of the path
+static const char *next_component(const char *path, char *name) {
+    int len = 0;
+    while (*path == '/')
+        path++;
+    while (*path && *path != '/') {
+        if (len < EXT2_NAME_LEN)
+            name[len++] = *path;
+        path++;
+    }
+    name[len] = '\0';
+    return path;
+}
+
+uint32 ext2_lookup(EXT2_FS *fs, const char *path) {
+    char name[EXT2_NAME_LEN + 1];
+    uint32 ino = EXT2_ROOT_INO;
+    EXT2_INODE inode;
+
+    while (1) {
+        path = next_component(path, name);
+        if (name[0] == '\0')
+            return ino;
+        if (ext2_read_inode(fs, ino, &inode) != 0)
+            return 0;
+        if ((inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR)
+            return 0;
+        ino = dir_find(fs, &inode, name, NULL, NULL);
+        if (ino == 0)
+            return 0;
+    }
+}
+
+// resolve the parent directory of path and copy the last component into name
+static uint32 lookup_parent(EXT2_FS *fs, const char *path, char *name) {
+    char parent[EXT2_NAME_LEN + 1];
+    const char *last = strrchr(path, '/');
+    int len;
+
+    if (last == NULL) {
+        next_component(path, name);
+        return EXT2_ROOT_INO;
+    }
+    next_component(last, name);
+    len = last - path;
+    if (len > EXT2_NAME_LEN)
+        return 0;
+    memcpy(parent, path, len);
+    parent[len] = '\0';
+    return ext2_lookup(fs, parent);
+}
+
+int ext2_create(EXT2_FS *fs, const char *path, uint16 mode) {
+    char name[EXT2_NAME_LEN + 1];
+    EXT2_INODE parent, inode;
+    uint32 parent_ino, ino;
+    int is_dir = (mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+    int res;
+
+    if (fs->read_only)
+        return EXT2_ERR_READ_ONLY;
+    parent_ino = lookup_parent(fs, path, name);
+    if (parent_ino == 0 || name[0] == '\0')
+        return EXT2_ERR_NOT_FOUND;
+    if (ext2_read_inode(fs, parent_ino, &parent) != 0)
+        return EXT2_ERR_IO;
+    if ((parent.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR)
+        return EXT2_ERR_NOT_DIR;
+    if (dir_find(fs, &parent, name, NULL, NULL) != 0)
+        return EXT2_ERR_EXISTS;
+
+    ino = alloc_inode(fs, parent_ino, is_dir);
+    if (ino == 0)
+        return EXT2_ERR_NO_SPACE;
+
+    memset(&inode, 0, sizeof(EXT2_INODE));
+    inode.i_mode = mode;
+    inode.i_atime = inode.i_ctime = inode.i_mtime = ext2_now(fs);
+    inode.i_links_count = is_dir ? 2 : 1;
+    if (write_inode(fs, ino, &inode) != 0) {
+        res = EXT2_ERR_IO;
+        goto fail;
+    }
+
+    if (is_dir) {
+        // "." and ".." fill the first block
+        uint32 block = bmap(fs, &inode, 0, 1, inode_goal(fs, ino), NULL);
+        if (block == 0) {
+            res = EXT2_ERR_NO_SPACE;
+            goto fail;
+        }
+        uint8 *data = get_new_block(fs, block);
+        EXT2_DIR_ENTRY *dot = (EXT2_DIR_ENTRY *)data;
+        dot->inode = ino;
+        dot->rec_len = DIR_REC_LEN(1);
+        dot->name_len = 1;
+        dot->file_type = dir_file_type(fs, EXT2_S_IFDIR);
+        dot->name[0] = '.';
+        EXT2_DIR_ENTRY *dotdot = (EXT2_DIR_ENTRY *)(data + dot->rec_len);
+        dotdot->inode = parent_ino;
+        dotdot->rec_len = fs->block_size - dot->rec_len;
+        dotdot->name_len = 2;
+        dotdot->file_type = dot->file_type;
+        dotdot->name[0] = '.';
+        dotdot->name[1] = '.';
+        put_block(fs, block, data);
+        inode.i_size = fs->block_size;
+        write_inode(fs, ino, &inode);
+        parent.i_links_count++;
+    }
+
+    res = dir_add(fs, parent_ino, &parent, name, ino, dir_file_type(fs, mode));
+    if (res != 0)
+        goto fail;
+    return ino;
+
+fail:
+    // no entry refers to the inode, give it back with its blocks
+    free_blocks_from(fs, &inode, 0);
+    inode.i_size = 0;
+    inode.i_links_count = 0;
+    inode.i_dtime = ext2_now(fs);
+    write_inode(fs, ino, &inode);
+    free_inode(fs, ino, is_dir);
+    return res;
+}
+
+int ext2_unlink(EXT2_FS *fs, const char *path) {
+    char name[EXT2_NAME_LEN + 1];
+    EXT2_INODE parent, inode;
+    uint32 parent_ino, ino;
+    int is_dir, res;
+
+    if (fs->read_only)
+        return EXT2_ERR_READ_ONLY;
+    parent_ino = lookup_parent(fs, path, name);
+    if (parent_ino == 0 || ext2_read_inode(fs, parent_ino, &parent) != 0)
+        return EXT2_ERR_NOT_FOUND;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || name[0] == '\0')
+        return EXT2_ERR_INVALID;
+    ino = dir_find(fs, &parent, name, NULL, NULL);
+    if (ino == 0 || ext2_read_inode(fs, ino, &inode) != 0)
+        return EXT2_ERR_NOT_FOUND;
+
+    is_dir = (inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+    if (is_dir && !dir_is_empty(fs, &inode))
+        return EXT2_ERR_NOT_EMPTY;
+
+    res = dir_remove(fs, &parent, name);
+    if (res != 0)
+        return res;
+    if (is_dir) {
+        parent.i_links_count--;
+        inode.i_links_count = 0;
+    } else {
+        inode.i_links_count--;
+    }
+    write_inode(fs, parent_ino, &parent);
+
+    if (inode.i_links_count == 0) {
+        free_blocks_from(fs, &inode, 0);
+        inode.i_size = 0;
+        inode.i_dtime = ext2_now(fs);
+        write_inode(fs, ino, &inode);
+        free_inode(fs, ino, is_dir);
+    } else {
+        write_inode(fs, ino, &inode);
+    }
+    return 0;
+}
+
+int ext2_rename(EXT2_FS *fs, const char *from, const char *to) {
+    char name[EXT2_NAME_LEN + 1], new_name[EXT2_NAME_LEN + 1];
+    EXT2_INODE parent, new_parent, inode;
+    uint32 parent_ino, new_parent_ino, ino, block, pos;
+    int is_dir, res;
+
+    if (fs->read_only)
+        return EXT2_ERR_READ_ONLY;
+    parent_ino = lookup_parent(fs, from, name);
+    if (parent_ino == 0 || ext2_read_inode(fs, parent_ino, &parent) != 0)
+        return EXT2_ERR_NOT_FOUND;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || name[0] == '\0')
+        return EXT2_ERR_INVALID;
+    ino = dir_find(fs, &parent, name, NULL, NULL);
+    if (ino == 0 || ext2_read_inode(fs, ino, &inode) != 0)
+        return EXT2_ERR_NOT_FOUND;
+
+    new_parent_ino = lookup_parent(fs, to, new_name);
+    if (new_parent_ino == 0 || new_name[0] == '\0')
+        return EXT2_ERR_NOT_FOUND;
+    if (strcmp(new_name, ".") == 0 || strcmp(new_name, "..") == 0)
+        return EXT2_ERR_INVALID;
+    if (ext2_read_inode(fs, new_parent_ino, &new_parent) != 0)
+        return EXT2_ERR_IO;
+    if ((new_parent.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR)
+        return EXT2_ERR_NOT_DIR;
+    if (dir_find(fs, &new_parent, new_name, NULL, NULL) != 0)
+        return EXT2_ERR_EXISTS;
+
+    // link the new name first, a crash in between leaves two names rather than none
+    is_dir = (inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+    if (is_dir && new_parent_ino != parent_ino)
+        new_parent.i_links_count++;
+    res = dir_add(fs, new_parent_ino, &new_parent, new_name, ino, dir_file_type(fs, inode.i_mode));
+    if (res != 0)
+        return res;
+
+    // dir_add() may have rewritten the old parent if it is the same directory
+    if (ext2_read_inode(fs, parent_ino, &parent) != 0)
+        return EXT2_ERR_IO;
+    res = dir_remove(fs, &parent, name);
+    if (res != 0)
+        return res;
+
+    if (is_dir && new_parent_ino != parent_ino) {
+        if (dir_find(fs, &inode, "..", &block, &pos) != 0) {
+            uint8 *data = get_block(fs, block);
+            if (data == NULL)
+                return EXT2_ERR_IO;
+            ((EXT2_DIR_ENTRY *)(data + pos))->inode = new_parent_ino;
+            put_block(fs, block, data);
+        }
+        parent.i_links_count--;
+        write_inode(fs, parent_ino, &parent);
+    }
+    inode.i_ctime = ext2_now(fs);
+    return write_inode(fs, ino, &inode);
+}
+
+/*
+ mount
+*/
+EXT2_FS *ext2_mount(BLOCK_DEVICE *dev) {
+    EXT2_FS *fs = NULL;
+    uint32 i, gdt_blocks;
+
+    for (i = 0; i < EXT2_MAX_MOUNTS; i++) {
+        if (!g_ext2_mounts[i].mounted) {
+            fs = &g_ext2_mounts[i];
+            break;
+        }
+    }
+    if (fs == NULL || dev == NULL)
+        return NULL;
+
+    memset(fs, 0, sizeof(EXT2_FS));
+    fs->dev = dev;
+    if (blockdev_read(dev, EXT2_SUPERBLOCK_OFFSET / BLOCKDEV_SECTOR_SIZE,
+                      sizeof(EXT2_SUPERBLOCK) / BLOCKDEV_SECTOR_SIZE, &fs->sb) != 0)
+        return NULL;
+    if (fs->sb.s_magic != EXT2_SUPER_MAGIC) {
+        console_putstr("[EXT2] Not an ext2 file system\n");
+        return NULL;
+    }
+
+    fs->block_size = EXT2_MIN_BLOCK_SIZE << fs->sb.s_log_block_size;
+    if (fs->block_size > EXT2_MAX_BLOCK_SIZE) {
+        console_printf("[EXT2] Unsupported block size %d\n", fs->block_size);
+        return NULL;
+    }
+    if (fs->sb.s_rev_level == 0) {
+        fs->inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+        fs->first_ino = EXT2_GOOD_OLD_FIRST_INO;
+    } else {
+        if (fs->sb.s_feature_incompat & ~EXT2_SUPPORTED_INCOMPAT) {
+            console_printf("[EXT2] Unsupported features 0x%x\n", fs->sb.s_feature_incompat);
+            return NULL;
+        }
+        if (fs->sb.s_feature_ro_compat & ~EXT2_SUPPORTED_RO_COMPAT) {
+            console_putstr("[EXT2] Mounting read-only\n");
+            fs->read_only = 1;
+        }
+        fs->inode_size = fs->sb.s_inode_size;
+        fs->first_ino = fs->sb.s_first_ino;
+    }
+
+    // both divide block and inode numbers into groups
+    if (fs->sb.s_blocks_per_group == 0 || fs->sb.s_inodes_per_group == 0) {
+        console_putstr("[EXT2] Corrupt superblock: empty groups\n");
+        return NULL;
+    }
+
+    fs->sectors_per_block = fs->block_size / BLOCKDEV_SECTOR_SIZE;
+    fs->addr_per_block = fs->block_size / sizeof(uint32);
+    fs->group_count = (fs->sb.s_blocks_count - fs->sb.s_first_data_block + fs->sb.s_blocks_per_group - 1)
+                      / fs->sb.s_blocks_per_group;
+    if (fs->group_count == 0 || fs->group_count > EXT2_MAX_GROUPS) {
+        console_printf("[EXT2] Unsupported group count %d\n", fs->group_count);
+        return NULL;
+    }
+
+    // the descriptor table follows the superblock, keep all of it in memory
+    fs->gdt_block = fs->sb.s_first_data_block + 1;
+    gdt_blocks = (fs->group_count * sizeof(EXT2_GROUP_DESC) + fs->block_size - 1) / fs->block_size;
+    for (i = 0; i < gdt_blocks; i++) {
+        if (read_block_raw(fs, fs->gdt_block + i, (uint8 *)fs->groups + i * fs->block_size) != 0)
+            return NULL;
+    }
+
+    fs->mounted = 1;
+    console_printf("[EXT2] %s: %d blocks of %d bytes, %d groups, %d free blocks\n",
+                   dev->name, fs->sb.s_blocks_count, fs->block_size, fs->group_count,
+                   fs->sb.s_free_blocks_count);
+    return fs;
+}
+
+int ext2_sync(EXT2_FS *fs) {
+    if (fs->read_only || !fs->sb_dirty)
+        return 0;
+    return write_superblock(fs);
+}
+
+void ext2_unmount(EXT2_FS *fs) {
+    int i;
+    if (fs == NULL || !fs->mounted)
+        return;
+    ext2_sync(fs);
+    for (i = 0; i < EXT2_BLOCK_CACHE_SIZE; i++) {
+        if (g_block_cache[i].fs == fs)
+            g_block_cache[i].fs = NULL;
+    }
+    for (i = 0; i < EXT2_INODE_CACHE_SIZE; i++) {
+        if (g_inode_cache[i].fs == fs)
+            g_inode_cache[i].fs = NULL;
+    }
+    fs->mounted = 0;
+}
+
+/* VFS glue, EXT2_ERR_* values are the matching VFS_ERR_* */
+
+static void *vfs_ext2_mount(BLOCK_DEVICE *dev, const char *options) {
+    return dev != NULL ? ext2_mount(dev) : NULL;
+}
+
+static void vfs_ext2_unmount(void *fs) {
+    ext2_unmount((EXT2_FS *)fs);
+}
+
+static int vfs_ext2_sync(void *fs) {
+    return ext2_sync((EXT2_FS *)fs);
+}
+
+static int vfs_ext2_stat(void *fs, uint32 node, VFS_STAT *st) {
+    EXT2_INODE inode;
+    if (ext2_read_inode((EXT2_FS *)fs, node, &inode) != 0)
+        return EXT2_ERR_IO;
+    st->node = node;
+    st->size = inode.i_size;
+    st->allocated = inode.i_blocks * 512; // i_blocks counts 512 byte units, indirect blocks included
+    st->permissions = inode.i_mode & 0777;
+    st->is_directory = (inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+    return 0;
+}
+
+static int vfs_ext2_lookup(void *fs, const char *path, VFS_STAT *st) {
+    uint32 ino = ext2_lookup((EXT2_FS *)fs, path);
+    if (ino == 0)
+        return EXT2_ERR_NOT_FOUND;
+    return vfs_ext2_stat(fs, ino, st);
+}
+
+static int vfs_ext2_read(void *fs, uint32 node, uint32 offset, void *buffer, uint32 length) {
+    return ext2_read((EXT2_FS *)fs, node, offset, buffer, length);
+}
+
+static int vfs_ext2_write(void *fs, uint32 node, uint32 offset, const void *buffer, uint32 length) {
+    return ext2_write((EXT2_FS *)fs, node, offset, buffer, length);
+}
+
+static int vfs_ext2_truncate(void *fs, uint32 node, uint32 size) {
+    return ext2_truncate((EXT2_FS *)fs, node, size);
+}
+
+static int vfs_ext2_create(void *fs, const char *path, uint8 is_directory, uint32 permissions, VFS_STAT *st) {
+    uint16 mode = (is_directory ? EXT2_S_IFDIR : EXT2_S_IFREG) | (permissions & 0777);
+    int ino = ext2_create((EXT2_FS *)fs, path, mode);
+    if (ino < 0)
+        return ino;
+    return vfs_ext2_stat(fs, ino, st);
+}
+
+static int vfs_ext2_unlink(void *fs, const char *path) {
+    return ext2_unlink((EXT2_FS *)fs, path);
+}
+
+static int vfs_ext2_rename(void *fs, const char *from, const char *to) {
+    return ext2_rename((EXT2_FS *)fs, from, to);
+}
+
+typedef struct {
+    EXT2_FS *fs;
+    VFS_DIR_CALLBACK callback;
+    void *arg;
+} EXT2_READDIR_CONTEXT;
+
+static int vfs_ext2_readdir_entry(const char *name, uint32 ino, uint8 file_type, void *arg) {
+    EXT2_READDIR_CONTEXT *ctx = (EXT2_READDIR_CONTEXT *)arg;
+    VFS_STAT st;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        return 0;
+    if (vfs_ext2_stat(ctx->fs, ino, &st) != 0)
+        return 0;
+    return ctx->callback(name, &st, ctx->arg);
+}
+
+static int vfs_ext2_readdir(void *fs, uint32 node, VFS_DIR_CALLBACK callback, void *arg) {
+    EXT2_READDIR_CONTEXT ctx = {(EXT2_FS *)fs, callback, arg};
+    return ext2_readdir((EXT2_FS *)fs, node, vfs_ext2_readdir_entry, &ctx);
+}
+
+VFS_DRIVER ext2_driver = {
+    .name = "ext2",
+    .mount = vfs_ext2_mount,
+    .unmount = vfs_ext2_unmount,
+    .sync = vfs_ext2_sync,
+    .lookup = vfs_ext2_lookup,
+    .stat = vfs_ext2_stat,
+    .read = vfs_ext2_read,
+    .write = vfs_ext2_write,
+    .truncate = vfs_ext2_truncate,
+    .create = vfs_ext2_create,
+    .unlink = vfs_ext2_unlink,
+    .rename = vfs_ext2_rename,
+    .readdir = vfs_ext2_readdir,
+};
@@ -0,0 +1,1572 @@
+#include "fs/fat.h"
+#include "console.h"
+#include "string.h"
+#include "meminfo.h"
+
+// fatgen103: https://download.microsoft.com/download/1/6/1/161ba512-40e2-4cc9-843a-923143f3456c/fatgen103.doc
+
+#define FAT_SECTOR_CACHE_SIZE 32
+#define FAT_CHAIN_CACHE_SIZE  8
+#define FAT_CHAIN_RUNS        16
+// clusters a chain lookup may read ahead while the chain stays contiguous
+#define FAT_READ_AHEAD        256
+
+// no wall clock yet, new entries are dated 1980-01-01 00:00
+#define FAT_DATE_EPOCH        ((1 << 5) | 1)
+
+/*
+ FAT sectors, and directory sectors, are cached. Changes stay in the
+ cache until the end of the operation that made them (flush_sectors()),
+ so a write allocating many clusters updates each FAT sector once.
+ File contents never go through the cache.
+*/
+typedef struct {
+    FAT_FS *fs;
+    uint32 lba;
+    uint32 last_used;
+    uint8 dirty;
+    uint8 data[FAT_SECTOR_SIZE];
+} FAT_CACHED_SECTOR;
+
+/*
+ where the clusters of a chain are, as runs of consecutive clusters:
+ file cluster index .. index + count - 1 is on cluster .. cluster + count - 1.
+ The runs cover the chain from its start up to where it was last
+ followed, so a sequential read follows each FAT entry only once.
+ When the runs are used up, cursor_* remembers the furthest point reached.
+*/
+typedef struct {
+    uint32 index;
+    uint32 cluster;
+    uint32 count;
+} FAT_RUN;
+
+typedef struct {
+    FAT_FS *fs;
+    uint32 first;               // first cluster, identifies the chain
+    uint32 last_used;
+    uint32 run_count;
+    FAT_RUN runs[FAT_CHAIN_RUNS];
+    uint32 cursor_index;
+    uint32 cursor_cluster;
+    uint8 complete;             // the end of the chain was seen
+} FAT_CHAIN;
+
+// a directory entry as seen by dir_walk()
+typedef struct {
+    char name[FAT_NAME_LEN + 1];  // UTF-8, the long name if there is one
+    char short_name[13];          // the 8.3 name, an alias for the long one
+    FAT_DIR_ENTRY entry;          // copy of the short entry
+    uint32 node;
+    uint32 first;                 // index of the first entry in the directory (long name or short)
+    uint32 index;                 // index of the short entry
+} FAT_DIRENT;
+
+// called for every entry by dir_walk(), return non zero to stop
+typedef int (*FAT_WALK_CALLBACK)(FAT_FS *fs, FAT_DIRENT *d, void *arg);
+
+static FAT_FS g_fat_mounts[FAT_MAX_MOUNTS];
+static FAT_CACHED_SECTOR g_sector_cache[FAT_SECTOR_CACHE_SIZE];
+MEMINFO_STATIC(g_sector_cache);
+static FAT_CHAIN g_chain_cache[FAT_CHAIN_CACHE_SIZE];
+static uint32 g_cache_clock = 0;
+
+// byte offsets of the 13 UCS-2 characters in a long name entry
+static const uint8 g_lfn_offsets[FAT_LFN_CHARS] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+
+static uint8 g_scratch[FAT_SECTOR_SIZE];
+static uint8 g_zero_sector[FAT_SECTOR_SIZE];
+
+/*
+ sector cache
+*/
+static int write_sector_raw(FAT_FS *fs, uint32 lba, const void *data) {
+    uint32 i;
+    if (blockdev_write(fs->dev, lba, 1, data) != 0)
+        return VFS_ERR_IO;
+    // keep the other copies of the FAT in step
+    if (fs->fat_mirror && lba >= fs->fat_start && lba < fs->fat_start + fs->fat_sectors) {
+        for (i = 1; i < fs->fat_count; i++) {
+            if (blockdev_write(fs->dev, lba + i * fs->fat_sectors, 1, data) != 0)
+                return VFS_ERR_IO;
+        }
+    }
+    return 0;
+}
+
+static FAT_CACHED_SECTOR *cache_lookup(FAT_FS *fs, uint32 lba) {
+    int i;
+    for (i = 0; i < FAT_SECTOR_CACHE_SIZE; i++) {
+        if (g_sector_cache[i].fs == fs && g_sector_cache[i].lba == lba) {
+            g_sector_cache[i].last_used = ++g_cache_clock;
+            return &g_sector_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// least recently used slot, written back first if it holds changes
+static FAT_CACHED_SECTOR *cache_victim() {
+    FAT_CACHED_SECTOR *entry = &g_sector_cache[0];
+    int i;
+    for (i = 1; i < FAT_SECTOR_CACHE_SIZE; i++) {
+        if (g_sector_cache[i].last_used < entry->last_used)
+            entry = &g_sector_cache[i];
+    }
+    if (entry->fs != NULL && entry->dirty)
+        write_sector_raw(entry->fs, entry->lba, entry->data);
+    entry->fs = NULL;
+    entry->dirty = 0;
+    return entry;
+}
+
+/*
+ returns the cached copy of a sector, valid until the next call into the
+ cache. With dirty set the caller is going to change it, it is written
+ back by flush_sectors()
+*/
+static uint8 *get_sector(FAT_FS *fs, uint32 lba, int dirty) {
+    FAT_CACHED_SECTOR *entry = cache_lookup(fs, lba);
+    if (entry == NULL) {
+        entry = cache_victim();
+        if (blockdev_read(fs->dev, lba, 1, entry->data) != 0)
+            return NULL;
+        entry->fs = fs;
+        entry->lba = lba;
+        entry->last_used = ++g_cache_clock;
+    }
+    if (dirty)
+        entry->dirty = 1;
+    return entry->data;
+}
+
+static int flush_sectors(FAT_FS *fs) {
+    int i, res = 0;
+    for (i = 0; i < FAT_SECTOR_CACHE_SIZE; i++) {
+        FAT_CACHED_SECTOR *entry = &g_sector_cache[i];
+        if (entry->fs == fs && entry->dirty) {
+            if (write_sector_raw(fs, entry->lba, entry->data) != 0)
+                res = VFS_ERR_IO;
+            entry->dirty = 0;
+        }
+    }
+    return res;
+}
+
+// drop cached copies of sectors that are being overwritten directly
+static void forget_sectors(FAT_FS *fs, uint32 lba, uint32 count) {
+    int i;
+    for (i = 0; i < FAT_SECTOR_CACHE_SIZE; i++) {
+        FAT_CACHED_SECTOR *entry = &g_sector_cache[i];
+        if (entry->fs == fs && entry->lba >= lba && entry->lba < lba + count) {
+            entry->fs = NULL;
+            entry->dirty = 0;
+        }
+    }
+}
+
+/*
+ FAT
+*/
+static uint32 cluster_lba(FAT_FS *fs, uint32 cluster) {
+    return fs->data_start + (cluster - 2) * fs->sectors_per_cluster;
+}
+
+static int valid_cluster(FAT_FS *fs, uint32 cluster) {
+    return cluster >= 2 && cluster < fs->cluster_count + 2;
+}
+
+// raw value of a FAT entry, FAT_EOC on i/o errors
+static uint32 fat_read_entry(FAT_FS *fs, uint32 cluster) {
+    uint32 offset, value;
+    uint8 *sector;
+
+    if (fs->type == 12) {
+        // 12 bits at byte cluster * 1.5, the two bytes may be in different sectors
+        offset = cluster + cluster / 2;
+        sector = get_sector(fs, fs->fat_start + offset / FAT_SECTOR_SIZE, 0);
+        if (sector == NULL)
+            return FAT_EOC;
+        value = sector[offset % FAT_SECTOR_SIZE];
+        offset++;
+        sector = get_sector(fs, fs->fat_start + offset / FAT_SECTOR_SIZE, 0);
+        if (sector == NULL)
+            return FAT_EOC;
+        value |= sector[offset % FAT_SECTOR_SIZE] << 8;
+        return cluster & 1 ? value >> 4 : value & 0xFFF;
+    }
+    offset = cluster * (fs->type / 8);
+    sector = get_sector(fs, fs->fat_start + offset / FAT_SECTOR_SIZE, 0);
+    if (sector == NULL)
+        return FAT_EOC;
+    if (fs->type == 16)
+        return *(uint16 *)(sector + offset % FAT_SECTOR_SIZE);
+    return *(uint32 *)(sector + offset % FAT_SECTOR_SIZE) & 0x0FFFFFFF;
+}
+
+/*
+ next cluster of a chain: FAT_FREE, a valid cluster or FAT_EOC for the
+ end of the chain and anything a chain cannot continue with (bad
+ clusters, reserved values, clusters past the end of the volume)
+*/
+static uint32 fat_get(FAT_FS *fs, uint32 cluster) {
+    uint32 value = fat_read_entry(fs, cluster);
+    if (value == FAT_FREE || valid_cluster(fs, value))
+        return value;
+    return FAT_EOC;
+}
+
+static int fat_set(FAT_FS *fs, uint32 cluster, uint32 value) {
+    uint32 offset, lba;
+    uint8 *sector;
+
+    if (fs->type == 12) {
+        value &= 0xFFF;
+        offset = cluster + cluster / 2;
+        lba = fs->fat_start + offset / FAT_SECTOR_SIZE;
+        sector = get_sector(fs, lba, 1);
+        if (sector == NULL)
+            return VFS_ERR_IO;
+        if (cluster & 1)
+            sector[offset % FAT_SECTOR_SIZE] = (sector[offset % FAT_SECTOR_SIZE] & 0x0F) | (value << 4);
+        else
+            sector[offset % FAT_SECTOR_SIZE] = value;
+        offset++;
+        sector = get_sector(fs, fs->fat_start + offset / FAT_SECTOR_SIZE, 1);
+        if (sector == NULL)
+            return VFS_ERR_IO;
+        if (cluster & 1)
+            sector[offset % FAT_SECTOR_SIZE] = value >> 4;
+        else
+            sector[offset % FAT_SECTOR_SIZE] = (sector[offset % FAT_SECTOR_SIZE] & 0xF0) | (value >> 8);
+        return 0;
+    }
+    offset = cluster * (fs->type / 8);
+    sector = get_sector(fs, fs->fat_start + offset / FAT_SECTOR_SIZE, 1);
+    if (sector == NULL)
+        return VFS_ERR_IO;
+    if (fs->type == 16) {
+        *(uint16 *)(sector + offset % FAT_SECTOR_SIZE) = value;
+    } else {
+        // the top 4 bits of a FAT32 entry are reserved and must be kept
+        uint32 *entry = (uint32 *)(sector + offset % FAT_SECTOR_SIZE);
+        *entry = (*entry & 0xF0000000) | (value & 0x0FFFFFFF);
+    }
+    return 0;
+}
+
+/*
+ find a free cluster, starting at hint so that files stay contiguous,
+ and mark it as the end of a chain. returns 0 if the volume is full
+*/
+static uint32 alloc_cluster(FAT_FS *fs, uint32 hint) {
+    uint32 i, cluster;
+
+    if (!valid_cluster(fs, hint))
+        hint = valid_cluster(fs, fs->next_free) ? fs->next_free : 2;
+    for (i = 0; i < fs->cluster_count; i++) {
+        cluster = hint + i;
+        if (cluster >= fs->cluster_count + 2)
+            cluster -= fs->cluster_count;
+        if (fat_read_entry(fs, cluster) != FAT_FREE)
+            continue;
+        if (fat_set(fs, cluster, FAT_EOC) != 0)
+            return 0;
+        if (fs->free_count != FAT_UNKNOWN && fs->free_count > 0)
+            fs->free_count--;
+        fs->next_free = cluster + 1;
+        fs->fsinfo_dirty = 1;
+        return cluster;
+    }
+    return 0;
+}
+
+static void free_chain(FAT_FS *fs, uint32 cluster) {
+    uint32 next, limit = fs->cluster_count;
+
+    // the limit stops at a chain that loops back on itself
+    while (valid_cluster(fs, cluster) && limit-- > 0) {
+        next = fat_get(fs, cluster);
+        if (next == FAT_FREE || fat_set(fs, cluster, FAT_FREE) != 0)
+            break;
+        if (fs->free_count != FAT_UNKNOWN)
+            fs->free_count++;
+        fs->fsinfo_dirty = 1;
+        cluster = next;
+    }
+}
+
+// zero a cluster on disk, for new directory clusters
+static int zero_cluster(FAT_FS *fs, uint32 cluster) {
+    uint32 lba = cluster_lba(fs, cluster), i;
+    forget_sectors(fs, lba, fs->sectors_per_cluster);
+    for (i = 0; i < fs->sectors_per_cluster; i++) {
+        if (blockdev_write(fs->dev, lba + i, 1, g_zero_sector) != 0)
+            return VFS_ERR_IO;
+    }
+    return 0;
+}
+
+/*
+ cluster chains
+*/
+static FAT_CHAIN *chain_get(FAT_FS *fs, uint32 first) {
+    FAT_CHAIN *chain = &g_chain_cache[0];
+    int i;
+    for (i = 0; i < FAT_CHAIN_CACHE_SIZE; i++) {
+        if (g_chain_cache[i].fs == fs && g_chain_cache[i].first == first) {
+            g_chain_cache[i].last_used = ++g_cache_clock;
+            return &g_chain_cache[i];
+        }
+        if (g_chain_cache[i].last_used < chain->last_used)
+            chain = &g_chain_cache[i];
+    }
+    chain->fs = fs;
+    chain->first = first;
+    chain->last_used = ++g_cache_clock;
+    chain->run_count = 1;
+    chain->runs[0].index = 0;
+    chain->runs[0].cluster = first;
+    chain->runs[0].count = 1;
+    chain->cursor_index = 0;
+    chain->cursor_cluster = first;
+    chain->complete = 0;
+    return chain;
+}
+
+// the chain was cut or freed
+static void chain_forget(FAT_FS *fs, uint32 first) {
+    int i;
+    for (i = 0; i < FAT_CHAIN_CACHE_SIZE; i++) {
+        if (g_chain_cache[i].fs == fs && g_chain_cache[i].first == first)
+            g_chain_cache[i].fs = NULL;
+    }
+}
+
+// clusters were appended, what is known stays valid but is no longer the end
+static void chain_grown(FAT_FS *fs, uint32 first) {
+    int i;
+    for (i = 0; i < FAT_CHAIN_CACHE_SIZE; i++) {
+        if (g_chain_cache[i].fs == fs && g_chain_cache[i].first == first)
+            g_chain_cache[i].complete = 0;
+    }
+}
+
+/*
+ disk cluster of cluster index of the chain starting at first, 0 past
+ its end. *contig is set to the number of clusters from there on that
+ are known to follow each other on disk
+*/
+static uint32 map_cluster(FAT_FS *fs, uint32 first, uint32 index, uint32 *contig) {
+    FAT_CHAIN *chain;
+    FAT_RUN *run;
+    uint32 pos, cluster, next, ahead;
+    int i, recording;
+
+    if (!valid_cluster(fs, first))
+        return 0;
+    chain = chain_get(fs, first);
+    for (i = chain->run_count - 1; i >= 0; i--) {
+        run = &chain->runs[i];
+        if (index >= run->index) {
+            if (index < run->index + run->count) {
+                if (contig != NULL)
+                    *contig = run->count - (index - run->index);
+                return run->cluster + (index - run->index);
+            }
+            break;
+        }
+    }
+    if (chain->complete)
+        return 0;
+
+    // follow the FAT from the end of the runs, or from the cursor when they are full
+    run = &chain->runs[chain->run_count - 1];
+    pos = run->index + run->count - 1;
+    cluster = run->cluster + run->count - 1;
+    recording = 1;
+    if (chain->cursor_index > pos) {
+        recording = 0;
+        if (chain->cursor_index <= index) {
+            pos = chain->cursor_index;
+            cluster = chain->cursor_cluster;
+        }
+    }
+    // past the wanted cluster only as long as the chain stays contiguous, to know *contig
+    ahead = 0;
+    while (pos < index || (recording && ahead < FAT_READ_AHEAD)) {
+        next = fat_get(fs, cluster);
+        if (!valid_cluster(fs, next)) {
+            // FAT_EOC, or a broken chain pointing to a free cluster
+            if (pos < index) {
+                if (recording)
+                    chain->complete = 1;
+                return 0;
+            }
+            if (recording)
+                chain->complete = 1;
+            break;
+        }
+        if (pos >= index && next != cluster + 1)
+            break;
+        pos++;
+        cluster = next;
+        if (pos > index)
+            ahead++;
+        if (recording) {
+            if (next == run->cluster + run->count) {
+                run->count++;
+            } else if (chain->run_count < FAT_CHAIN_RUNS) {
+                run = &chain->runs[chain->run_count++];
+                run->index = pos;
+                run->cluster = next;
+                run->count = 1;
+            } else {
+                recording = 0;
+            }
+        }
+        if (!recording) {
+            chain->cursor_index = pos;
+            chain->cursor_cluster = cluster;
+        }
+    }
+    if (pos < index)
+        return 0;
+    if (contig != NULL)
+        *contig = ahead + 1;
+    return cluster - (pos - index);
+}
+
+/*
+ directories, identified by their first cluster. 0 is the fixed root
+ directory of FAT12/16, the FAT32 root is a cluster chain like any other
+*/
+static uint32 root_dir(FAT_FS *fs) {
+    return fs->type == 32 ? fs->root_cluster : 0;
+}
+
+static uint32 entry_cluster(FAT_FS *fs, const FAT_DIR_ENTRY *entry) {
+    uint32 cluster = entry->cluster_low;
+    if (fs->type == 32)
+        cluster |= (uint32)entry->cluster_high << 16;
+    return cluster;
+}
+
+static void set_entry_cluster(FAT_FS *fs, FAT_DIR_ENTRY *entry, uint32 cluster) {
+    entry->cluster_low = cluster & 0xFFFF;
+    entry->cluster_high = fs->type == 32 ? cluster >> 16 : 0;
+}
+
+// sector holding entry index of dir, 0 past the end of the directory
+static uint32 dir_lba(FAT_FS *fs, uint32 dir, uint32 index) {
+    uint32 sector = index / FAT_ENTRIES_PER_SECTOR;
+    if (dir == 0)
+        return sector < fs->root_sectors ? fs->root_start + sector : 0;
+    uint32 cluster = map_cluster(fs, dir, sector / fs->sectors_per_cluster, NULL);
+    return cluster != 0 ? cluster_lba(fs, cluster) + sector % fs->sectors_per_cluster : 0;
+}
+
+// entry index of dir in the sector cache, NULL past the end of the directory
+static FAT_DIR_ENTRY *dir_entry(FAT_FS *fs, uint32 dir, uint32 index, int dirty, uint32 *node) {
+    uint32 lba;
+    uint8 *sector;
+
+    if (index >= FAT_MAX_DIR_ENTRIES)
+        return NULL;
+    lba = dir_lba(fs, dir, index);
+    if (lba == 0)
+        return NULL;
+    sector = get_sector(fs, lba, dirty);
+    if (sector == NULL)
+        return NULL;
+    if (node != NULL)
+        *node = lba * FAT_ENTRIES_PER_SECTOR + index % FAT_ENTRIES_PER_SECTOR;
+    return (FAT_DIR_ENTRY *)sector + index % FAT_ENTRIES_PER_SECTOR;
+}
+
+// short entry of a node in the sector cache
+static FAT_DIR_ENTRY *node_entry(FAT_FS *fs, uint32 node, int dirty) {
+    uint8 *sector;
+    if (node == FAT_ROOT_NODE)
+        return NULL;
+    sector = get_sector(fs, node / FAT_ENTRIES_PER_SECTOR, dirty);
+    if (sector == NULL)
+        return NULL;
+    return (FAT_DIR_ENTRY *)sector + node % FAT_ENTRIES_PER_SECTOR;
+}
+
+/*
+ names
+*/
+static uint8 sfn_checksum(const uint8 *name) {
+    uint8 sum = 0;
+    int i;
+    for (i = 0; i < FAT_SFN_LEN; i++)
+        sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+    return sum;
+}
+
+static int lower_ascii(int c) {
+    return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+}
+
+static int upper_ascii(int c) {
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+// names compare without regard to ASCII case, like on every other FAT implementation
+static int name_equal(const char *a, const char *b) {
+    while (*a != '\0' && lower_ascii((uint8)*a) == lower_ascii((uint8)*b)) {
+        a++;
+        b++;
+    }
+    return *a == '\0' && *b == '\0';
+}
+
+// display form of a short name
+static void sfn_to_name(const FAT_DIR_ENTRY *entry, char *name) {
+    int len = 0, i, end;
+
+    for (end = 8; end > 0 && entry->name[end - 1] == ' '; end--)
+        ;
+    for (i = 0; i < end; i++) {
+        uint8 c = entry->name[i];
+        if (i == 0 && c == FAT_DIR_KANJI_E5)
+            c = FAT_DIR_DELETED;
+        name[len++] = entry->nt_res & FAT_NT_LOWER_BASE ? lower_ascii(c) : c;
+    }
+    for (end = FAT_SFN_LEN; end > 8 && entry->name[end - 1] == ' '; end--)
+        ;
+    if (end > 8)
+        name[len++] = '.';
+    for (i = 8; i < end; i++)
+        name[len++] = entry->nt_res & FAT_NT_LOWER_EXT ? lower_ascii(entry->name[i]) : entry->name[i];
+    name[len] = '\0';
+}
+
+// UCS-2 long name to UTF-8, stops at the 0 terminator or the 0xFFFF padding
+static void lfn_to_name(const uint16 *lfn, int chars, char *name) {
+    int len = 0, i;
+    for (i = 0; i < chars && lfn[i] != 0 && lfn[i] != 0xFFFF; i++) {
+        uint16 c = lfn[i];
+        int need = c < 0x80 ? 1 : c < 0x800 ? 2 : 3;
+        if (len + need > FAT_NAME_LEN)
+            break;
+        if (need == 1) {
+            name[len++] = c;
+        } else if (need == 2) {
+            name[len++] = 0xC0 | (c >> 6);
+            name[len++] = 0x80 | (c & 0x3F);
+        } else {
+            name[len++] = 0xE0 | (c >> 12);
+            name[len++] = 0x80 | ((c >> 6) & 0x3F);
+            name[len++] = 0x80 | (c & 0x3F);
+        }
+    }
+    name[len] = '\0';
+}
+
+// UTF-8 to UCS-2, returns the number of characters or -1 if name cannot be a long name
+static int name_to_lfn(const char *name, uint16 *lfn) {
+    const uint8 *p = (const uint8 *)name;
+    int chars = 0;
+
+    while (*p != '\0') {
+        uint32 c = *p++;
+        if (c >= 0xE0 && c < 0xF0 && (p[0] & 0xC0) == 0x80 && (p[1] & 0xC0) == 0x80) {
+            c = ((c & 0x0F) << 12) | ((p[0] & 0x3F) << 6) | (p[1] & 0x3F);
+            p += 2;
+        } else if (c >= 0xC0 && c < 0xE0 && (p[0] & 0xC0) == 0x80) {
+            c = ((c & 0x1F) << 6) | (p[0] & 0x3F);
+            p++;
+        } else if (c >= 0x80) {
+            return -1; // not UTF-8, or outside the BMP
+        }
+        if (c < 0x20 || (c < 0x80 && strrchr("\"*/:<>?\\|", c) != NULL))
+            return -1;
+        if (chars == FAT_NAME_LEN)
+            return -1;
+        lfn[chars++] = c;
+    }
+    // Windows drops trailing dots and spaces, such names could never be opened there
+    if (chars == 0 || lfn[chars - 1] == '.' || lfn[chars - 1] == ' ')
+        return -1;
+    return chars;
+}
+
+static int sfn_char(int c) {
+    return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (c >= 0x80 && c != FAT_DIR_DELETED) ||
+           (c != '\0' && strrchr("!#$%&'()-@^_`{}~", c) != NULL);
+}
+
+/*
+ the short entry name of name if it is a valid upper case 8.3 ASCII
+ name as it is, then no long name is needed. returns 0 if it is not
+*/
+static int name_to_sfn(const char *name, uint8 *sfn) {
+    int i = 0, len = 0;
+
+    memset(sfn, ' ', FAT_SFN_LEN);
+    for (; name[i] != '\0' && name[i] != '.'; i++) {
+        if (len == 8 || (uint8)name[i] >= 0x80 || !sfn_char(name[i]))
+            return 0;
+        sfn[len++] = name[i];
+    }
+    if (len == 0)
+        return 0;
+    if (name[i] == '.') {
+        i++;
+        for (len = 8; name[i] != '\0'; i++) {
+            if (len == FAT_SFN_LEN || (uint8)name[i] >= 0x80 || !sfn_char(name[i]))
+                return 0;
+            sfn[len++] = name[i];
+        }
+        if (len == 8)
+            return 0; // "NAME."
+    }
+    return 1;
+}
+
+/*
+ the short name that goes with a long one: upper case, characters a
+ short name cannot hold become '_', base cut to leave room for "~tail"
+*/
+static void make_sfn(const char *name, uint32 tail, uint8 *sfn) {
+    char digits[12];
+    const char *dot = strrchr(name, '.');
+    int len = 0, max, i;
+
+    memset(sfn, ' ', FAT_SFN_LEN);
+    itoa(digits, 'd', tail);
+    max = 8 - 1 - strlen(digits);
+    while (*name == '.')
+        name++;
+    if (dot != NULL && dot < name)
+        dot = NULL; // ".profile" has no extension
+    for (; *name != '\0' && name != dot && len < max; name++) {
+        int c = upper_ascii((uint8)*name);
+        if (c == ' ' || c == '.')
+            continue;
+        sfn[len++] = c < 0x80 && sfn_char(c) ? c : '_';
+    }
+    if (len == 0)
+        sfn[len++] = '_';
+    sfn[len++] = '~';
+    for (i = 0; digits[i] != '\0'; i++)
+        sfn[len++] = digits[i];
+    if (dot != NULL) {
+        for (dot++, len = 8; *dot != '\0' && len < FAT_SFN_LEN; dot++) {
+            int c = upper_ascii((uint8)*dot);
+            if (c == ' ')
+                continue;
+            sfn[len++] = c < 0x80 && sfn_char(c) ? c : '_';
+        }
+    }
+}
+
+/*
+ directory walks
+*/
+
+// copy the characters of a long name entry to their place in lfn
+static void lfn_copy(const FAT_LFN_ENTRY *entry, uint16 *lfn) {
+    const uint8 *raw = (const uint8 *)entry;
+    int seq = (entry->order & FAT_LFN_SEQ_MASK) - 1;
+    int i;
+    for (i = 0; i < FAT_LFN_CHARS; i++)
+        lfn[seq * FAT_LFN_CHARS + i] = raw[g_lfn_offsets[i]] | (raw[g_lfn_offsets[i] + 1] << 8);
+}
+
+/*
+ call callback for every file and directory in dir, "." and ".." and the
+ volume label left out. returns what the callback returned to stop, 0 at
+ the end of the directory
+*/
+static int dir_walk(FAT_FS *fs, uint32 dir, FAT_WALK_CALLBACK callback, void *arg) {
+    static uint16 lfn[FAT_LFN_MAX_ENTRIES * FAT_LFN_CHARS];
+    FAT_DIRENT d;
+    FAT_DIR_ENTRY *entry;
+    uint32 index, node, lfn_first = 0;
+    int lfn_seq = 0, lfn_chars = 0, res;
+    uint8 lfn_sum = 0;
+
+    for (index = 0; (entry = dir_entry(fs, dir, index, 0, &node)) != NULL; index++) {
+        if (entry->name[0] == FAT_DIR_END)
+            break;
+        if (entry->name[0] == FAT_DIR_DELETED) {
+            lfn_seq = 0;
+            continue;
+        }
+        if ((entry->attr & FAT_ATTR_LFN_MASK) == FAT_ATTR_LFN) {
+            FAT_LFN_ENTRY *long_entry = (FAT_LFN_ENTRY *)entry;
+            int seq = long_entry->order & FAT_LFN_SEQ_MASK;
+            if (long_entry->order & FAT_LFN_LAST) {
+                if (seq == 0 || seq > FAT_LFN_MAX_ENTRIES) {
+                    lfn_seq = 0;
+                    continue;
+                }
+                lfn_first = index;
+                lfn_sum = long_entry->checksum;
+                lfn_chars = seq * FAT_LFN_CHARS;
+            } else if (lfn_seq == 0 || seq != lfn_seq - 1 || long_entry->checksum != lfn_sum) {
+                // an orphan left behind by a program that does not know long names
+                lfn_seq = 0;
+                continue;
+            }
+            lfn_seq = seq;
+            lfn_copy(long_entry, lfn);
+            continue;
+        }
+        if ((entry->attr & FAT_ATTR_VOLUME_ID) || entry->name[0] == '.') {
+            lfn_seq = 0;
+            continue;
+        }
+
+        memcpy(&d.entry, entry, sizeof(FAT_DIR_ENTRY));
+        d.node = node;
+        d.index = index;
+        sfn_to_name(entry, d.short_name);
+        if (lfn_seq == 1 && sfn_checksum(entry->name) == lfn_sum) {
+            lfn_to_name(lfn, lfn_chars, d.name);
+            d.first = lfn_first;
+        } else {
+            strcpy(d.name, d.short_name);
+            d.first = index;
+        }
+        lfn_seq = 0;
+        res = callback(fs, &d, arg);
+        if (res != 0)
+            return res;
+    }
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    FAT_DIRENT *out;
+} FAT_FIND_CONTEXT;
+
+static int find_entry_cb(FAT_FS *fs, FAT_DIRENT *d, void *arg) {
+    FAT_FIND_CONTEXT *ctx = (FAT_FIND_CONTEXT *)arg;
+    if (!name_equal(d->name, ctx->name) && !name_equal(d->short_name, ctx->name))
+        return 0;
+    memcpy(ctx->out, d, sizeof(FAT_DIRENT));
+    return 1;
+}
+
+static int find_entry(FAT_FS *fs, uint32 dir, const char *name, FAT_DIRENT *out) {
+    FAT_FIND_CONTEXT ctx = {name, out};
+    return dir_walk(fs, dir, find_entry_cb, &ctx) == 1 ? 0 : VFS_ERR_NOT_FOUND;
+}
+
+static int sfn_exists_cb(FAT_FS *fs, FAT_DIRENT *d, void *arg) {
+    return memcmp(d->entry.name, (uint8 *)arg, FAT_SFN_LEN);
+}
+
+static int dir_is_empty_cb(FAT_FS *fs, FAT_DIRENT *d, void *arg) {
+    return 1;
+}
+
+/*
+ add an entry named name to dir, with the attributes, cluster and size
+ of entry. The long name entries go right before the short one, the
+ directory grows by a cluster when it has no room for them
+*/
+static int dir_add(FAT_FS *fs, uint32 dir, const char *name, const FAT_DIR_ENTRY *entry, uint32 *node) {
+    uint16 lfn[FAT_NAME_LEN];
+    uint8 sfn[FAT_SFN_LEN];
+    int chars, lfn_entries = 0, need, run = 0, i;
+    uint32 index, tail, start, last, cluster;
+    FAT_DIR_ENTRY *slot;
+
+    chars = name_to_lfn(name, lfn);
+    if (chars < 0)
+        return VFS_ERR_INVALID;
+    if (!name_to_sfn(name, sfn)) {
+        lfn_entries = (chars + FAT_LFN_CHARS - 1) / FAT_LFN_CHARS;
+        for (tail = 1; tail < 1000000; tail++) {
+            make_sfn(name, tail, sfn);
+            if (dir_walk(fs, dir, sfn_exists_cb, sfn) == 0)
+                break;
+        }
+        if (tail == 1000000)
+            return VFS_ERR_EXISTS;
+    }
+    need = lfn_entries + 1;
+
+    // a run of need free entries
+    for (index = 0;; index++) {
+        slot = dir_entry(fs, dir, index, 0, NULL);
+        if (slot == NULL) {
+            // end of the directory, add a cluster unless it is the fixed root
+            if (dir == 0 || index >= FAT_MAX_DIR_ENTRIES)
+                return VFS_ERR_NO_SPACE;
+            last = map_cluster(fs, dir, index / FAT_ENTRIES_PER_SECTOR / fs->sectors_per_cluster - 1, NULL);
+            if (last == 0)
+                return VFS_ERR_IO;
+            cluster = alloc_cluster(fs, last + 1);
+            if (cluster == 0)
+                return VFS_ERR_NO_SPACE;
+            if (zero_cluster(fs, cluster) != 0 || fat_set(fs, last, cluster) != 0)
+                return VFS_ERR_IO;
+            chain_grown(fs, dir);
+            slot = dir_entry(fs, dir, index, 0, NULL);
+            if (slot == NULL)
+                return VFS_ERR_IO;
+        }
+        if (slot->name[0] == FAT_DIR_END || slot->name[0] == FAT_DIR_DELETED)
+            run++;
+        else
+            run = 0;
+        if (run == need)
+            break;
+    }
+    start = index + 1 - need;
+
+    for (i = 0; i < lfn_entries; i++) {
+        FAT_LFN_ENTRY *long_entry = (FAT_LFN_ENTRY *)dir_entry(fs, dir, start + i, 1, NULL);
+        int seq = lfn_entries - i, k;
+        if (long_entry == NULL)
+            return VFS_ERR_IO;
+        memset(long_entry, 0, sizeof(FAT_LFN_ENTRY));
+        long_entry->order = seq | (i == 0 ? FAT_LFN_LAST : 0);
+        long_entry->attr = FAT_ATTR_LFN;
+        long_entry->checksum = sfn_checksum(sfn);
+        for (k = 0; k < FAT_LFN_CHARS; k++) {
+            int pos = (seq - 1) * FAT_LFN_CHARS + k;
+            // terminated by 0 unless it fills the last entry, padded with 0xFFFF
+            uint16 c = pos < chars ? lfn[pos] : pos == chars ? 0 : 0xFFFF;
+            ((uint8 *)long_entry)[g_lfn_offsets[k]] = c & 0xFF;
+            ((uint8 *)long_entry)[g_lfn_offsets[k] + 1] = c >> 8;
+        }
+    }
+    slot = dir_entry(fs, dir, start + lfn_entries, 1, node);
+    if (slot == NULL)
+        return VFS_ERR_IO;
+    memcpy(slot, entry, sizeof(FAT_DIR_ENTRY));
+    memcpy(slot->name, sfn, FAT_SFN_LEN);
+    if (slot->name[0] == FAT_DIR_DELETED)
+        slot->name[0] = FAT_DIR_KANJI_E5;
+    slot->nt_res = 0;
+    return 0;
+}
+
+// mark the entries of d as deleted, the long name ones included
+static int dir_remove(FAT_FS *fs, uint32 dir, const FAT_DIRENT *d) {
+    uint32 index;
+    for (index = d->first; index <= d->index; index++) {
+        FAT_DIR_ENTRY *entry = dir_entry(fs, dir, index, 1, NULL);
+        if (entry == NULL)
+            return VFS_ERR_IO;
+        entry->name[0] = FAT_DIR_DELETED;
+    }
+    return 0;
+}
+
+/*
+ paths
+*/
+
+// copy the next path component into name, returns the rest of the path
+// or NULL if the component is too long
+static const char *next_component(const char *path, char *name) {
+    int len = 0;
+    while (*path == '/')
+        path++;
+    while (*path && *path != '/') {
+        if (len == FAT_NAME_LEN)
+            return NULL;
+        name[len++] = *path++;
+    }
+    name[len] = '\0';
+    return path;
+}
+
+// the root as a FAT_DIRENT, it has no entry of its own
+static void root_dirent(FAT_FS *fs, FAT_DIRENT *d) {
+    memset(d, 0, sizeof(FAT_DIRENT));
+    d->node = FAT_ROOT_NODE;
+    d->entry.attr = FAT_ATTR_DIRECTORY;
+    set_entry_cluster(fs, &d->entry, root_dir(fs));
+}
+
+static int lookup(FAT_FS *fs, const char *path, FAT_DIRENT *d) {
+    char name[FAT_NAME_LEN + 1];
+    uint32 dir;
+
+    root_dirent(fs, d);
+    while (1) {
+        path = next_component(path, name);
+        if (path == NULL)
+            return VFS_ERR_NOT_FOUND;
+        if (name[0] == '\0')
+            return 0;
+        if (!(d->entry.attr & FAT_ATTR_DIRECTORY))
+            return VFS_ERR_NOT_FOUND;
+        dir = d->node == FAT_ROOT_NODE ? root_dir(fs) : entry_cluster(fs, &d->entry);
+        if (find_entry(fs, dir, name, d) != 0)
+            return VFS_ERR_NOT_FOUND;
+    }
+}
+
+// directory holding path, the last component is copied into name
+static int lookup_parent(FAT_FS *fs, const char *path, char *name, uint32 *dir) {
+    char parent[VFS_PATH_LENGTH];
+    const char *last = strrchr(path, '/');
+    FAT_DIRENT d;
+    int len, res;
+
+    if (last == NULL || next_component(last, name) == NULL || name[0] == '\0')
+        return VFS_ERR_INVALID;
+    len = last - path;
+    if (len >= VFS_PATH_LENGTH)
+        return VFS_ERR_INVALID;
+    memcpy(parent, path, len);
+    parent[len] = '\0';
+    res = lookup(fs, parent, &d);
+    if (res != 0)
+        return res;
+    if (!(d.entry.attr & FAT_ATTR_DIRECTORY))
+        return VFS_ERR_NOT_DIR;
+    *dir = d.node == FAT_ROOT_NODE ? root_dir(fs) : entry_cluster(fs, &d.entry);
+    return 0;
+}
+
+/*
+ file data, read and written directly between the disk and the caller's
+ buffer a run of contiguous clusters at a time
+*/
+
+// bytes of the sectors from lba on, starting at byte within of the first one
+static int read_span(FAT_FS *fs, uint32 lba, uint32 within, uint8 *out, uint32 length) {
+    uint32 done = 0, count;
+
+    lba += within / FAT_SECTOR_SIZE;
+    within %= FAT_SECTOR_SIZE;
+    while (done < length) {
+        if (within == 0 && length - done >= FAT_SECTOR_SIZE) {
+            count = (length - done) / FAT_SECTOR_SIZE;
+            if (blockdev_read(fs->dev, lba, count, out + done) != 0)
+                return VFS_ERR_IO;
+            lba += count;
+            done += count * FAT_SECTOR_SIZE;
+            continue;
+        }
+        count = FAT_SECTOR_SIZE - within;
+        if (count > length - done)
+            count = length - done;
+        if (blockdev_read(fs->dev, lba, 1, g_scratch) != 0)
+            return VFS_ERR_IO;
+        memcpy(out + done, g_scratch + within, count);
+        lba++;
+        within = 0;
+        done += count;
+    }
+    return 0;
+}
+
+// same for writing, in == NULL writes zeros. fresh sectors hold nothing to keep
+static int write_span(FAT_FS *fs, uint32 lba, uint32 within, const uint8 *in, uint32 length, int fresh) {
+    uint32 done = 0, count;
+
+    lba += within / FAT_SECTOR_SIZE;
+    within %= FAT_SECTOR_SIZE;
+    forget_sectors(fs, lba, (within + length + FAT_SECTOR_SIZE - 1) / FAT_SECTOR_SIZE);
+    while (done < length) {
+        if (within == 0 && length - done >= FAT_SECTOR_SIZE) {
+            count = in != NULL ? (length - done) / FAT_SECTOR_SIZE : 1;
+            if (blockdev_write(fs->dev, lba, count, in != NULL ? in + done : g_zero_sector) != 0)
+                return VFS_ERR_IO;
+            lba += count;
+            done += count * FAT_SECTOR_SIZE;
+            continue;
+        }
+        count = FAT_SECTOR_SIZE - within;
+        if (count > length - done)
+            count = length - done;
+        if (fresh)
+            memset(g_scratch, 0, FAT_SECTOR_SIZE);
+        else if (blockdev_read(fs->dev, lba, 1, g_scratch) != 0)
+            return VFS_ERR_IO;
+        if (in != NULL)
+            memcpy(g_scratch + within, in + done, count);
+        else
+            memset(g_scratch + within, 0, count);
+        if (blockdev_write(fs->dev, lba, 1, g_scratch) != 0)
+            return VFS_ERR_IO;
+        lba++;
+        within = 0;
+        done += count;
+    }
+    return 0;
+}
+
+/*
+ write length bytes at offset of the file whose short entry is entry,
+ allocating clusters as needed. entry is a copy, its cluster is updated
+ when the file gets its first one. returns the bytes written
+*/
+static int write_data(FAT_FS *fs, FAT_DIR_ENTRY *entry, uint32 offset, const uint8 *in, uint32 length) {
+    uint32 first = entry_cluster(fs, entry);
+    uint32 done = 0, contig, span, prev;
+    int res = 0;
+
+    while (done < length) {
+        uint32 pos = offset + done;
+        uint32 index = pos / fs->cluster_size;
+        uint32 within = pos % fs->cluster_size;
+        uint32 cluster = first != 0 ? map_cluster(fs, first, index, &contig) : 0;
+        int fresh = 0;
+
+        if (cluster == 0) {
+            // past the end of the chain, which ends right before index
+            if (index == 0) {
+                cluster = alloc_cluster(fs, 0);
+                if (cluster == 0) {
+                    res = VFS_ERR_NO_SPACE;
+                    break;
+                }
+                first = cluster;
+                set_entry_cluster(fs, entry, first);
+            } else {
+                prev = map_cluster(fs, first, index - 1, NULL);
+                if (prev == 0) {
+                    res = VFS_ERR_IO;
+                    break;
+                }
+                cluster = alloc_cluster(fs, prev + 1);
+                if (cluster == 0) {
+                    res = VFS_ERR_NO_SPACE;
+                    break;
+                }
+                if (fat_set(fs, prev, cluster) != 0) {
+                    res = VFS_ERR_IO;
+                    break;
+                }
+            }
+            // take the clusters right after it while they are free, to write them in one go
+            contig = 1;
+            while (contig * fs->cluster_size - within < length - done &&
+                   valid_cluster(fs, cluster + contig) && fat_read_entry(fs, cluster + contig) == FAT_FREE) {
+                if (alloc_cluster(fs, cluster + contig) != cluster + contig ||
+                    fat_set(fs, cluster + contig - 1, cluster + contig) != 0)
+                    break;
+                contig++;
+            }
+            chain_grown(fs, first);
+            fresh = 1;
+        }
+
+        span = contig * fs->cluster_size - within;
+        if (span > length - done)
+            span = length - done;
+        res = write_span(fs, cluster_lba(fs, cluster), within, in != NULL ? in + done : NULL, span, fresh);
+        if (res != 0)
+            break;
+        done += span;
+    }
+    return done > 0 ? (int)done : res;
+}
+
+// free the clusters past the first size bytes of a file
+static int cut_chain(FAT_FS *fs, FAT_DIR_ENTRY *entry, uint32 size) {
+    uint32 first = entry_cluster(fs, entry);
+    uint32 keep = (size + fs->cluster_size - 1) / fs->cluster_size;
+    uint32 last, next;
+
+    if (!valid_cluster(fs, first))
+        return 0;
+    if (keep == 0) {
+        chain_forget(fs, first);
+        free_chain(fs, first);
+        set_entry_cluster(fs, entry, 0);
+        return 0;
+    }
+    last = map_cluster(fs, first, keep - 1, NULL);
+    chain_forget(fs, first);
+    if (last == 0)
+        return 0;
+    next = fat_get(fs, last);
+    if (next == FAT_FREE || next == FAT_EOC)
+        return 0;
+    if (fat_set(fs, last, FAT_EOC) != 0)
+        return VFS_ERR_IO;
+    free_chain(fs, next);
+    return 0;
+}
+
+/*
+ mount
+*/
+static void *fat_mount(BLOCK_DEVICE *dev, const char *options) {
+    FAT_BOOT_SECTOR *boot = (FAT_BOOT_SECTOR *)g_scratch;
+    FAT_FS *fs = NULL;
+    uint32 total, fat_size, i;
+
+    for (i = 0; i < FAT_MAX_MOUNTS; i++) {
+        if (!g_fat_mounts[i].mounted) {
+            fs = &g_fat_mounts[i];
+            break;
+        }
+    }
+    if (fs == NULL || dev == NULL)
+        return NULL;
+    if (blockdev_read(dev, 0, 1, g_scratch) != 0)
+        return NULL;
+    if (*(uint16 *)(g_scratch + 510) != FAT_BOOT_SIGNATURE || boot->bytes_per_sector == 0 ||
+        boot->sectors_per_cluster == 0 || (boot->sectors_per_cluster & (boot->sectors_per_cluster - 1)) ||
+        boot->reserved_sectors == 0 || boot->fat_count == 0) {
+        console_putstr("[FAT] Not a FAT file system\n");
+        return NULL;
+    }
+    if (boot->bytes_per_sector != FAT_SECTOR_SIZE) {
+        console_printf("[FAT] Unsupported sector size %d\n", boot->bytes_per_sector);
+        return NULL;
+    }
+
+    memset(fs, 0, sizeof(FAT_FS));
+    fs->dev = dev;
+    fs->sectors_per_cluster = boot->sectors_per_cluster;
+    fs->cluster_size = fs->sectors_per_cluster * FAT_SECTOR_SIZE;
+    fs->fat_count = boot->fat_count;
+    fs->fat_mirror = 1;
+    fat_size = boot->fat_size_16 != 0 ? boot->fat_size_16 : boot->fat_size_32;
+    total = boot->total_sectors_16 != 0 ? boot->total_sectors_16 : boot->total_sectors_32;
+    fs->fat_sectors = fat_size;
+    fs->fat_start = boot->reserved_sectors;
+    fs->root_sectors = (boot->root_entries * FAT_ENTRY_SIZE + FAT_SECTOR_SIZE - 1) / FAT_SECTOR_SIZE;
+    fs->root_start = fs->fat_start + fs->fat_count * fat_size;
+    fs->data_start = fs->root_start + fs->root_sectors;
+    if (fat_size == 0 || total <= fs->data_start || total > dev->sector_count) {
+        console_putstr("[FAT] Bad volume geometry\n");
+        return NULL;
+    }
+
+    // the type follows from the cluster count alone
+    fs->cluster_count = (total - fs->data_start) / fs->sectors_per_cluster;
+    if (fs->cluster_count <= FAT12_MAX_CLUSTERS)
+        fs->type = 12;
+    else if (fs->cluster_count <= FAT16_MAX_CLUSTERS)
+        fs->type = 16;
+    else
+        fs->type = 32;
+    if ((fs->type == 12 ? (fs->cluster_count + 2) * 3 / 2 : (fs->cluster_count + 2) * (fs->type / 8)) >
+        fat_size * FAT_SECTOR_SIZE) {
+        console_putstr("[FAT] FAT too small for the volume\n");
+        return NULL;
+    }
+
+    fs->free_count = FAT_UNKNOWN;
+    fs->next_free = 2;
+    if (fs->type == 32) {
+        if (boot->root_entries != 0 || boot->fs_version != 0) {
+            console_putstr("[FAT] Unsupported FAT32 version\n");
+            return NULL;
+        }
+        fs->root_cluster = boot->root_cluster;
+        if (!valid_cluster(fs, fs->root_cluster)) {
+            console_putstr("[FAT] Bad root directory cluster\n");
+            return NULL;
+        }
+        if (boot->ext_flags & FAT32_NO_MIRROR) {
+            fs->fat_mirror = 0;
+            fs->fat_start += (boot->ext_flags & FAT32_ACTIVE_FAT_MASK) * fat_size;
+        }
+        // free cluster count and allocation hint, only hints as the spec says
+        if (boot->fs_info != 0 && boot->fs_info < boot->reserved_sectors) {
+            FAT_FSINFO *info = (FAT_FSINFO *)g_scratch;
+            uint32 sector = boot->fs_info;
+            if (blockdev_read(dev, sector, 1, g_scratch) == 0 && info->lead_sig == FAT_FSINFO_LEAD_SIG &&
+                info->struct_sig == FAT_FSINFO_STRUCT_SIG && info->trail_sig == FAT_FSINFO_TRAIL_SIG) {
+                fs->fsinfo_sector = sector;
+                if (info->free_count <= fs->cluster_count)
+                    fs->free_count = info->free_count;
+                if (valid_cluster(fs, info->next_free))
+                    fs->next_free = info->next_free;
+            }
+        }
+    }
+
+    fs->mounted = 1;
+    console_printf("[FAT] %s: FAT%d, %d clusters of %d bytes\n", dev->name, fs->type,
+                   fs->cluster_count, fs->cluster_size);
+    return fs;
+}
+
+static int fat_sync(void *fs) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    FAT_FSINFO *info = (FAT_FSINFO *)g_scratch;
+    int res = flush_sectors(ffs);
+
+    if (ffs->fsinfo_sector != 0 && ffs->fsinfo_dirty) {
+        if (blockdev_read(ffs->dev, ffs->fsinfo_sector, 1, g_scratch) != 0)
+            return VFS_ERR_IO;
+        info->free_count = ffs->free_count;
+        info->next_free = ffs->next_free;
+        if (blockdev_write(ffs->dev, ffs->fsinfo_sector, 1, g_scratch) != 0)
+            return VFS_ERR_IO;
+        ffs->fsinfo_dirty = 0;
+    }
+    return res;
+}
+
+static void fat_unmount(void *fs) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    int i;
+    if (ffs == NULL || !ffs->mounted)
+        return;
+    fat_sync(ffs);
+    for (i = 0; i < FAT_SECTOR_CACHE_SIZE; i++) {
+        if (g_sector_cache[i].fs == ffs)
+            g_sector_cache[i].fs = NULL;
+    }
+    for (i = 0; i < FAT_CHAIN_CACHE_SIZE; i++) {
+        if (g_chain_cache[i].fs == ffs)
+            g_chain_cache[i].fs = NULL;
+    }
+    ffs->mounted = 0;
+}
+
+/*
+ VFS operations
+*/
+static void fill_stat(FAT_FS *fs, const FAT_DIR_ENTRY *entry, uint32 node, VFS_STAT *st) {
+    st->node = node;
+    st->is_directory = (entry->attr & FAT_ATTR_DIRECTORY) != 0;
+    st->size = st->is_directory ? 0 : entry->size;
+    // there are no holes, a chain has as many clusters as the size needs
+    st->allocated = (st->size + fs->cluster_size - 1) / fs->cluster_size * fs->cluster_size;
+    // FAT has a read-only bit and nothing else
+    st->permissions = st->is_directory ? 0755 : 0644;
+    if (entry->attr & FAT_ATTR_READ_ONLY)
+        st->permissions &= ~0222;
+}
+
+static int fat_stat(void *fs, uint32 node, VFS_STAT *st) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    FAT_DIRENT root;
+    FAT_DIR_ENTRY *entry;
+
+    if (node == FAT_ROOT_NODE) {
+        root_dirent(ffs, &root);
+        fill_stat(ffs, &root.entry, node, st);
+        return 0;
+    }
+    entry = node_entry(ffs, node, 0);
+    if (entry == NULL)
+        return VFS_ERR_IO;
+    fill_stat(ffs, entry, node, st);
+    return 0;
+}
+
+static int fat_lookup(void *fs, const char *path, VFS_STAT *st) {
+    FAT_DIRENT d;
+    int res = lookup((FAT_FS *)fs, path, &d);
+    if (res != 0)
+        return res;
+    fill_stat((FAT_FS *)fs, &d.entry, d.node, st);
+    return 0;
+}
+
+static int fat_read(void *fs, uint32 node, uint32 offset, void *buffer, uint32 length) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    FAT_DIR_ENTRY *entry;
+    uint8 *out = (uint8 *)buffer;
+    uint32 first, size, done = 0, contig, span;
+
+    if (node == FAT_ROOT_NODE)
+        return VFS_ERR_IS_DIR;
+    entry = node_entry(ffs, node, 0);
+    if (entry == NULL)
+        return VFS_ERR_IO;
+    if (entry->attr & FAT_ATTR_DIRECTORY)
+        return VFS_ERR_IS_DIR;
+    first = entry_cluster(ffs, entry);
+    size = entry->size;
+    if (offset >= size)
+        return 0;
+    if (length > size - offset)
+        length = size - offset;
+
+    while (done < length) {
+        uint32 pos = offset + done;
+        uint32 cluster = map_cluster(ffs, first, pos / ffs->cluster_size, &contig);
+        uint32 within = pos % ffs->cluster_size;
+        if (cluster == 0)
+            return done > 0 ? (int)done : VFS_ERR_IO; // chain shorter than the size says
+        span = contig * ffs->cluster_size - within;
+        if (span > length - done)
+            span = length - done;
+        if (read_span(ffs, cluster_lba(ffs, cluster), within, out + done, span) != 0)
+            return VFS_ERR_IO;
+        done += span;
+    }
+    return done;
+}
+
+static int fat_write(void *fs, uint32 node, uint32 offset, const void *buffer, uint32 length) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    FAT_DIR_ENTRY entry, *slot;
+    int res = 0, written;
+
+    if (node == FAT_ROOT_NODE)
+        return VFS_ERR_IS_DIR;
+    slot = node_entry(ffs, node, 0);
+    if (slot == NULL)
+        return VFS_ERR_IO;
+    memcpy(&entry, slot, sizeof(FAT_DIR_ENTRY));
+    if (entry.attr & FAT_ATTR_DIRECTORY)
+        return VFS_ERR_IS_DIR;
+    if (entry.attr & FAT_ATTR_READ_ONLY)
+        return VFS_ERR_READ_ONLY;
+    // files end below 4 GiB
+    if (length > 0xFFFFFFFF - offset)
+        length = 0xFFFFFFFF - offset;
+    if (length == 0)
+        return offset == 0xFFFFFFFF ? VFS_ERR_TOO_BIG : 0;
+
+    // FAT has no holes, the gap up to offset is written as zeros
+    if (offset > entry.size) {
+        written = write_data(ffs, &entry, entry.size, NULL, offset - entry.size);
+        if (written > 0)
+            entry.size += written;
+        if (entry.size < offset)
+            res = written < 0 ? written : VFS_ERR_NO_SPACE;
+    }
+    written = 0;
+    if (res == 0) {
+        written = write_data(ffs, &entry, offset, (const uint8 *)buffer, length);
+        if (written > 0 && offset + written > entry.size)
+            entry.size = offset + written;
+    }
+
+    slot = node_entry(ffs, node, 1);
+    if (slot == NULL)
+        return VFS_ERR_IO;
+    slot->size = entry.size;
+    set_entry_cluster(ffs, slot, entry_cluster(ffs, &entry));
+    slot->attr |= FAT_ATTR_ARCHIVE;
+    if (flush_sectors(ffs) != 0)
+        return VFS_ERR_IO;
+    if (res != 0)
+        return res;
+    return written;
+}
+
+static int fat_truncate(void *fs, uint32 node, uint32 size) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    FAT_DIR_ENTRY entry, *slot;
+    int res = 0;
+
+    if (node == FAT_ROOT_NODE)
+        return VFS_ERR_IS_DIR;
+    slot = node_entry(ffs, node, 0);
+    if (slot == NULL)
+        return VFS_ERR_IO;
+    memcpy(&entry, slot, sizeof(FAT_DIR_ENTRY));
+    if (entry.attr & FAT_ATTR_DIRECTORY)
+        return VFS_ERR_IS_DIR;
+    if (entry.attr & FAT_ATTR_READ_ONLY)
+        return VFS_ERR_READ_ONLY;
+
+    if (size < entry.size) {
+        res = cut_chain(ffs, &entry, size);
+        if (res == 0)
+            entry.size = size;
+    } else if (size > entry.size) {
+        int written = write_data(ffs, &entry, entry.size, NULL, size - entry.size);
+        if (written > 0)
+            entry.size += written;
+        if (entry.size < size)
+            res = written < 0 ? written : VFS_ERR_NO_SPACE;
+    }
+
+    slot = node_entry(ffs, node, 1);
+    if (slot == NULL)
+        return VFS_ERR_IO;
+    slot->size = entry.size;
+    set_entry_cluster(ffs, slot, entry_cluster(ffs, &entry));
+    slot->attr |= FAT_ATTR_ARCHIVE;
+    if (flush_sectors(ffs) != 0)
+        return VFS_ERR_IO;
+    return res;
+}
+
+static int fat_create(void *fs, const char *path, uint8 is_directory, uint32 permissions, VFS_STAT *st) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    char name[FAT_NAME_LEN + 1];
+    FAT_DIRENT existing;
+    FAT_DIR_ENTRY entry, *dots;
+    uint32 dir, cluster = 0, node;
+    int res;
+
+    res = lookup_parent(ffs, path, name, &dir);
+    if (res != 0)
+        return res;
+    if (find_entry(ffs, dir, name, &existing) == 0)
+        return VFS_ERR_EXISTS;
+
+    memset(&entry, 0, sizeof(FAT_DIR_ENTRY));
+    entry.attr = is_directory ? FAT_ATTR_DIRECTORY : FAT_ATTR_ARCHIVE;
+    if (!(permissions & 0200))
+        entry.attr |= FAT_ATTR_READ_ONLY;
+    entry.create_date = FAT_DATE_EPOCH;
+    entry.write_date = FAT_DATE_EPOCH;
+    entry.access_date = FAT_DATE_EPOCH;
+
+    if (is_directory) {
+        // a directory starts with one cluster holding "." and ".."
+        cluster = alloc_cluster(ffs, 0);
+        if (cluster == 0)
+            return VFS_ERR_NO_SPACE;
+        if (zero_cluster(ffs, cluster) != 0) {
+            res = VFS_ERR_IO;
+            goto fail;
+        }
+        dots = (FAT_DIR_ENTRY *)get_sector(ffs, cluster_lba(ffs, cluster), 1);
+        if (dots == NULL) {
+            res = VFS_ERR_IO;
+            goto fail;
+        }
+        memcpy(&dots[0], &entry, sizeof(FAT_DIR_ENTRY));
+        memset(dots[0].name, ' ', FAT_SFN_LEN);
+        dots[0].name[0] = '.';
+        set_entry_cluster(ffs, &dots[0], cluster);
+        memcpy(&dots[1], &dots[0], sizeof(FAT_DIR_ENTRY));
+        dots[1].name[1] = '.';
+        // ".." of a directory in the root is 0, on FAT32 too
+        set_entry_cluster(ffs, &dots[1], dir == root_dir(ffs) ? 0 : dir);
+        set_entry_cluster(ffs, &entry, cluster);
+    }
+
+    res = dir_add(ffs, dir, name, &entry, &node);
+    if (res != 0)
+        goto fail;
+    if (flush_sectors(ffs) != 0)
+        return VFS_ERR_IO;
+    fill_stat(ffs, &entry, node, st);
+    return 0;
+
+fail:
+    if (cluster != 0) {
+        chain_forget(ffs, cluster);
+        free_chain(ffs, cluster);
+    }
+    flush_sectors(ffs);
+    return res;
+}
+
+static int fat_unlink(void *fs, const char *path) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    char name[FAT_NAME_LEN + 1];
+    FAT_DIRENT d;
+    uint32 dir, cluster;
+    int res;
+
+    res = lookup_parent(ffs, path, name, &dir);
+    if (res != 0)
+        return res;
+    if (find_entry(ffs, dir, name, &d) != 0)
+        return VFS_ERR_NOT_FOUND;
+    cluster = entry_cluster(ffs, &d.entry);
+    if (d.entry.attr & FAT_ATTR_DIRECTORY) {
+        if (dir_walk(ffs, cluster, dir_is_empty_cb, NULL) != 0)
+            return VFS_ERR_NOT_EMPTY;
+    } else if (d.entry.attr & FAT_ATTR_READ_ONLY) {
+        return VFS_ERR_READ_ONLY;
+    }
+
+    res = dir_remove(ffs, dir, &d);
+    if (res == 0 && valid_cluster(ffs, cluster)) {
+        chain_forget(ffs, cluster);
+        free_chain(ffs, cluster);
+    }
+    if (flush_sectors(ffs) != 0)
+        return VFS_ERR_IO;
+    return res;
+}
+
+// the entry moves to the new directory, the clusters stay where they are
+static int fat_rename(void *fs, const char *from, const char *to) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    char name[FAT_NAME_LEN + 1];
+    FAT_DIRENT d, existing;
+    FAT_DIR_ENTRY *dots;
+    uint32 from_dir, to_dir, node;
+    int res;
+
+    res = lookup_parent(ffs, from, name, &from_dir);
+    if (res != 0)
+        return res;
+    if (find_entry(ffs, from_dir, name, &d) != 0)
+        return VFS_ERR_NOT_FOUND;
+    res = lookup_parent(ffs, to, name, &to_dir);
+    if (res != 0)
+        return res;
+    // the name may only change case, then it finds the file itself
+    if (find_entry(ffs, to_dir, name, &existing) == 0 && existing.node != d.node)
+        return VFS_ERR_EXISTS;
+
+    // the new entries first: if there is no room the file stays where it was
+    res = dir_add(ffs, to_dir, name, &d.entry, &node);
+    if (res == 0)
+        res = dir_remove(ffs, from_dir, &d);
+    if (res == 0 && (d.entry.attr & FAT_ATTR_DIRECTORY) && from_dir != to_dir) {
+        dots = dir_entry(ffs, entry_cluster(ffs, &d.entry), 1, 1, NULL);
+        if (dots != NULL && dots->name[0] == '.' && dots->name[1] == '.')
+            set_entry_cluster(ffs, dots, to_dir == root_dir(ffs) ? 0 : to_dir);
+    }
+    if (flush_sectors(ffs) != 0)
+        return VFS_ERR_IO;
+    if (res == 0)
+        vfs_node_moved(fs, d.node, node);
+    return res;
+}
+
+typedef struct {
+    VFS_DIR_CALLBACK callback;
+    void *arg;
+} FAT_READDIR_CONTEXT;
+
+static int fat_readdir_entry(FAT_FS *fs, FAT_DIRENT *d, void *arg) {
+    FAT_READDIR_CONTEXT *ctx = (FAT_READDIR_CONTEXT *)arg;
+    VFS_STAT st;
+    fill_stat(fs, &d->entry, d->node, &st);
+    return ctx->callback(d->name, &st, ctx->arg);
+}
+
+static int fat_readdir(void *fs, uint32 node, VFS_DIR_CALLBACK callback, void *arg) {
+    FAT_FS *ffs = (FAT_FS *)fs;
+    FAT_READDIR_CONTEXT ctx = {callback, arg};
+    FAT_DIR_ENTRY *entry;
+    uint32 dir;
+
+    if (node == FAT_ROOT_NODE) {
+        dir = root_dir(ffs);
+    } else {
+        entry = node_entry(ffs, node, 0);
+        if (entry == NULL)
+            return VFS_ERR_IO;
+        if (!(entry->attr & FAT_ATTR_DIRECTORY))
+            return VFS_ERR_NOT_DIR;
+        dir = entry_cluster(ffs, entry);
+    }
+    dir_walk(ffs, dir, fat_readdir_entry, &ctx);
+    return 0;
+}
+
+VFS_DRIVER fat_driver = {
+    .name = "fat",
+    .mount = fat_mount,
+    .unmount = fat_unmount,
+    .sync = fat_sync,
+    .lookup = fat_lookup,
+    .stat = fat_stat,
+    .read = fat_read,
+    .write = fat_write,
+    .truncate = fat_truncate,
+    .create = fat_create,
+    .unlink = fat_unlink,
+    .rename = fat_rename,
+    .readdir = fat_readdir,
+};
@@ -0,0 +1,554 @@
+#include "fs/tmpfs.h"
+#include "string.h"
+#include "kmalloc.h"
+#include "pmm.h"
+#include "paging.h"
+#include <stddef.h> // Для NULL
+
+// Pages are physical addresses of frames from pmm, 0 is a hole. A page
+// shared by clones has one pmm owner per file, see tmpfs_clone().
+static TMPFS g_tmpfs_mounts[TMPFS_MAX_MOUNTS];
+static KMEM_CACHE *g_node_cache = NULL; // nodes of every volume
+
+/*
+ pages
+*/
+
+static uint8 *page_data(uint32 page) {
+    return (uint8 *)PHYS_TO_VIRT(page);
+}
+
+// zeroed 2^order frames charged to fs, 0 if memory or the size cap is exhausted
+static uint32 alloc_block(TMPFS *fs, uint32 order) {
+    uint32 page;
+
+    if (fs->max_pages != 0 && fs->used_pages + (1u << order) > fs->max_pages)
+        return 0;
+    page = pmm_alloc_order(order);
+    if (page == 0)
+        return 0;
+    fs->used_pages += 1u << order;
+    memset(page_data(page), 0, TMPFS_PAGE_SIZE << order);
+    return page;
+}
+
+static uint32 alloc_page(TMPFS *fs) {
+    return alloc_block(fs, 0);
+}
+
+static void free_page(TMPFS *fs, uint32 page) {
+    if (page == 0)
+        return;
+    if (!pmm_shared(page))
+        fs->used_pages -= pmm_block_frames(page);
+    pmm_free(page);
+}
+
+// where the page number of page index of node is kept, NULL past the
+// end of the file or, unless create, if the indirect page is missing
+static uint32 *page_slot(TMPFS *fs, TMPFS_NODE *node, uint32 index, int create) {
+    if (index < TMPFS_DIRECT_PAGES)
+        return &node->direct[index];
+    index -= TMPFS_DIRECT_PAGES;
+    if (index >= TMPFS_INDIRECT_PAGES)
+        return NULL;
+    if (node->indirect == 0) {
+        if (!create)
+            return NULL;
+        node->indirect = alloc_block(fs, TMPFS_INDIRECT_ORDER);
+        if (node->indirect == 0)
+            return NULL;
+    }
+    return (uint32 *)page_data(node->indirect) + index;
+}
+
+// page number backing page index of node, 0 for a hole. With create
+// the page is allocated if missing and made private to node if shared,
+// ready to be written; 0 then means memory is exhausted.
+static uint32 get_page(TMPFS *fs, TMPFS_NODE *node, uint32 index, int create) {
+    uint32 *slot = page_slot(fs, node, index, create);
+    uint32 page;
+
+    if (slot == NULL)
+        return 0;
+    if (!create || (*slot != 0 && !pmm_shared(*slot)))
+        return *slot;
+    page = alloc_page(fs);
+    if (page != 0 && *slot != 0) {
+        memcpy(page_data(page), page_data(*slot), TMPFS_PAGE_SIZE);
+        free_page(fs, *slot);
+    }
+    if (page != 0)
+        *slot = page;
+    return page;
+}
+
+// one more file uses page: the page itself, or a copy once it has as
+// many owners as pmm counts. 0 only if no copy could be made.
+static uint32 share_page(TMPFS *fs, uint32 page) {
+    uint32 copy;
+
+    if (page == 0 || pmm_share(page) == 0)
+        return page;
+    copy = alloc_page(fs);
+    if (copy != 0)
+        memcpy(page_data(copy), page_data(page), TMPFS_PAGE_SIZE);
+    return copy;
+}
+
+// give back the pages of node from page index first on
+static void free_pages_from(TMPFS *fs, TMPFS_NODE *node, uint32 first) {
+    uint32 i;
+
+    for (i = first; i < TMPFS_DIRECT_PAGES; i++) {
+        free_page(fs, node->direct[i]);
+        node->direct[i] = 0;
+    }
+    if (node->indirect == 0)
+        return;
+    uint32 *table = (uint32 *)page_data(node->indirect);
+    i = first > TMPFS_DIRECT_PAGES ? first - TMPFS_DIRECT_PAGES : 0;
+    for (; i < TMPFS_INDIRECT_PAGES; i++) {
+        free_page(fs, table[i]);
+        table[i] = 0;
+    }
+    if (first <= TMPFS_DIRECT_PAGES) {
+        free_page(fs, node->indirect);
+        node->indirect = 0;
+    }
+}
+
+/*
+ nodes
+*/
+
+// a zeroed node in free slot index, NULL without memory
+static TMPFS_NODE *new_node(TMPFS *fs, int index) {
+    TMPFS_NODE *node = (TMPFS_NODE *)kmem_cache_alloc(g_node_cache);
+    if (node == NULL)
+        return NULL;
+    memset(node, 0, sizeof(TMPFS_NODE));
+    fs->nodes[index] = node;
+    return node;
+}
+
+static void delete_node(TMPFS *fs, int index) {
+    free_pages_from(fs, fs->nodes[index], 0);
+    kmem_cache_free(g_node_cache, fs->nodes[index]);
+    fs->nodes[index] = NULL;
+}
+
+/*
+ paths
+*/
+
+// copy the next path component into name, returns the rest of the path
+// or NULL if the component is too long
+static const char *next_component(const char *path, char *name) {
+    int len = 0;
+    while (*path == '/')
+        path++;
+    while (*path && *path != '/') {
+        if (len == TMPFS_NAME_LENGTH - 1)
+            return NULL;
+        name[len++] = *path++;
+    }
+    name[len] = '\0';
+    return path;
+}
+
+static int find_child(TMPFS *fs, uint32 dir, const char *name) {
+    int i;
+    for (i = 0; i < TMPFS_MAX_NODES; i++) {
+        TMPFS_NODE *node = fs->nodes[i];
+        if (node != NULL && node->parent == dir && i != TMPFS_ROOT_NODE && strcmp(node->name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// node of path, or -1
+static int lookup(TMPFS *fs, const char *path) {
+    char name[TMPFS_NAME_LENGTH];
+    int node = TMPFS_ROOT_NODE;
+
+    while (1) {
+        path = next_component(path, name);
+        if (path == NULL)
+            return -1;
+        if (name[0] == '\0')
+            return node;
+        if (!fs->nodes[node]->is_directory)
+            return -1;
+        node = find_child(fs, node, name);
+        if (node == -1)
+            return -1;
+    }
+}
+
+// parent of path and its last component in name, or -1
+static int lookup_parent(TMPFS *fs, const char *path, char *name) {
+    char parent_path[VFS_PATH_LENGTH];
+    const char *last = strrchr(path, '/');
+    int parent;
+
+    if (last == NULL || last - path >= VFS_PATH_LENGTH)
+        return -1;
+    if (next_component(last, name) == NULL || name[0] == '\0')
+        return -1;
+    memcpy(parent_path, path, last - path);
+    parent_path[last - path] = '\0';
+    parent = lookup(fs, parent_path);
+    if (parent == -1 || !fs->nodes[parent]->is_directory)
+        return -1;
+    return parent;
+}
+
+/*
+ vfs driver
+*/
+
+// data pages of node and its pages of page numbers, holes not counted
+static uint32 count_pages(TMPFS_NODE *node) {
+    uint32 count = 0, i;
+
+    for (i = 0; i < TMPFS_DIRECT_PAGES; i++) {
+        if (node->direct[i] != 0)
+            count++;
+    }
+    if (node->indirect != 0) {
+        uint32 *table = (uint32 *)page_data(node->indirect);
+        count += 1u << TMPFS_INDIRECT_ORDER;
+        for (i = 0; i < TMPFS_INDIRECT_PAGES; i++) {
+            if (table[i] != 0)
+                count++;
+        }
+    }
+    return count;
+}
+
+static void fill_stat(TMPFS *fs, uint32 node, VFS_STAT *st) {
+    st->node = node;
+    st->size = fs->nodes[node]->size;
+    st->allocated = count_pages(fs->nodes[node]) * TMPFS_PAGE_SIZE;
+    st->permissions = fs->nodes[node]->permissions;
+    st->is_directory = fs->nodes[node]->is_directory;
+}
+
+static TMPFS_NODE *get_node(TMPFS *fs, uint32 node) {
+    if (node >= TMPFS_MAX_NODES)
+        return NULL;
+    return fs->nodes[node];
+}
+
+// options: "size=<KB>" caps the memory the volume may take, data and
+// page tables together; without it the volume can grow until RAM runs out
+static void *tmpfs_mount(BLOCK_DEVICE *dev, const char *options) {
+    TMPFS *fs = NULL;
+    int i;
+
+    for (i = 0; i < TMPFS_MAX_MOUNTS; i++) {
+        if (!g_tmpfs_mounts[i].mounted) {
+            fs = &g_tmpfs_mounts[i];
+            break;
+        }
+    }
+    if (fs == NULL)
+        return NULL;
+
+    if (g_node_cache == NULL)
+        g_node_cache = kmem_cache_create("tmpfs_node", sizeof(TMPFS_NODE));
+    if (g_node_cache == NULL)
+        return NULL;
+    memset(fs, 0, sizeof(TMPFS));
+    if (options != NULL && memcmp((uint8 *)options, (uint8 *)"size=", 5)) {
+        uint32 kb = 0;
+        for (options += 5; *options >= '0' && *options <= '9'; options++)
+            kb = kb * 10 + (*options - '0');
+        if (kb == 0 || *options != '\0')
+            return NULL;
+        fs->max_pages = (kb * 1024 + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE;
+    }
+    if (new_node(fs, TMPFS_ROOT_NODE) == NULL)
+        return NULL;
+    fs->nodes[TMPFS_ROOT_NODE]->is_directory = 1;
+    fs->nodes[TMPFS_ROOT_NODE]->permissions = 0777;
+    fs->mounted = 1;
+    return fs;
+}
+
+static void tmpfs_unmount(void *fs) {
+    TMPFS *tfs = (TMPFS *)fs;
+    int i;
+
+    for (i = 0; i < TMPFS_MAX_NODES; i++) {
+        if (tfs->nodes[i] != NULL)
+            delete_node(tfs, i);
+    }
+    tfs->mounted = 0;
+}
+
+static int tmpfs_sync(void *fs) {
+    return 0; // nothing to write back
+}
+
+static int tmpfs_lookup(void *fs, const char *path, VFS_STAT *st) {
+    int node = lookup((TMPFS *)fs, path);
+    if (node == -1)
+        return VFS_ERR_NOT_FOUND;
+    fill_stat((TMPFS *)fs, node, st);
+    return 0;
+}
+
+static int tmpfs_stat(void *fs, uint32 node, VFS_STAT *st) {
+    if (get_node((TMPFS *)fs, node) == NULL)
+        return VFS_ERR_NOT_FOUND;
+    fill_stat((TMPFS *)fs, node, st);
+    return 0;
+}
+
+static int tmpfs_read(void *fs, uint32 node, uint32 offset, void *buffer, uint32 length) {
+    TMPFS *tfs = (TMPFS *)fs;
+    TMPFS_NODE *n = get_node(tfs, node);
+    uint32 done = 0;
+
+    if (n == NULL)
+        return VFS_ERR_NOT_FOUND;
+    if (n->is_directory)
+        return VFS_ERR_IS_DIR;
+    if (offset >= n->size)
+        return 0;
+    if (length > n->size - offset)
+        length = n->size - offset;
+
+    while (done < length) {
+        uint32 pos = offset + done;
+        uint32 in_page = pos % TMPFS_PAGE_SIZE;
+        uint32 chunk = TMPFS_PAGE_SIZE - in_page;
+        if (chunk > length - done)
+            chunk = length - done;
+        uint32 page = get_page(tfs, n, pos / TMPFS_PAGE_SIZE, 0);
+        if (page == 0)
+            memset((uint8 *)buffer + done, 0, chunk);
+        else
+            memcpy((uint8 *)buffer + done, page_data(page) + in_page, chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+static int tmpfs_write(void *fs, uint32 node, uint32 offset, const void *buffer, uint32 length) {
+    TMPFS *tfs = (TMPFS *)fs;
+    TMPFS_NODE *n = get_node(tfs, node);
+    uint32 max_size = TMPFS_MAX_FILE_PAGES * TMPFS_PAGE_SIZE;
+    uint32 done = 0;
+
+    if (n == NULL)
+        return VFS_ERR_NOT_FOUND;
+    if (n->is_directory)
+        return VFS_ERR_IS_DIR;
+    if (length == 0)
+        return 0;
+    if (offset >= max_size)
+        return VFS_ERR_TOO_BIG;
+    if (length > max_size - offset)
+        length = max_size - offset;
+
+    while (done < length) {
+        uint32 pos = offset + done;
+        uint32 in_page = pos % TMPFS_PAGE_SIZE;
+        uint32 chunk = TMPFS_PAGE_SIZE - in_page;
+        if (chunk > length - done)
+            chunk = length - done;
+        // zeros over a hole need no page, a whole page of them makes one
+        if (mem_is_zero((const uint8 *)buffer + done, chunk)) {
+            uint32 *slot = page_slot(tfs, n, pos / TMPFS_PAGE_SIZE, 0);
+            if (slot != NULL && *slot != 0 && chunk == TMPFS_PAGE_SIZE) {
+                free_page(tfs, *slot);
+                *slot = 0;
+            }
+            if (slot == NULL || *slot == 0) {
+                done += chunk;
+                continue;
+            }
+        }
+        uint32 page = get_page(tfs, n, pos / TMPFS_PAGE_SIZE, 1);
+        if (page == 0)
+            break; // out of pages, short write
+        memcpy(page_data(page) + in_page, (const uint8 *)buffer + done, chunk);
+        done += chunk;
+    }
+    if (offset + done > n->size)
+        n->size = offset + done;
+    return done > 0 ? (int)done : VFS_ERR_NO_SPACE;
+}
+
+static int tmpfs_truncate(void *fs, uint32 node, uint32 size) {
+    TMPFS *tfs = (TMPFS *)fs;
+    TMPFS_NODE *n = get_node(tfs, node);
+
+    if (n == NULL)
+        return VFS_ERR_NOT_FOUND;
+    if (n->is_directory)
+        return VFS_ERR_IS_DIR;
+    if (size > TMPFS_MAX_FILE_PAGES * TMPFS_PAGE_SIZE)
+        return VFS_ERR_TOO_BIG;
+    if (size < n->size) {
+        // growing again must read zeros, so clear the rest of the last page
+        uint32 in_page = size % TMPFS_PAGE_SIZE;
+        if (in_page != 0 && get_page(tfs, n, size / TMPFS_PAGE_SIZE, 0) != 0) {
+            uint32 page = get_page(tfs, n, size / TMPFS_PAGE_SIZE, 1); // may be shared
+            if (page == 0)
+                return VFS_ERR_NO_SPACE;
+            memset(page_data(page) + in_page, 0, TMPFS_PAGE_SIZE - in_page);
+        }
+        free_pages_from(tfs, n, (size + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE);
+    }
+    n->size = size; // growing leaves a hole, pages come with the first write
+    return 0;
+}
+
+static int tmpfs_create(void *fs, const char *path, uint8 is_directory, uint32 permissions, VFS_STAT *st) {
+    TMPFS *tfs = (TMPFS *)fs;
+    char name[TMPFS_NAME_LENGTH];
+    int parent, i;
+
+    parent = lookup_parent(tfs, path, name);
+    if (parent == -1)
+        return VFS_ERR_NOT_FOUND;
+    if (find_child(tfs, parent, name) != -1)
+        return VFS_ERR_EXISTS;
+
+    for (i = 0; i < TMPFS_MAX_NODES; i++) {
+        if (tfs->nodes[i] != NULL)
+            continue;
+        TMPFS_NODE *node = new_node(tfs, i);
+        if (node == NULL)
+            return VFS_ERR_NO_SPACE;
+        strcpy(node->name, name);
+        node->parent = parent;
+        node->permissions = permissions & 0777;
+        node->is_directory = is_directory;
+        fill_stat(tfs, i, st);
+        return 0;
+    }
+    return VFS_ERR_NO_SPACE;
+}
+
+static int tmpfs_unlink(void *fs, const char *path) {
+    TMPFS *tfs = (TMPFS *)fs;
+    int node = lookup(tfs, path);
+    int i;
+
+    if (node == -1)
+        return VFS_ERR_NOT_FOUND;
+    if (node == TMPFS_ROOT_NODE)
+        return VFS_ERR_BUSY;
+    if (tfs->nodes[node]->is_directory) {
+        for (i = 0; i < TMPFS_MAX_NODES; i++) {
+            if (tfs->nodes[i] != NULL && tfs->nodes[i]->parent == (uint32)node && i != TMPFS_ROOT_NODE)
+                return VFS_ERR_NOT_EMPTY;
+        }
+    }
+    delete_node(tfs, node);
+    return 0;
+}
+
+static int tmpfs_rename(void *fs, const char *from, const char *to) {
+    TMPFS *tfs = (TMPFS *)fs;
+    char name[TMPFS_NAME_LENGTH];
+    int node = lookup(tfs, from);
+    int parent;
+
+    if (node == -1)
+        return VFS_ERR_NOT_FOUND;
+    parent = lookup_parent(tfs, to, name);
+    if (parent == -1)
+        return VFS_ERR_NOT_FOUND;
+    if (find_child(tfs, parent, name) != -1)
+        return VFS_ERR_EXISTS;
+    strcpy(tfs->nodes[node]->name, name);
+    tfs->nodes[node]->parent = parent;
+    return 0;
+}
+
+static int tmpfs_readdir(void *fs, uint32 node, VFS_DIR_CALLBACK callback, void *arg) {
+    TMPFS *tfs = (TMPFS *)fs;
+    VFS_STAT st;
+    int i;
+
+    if (get_node(tfs, node) == NULL)
+        return VFS_ERR_NOT_FOUND;
+    if (!tfs->nodes[node]->is_directory)
+        return VFS_ERR_NOT_DIR;
+    for (i = 0; i < TMPFS_MAX_NODES; i++) {
+        if (tfs->nodes[i] == NULL || tfs->nodes[i]->parent != node || i == TMPFS_ROOT_NODE)
+            continue;
+        fill_stat(tfs, i, &st);
+        if (callback(tfs->nodes[i]->name, &st, arg))
+            break;
+    }
+    return 0;
+}
+
+// to gets the pages of from, shared until either writes to one of them.
+// Only the page of page numbers is copied.
+static int tmpfs_clone(void *fs, uint32 from, uint32 to) {
+    TMPFS *tfs = (TMPFS *)fs;
+    TMPFS_NODE *src = get_node(tfs, from);
+    TMPFS_NODE *dst = get_node(tfs, to);
+    uint32 indirect = 0;
+    uint32 i;
+
+    if (src == NULL || dst == NULL)
+        return VFS_ERR_NOT_FOUND;
+    if (src->is_directory || dst->is_directory)
+        return VFS_ERR_IS_DIR;
+    if (from == to)
+        return 0;
+    if (src->indirect != 0) {
+        indirect = alloc_block(tfs, TMPFS_INDIRECT_ORDER);
+        if (indirect == 0)
+            return VFS_ERR_NO_SPACE;
+    }
+    free_pages_from(tfs, dst, 0);
+    dst->size = 0;
+    dst->indirect = indirect;
+    for (i = 0; i < TMPFS_DIRECT_PAGES; i++) {
+        dst->direct[i] = share_page(tfs, src->direct[i]);
+        if (dst->direct[i] == 0 && src->direct[i] != 0)
+            goto no_space;
+    }
+    if (indirect != 0) {
+        uint32 *src_table = (uint32 *)page_data(src->indirect);
+        uint32 *table = (uint32 *)page_data(indirect);
+        for (i = 0; i < TMPFS_INDIRECT_PAGES; i++) {
+            table[i] = share_page(tfs, src_table[i]);
+            if (table[i] == 0 && src_table[i] != 0)
+                goto no_space;
+        }
+    }
+    dst->size = src->size;
+    return 0;
+
+no_space:
+    free_pages_from(tfs, dst, 0);
+    return VFS_ERR_NO_SPACE;
+}
+
+VFS_DRIVER tmpfs_driver = {
+    .name = "tmpfs",
+    .mount = tmpfs_mount,
+    .unmount = tmpfs_unmount,
+    .sync = tmpfs_sync,
+    .lookup = tmpfs_lookup,
+    .stat = tmpfs_stat,
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .truncate = tmpfs_truncate,
+    .create = tmpfs_create,
+    .unlink = tmpfs_unlink,
+    .rename = tmpfs_rename,
+    .readdir = tmpfs_readdir,
+    .clone = tmpfs_clone,
+};
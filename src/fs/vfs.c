@@ -0,0 +1,527 @@
+#include "fs/vfs.h"
+#include "string.h"
+#include <stddef.h> // Для NULL
+
+// an open file, the index in g_open_files is the file descriptor
+typedef struct {
+    VFS_MOUNT *mount;
+    uint32 node;
+    uint32 offset;
+    uint32 flags;
+    uint8 in_use;
+} VFS_FILE;
+
+static VFS_DRIVER *g_drivers[VFS_MAX_DRIVERS];
+static VFS_MOUNT g_mounts[VFS_MAX_MOUNTS];
+static VFS_FILE g_open_files[VFS_MAX_OPEN];
+
+int vfs_register_driver(VFS_DRIVER *driver) {
+    for (int i = 0; i < VFS_MAX_DRIVERS; i++) {
+        if (g_drivers[i] == NULL || g_drivers[i] == driver) {
+            g_drivers[i] = driver;
+            return 0;
+        }
+    }
+    return VFS_ERR_TOO_MANY;
+}
+
+static VFS_DRIVER *find_driver(const char *name) {
+    for (int i = 0; i < VFS_MAX_DRIVERS; i++) {
+        if (g_drivers[i] != NULL && strcmp(g_drivers[i]->name, name) == 0) {
+            return g_drivers[i];
+        }
+    }
+    return NULL;
+}
+
+int vfs_normalize_path(const char *path, char *out) {
+    int len = 0;
+
+    if (path[0] != '/') {
+        return VFS_ERR_INVALID;
+    }
+    while (*path != '\0') {
+        while (*path == '/') {
+            path++;
+        }
+        int n = 0;
+        while (path[n] != '\0' && path[n] != '/') {
+            n++;
+        }
+        if (n == 0 || (n == 1 && path[0] == '.')) {
+            path += n;
+            continue;
+        }
+        if (n == 2 && path[0] == '.' && path[1] == '.') {
+            // back to the previous '/', the root has no parent
+            while (len > 0 && out[len - 1] != '/') {
+                len--;
+            }
+            if (len > 0) {
+                len--;
+            }
+            path += n;
+            continue;
+        }
+        if (len + 1 + n >= VFS_PATH_LENGTH) {
+            return VFS_ERR_INVALID;
+        }
+        out[len++] = '/';
+        memcpy(out + len, path, n);
+        len += n;
+        path += n;
+    }
+    if (len == 0) {
+        out[len++] = '/';
+    }
+    out[len] = '\0';
+    return 0;
+}
+
+// Mount holding a normalized path: the longest mount point that is the
+// path itself or one of its parent directories. *rel is the rest of the
+// path as seen by the driver.
+static VFS_MOUNT *find_mount(const char *path, const char **rel) {
+    VFS_MOUNT *best = NULL;
+    int best_len = -1;
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VFS_MOUNT *m = &g_mounts[i];
+        if (!m->in_use) {
+            continue;
+        }
+        int len = strlen(m->path);
+        if (len == 1) {
+            len = 0; // "/" prefixes everything
+        } else if (!memcmp((uint8 *)path, (uint8 *)m->path, len) ||
+                   (path[len] != '\0' && path[len] != '/')) {
+            continue;
+        }
+        if (len > best_len) {
+            best = m;
+            best_len = len;
+        }
+    }
+    if (best != NULL) {
+        *rel = path[best_len] == '\0' ? "/" : path + best_len;
+    }
+    return best;
+}
+
+// Normalize path into buf and find the mount it lives on
+static VFS_MOUNT *resolve(const char *path, char *buf, const char **rel) {
+    if (vfs_normalize_path(path, buf) != 0) {
+        return NULL;
+    }
+    return find_mount(buf, rel);
+}
+
+int vfs_mount(const char *type, BLOCK_DEVICE *dev, const char *path, const char *options) {
+    char normalized[VFS_PATH_LENGTH];
+    VFS_MOUNT *slot = NULL;
+    int have_root = 0;
+
+    if (vfs_normalize_path(path, normalized) != 0) {
+        return VFS_ERR_INVALID;
+    }
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (!g_mounts[i].in_use) {
+            if (slot == NULL) {
+                slot = &g_mounts[i];
+            }
+        } else if (strcmp(g_mounts[i].path, normalized) == 0) {
+            return VFS_ERR_BUSY;
+        } else if (strcmp(g_mounts[i].path, "/") == 0) {
+            have_root = 1;
+        }
+    }
+    if (slot == NULL) {
+        return VFS_ERR_TOO_MANY;
+    }
+
+    // the root goes first, everything else needs a directory to cover
+    if (!have_root) {
+        if (strcmp(normalized, "/") != 0) {
+            return VFS_ERR_NOT_FOUND;
+        }
+    } else {
+        VFS_STAT st;
+        int res = vfs_stat(normalized, &st);
+        if (res != 0) {
+            return res;
+        }
+        if (!st.is_directory) {
+            return VFS_ERR_NOT_DIR;
+        }
+    }
+
+    VFS_DRIVER *driver = find_driver(type);
+    if (driver == NULL) {
+        return VFS_ERR_NO_DRIVER;
+    }
+    void *fs = driver->mount(dev, options);
+    if (fs == NULL) {
+        return VFS_ERR_INVALID; // not a volume the driver can use
+    }
+
+    strcpy(slot->path, normalized);
+    slot->driver = driver;
+    slot->dev = dev;
+    slot->fs = fs;
+    slot->in_use = 1;
+    return 0;
+}
+
+int vfs_umount(const char *path) {
+    char normalized[VFS_PATH_LENGTH];
+    VFS_MOUNT *m = NULL;
+
+    if (vfs_normalize_path(path, normalized) != 0) {
+        return VFS_ERR_INVALID;
+    }
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (g_mounts[i].in_use && strcmp(g_mounts[i].path, normalized) == 0) {
+            m = &g_mounts[i];
+        }
+    }
+    if (m == NULL) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (strcmp(m->path, "/") == 0) {
+        return VFS_ERR_BUSY;
+    }
+
+    // nothing may be open on it or mounted below it
+    for (int i = 0; i < VFS_MAX_OPEN; i++) {
+        if (g_open_files[i].in_use && g_open_files[i].mount == m) {
+            return VFS_ERR_BUSY;
+        }
+    }
+    int len = strlen(m->path);
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (g_mounts[i].in_use && &g_mounts[i] != m &&
+            memcmp((uint8 *)g_mounts[i].path, (uint8 *)m->path, len) && g_mounts[i].path[len] == '/') {
+            return VFS_ERR_BUSY;
+        }
+    }
+
+    m->driver->unmount(m->fs);
+    m->in_use = 0;
+    return 0;
+}
+
+VFS_MOUNT *vfs_get_mount(int index) {
+    if (index < 0 || index >= VFS_MAX_MOUNTS || !g_mounts[index].in_use) {
+        return NULL;
+    }
+    return &g_mounts[index];
+}
+
+int vfs_sync() {
+    int result = 0;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (g_mounts[i].in_use && g_mounts[i].driver->sync != NULL) {
+            int res = g_mounts[i].driver->sync(g_mounts[i].fs);
+            if (res != 0) {
+                result = res;
+            }
+        }
+    }
+    return result;
+}
+
+int vfs_stat(const char *path, VFS_STAT *st) {
+    char buf[VFS_PATH_LENGTH];
+    const char *rel;
+    VFS_MOUNT *m = resolve(path, buf, &rel);
+    if (m == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    return m->driver->lookup(m->fs, rel, st);
+}
+
+int vfs_create(const char *path, uint8 is_directory, uint32 permissions) {
+    char buf[VFS_PATH_LENGTH];
+    const char *rel;
+    VFS_STAT st;
+    VFS_MOUNT *m = resolve(path, buf, &rel);
+    if (m == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    if (strcmp(rel, "/") == 0) {
+        return VFS_ERR_EXISTS; // a mount point
+    }
+    int res = m->driver->create(m->fs, rel, is_directory, permissions, &st);
+    return res < 0 ? res : 0;
+}
+
+int vfs_unlink(const char *path) {
+    char buf[VFS_PATH_LENGTH];
+    const char *rel;
+    VFS_STAT st;
+    VFS_MOUNT *m = resolve(path, buf, &rel);
+    if (m == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    if (strcmp(rel, "/") == 0) {
+        return VFS_ERR_BUSY;
+    }
+    // mount points stay until they are unmounted
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (g_mounts[i].in_use && strcmp(g_mounts[i].path, buf) == 0) {
+            return VFS_ERR_BUSY;
+        }
+    }
+    int res = m->driver->lookup(m->fs, rel, &st);
+    if (res != 0) {
+        return res;
+    }
+    for (int i = 0; i < VFS_MAX_OPEN; i++) {
+        if (g_open_files[i].in_use && g_open_files[i].mount == m && g_open_files[i].node == st.node) {
+            return VFS_ERR_BUSY;
+        }
+    }
+    return m->driver->unlink(m->fs, rel);
+}
+
+int vfs_rename(const char *from, const char *to) {
+    char from_buf[VFS_PATH_LENGTH];
+    char to_buf[VFS_PATH_LENGTH];
+    const char *from_rel, *to_rel;
+    VFS_MOUNT *m = resolve(from, from_buf, &from_rel);
+    VFS_MOUNT *to_m = resolve(to, to_buf, &to_rel);
+    if (m == NULL || to_m == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    if (m != to_m) {
+        return VFS_ERR_CROSS_DEVICE;
+    }
+    if (strcmp(from_rel, "/") == 0 || strcmp(to_rel, "/") == 0) {
+        return VFS_ERR_BUSY;
+    }
+    // a directory cannot move below itself
+    int len = strlen(from_buf);
+    if (memcmp((uint8 *)to_buf, (uint8 *)from_buf, len) && (to_buf[len] == '\0' || to_buf[len] == '/')) {
+        return strcmp(to_buf, from_buf) == 0 ? 0 : VFS_ERR_INVALID;
+    }
+    // neither can a mount point or anything above one
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (g_mounts[i].in_use && memcmp((uint8 *)g_mounts[i].path, (uint8 *)from_buf, len) &&
+            (g_mounts[i].path[len] == '\0' || g_mounts[i].path[len] == '/')) {
+            return VFS_ERR_BUSY;
+        }
+    }
+    if (m->driver->rename == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    return m->driver->rename(m->fs, from_rel, to_rel);
+}
+
+int vfs_clone(const char *from, const char *to) {
+    char from_buf[VFS_PATH_LENGTH];
+    char to_buf[VFS_PATH_LENGTH];
+    const char *from_rel, *to_rel;
+    VFS_STAT st, to_st;
+    VFS_MOUNT *m = resolve(from, from_buf, &from_rel);
+    VFS_MOUNT *to_m = resolve(to, to_buf, &to_rel);
+    if (m == NULL || to_m == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    if (m != to_m) {
+        return VFS_ERR_CROSS_DEVICE;
+    }
+    if (m->driver->clone == NULL) {
+        return VFS_ERR_NOT_SUPPORTED;
+    }
+    if (strcmp(to_rel, "/") == 0) {
+        return VFS_ERR_EXISTS;
+    }
+    int res = m->driver->lookup(m->fs, from_rel, &st);
+    if (res != 0) {
+        return res;
+    }
+    if (st.is_directory) {
+        return VFS_ERR_IS_DIR;
+    }
+    res = m->driver->create(m->fs, to_rel, 0, st.permissions, &to_st);
+    if (res < 0) {
+        return res;
+    }
+    res = m->driver->clone(m->fs, st.node, to_st.node);
+    if (res != 0) {
+        m->driver->unlink(m->fs, to_rel);
+    }
+    return res;
+}
+
+int vfs_might_contain(const char *dir, uint32 node, const char *text, uint32 length) {
+    char buf[VFS_PATH_LENGTH];
+    const char *rel;
+    VFS_MOUNT *m = resolve(dir, buf, &rel);
+    if (m == NULL || m->driver->might_contain == NULL) {
+        return 1;
+    }
+    return m->driver->might_contain(m->fs, node, text, length) != 0;
+}
+
+int vfs_readdir(const char *path, VFS_DIR_CALLBACK callback, void *arg) {
+    char buf[VFS_PATH_LENGTH];
+    const char *rel;
+    VFS_STAT st;
+    VFS_MOUNT *m = resolve(path, buf, &rel);
+    if (m == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    int res = m->driver->lookup(m->fs, rel, &st);
+    if (res != 0) {
+        return res;
+    }
+    if (!st.is_directory) {
+        return VFS_ERR_NOT_DIR;
+    }
+    return m->driver->readdir(m->fs, st.node, callback, arg);
+}
+
+static VFS_FILE *get_file(int fd) {
+    if (fd < 0 || fd >= VFS_MAX_OPEN || !g_open_files[fd].in_use) {
+        return NULL;
+    }
+    return &g_open_files[fd];
+}
+
+int vfs_open(const char *path, uint32 flags) {
+    char buf[VFS_PATH_LENGTH];
+    const char *rel;
+    VFS_STAT st;
+    int fd;
+
+    fd = 0;
+    while (fd < VFS_MAX_OPEN && g_open_files[fd].in_use) {
+        fd++;
+    }
+    if (fd == VFS_MAX_OPEN) {
+        return VFS_ERR_TOO_MANY;
+    }
+    VFS_MOUNT *m = resolve(path, buf, &rel);
+    if (m == NULL) {
+        return VFS_ERR_INVALID;
+    }
+
+    int res = m->driver->lookup(m->fs, rel, &st);
+    if (res == VFS_ERR_NOT_FOUND && (flags & VFS_O_CREAT)) {
+        res = m->driver->create(m->fs, rel, 0, 0644, &st);
+    }
+    if (res < 0) {
+        return res;
+    }
+    if (st.is_directory && (flags & VFS_O_WRITE)) {
+        return VFS_ERR_IS_DIR;
+    }
+    if ((flags & VFS_O_TRUNC) && (flags & VFS_O_WRITE) && st.size > 0) {
+        res = m->driver->truncate(m->fs, st.node, 0);
+        if (res != 0) {
+            return res;
+        }
+    }
+
+    VFS_FILE *file = &g_open_files[fd];
+    file->mount = m;
+    file->node = st.node;
+    file->offset = 0;
+    file->flags = flags;
+    file->in_use = 1;
+    return fd;
+}
+
+int vfs_read(int fd, void *buffer, uint32 length) {
+    VFS_FILE *file = get_file(fd);
+    if (file == NULL || !(file->flags & VFS_O_READ)) {
+        return VFS_ERR_BAD_FD;
+    }
+    int n = file->mount->driver->read(file->mount->fs, file->node, file->offset, buffer, length);
+    if (n > 0) {
+        file->offset += n;
+    }
+    return n;
+}
+
+int vfs_write(int fd, const void *buffer, uint32 length) {
+    VFS_FILE *file = get_file(fd);
+    if (file == NULL || !(file->flags & VFS_O_WRITE)) {
+        return VFS_ERR_BAD_FD;
+    }
+    if (file->flags & VFS_O_APPEND) {
+        VFS_STAT st;
+        int res = file->mount->driver->stat(file->mount->fs, file->node, &st);
+        if (res != 0) {
+            return res;
+        }
+        file->offset = st.size;
+    }
+    int n = file->mount->driver->write(file->mount->fs, file->node, file->offset, buffer, length);
+    if (n > 0) {
+        file->offset += n;
+    }
+    return n;
+}
+
+int vfs_lseek(int fd, int offset, int whence) {
+    VFS_FILE *file = get_file(fd);
+    int base;
+
+    if (file == NULL) {
+        return VFS_ERR_BAD_FD;
+    }
+    if (whence == VFS_SEEK_SET) {
+        base = 0;
+    } else if (whence == VFS_SEEK_CUR) {
+        base = file->offset;
+    } else if (whence == VFS_SEEK_END) {
+        VFS_STAT st;
+        int res = file->mount->driver->stat(file->mount->fs, file->node, &st);
+        if (res != 0) {
+            return res;
+        }
+        base = st.size;
+    } else {
+        return VFS_ERR_INVALID;
+    }
+    if (base + offset < 0) {
+        return VFS_ERR_INVALID;
+    }
+    file->offset = base + offset;
+    return file->offset;
+}
+
+int vfs_fsync(int fd) {
+    VFS_FILE *file = get_file(fd);
+    if (file == NULL) {
+        return VFS_ERR_BAD_FD;
+    }
+    VFS_DRIVER *driver = file->mount->driver;
+    if (driver->flush != NULL) {
+        return driver->flush(file->mount->fs, file->node);
+    }
+    return driver->sync != NULL ? driver->sync(file->mount->fs) : 0;
+}
+
+int vfs_close(int fd) {
+    VFS_FILE *file = get_file(fd);
+    if (file == NULL) {
+        return VFS_ERR_BAD_FD;
+    }
+    int res = 0;
+    if ((file->flags & VFS_O_WRITE) && file->mount->driver->flush != NULL) {
+        res = file->mount->driver->flush(file->mount->fs, file->node);
+    }
+    file->in_use = 0;
+    return res;
+}
+
+void vfs_node_moved(void *fs, uint32 from, uint32 to) {
+    for (int i = 0; i < VFS_MAX_OPEN; i++) {
+        if (g_open_files[i].in_use && g_open_files[i].mount->fs == fs && g_open_files[i].node == from) {
+            g_open_files[i].node = to;
+        }
+    }
+}
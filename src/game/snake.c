@@ -1,4 +1,6 @@
 #include "../include/game/snake.h"
+#include "arena.h"
+#include <stddef.h> // Для NULL
 // #include "../include/stdlib.h" // Для rand и srand - временно закомментировано
 // #include "../include/time.h"   // Для инициализации генератора случайных чисел - временно закомментировано
 
@@ -170,16 +172,21 @@ void snake_update(SnakeGame* game) {
 
 // Команда для запуска игры
 void cmd_snake() {
-    SnakeGame game;
-    snake_init(&game);
+    // Слишком велика для стека, живёт до конца команды
+    SnakeGame* game = (SnakeGame*)arena_alloc(&g_scratch_arena, sizeof(SnakeGame));
+    if (game == NULL) {
+        console_putstr("Error: Not enough memory\n");
+        return;
+    }
+    snake_init(game);
 
-    while (!game.game_over) {
-        snake_draw(&game);
+    while (!game->game_over) {
+        snake_draw(game);
         
         // Обработка ввода (неблокирующая, если возможно, или с таймаутом)
         // TODO: Реализовать неблокирующий ввод или ввод с таймаутом
         // Обработка ввода (неблокирующая, если возможно, или с таймаутом)
-        snake_update(&game);
+        snake_update(game);
 
         // Небольшая задержка для управления скоростью игры
         // Небольшая задержка для управления скоростью игры
@@ -189,10 +196,10 @@ void cmd_snake() {
                 if (g_ch == 0x1B) { // Check for ESC
                     g_ch = 0; // Reset g_ch
                     g_exit_program = 0; // Reset exit flag (in case it was set by handler)
-                    game.game_over = TRUE; // Set game over to exit main loop
+                    game->game_over = TRUE; // Set game over to exit main loop
                     break; // Exit delay loop
                 }
-                snake_handle_input(&game, g_ch); // Process other input
+                snake_handle_input(game, g_ch); // Process other input
                 g_ch = 0; // Reset g_ch after processing
             }
         }
@@ -205,10 +212,10 @@ void cmd_snake() {
 
     // Игра окончена
     console_clear(COLOR_BLACK, COLOR_BLACK);
-    console_gotoxy(game.offset_x + GAME_WIDTH / 2 - 5, game.offset_y + GAME_HEIGHT / 2);
+    console_gotoxy(game->offset_x + GAME_WIDTH / 2 - 5, game->offset_y + GAME_HEIGHT / 2);
     console_putstr("Game Over!");
-    console_gotoxy(game.offset_x + GAME_WIDTH / 2 - 7, game.offset_y + GAME_HEIGHT / 2 + 1);
-    console_printf("Final Score: %d", game.score);
+    console_gotoxy(game->offset_x + GAME_WIDTH / 2 - 7, game->offset_y + GAME_HEIGHT / 2 + 1);
+    console_printf("Final Score: %d", game->score);
 
     // TODO: Вернуться в командную оболочку после нажатия клавиши
 }
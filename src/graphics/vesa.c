@@ -3,6 +3,7 @@
 #include "console.h"
 #include "io_ports.h"
 #include "isr.h"
+#include "paging.h"
 #include "string.h"
 #include "types.h"
 #include <stddef.h> // Для NULL
@@ -126,8 +127,14 @@ int vesa_init(uint32 width, uint32 height, uint32 bpp) {
         // set selection resolution to width & height
         g_width = g_vbe_modeinfoblock.XResolution;
         g_height = g_vbe_modeinfoblock.YResolution;
-        // set selected mode video physical address point to buffer for pixel plotting
-        g_vbe_buffer = (uint32 *)g_vbe_modeinfoblock.PhysBasePtr;
+        // map the frame buffer of the selected mode for pixel plotting
+        g_vbe_buffer = (uint32 *)paging_map_mmio(g_vbe_modeinfoblock.PhysBasePtr,
+                                                 g_vbe_modeinfoblock.YResolution * g_vbe_modeinfoblock.BytesPerScanLine,
+                                                 PAGE_WRITE);
+        if (g_vbe_buffer == NULL) {
+            console_printf("no address space left for the frame buffer\n");
+            return -1;
+        }
         // set the mode to start graphics window
         vbe_set_mode(g_selected_mode);
     #endif
@@ -0,0 +1,56 @@
+#include "arena.h"
+#include "string.h"
+#include "meminfo.h"
+#include <stddef.h> // Для NULL
+
+#define ARENA_ALIGN 8
+
+static uint8 g_scratch_memory[SCRATCH_ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+MEMINFO_STATIC(g_scratch_memory);
+
+// Usable before any allocator is up, ide_init() takes from it at boot
+ARENA g_scratch_arena = { g_scratch_memory, SCRATCH_ARENA_SIZE, 0, 0, 0 };
+
+void arena_init(ARENA *arena, void *memory, uint32 size) {
+    arena->base = (uint8 *)memory;
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->failures = 0;
+}
+
+void *arena_alloc(ARENA *arena, uint32 size) {
+    uint32 start = (arena->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (start > arena->size || size > arena->size - start) {
+        arena->failures++;
+        return NULL;
+    }
+    arena->used = start + size;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    return arena->base + start;
+}
+
+void *arena_zalloc(ARENA *arena, uint32 size) {
+    void *ptr = arena_alloc(arena, size);
+    if (ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void arena_reset(ARENA *arena) {
+    arena->used = 0;
+}
+
+ARENA_SCOPE arena_scope_begin(ARENA *arena) {
+    ARENA_SCOPE scope = { arena, arena->used };
+    return scope;
+}
+
+void arena_scope_end(ARENA_SCOPE scope) {
+    if (scope.mark < scope.arena->used) {
+        scope.arena->used = scope.mark;
+    }
+}
@@ -7,9 +7,33 @@ align 4
     dd 0x03                   ; Flags: align modules and provide memory map
     dd -(0x1BADB002 + 0x03)   ; Checksum
 
+; The kernel is linked at KERNEL_VIRTUAL_BASE + 1 MiB (link.ld, paging.h)
+; and loaded at 1 MiB. Until paging is on, addresses of symbols need the
+; base taken off.
+KERNEL_VIRTUAL_BASE equ 0xC0000000
+KERNEL_PDE equ (KERNEL_VIRTUAL_BASE >> 22)
+BOOT_LARGE_PAGES equ 4 ; 16 MiB, the image with bss and the stack fits
+
 section .data
     align 4096
 
+; Boot page directory: the first 16 MiB with 4 MiB pages, identity mapped
+; for the instructions before the jump and at KERNEL_VIRTUAL_BASE for the
+; rest. paging_init() replaces it.
+boot_page_directory:
+%assign i 0
+%rep BOOT_LARGE_PAGES
+    dd (i << 22) | 0x83       ; present, writable, 4 MiB
+%assign i i + 1
+%endrep
+    times (KERNEL_PDE - BOOT_LARGE_PAGES) dd 0
+%assign i 0
+%rep BOOT_LARGE_PAGES
+    dd (i << 22) | 0x83
+%assign i i + 1
+%endrep
+    times (1024 - KERNEL_PDE - BOOT_LARGE_PAGES) dd 0
+
 ; initial stack
 section .initial_stack, nobits
     align 4
@@ -23,8 +47,25 @@ stack_top:
 section .text
     global _start
 
-; define _start, aligned by linker.ld script
-_start:
+; The boot loader jumps to the physical address with paging off
+_start equ (start - KERNEL_VIRTUAL_BASE)
+
+start:
+    ; Paging on with 4 MiB pages. eax and ebx hold the multiboot magic and info.
+    mov ecx, cr4
+    or ecx, 0x10              ; PSE
+    mov cr4, ecx
+    mov ecx, (boot_page_directory - KERNEL_VIRTUAL_BASE)
+    mov cr3, ecx
+    mov ecx, cr0
+    or ecx, 0x80010000        ; PG, and WP: read-only pages hold for the kernel too
+    mov cr0, ecx
+
+    ; Continue at the linked address
+    lea ecx, [higher_half]
+    jmp ecx
+
+higher_half:
     ; Set up stack
     mov esp, stack_top
     
@@ -34,8 +75,9 @@ _start:
     ; Clear direction flag
     cld
     
-    ; Save multiboot info
+    ; Pass the multiboot info and the magic proving it: kmain(magic, info)
     push ebx
+    push eax
     
     ; Call kernel main
     extern kmain
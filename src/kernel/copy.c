@@ -0,0 +1,252 @@
+#include "copy.h"
+#include "string.h"
+#include "fs/vfs.h"
+#include "meminfo.h"
+#include <stddef.h> // Для NULL
+
+// The walk keeps one source and one destination path and extends them
+// by a component per level, so a level costs the stack only the frames
+// of vfs_readdir() and the driver. Drivers allow calls back into the
+// file system from a readdir callback.
+static char src_path[VFS_PATH_LENGTH];
+static char dst_path[VFS_PATH_LENGTH];
+static uint8 copy_buf[COPY_BUF_SIZE];
+MEMINFO_STATIC(copy_buf);
+static CopyStats* copy_stats;
+static int walk_depth;
+static int walk_error;
+
+// Append "/name" to path, returns the length to cut it back to or -1
+// if the result does not fit
+static int path_push(char* path, const char* name) {
+    int len = strlen(path);
+    int sep = path[len - 1] == '/' ? 0 : 1; // "/" itself
+    if (len + sep + (int)strlen(name) >= VFS_PATH_LENGTH) {
+        return -1;
+    }
+    if (sep) {
+        path[len] = '/';
+    }
+    strcpy(path + len + sep, name);
+    return len;
+}
+
+// path is below dir, or dir itself
+static int path_within(const char* path, const char* dir) {
+    int len = strlen(dir);
+    if (strcmp(dir, "/") == 0) {
+        return 1;
+    }
+    return memcmp((uint8*)path, (uint8*)dir, len) && (path[len] == '\0' || path[len] == '/');
+}
+
+// Write all of length bytes. A short write is retried, so that the
+// driver reports why the rest did not fit.
+static int write_all(int fd, const uint8* buffer, uint32 length) {
+    uint32 done = 0;
+    while (done < length) {
+        int n = vfs_write(fd, buffer + done, length - done);
+        if (n < 0) {
+            return n;
+        }
+        if (n == 0) {
+            return VFS_ERR_NO_SPACE;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static int stream_file(uint32 permissions) {
+    int res = vfs_create(dst_path, 0, permissions);
+    if (res < 0) {
+        return res;
+    }
+    int in = vfs_open(src_path, VFS_O_READ);
+    if (in < 0) {
+        vfs_unlink(dst_path);
+        return in;
+    }
+    int out = vfs_open(dst_path, VFS_O_WRITE);
+    if (out < 0) {
+        vfs_close(in);
+        vfs_unlink(dst_path);
+        return out;
+    }
+    int n;
+    while ((n = vfs_read(in, copy_buf, sizeof(copy_buf))) > 0) {
+        res = write_all(out, copy_buf, n);
+        if (res != 0) {
+            break;
+        }
+        copy_stats->bytes_copied += n;
+    }
+    if (n < 0) {
+        res = n;
+    }
+    vfs_close(in);
+    int closed = vfs_close(out);
+    if (res == 0) {
+        res = closed;
+    }
+    if (res != 0) {
+        vfs_unlink(dst_path); // no partial copies
+    }
+    return res;
+}
+
+static int copy_file(const VFS_STAT* st) {
+    int res = vfs_clone(src_path, dst_path);
+    if (res == 0) {
+        copy_stats->bytes_shared += st->size;
+    } else if (res == VFS_ERR_NOT_SUPPORTED || res == VFS_ERR_CROSS_DEVICE) {
+        res = stream_file(st->permissions);
+    }
+    if (res == 0) {
+        copy_stats->files++;
+    }
+    return res;
+}
+
+static int copy_entry(const VFS_STAT* st);
+
+static int copy_child(const char* name, const VFS_STAT* st, void* arg) {
+    int src_len = path_push(src_path, name);
+    int dst_len = path_push(dst_path, name);
+    int res = src_len < 0 || dst_len < 0 ? VFS_ERR_INVALID : copy_entry(st);
+    if (src_len >= 0) {
+        src_path[src_len] = '\0';
+    }
+    if (dst_len >= 0) {
+        dst_path[dst_len] = '\0';
+    }
+    if (res < 0) {
+        walk_error = res;
+        return 1;
+    }
+    return 0;
+}
+
+static int copy_entry(const VFS_STAT* st) {
+    if (!st->is_directory) {
+        return copy_file(st);
+    }
+    if (walk_depth >= COPY_MAX_DEPTH) {
+        return VFS_ERR_INVALID;
+    }
+    int res = vfs_create(dst_path, 1, st->permissions);
+    if (res < 0) {
+        return res;
+    }
+    copy_stats->dirs++;
+    walk_depth++;
+    res = vfs_readdir(src_path, copy_child, NULL);
+    walk_depth--;
+    return res < 0 ? res : walk_error;
+}
+
+static int start_walk(const char* from, const char* to, CopyStats* stats) {
+    if (strlen(from) >= VFS_PATH_LENGTH || strlen(to) >= VFS_PATH_LENGTH) {
+        return VFS_ERR_INVALID;
+    }
+    strcpy(src_path, from);
+    strcpy(dst_path, to);
+    memset(stats, 0, sizeof(CopyStats));
+    copy_stats = stats;
+    walk_depth = 0;
+    walk_error = 0;
+    return 0;
+}
+
+int copy_tree(const char* from, const char* to, int recursive, CopyStats* stats) {
+    VFS_STAT st;
+    int res = start_walk(from, to, stats);
+    if (res != 0) {
+        return res;
+    }
+    res = vfs_stat(from, &st);
+    if (res != 0) {
+        return res;
+    }
+    if (st.is_directory && !recursive) {
+        return VFS_ERR_IS_DIR;
+    }
+    // The copy would be walked into as it grows
+    if (st.is_directory && path_within(to, from)) {
+        return VFS_ERR_INVALID;
+    }
+    return copy_entry(&st);
+}
+
+typedef struct {
+    int cut;           // length of src_path before the child was appended
+    uint8 is_directory;
+} RemoveChild;
+
+// Stop at the first entry: removing while the driver walks the
+// directory could skip entries (the root table compacts itself)
+static int first_child(const char* name, const VFS_STAT* st, void* arg) {
+    RemoveChild* child = (RemoveChild*)arg;
+    child->cut = path_push(src_path, name);
+    child->is_directory = st->is_directory;
+    return 1;
+}
+
+static int remove_entry(uint8 is_directory) {
+    if (is_directory) {
+        if (walk_depth >= COPY_MAX_DEPTH) {
+            return VFS_ERR_INVALID;
+        }
+        walk_depth++;
+        while (1) {
+            RemoveChild child;
+            child.cut = -2;
+            int res = vfs_readdir(src_path, first_child, &child);
+            if (res == 0 && child.cut == -1) {
+                res = VFS_ERR_INVALID;
+            }
+            if (res == 0 && child.cut >= 0) {
+                res = remove_entry(child.is_directory);
+                src_path[child.cut] = '\0';
+            }
+            if (res != 0) {
+                walk_depth--;
+                return res;
+            }
+            if (child.cut == -2) {
+                break; // empty
+            }
+        }
+        walk_depth--;
+    }
+    return vfs_unlink(src_path);
+}
+
+int remove_tree(const char* path) {
+    CopyStats stats;
+    VFS_STAT st;
+    int res = start_walk(path, "/", &stats);
+    if (res != 0) {
+        return res;
+    }
+    res = vfs_stat(path, &st);
+    return res != 0 ? res : remove_entry(st.is_directory);
+}
+
+int move_tree(const char* from, const char* to, CopyStats* stats) {
+    VFS_STAT st;
+    memset(stats, 0, sizeof(CopyStats));
+    int res = vfs_rename(from, to);
+    if (res != VFS_ERR_CROSS_DEVICE) {
+        return res;
+    }
+    if (vfs_stat(to, &st) == 0) {
+        return VFS_ERR_EXISTS;
+    }
+    res = copy_tree(from, to, 1, stats);
+    if (res != 0) {
+        remove_tree(to); // the source stays as it was
+        return res;
+    }
+    return remove_tree(from);
+}
@@ -0,0 +1,38 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include "types.h"
+
+/**
+ * Copying and moving files and trees over the VFS, for cp and mv.
+ *
+ * Within one volume a move is a rename, only the directory entry
+ * changes. A copy asks the driver to share the contents copy-on-write
+ * (vfs_clone()) and streams them through a large buffer when it cannot
+ * or the copy goes to another volume. Paths are absolute.
+ */
+
+#define COPY_BUF_SIZE (32 * 1024)
+#define COPY_MAX_DEPTH 32 // directory levels below the top, bounds the stack
+
+typedef struct {
+    uint32 files;
+    uint32 dirs;
+    uint32 bytes_copied; // streamed through the buffer
+    uint32 bytes_shared; // shared copy-on-write
+} CopyStats;
+
+// Copy the file from, or with recursive the whole tree, to to, which
+// must not exist. A failed file copy is removed, the copies made
+// before it are left.
+int copy_tree(const char* from, const char* to, int recursive, CopyStats* stats);
+
+// Move from to to, which must not exist: a rename within a volume,
+// otherwise a recursive copy followed by removal of from. A copy that
+// fails is removed again and from is left alone.
+int move_tree(const char* from, const char* to, CopyStats* stats);
+
+// Remove path and everything below it
+int remove_tree(const char* path);
+
+#endif
@@ -2,48 +2,480 @@
 #include "console.h" // Assuming console_putstr and console_printf are used
 #include "string.h"  // Assuming strcpy, strcmp, strcat, strrchr, strncpy, memcpy are used
 #include "types.h"   // Assuming uint32, uint8 are used
-#include "ide.h"
+#include "ide.h" // ATA_SECTOR_SIZE
+#include "fsdisk.h"
+#include "journal.h"
+#include "namepool.h"
+#include "lz4.h"
+#include "crc32c.h"
+#include "tsc.h"
+#include "trigram.h"
+#include "snapshot.h"
+#include "meminfo.h"
+#include <stddef.h> // Для NULL
 
-#define FS_DISK_DRIVE 0 // Используем первый диск
-#define FS_START_SECTOR 10 // С какого сектора сохранять файловую систему
-#define FS_SECTOR_COUNT ((sizeof(FileEntry) * MAX_FILES + 511) / 512) // Количество секторов для всей ФС
+#define FS_DATA_START (FS_JOURNAL_START + JOURNAL_SECTORS)
+#define FS_CACHE_SLOTS 8 // содержимое скольких файлов держим в памяти
 
 // Simple file system
+FileKey file_keys[MAX_FILES];
+MEMINFO_STATIC(file_keys);
 FileEntry file_system[MAX_FILES];
+MEMINFO_STATIC(file_system);
 int file_count = 0;
 char current_dir[MAX_PATH_LENGTH] = HOME_DIR;
 char home_dir[MAX_PATH_LENGTH] = HOME_DIR;
+uint8 fs_compress_default = 0;
+FsDataStats fs_data_stats;
+uint32 fs_crc_errors = 0;
+uint8 fs_deferred_commit = 0;
+
+// Dirty tracking: one bit per metadata block touched by a change. Blocks
+// are written whole, so a block CRC always covers what is on disk even
+// where memory drifted without a change being logged (name reference counts).
+static uint32 dirty_blocks[(FS_META_BLOCKS + 31) / 32];
+// Bounce buffer for the header and for the last sector of the table and
+// of the pool, which are only partly covered by the arrays in memory
+static uint8 sector_buf[ATA_SECTOR_SIZE];
+
+// CRC of every metadata block as of the last checkpoint, or of the one
+// in progress once its sectors are written; goes into the header
+static uint32 block_crc[FS_META_BLOCKS];
+static const uint8 zero_sector[ATA_SECTOR_SIZE];
+
+// Data slots referenced by the table, bit (slot - 1); rebuilt at load.
+// A slot shared by copies (share_file_content()) counts its entries in
+// slot_refs and is freed with the last of them. Slots that only
+// snapshots refer to have their bit set and no references.
+static uint32 used_slots[(FS_DATA_SLOTS + 31) / 32];
+static uint16 slot_refs[FS_DATA_SLOTS];
+MEMINFO_STATIC(slot_refs);
+// With deferred commits a slot freed by a change still in memory keeps
+// its bit in used_slots until the journal holds the change: until then
+// a crash brings back the entry that points at it.
+static uint32 freed_slots[(FS_DATA_SLOTS + 31) / 32];
+static uint8 slots_freed = 0;
+
+// Contents read or written recently. A slot is never rewritten in place,
+// so a cached copy stays valid for as long as the slot is in use.
+typedef struct {
+    uint32 slot; // 0 - пусто
+    uint32 last_use;
+    char data[FS_DATA_SECTORS * ATA_SECTOR_SIZE];
+} ContentCache;
+
+static ContentCache content_cache[FS_CACHE_SLOTS];
+static uint32 cache_clock = 0;
+
+// A data slot as stored on disk when it holds an LZ4 block
+static uint8 packed_buf[FS_DATA_SECTORS * ATA_SECTOR_SIZE];
+static char plain_buf[MAX_FILE_SIZE]; // для перезаписи файла при смене сжатия
+static const char zero_content[MAX_FILE_SIZE]; // a file of zeros has no slot
+
+static int block_is_dirty(uint32 block) {
+    return (dirty_blocks[block / 32] >> (block % 32)) & 1;
+}
+
+static void mark_sectors_dirty(uint32 first, uint32 last) {
+    for (uint32 b = first / FS_CRC_BLOCK_SECTORS; b <= last / FS_CRC_BLOCK_SECTORS; b++) {
+        dirty_blocks[b / 32] |= 1u << (b % 32);
+    }
+}
+
+static uint32 data_slot_lba(uint32 slot) {
+    return FS_DATA_START + (slot - 1) * FS_DATA_SECTORS;
+}
+
+static uint32 find_free_slot() {
+    for (uint32 i = 0; i < (FS_DATA_SLOTS + 31) / 32; i++) {
+        if (used_slots[i] == 0xFFFFFFFF) {
+            continue;
+        }
+        for (uint32 bit = 0; bit < 32; bit++) {
+            uint32 slot = i * 32 + bit + 1;
+            if (slot > FS_DATA_SLOTS) {
+                return 0;
+            }
+            if (!(used_slots[i] & (1u << bit))) {
+                used_slots[i] |= 1u << bit;
+                slot_refs[slot - 1] = 1;
+                return slot;
+            }
+        }
+    }
+    return 0;
+}
+
+// Nothing refers to slot any more
+static void drop_data_slot(uint32 slot) {
+    if (fs_deferred_commit) {
+        freed_slots[(slot - 1) / 32] |= 1u << ((slot - 1) % 32);
+        slots_freed = 1;
+    } else {
+        used_slots[(slot - 1) / 32] &= ~(1u << ((slot - 1) % 32));
+    }
+    for (int i = 0; i < FS_CACHE_SLOTS; i++) {
+        if (content_cache[i].slot == slot) {
+            content_cache[i].slot = 0;
+            content_cache[i].last_use = 0;
+        }
+    }
+}
+
+static void free_data_slot(uint32 slot) {
+    if (slot == 0 || slot > FS_DATA_SLOTS) {
+        return;
+    }
+    if (slot_refs[slot - 1] > 1) {
+        slot_refs[slot - 1]--; // still read by the other copies
+        return;
+    }
+    slot_refs[slot - 1] = 0;
+    if (!snapshot_holds_slot(slot)) {
+        drop_data_slot(slot); // otherwise it goes with the snapshot
+    }
+}
+
+// A snapshot let go of slot, returns 1 if that freed it
+int release_snapshot_slot(uint32 slot) {
+    if (slot == 0 || slot > FS_DATA_SLOTS || slot_refs[slot - 1] != 0 || snapshot_holds_slot(slot)) {
+        return 0;
+    }
+    drop_data_slot(slot);
+    return 1;
+}
+
+uint32 get_slot_refs(uint32 slot) {
+    return slot != 0 && slot <= FS_DATA_SLOTS ? slot_refs[slot - 1] : 0;
+}
+
+// The changes that freed them are durable now
+static void release_freed_slots() {
+    if (!slots_freed) {
+        return;
+    }
+    for (uint32 i = 0; i < (FS_DATA_SLOTS + 31) / 32; i++) {
+        used_slots[i] &= ~freed_slots[i];
+    }
+    memset(freed_slots, 0, sizeof(freed_slots));
+    slots_freed = 0;
+}
+
+static uint32 alloc_data_slot() {
+    uint32 slot = find_free_slot();
+    if (slot == 0 && slots_freed && flush_file_system() == 0) {
+        slot = find_free_slot(); // every free slot was waiting for the journal
+    }
+    return slot;
+}
+
+static void rebuild_used_slots() {
+    memset(freed_slots, 0, sizeof(freed_slots));
+    slots_freed = 0;
+    memset(used_slots, 0, sizeof(used_slots));
+    memset(slot_refs, 0, sizeof(slot_refs));
+    for (int i = 0; i < file_count; i++) {
+        uint32 slot = file_system[i].data_slot;
+        if (slot != 0 && slot <= FS_DATA_SLOTS) {
+            used_slots[(slot - 1) / 32] |= 1u << ((slot - 1) % 32);
+            slot_refs[slot - 1]++;
+        }
+    }
+    snapshot_add_slots(used_slots);
+}
+
+// Cache entry holding slot, or the least recently used one to reuse for it
+static ContentCache* cache_lookup(uint32 slot, int* hit) {
+    ContentCache* victim = NULL;
+    for (int i = 0; i < FS_CACHE_SLOTS; i++) {
+        if (content_cache[i].slot == slot) {
+            *hit = 1;
+            content_cache[i].last_use = ++cache_clock;
+            return &content_cache[i];
+        }
+        if (victim == NULL || content_cache[i].last_use < victim->last_use) {
+            victim = &content_cache[i];
+        }
+    }
+    *hit = 0;
+    victim->slot = 0;
+    victim->last_use = ++cache_clock;
+    return victim;
+}
+
+static uint32 sectors_for(uint32 bytes) {
+    return (bytes + ATA_SECTOR_SIZE - 1) / ATA_SECTOR_SIZE;
+}
 
 // File system functions
 void init_file_system() {
+    memset(file_keys, 0, sizeof(file_keys));
+    memset(file_system, 0, sizeof(file_system));
+    memset(used_slots, 0, sizeof(used_slots));
+    memset(freed_slots, 0, sizeof(freed_slots));
+    slots_freed = 0;
+    memset(content_cache, 0, sizeof(content_cache));
+    trigram_reset();
+    name_pool_reset();
+    journal_format();
+    snapshot_format();
+
     // Create root directory
-    strcpy(file_system[0].name, "/");
-    file_system[0].is_directory = 1;
-    file_system[0].size = 0;
-    strcpy(file_system[0].path, "/");
-    file_system[0].permissions = 0755;
+    file_keys[FS_ROOT_INDEX].parent_id = FS_ROOT_INDEX;
+    file_keys[FS_ROOT_INDEX].name = name_pool_intern("/");
+    file_system[FS_ROOT_INDEX].is_directory = 1;
+    file_system[FS_ROOT_INDEX].permissions = 0755;
+    file_count = 1;
 
     // Create home directory
-    strcpy(file_system[1].name, "home");
-    file_system[1].is_directory = 1;
-    file_system[1].size = 0;
-    strcpy(file_system[1].path, "/home");
-    file_system[1].permissions = 0755;
-
-    file_count = 2;
+    create_file(HOME_DIR, 1, 0755);
 
+    mark_file_dirty(FS_ROOT_INDEX);
+    // Every metadata sector is written once, so no block is checksummed
+    // over whatever the disk held before
+    mark_sectors_dirty(0, FS_META_SECTORS - 1);
     save_file_system();
 }
 
-int find_file(const char* path) {
-    for (int i = 0; i < file_count; i++) {
-        if (strcmp(file_system[i].path, path) == 0) {
-            return i;
+int find_child(int dir_index, const char* name) {
+    // Names are interned, so a name that is not in the pool is nowhere
+    uint32 name_id = name_pool_find(name);
+    if (name_id == NAME_POOL_NONE) {
+        return -1;
+    }
+    // The root is entry 0 and no child is named "/", so the scan starts past it
+    FileKey* end = &file_keys[file_count];
+    for (FileKey* key = &file_keys[FS_ROOT_INDEX + 1]; key < end; key++) {
+        if (key->name == name_id && key->parent_id == (uint32)dir_index) {
+            return key - file_keys;
         }
     }
     return -1;
 }
 
+// Walk an absolute path from the root, "." and ".." are understood
+int find_file(const char* path) {
+    char component[MAX_FILENAME];
+    int index = FS_ROOT_INDEX;
+
+    if (path[0] != '/') {
+        return -1;
+    }
+    while (*path != '\0') {
+        while (*path == '/') {
+            path++;
+        }
+        int len = 0;
+        while (path[len] != '\0' && path[len] != '/') {
+            len++;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (len >= MAX_FILENAME || !file_system[index].is_directory) {
+            return -1;
+        }
+        memcpy(component, path, len);
+        component[len] = '\0';
+        path += len;
+
+        if (strcmp(component, "..") == 0) {
+            index = file_keys[index].parent_id;
+        } else if (strcmp(component, ".") != 0) {
+            index = find_child(index, component);
+            if (index == -1) {
+                return -1;
+            }
+        }
+    }
+    return index;
+}
+
+const char* get_file_name(int index) {
+    return name_pool_get(file_keys[index].name);
+}
+
+// Rebuild the full path of an entry from the parent chain
+void get_file_path(int index, char* path) {
+    char buf[MAX_PATH_LENGTH];
+    int pos = MAX_PATH_LENGTH - 1;
+    buf[pos] = '\0';
+
+    // Every step consumes at least two bytes, which also bounds a looping chain
+    while (index != FS_ROOT_INDEX && index > 0 && index < file_count) {
+        const char* name = get_file_name(index);
+        int len = strlen(name);
+        if (pos - len - 1 < 0) {
+            break;
+        }
+        pos -= len;
+        memcpy(buf + pos, name, len);
+        buf[--pos] = '/';
+        index = file_keys[index].parent_id;
+    }
+    if (buf[pos] == '\0') {
+        buf[--pos] = '/';
+    }
+    strcpy(path, buf + pos);
+}
+
+// Split full_path into its parent directory, which must exist, and a
+// valid last component. Returns the parent index or FS_ERR_*.
+static int split_path(const char* full_path, char* name) {
+    char parent_path[MAX_PATH_LENGTH];
+    strcpy(parent_path, full_path);
+
+    int len = strlen(parent_path);
+    while (len > 1 && parent_path[len - 1] == '/') {
+        parent_path[--len] = '\0';
+    }
+    char* slash = strrchr(parent_path, '/');
+    if (slash == NULL) {
+        return FS_ERR_NO_PARENT;
+    }
+    if (strlen(slash + 1) >= MAX_FILENAME) {
+        return FS_ERR_BAD_NAME;
+    }
+    strcpy(name, slash + 1);
+    if (name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        return FS_ERR_BAD_NAME;
+    }
+    if (slash == parent_path) {
+        slash[1] = '\0'; // parent is the root
+    } else {
+        slash[0] = '\0';
+    }
+
+    int parent = find_file(parent_path);
+    if (parent == -1 || !file_system[parent].is_directory) {
+        return FS_ERR_NO_PARENT;
+    }
+    return parent;
+}
+
+static int compact_names();
+
+// name_pool_intern(), compacting the pool once if it is full
+static uint32 intern_name(const char* name) {
+    uint32 name_id = name_pool_intern(name);
+    if (name_id == NAME_POOL_NONE && compact_names() == 0) {
+        name_id = name_pool_intern(name);
+    }
+    return name_id;
+}
+
+// Add an entry for full_path, returns its index or FS_ERR_*.
+// The caller commits the change.
+int create_file(const char* full_path, uint8 is_directory, uint16 permissions) {
+    char name[MAX_FILENAME];
+    int parent = split_path(full_path, name);
+    if (parent < 0) {
+        return parent;
+    }
+    if (file_count >= MAX_FILES) {
+        return FS_ERR_FULL;
+    }
+    if (find_child(parent, name) != -1) {
+        return FS_ERR_EXISTS;
+    }
+    if (journal_reserve(1) != 0) {
+        return FS_ERR_JOURNAL;
+    }
+    uint32 name_id = intern_name(name);
+    if (name_id == NAME_POOL_NONE) {
+        return FS_ERR_FULL;
+    }
+
+    int index = file_count;
+    FileEntry* entry = &file_system[index];
+    memset(entry, 0, sizeof(FileEntry));
+    file_keys[index].parent_id = parent;
+    file_keys[index].name = name_id;
+    entry->is_directory = is_directory;
+    entry->permissions = permissions;
+    entry->flags = is_directory ? 0 : fs_compress_default;
+    file_count++;
+    mark_file_dirty(index);
+    return index;
+}
+
+// Move an entry to new_path, which must not exist. Only the entry
+// itself changes: children refer to it by index. The caller makes sure
+// a directory does not move below itself and commits the change.
+int rename_file(int index, const char* new_path) {
+    if (index <= FS_ROOT_INDEX || index >= file_count) {
+        return -1;
+    }
+    char name[MAX_FILENAME];
+    int parent = split_path(new_path, name);
+    if (parent < 0) {
+        return parent;
+    }
+    if (find_child(parent, name) != -1) {
+        return FS_ERR_EXISTS;
+    }
+    if (journal_reserve(1) != 0) {
+        return FS_ERR_JOURNAL;
+    }
+    uint32 name_id = intern_name(name);
+    if (name_id == NAME_POOL_NONE) {
+        return FS_ERR_FULL;
+    }
+    name_pool_release(file_keys[index].name);
+    file_keys[index].name = name_id;
+    file_keys[index].parent_id = parent;
+    mark_file_dirty(index);
+    return 0;
+}
+
+// Remove an entry, keeping the table dense: the last entry moves into
+// the hole and its children are pointed at the new index.
+// The caller commits the change.
+int remove_file(int index) {
+    if (index <= FS_ROOT_INDEX || index >= file_count) {
+        return -1;
+    }
+    if (file_system[index].is_directory) {
+        for (int i = 0; i < file_count; i++) {
+            if (file_keys[i].parent_id == (uint32)index && i != index) {
+                return FS_ERR_NOT_EMPTY;
+            }
+        }
+    }
+
+    // The moved entry, its children and the vacated slot go to the
+    // journal as one transaction; the children as a single record, there
+    // may be more of them than a transaction holds
+    int last = file_count - 1;
+    if (journal_reserve(index != last ? 3 : 1) != 0) {
+        return FS_ERR_JOURNAL;
+    }
+
+    release_file_content(index);
+    name_pool_release(file_keys[index].name);
+    file_count--;
+    if (index != last) {
+        file_keys[index] = file_keys[last];
+        file_system[index] = file_system[last];
+        trigram_copy(last, index);
+        mark_file_dirty(index);
+        if (file_system[index].is_directory) {
+            for (int i = 0; i < file_count; i++) {
+                if (file_keys[i].parent_id == (uint32)last) {
+                    file_keys[i].parent_id = index;
+                    mark_table_dirty(i);
+                }
+            }
+            journal_log_parent(last, index);
+        }
+    }
+    // Clear the vacated slot so that only the touched sectors are rewritten
+    memset(&file_keys[last], 0, sizeof(FileKey));
+    memset(&file_system[last], 0, sizeof(FileEntry));
+    mark_file_dirty(last);
+    return 0;
+}
+
 void get_full_path(const char* name, char* full_path) {
     if (name[0] == '/') {
         strcpy(full_path, name);
@@ -56,27 +488,678 @@ void get_full_path(const char* name, char* full_path) {
     }
 }
 
+void mark_table_dirty(int index) {
+    if (index < 0 || index >= MAX_FILES) {
+        return;
+    }
+    // An entry may straddle a sector boundary, so mark every sector it touches
+    mark_sectors_dirty((index * sizeof(FileKey)) / ATA_SECTOR_SIZE,
+                       ((index + 1) * sizeof(FileKey) - 1) / ATA_SECTOR_SIZE);
+    mark_sectors_dirty(FS_META_TABLE + (index * sizeof(FileEntry)) / ATA_SECTOR_SIZE,
+                       FS_META_TABLE + ((index + 1) * sizeof(FileEntry) - 1) / ATA_SECTOR_SIZE);
+}
+
+void mark_pool_dirty(uint32 offset, uint32 len) {
+    if (len == 0 || offset + len > FS_NAME_POOL_BYTES) {
+        return;
+    }
+    mark_sectors_dirty(FS_META_POOL + offset / ATA_SECTOR_SIZE,
+                       FS_META_POOL + (offset + len - 1) / ATA_SECTOR_SIZE);
+}
+
+void mark_file_dirty(int index) {
+    if (index < 0 || index >= MAX_FILES) {
+        return;
+    }
+    mark_table_dirty(index);
+
+    if (file_keys[index].name == NAME_POOL_NONE) {
+        journal_log_clear(index);
+    } else {
+        journal_log_entry(index);
+    }
+}
+
+// Read the slot of entry into out: only the sectors the contents occupy,
+// and for an LZ4 slot the block is inflated after the first sector tells
+// how long it is
+static int read_data_slot(FileEntry* entry, char* out) {
+    uint32 lba = data_slot_lba(entry->data_slot);
+    uint32 raw_sectors = sectors_for(entry->size);
+
+    if (!(entry->flags & FS_FLAG_LZ4)) {
+        if (fs_disk_read(lba, raw_sectors, out) != 0) {
+            return -1;
+        }
+        fs_data_stats.sectors_read += raw_sectors;
+        fs_data_stats.raw_sectors_read += raw_sectors;
+        return 0;
+    }
+
+    if (fs_disk_read(lba, 1, packed_buf) != 0) {
+        return -1;
+    }
+    uint32 packed = packed_buf[0] | (packed_buf[1] << 8);
+    uint32 sectors = sectors_for(packed + 2);
+    if (sectors > FS_DATA_SECTORS) {
+        return -1;
+    }
+    if (sectors > 1 && fs_disk_read(lba + 1, sectors - 1, packed_buf + ATA_SECTOR_SIZE) != 0) {
+        return -1;
+    }
+    fs_data_stats.sectors_read += sectors;
+    fs_data_stats.raw_sectors_read += raw_sectors;
+
+    uint32 started = tsc_kcycles();
+    int size = lz4_decompress(packed_buf + 2, packed, (uint8*)out, MAX_FILE_SIZE);
+    fs_data_stats.decompress_cycles += tsc_kcycles() - started;
+    return size == (int)entry->size ? 0 : -1;
+}
+
+// Contents of file_system[index], read from disk on first access.
+// Returns NULL for directories, empty files and read errors.
+const char* read_file_content(int index) {
+    if (index < 0 || index >= file_count) {
+        return NULL;
+    }
+    return read_entry_content(&file_system[index]);
+}
+
+// Contents of an entry of the table or of a snapshot
+const char* read_entry_content(FileEntry* entry) {
+    uint32 slot = entry->data_slot;
+    if (slot == 0 && entry->size > 0 && !entry->is_directory && entry->size <= MAX_FILE_SIZE) {
+        return zero_content;
+    }
+    if (slot == 0 || slot > FS_DATA_SLOTS || entry->size > MAX_FILE_SIZE) {
+        return NULL;
+    }
+
+    int hit;
+    ContentCache* cached = cache_lookup(slot, &hit);
+    if (!hit) {
+        uint32 started = tsc_kcycles();
+        if (read_data_slot(entry, cached->data) != 0) {
+            console_putstr("[FS] Ошибка чтения содержимого файла!\n");
+            return NULL;
+        }
+        if (crc32c(0, cached->data, entry->size) != entry->data_crc) {
+            console_putstr("[FS] Ошибка контрольной суммы содержимого файла!\n");
+            fs_crc_errors++;
+            return NULL;
+        }
+        fs_data_stats.read_cycles += tsc_kcycles() - started;
+        fs_data_stats.bytes_read += entry->size;
+        cached->slot = slot;
+    }
+    return cached->data;
+}
+
+// Write size bytes of data to slot, as an LZ4 block if entry asks for
+// compression and that saves at least one sector. Sets FS_FLAG_LZ4
+// accordingly. Incompressible data is caught by the compressor giving up
+// once the output reaches the raw size less a sector. data is padded with
+// zeros to whole sectors.
+static int write_data_slot(FileEntry* entry, uint32 slot, const char* data, uint32 size) {
+    uint32 raw_sectors = sectors_for(size);
+    uint32 sectors = raw_sectors;
+    const void* buffer = data;
+
+    entry->flags &= ~FS_FLAG_LZ4;
+    if ((entry->flags & FS_FLAG_COMPRESS) && raw_sectors > 1) {
+        uint32 started = tsc_kcycles();
+        uint32 packed = lz4_compress((const uint8*)data, size, packed_buf + 2,
+                                     (raw_sectors - 1) * ATA_SECTOR_SIZE - 2);
+        fs_data_stats.compress_cycles += tsc_kcycles() - started;
+        if (packed != 0) {
+            packed_buf[0] = packed & 0xFF;
+            packed_buf[1] = packed >> 8;
+            sectors = sectors_for(packed + 2);
+            memset(packed_buf + 2 + packed, 0, sectors * ATA_SECTOR_SIZE - packed - 2);
+            buffer = packed_buf;
+            entry->flags |= FS_FLAG_LZ4;
+            fs_data_stats.blocks_compressed++;
+        } else {
+            fs_data_stats.blocks_bypassed++;
+        }
+    }
+    if (fs_disk_write(data_slot_lba(slot), sectors, buffer) != 0) {
+        return -1;
+    }
+    fs_data_stats.sectors_written += sectors;
+    fs_data_stats.raw_sectors_written += raw_sectors;
+    return 0;
+}
+
+// Replace the contents of file_system[index]. The data goes to a fresh
+// slot before the entry is logged, so a crash leaves either the old or
+// the new contents. Contents that are all zeros take no slot.
+// The caller commits the metadata change.
+int write_file_content(int index, const char* data, uint32 size) {
+    if (index < 0 || index >= file_count || size > MAX_FILE_SIZE) {
+        return -1;
+    }
+    FileEntry* entry = &file_system[index];
+    uint32 old_slot = entry->data_slot;
+    uint32 slot = 0;
+    if (journal_reserve(1) != 0) {
+        return -1;
+    }
+
+    if (size > 0 && !mem_is_zero(data, size)) {
+        uint32 started = tsc_kcycles();
+        slot = alloc_data_slot();
+        if (slot == 0) {
+            return -1;
+        }
+        // The cache keeps the plain contents whatever goes to disk
+        int hit;
+        ContentCache* cached = cache_lookup(slot, &hit);
+        memset(cached->data, 0, sizeof(cached->data));
+        memcpy(cached->data, data, size);
+        uint8 flags = entry->flags;
+        if (write_data_slot(entry, slot, cached->data, size) != 0) {
+            entry->flags = flags;
+            free_data_slot(slot);
+            return -1;
+        }
+        cached->slot = slot;
+        fs_data_stats.write_cycles += tsc_kcycles() - started;
+        fs_data_stats.bytes_written += size;
+    } else {
+        entry->flags &= ~FS_FLAG_LZ4;
+    }
+
+    free_data_slot(old_slot);
+    entry->data_slot = slot;
+    entry->size = size;
+    entry->data_crc = crc32c(0, data, size);
+    trigram_update(index, data, size);
+    mark_file_dirty(index);
+    return 0;
+}
+
+// Turn compression of one file on or off and store its contents again
+// the new way. The caller commits the change.
+int set_file_compression(int index, uint8 enable) {
+    if (index < 0 || index >= file_count || file_system[index].is_directory) {
+        return -1;
+    }
+    if (journal_reserve(1) != 0) {
+        return -1;
+    }
+    FileEntry* entry = &file_system[index];
+    if (enable) {
+        entry->flags |= FS_FLAG_COMPRESS;
+    } else {
+        entry->flags &= ~FS_FLAG_COMPRESS;
+    }
+    if (entry->size == 0) {
+        mark_file_dirty(index);
+        return 0;
+    }
+    const char* content = read_file_content(index);
+    if (content == NULL) {
+        return -1;
+    }
+    // write_file_content() may reuse the cache entry content points into
+    memcpy(plain_buf, content, entry->size);
+    return write_file_content(index, plain_buf, entry->size);
+}
+
+// Give file_system[to] the contents of file_system[from] by pointing it
+// at the same data slot. Slots are never rewritten in place, so the two
+// part ways on the next write to either. The caller commits the change.
+int share_file_content(int from, int to) {
+    if (from < 0 || from >= file_count || to < 0 || to >= file_count || from == to) {
+        return -1;
+    }
+    FileEntry* source = &file_system[from];
+    FileEntry* entry = &file_system[to];
+    if (source->is_directory || entry->is_directory) {
+        return -1;
+    }
+    uint32 slot = source->data_slot;
+    if (slot > FS_DATA_SLOTS || (slot != 0 && slot_refs[slot - 1] == 0xFFFF)) {
+        return -1;
+    }
+    if (journal_reserve(1) != 0) {
+        return -1;
+    }
+    if (slot != 0) {
+        slot_refs[slot - 1]++;
+    }
+    free_data_slot(entry->data_slot);
+    entry->data_slot = slot;
+    entry->size = source->size;
+    entry->data_crc = source->data_crc;
+    entry->flags = source->flags; // FS_FLAG_LZ4 describes the slot
+    trigram_copy(from, to);
+    mark_file_dirty(to);
+    return 0;
+}
+
+// Free the data slot of an entry that is about to be removed
+void release_file_content(int index) {
+    if (index < 0 || index >= file_count) {
+        return;
+    }
+    free_data_slot(file_system[index].data_slot);
+    file_system[index].data_slot = 0;
+}
+
+// End of a change. It is written to the journal now, or with
+// fs_deferred_commit set by the flusher together with the changes that
+// follow it, as one transaction.
+void commit_file_system() {
+    if (!fs_deferred_commit) {
+        flush_file_system();
+    }
+}
+
+// Write the changes logged so far to the journal, 0 on success
+int flush_file_system() {
+    if (journal_commit() != 0 || journal_pending_records() != 0) {
+        return -1; // a checkpoint that failed keeps the records pending
+    }
+    release_freed_slots();
+    return 0;
+}
+
+// Transfer sectors [start, start + count) of a region of bytes in memory
+// that is stored from lba on. The last sector is only partly backed by
+// the array, so it goes through sector_buf instead of overrunning it.
+static int transfer_region(uint8 direction, uint8* base, uint32 bytes, uint32 lba,
+                           uint32 start, uint32 count) {
+    uint32 tail = (bytes - 1) / ATA_SECTOR_SIZE;
+    uint32 tail_bytes = bytes - tail * ATA_SECTOR_SIZE;
+    int res;
+
+    if (start + count > tail && tail_bytes < ATA_SECTOR_SIZE) {
+        if (count > 1 && (res = transfer_region(direction, base, bytes, lba, start, count - 1)) != 0) {
+            return res;
+        }
+        if (direction == ATA_WRITE) {
+            memset(sector_buf, 0, ATA_SECTOR_SIZE);
+            memcpy(sector_buf, base + tail * ATA_SECTOR_SIZE, tail_bytes);
+            return fs_disk_write(lba + tail, 1, sector_buf);
+        }
+        res = fs_disk_read(lba + tail, 1, sector_buf);
+        if (res == 0) {
+            memcpy(base + tail * ATA_SECTOR_SIZE, sector_buf, tail_bytes);
+        }
+        return res;
+    }
+
+    uint8* buffer = base + start * ATA_SECTOR_SIZE;
+    if (direction == ATA_WRITE) {
+        return fs_disk_write(lba + start, count, buffer);
+    }
+    return fs_disk_read(lba + start, count, buffer);
+}
+
+// Where metadata sectors live in memory and on disk
+typedef struct {
+    uint8* base;
+    uint32 bytes;
+    uint32 lba;
+    uint32 first; // metadata sector of the region
+    uint32 end;   // metadata sector past the region
+} MetaRegion;
+
+static void get_meta_regions(MetaRegion* regions) {
+    MetaRegion r[3] = {
+        {(uint8*)file_keys, FS_KEYS_BYTES, FS_KEYS_START, 0, FS_META_TABLE},
+        {(uint8*)file_system, FS_TABLE_BYTES, FS_TABLE_START, FS_META_TABLE, FS_META_POOL},
+        {name_pool_data(), FS_NAME_POOL_BYTES, FS_POOL_START, FS_META_POOL, FS_META_SECTORS},
+    };
+    memcpy(regions, r, sizeof(r));
+}
+
+// Transfer metadata sectors [start, start + count), keys, entries and
+// pool, with metadata sector 0 at lba
+static int transfer_meta(uint8 direction, uint32 lba, uint32 start, uint32 count) {
+    MetaRegion regions[3];
+    get_meta_regions(regions);
+
+    for (int i = 0; i < 3 && count > 0; i++) {
+        MetaRegion* r = &regions[i];
+        if (start >= r->end) {
+            continue;
+        }
+        uint32 n = start + count > r->end ? r->end - start : count;
+        int res = transfer_region(direction, r->base, r->bytes, lba + r->first, start - r->first, n);
+        if (res != 0) {
+            return res;
+        }
+        start += n;
+        count -= n;
+    }
+    return 0;
+}
+
+static int transfer_sectors(uint8 direction, uint32 start, uint32 count) {
+    return transfer_meta(direction, FS_KEYS_START, start, count);
+}
+
+// Metadata sectors holding the keys in use and the used part of the pool
+static uint32 key_sectors_used() {
+    return (file_count * sizeof(FileKey) + ATA_SECTOR_SIZE - 1) / ATA_SECTOR_SIZE;
+}
+
+static uint32 pool_sectors_used(uint32 pool_used) {
+    return (pool_used + ATA_SECTOR_SIZE - 1) / ATA_SECTOR_SIZE;
+}
+
+// Compacting the pool renumbers the name of every entry, which the
+// journal does not record entry by entry, and a checkpoint cut short
+// would leave keys and pool from different layouts. So the new keys and
+// pool go to the area of a free snapshot first, a journal record points
+// replay at that copy, and only then the checkpoint writes them in place.
+// -1 if the record was not logged; once it is, a checkpoint that fails
+// is retried later like any other.
+static int write_name_copy() {
+    uint32 lba = snapshot_scratch_lba();
+    if (lba == 0) {
+        return -1;
+    }
+    uint32 pool_used = name_pool_used();
+    if (transfer_meta(ATA_WRITE, lba, 0, key_sectors_used()) != 0 ||
+        transfer_meta(ATA_WRITE, lba, FS_META_POOL, pool_sectors_used(pool_used)) != 0) {
+        return -1;
+    }
+    // The checkpoint before compacting left the journal empty; after
+    // replay it may be too full to log the copy instead of checkpointing
+    if (journal_used() + JOURNAL_TXN_MAX_SECTORS >= JOURNAL_SECTORS) {
+        return -1;
+    }
+    journal_log_names(lba, pool_used);
+    if (journal_commit() != 0 || journal_pending_records() != 0) {
+        return -1;
+    }
+    if (checkpoint_file_system() < 0) {
+        console_putstr("[FS] Ошибка сохранения файловой системы!\n");
+    }
+    return 0;
+}
+
+// Undo name_pool_compact() when its copy could not be logged. The
+// checkpoint before it left the keys and the pool of pool_used bytes on
+// disk as they were, and no checkpoint may write the new ones in place.
+static int reload_names(uint32 pool_used) {
+    if (transfer_sectors(ATA_READ, 0, key_sectors_used()) != 0 ||
+        transfer_sectors(ATA_READ, FS_META_POOL, pool_sectors_used(pool_used)) != 0) {
+        return -1;
+    }
+    name_pool_rebuild(pool_used);
+    return 0;
+}
+
+int load_name_copy(uint32 lba, uint32 pool_used) {
+    if (lba < SNAPSHOT_START || lba + FS_META_SECTORS > SNAPSHOT_END || pool_used > FS_NAME_POOL_BYTES) {
+        return -1;
+    }
+    uint32 keys = key_sectors_used();
+    uint32 pool = pool_sectors_used(pool_used);
+    if (transfer_meta(ATA_READ, lba, 0, keys) != 0 || transfer_meta(ATA_READ, lba, FS_META_POOL, pool) != 0) {
+        return -1;
+    }
+    name_pool_rebuild(pool_used);
+    if (keys > 0) {
+        mark_sectors_dirty(0, keys - 1);
+    }
+    if (pool > 0) {
+        mark_sectors_dirty(FS_META_POOL, FS_META_POOL + pool - 1);
+    }
+    return 0;
+}
+
+// Make room in a full pool, see write_name_copy(). 0 if it freed some.
+static int compact_names() {
+    if (snapshot_scratch_lba() == 0) {
+        console_putstr("[FS] Пул имён заполнен, а для уплотнения нужен свободный снимок.\n");
+        return -1;
+    }
+    // Disk and memory agree from here, the copy is all replay needs
+    if (checkpoint_file_system() < 0) {
+        return -1;
+    }
+    uint32 pool_used = name_pool_used();
+    if (name_pool_compact() == 0) {
+        return -1;
+    }
+    if (write_name_copy() != 0) {
+        console_putstr("[FS] Ошибка записи уплотнённого пула имён!\n");
+        if (reload_names(pool_used) != 0) {
+            console_putstr("[FS] Не удалось вернуть пул имён с диска!\n");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// CRC of a metadata block as it is on disk: the sectors from memory, the
+// part of a last sector past the end of its array as zeros
+static uint32 block_checksum(uint32 block) {
+    MetaRegion regions[3];
+    get_meta_regions(regions);
+    uint32 crc = 0;
+    uint32 m = block * FS_CRC_BLOCK_SECTORS;
+    uint32 last = m + FS_CRC_BLOCK_SECTORS < FS_META_SECTORS ? m + FS_CRC_BLOCK_SECTORS : FS_META_SECTORS;
+
+    for (int i = 0; i < 3 && m < last; i++) {
+        MetaRegion* r = &regions[i];
+        for (; m < last && m < r->end; m++) {
+            uint32 offset = (m - r->first) * ATA_SECTOR_SIZE;
+            uint32 n = r->bytes - offset < ATA_SECTOR_SIZE ? r->bytes - offset : ATA_SECTOR_SIZE;
+            crc = crc32c(crc, r->base + offset, n);
+            if (n < ATA_SECTOR_SIZE) {
+                crc = crc32c(crc, zero_sector, ATA_SECTOR_SIZE - n);
+            }
+        }
+    }
+    return crc;
+}
+
+int fs_check_header(const FsHeader* header) {
+    if (header->magic != FS_MAGIC) {
+        return FS_HEADER_NONE;
+    }
+    if (header->version < FS_VERSION_OLDEST || header->version > FS_VERSION) {
+        return FS_HEADER_VERSION;
+    }
+    if (crc32c(0, header, offsetof(FsHeader, crc)) != header->crc || header->file_count == 0 ||
+        header->file_count > MAX_FILES || header->pool_used > FS_NAME_POOL_BYTES) {
+        return FS_HEADER_CORRUPT;
+    }
+    return 0;
+}
+
+static int write_header() {
+    FsHeader* header = (FsHeader*)sector_buf;
+    memset(sector_buf, 0, ATA_SECTOR_SIZE);
+    header->magic = FS_MAGIC;
+    header->version = FS_VERSION;
+    header->file_count = file_count;
+    header->journal_head = journal_head();
+    header->journal_seq = journal_seq();
+    header->pool_used = name_pool_used();
+    memcpy(header->block_crc, block_crc, sizeof(block_crc));
+    header->crc = crc32c(0, header, offsetof(FsHeader, crc));
+    return fs_disk_write(FS_START_SECTOR, 1, sector_buf);
+}
+
+// Checkpoint: write back only the dirty blocks, one request per
+// contiguous run, then move the journal start past everything logged.
+// The CRCs of the blocks written are recomputed from memory. Returns
+// the sectors written, -1 on errors.
+int checkpoint_file_system() {
+    uint32 written = 0;
+    int failed = 0;
+    uint32 b = 0;
+
+    while (b < FS_META_BLOCKS) {
+        if (!block_is_dirty(b)) {
+            b++;
+            continue;
+        }
+        uint32 first = b;
+        while (b < FS_META_BLOCKS && block_is_dirty(b)) {
+            b++;
+        }
+        uint32 start = first * FS_CRC_BLOCK_SECTORS;
+        uint32 end = b * FS_CRC_BLOCK_SECTORS < FS_META_SECTORS ? b * FS_CRC_BLOCK_SECTORS : FS_META_SECTORS;
+        if (snapshot_preserve(first, b) != 0 || transfer_sectors(ATA_WRITE, start, end - start) != 0) {
+            failed = 1; // keep the run dirty so the next save retries it
+            continue;
+        }
+        for (uint32 i = first; i < b; i++) {
+            dirty_blocks[i / 32] &= ~(1u << (i % 32));
+            block_crc[i] = block_checksum(i);
+        }
+        written += end - start;
+    }
+
+    // The index is not covered by the header, a record that misses this
+    // checkpoint is ignored after a reload
+    trigram_save();
+    if (failed || write_header() != 0) {
+        return -1;
+    }
+    journal_checkpointed();
+    release_freed_slots();
+    return written;
+}
+
 void save_file_system() {
-    int res = ide_write_sectors(FS_DISK_DRIVE, FS_SECTOR_COUNT, FS_START_SECTOR, (uint32)file_system);
-    if (res != 0) {
+    int written = checkpoint_file_system();
+    if (written < 0) {
         console_putstr("[FS] Ошибка сохранения файловой системы!\n");
-    } else {
-        console_putstr("[FS] Файловая система сохранена.\n");
+    } else if (written > 0) {
+        console_printf("[FS] Файловая система сохранена (%d сект.).\n", written);
     }
 }
 
+// Read the whole blocks covering metadata sectors [start, start + count)
+// and check them against the header. Blocks below *checked were handled
+// with the previous region. Returns the number of bad blocks, -1 on I/O
+// errors; a bad block is rewritten with a fresh CRC at the next checkpoint.
+static int load_blocks(uint32 start, uint32 count, uint32* checked, uint32* sectors_read) {
+    if (count == 0) {
+        return 0;
+    }
+    uint32 first = start / FS_CRC_BLOCK_SECTORS;
+    uint32 last = (start + count - 1) / FS_CRC_BLOCK_SECTORS;
+    if (first < *checked) {
+        first = *checked;
+    }
+    if (first > last) {
+        return 0;
+    }
+    uint32 from = first * FS_CRC_BLOCK_SECTORS;
+    uint32 to = (last + 1) * FS_CRC_BLOCK_SECTORS;
+    if (to > FS_META_SECTORS) {
+        to = FS_META_SECTORS;
+    }
+    if (transfer_sectors(ATA_READ, from, to - from) != 0) {
+        return -1;
+    }
+    *sectors_read += to - from;
+    *checked = last + 1;
+
+    int bad = 0;
+    for (uint32 b = first; b <= last; b++) {
+        if (block_checksum(b) != block_crc[b]) {
+            dirty_blocks[b / 32] |= 1u << (b % 32);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// Boot-time load: only the header and the blocks of the table in use are
+// read and checksummed, file contents stay on disk until
+// read_file_content() asks for them
 void load_file_system() {
-    int res = ide_read_sectors(FS_DISK_DRIVE, FS_SECTOR_COUNT, FS_START_SECTOR, (uint32)file_system);
+    uint32 started = tsc_kcycles();
+    FsHeader* header = (FsHeader*)sector_buf;
+    int res = fs_disk_read(FS_START_SECTOR, 1, sector_buf);
+    res = res != 0 ? FS_HEADER_NONE : fs_check_header(header);
     if (res != 0) {
+        if (res == FS_HEADER_VERSION) {
+            console_printf("[FS] Неподдерживаемая версия ФС: %d! Используется новая ФС.\n", header->version);
+        } else if (res == FS_HEADER_CORRUPT) {
+            console_putstr("[FS] Заголовок ФС повреждён! Используется новая ФС.\n");
+        } else {
+            console_putstr("[FS] Файловая система не найдена! Используется новая ФС.\n");
+        }
+        init_file_system();
+        return;
+    }
+    file_count = header->file_count;
+    uint32 replay_head = header->journal_head;
+    uint32 replay_seq = header->journal_seq;
+    uint32 pool_used = header->pool_used;
+    memcpy(block_crc, header->block_crc, sizeof(block_crc));
+    trigram_reset();
+
+    // Entries past file_count are never looked at, blocks holding none stay unread
+    uint32 key_sectors = (file_count * sizeof(FileKey) + ATA_SECTOR_SIZE - 1) / ATA_SECTOR_SIZE;
+    uint32 table_sectors = (file_count * sizeof(FileEntry) + ATA_SECTOR_SIZE - 1) / ATA_SECTOR_SIZE;
+    uint32 pool_sectors = (pool_used + ATA_SECTOR_SIZE - 1) / ATA_SECTOR_SIZE;
+    uint32 checked = 0;
+    uint32 sectors_read = 1;
+    int bad_keys, bad_table = 0, bad_pool = 0;
+    memset(dirty_blocks, 0, sizeof(dirty_blocks));
+    bad_keys = load_blocks(0, key_sectors, &checked, &sectors_read);
+    if (bad_keys >= 0) {
+        bad_table = load_blocks(FS_META_TABLE, table_sectors, &checked, &sectors_read);
+    }
+    if (bad_keys >= 0 && bad_table >= 0) {
+        bad_pool = load_blocks(FS_META_POOL, pool_sectors, &checked, &sectors_read);
+    }
+    if (bad_keys < 0 || bad_table < 0 || bad_pool < 0) {
         console_putstr("[FS] Ошибка загрузки файловой системы! Используется новая ФС.\n");
         init_file_system();
-    } else {
-        console_putstr("[FS] Файловая система загружена.\n");
+        return;
+    }
+    // The last sectors may carry stale entries past file_count
+    uint32 loaded = key_sectors * ATA_SECTOR_SIZE;
+    if (loaded > FS_KEYS_BYTES) {
+        loaded = FS_KEYS_BYTES;
+    }
+    memset(&file_keys[file_count], 0, loaded - file_count * sizeof(FileKey));
+    loaded = table_sectors * ATA_SECTOR_SIZE;
+    if (loaded > FS_TABLE_BYTES) {
+        loaded = FS_TABLE_BYTES;
+    }
+    memset(&file_system[file_count], 0, loaded - file_count * sizeof(FileEntry));
+    name_pool_rebuild(pool_used);
+
+    // A checkpoint cut short leaves blocks newer than the header; the
+    // journal below replays what they should hold
+    if (bad_keys + bad_table + bad_pool > 0) {
+        fs_crc_errors += bad_keys + bad_table + bad_pool;
+        console_printf("[FS] Контрольная сумма не сошлась: блоков ключей %d, записей %d, имён %d.\n",
+                       bad_keys, bad_table, bad_pool);
+    }
+
+    // Bring the table up to date with transactions committed after the last checkpoint
+    int replayed = journal_replay(replay_head, replay_seq);
+    if (replayed > 0) {
+        console_printf("[FS] Восстановлено транзакций из журнала: %d\n", replayed);
+    }
+    snapshot_load();
+    rebuild_used_slots();
+    if (journal_replay_compacted() && write_name_copy() != 0) {
+        console_putstr("[FS] Ошибка записи уплотнённого пула имён!\n");
     }
+    console_printf("[FS] Файловая система загружена: %d файлов, %d сект., %u K тактов.\n",
+                   file_count, sectors_read, tsc_kcycles() - started);
 }
 
 void file_system_startup() {
     load_file_system();
 }
 
-// После операций создания/удаления файлов также вызывать save_file_system()
+// После операций создания/удаления файлов вызывать mark_file_dirty(), а затем commit_file_system()
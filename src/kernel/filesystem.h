@@ -2,35 +2,172 @@
 #define FILESYSTEM_H
 
 #include "types.h" // Assuming types.h is needed for uint32, uint8
+#include "fs/vfs.h"
 
 // File system structures
-#define MAX_FILES 100
+#define MAX_FILES 10000
 #define MAX_FILENAME 32
 #define MAX_FILE_SIZE 1024
 #define MAX_PATH_LENGTH 256
 #define HOME_DIR "/home"
 
+// On-disk layout: header sector, keys, entries, name pool, metadata journal, file data,
+// trigram index (trigram.h), snapshots (snapshot.h)
+#define FS_DISK_DRIVE 0 // Используем первый диск
+#define FS_START_SECTOR 10 // С какого сектора сохранять файловую систему
+#define FS_KEYS_BYTES (sizeof(FileKey) * MAX_FILES)
+#define FS_KEY_SECTORS ((FS_KEYS_BYTES + 511) / 512)
+#define FS_KEYS_START (FS_START_SECTOR + 1)
+#define FS_TABLE_BYTES (sizeof(FileEntry) * MAX_FILES)
+#define FS_SECTOR_COUNT ((FS_TABLE_BYTES + 511) / 512)
+#define FS_TABLE_START (FS_KEYS_START + FS_KEY_SECTORS)
+#define FS_NAME_POOL_BYTES (MAX_FILES * 16) // имена в среднем заметно короче
+#define FS_POOL_SECTORS ((FS_NAME_POOL_BYTES + 511) / 512)
+#define FS_POOL_START (FS_TABLE_START + FS_SECTOR_COUNT)
+#define FS_JOURNAL_START (FS_POOL_START + FS_POOL_SECTORS)
+// After the journal: file contents, one fixed slot of FS_DATA_SECTORS per file
+#define FS_DATA_SECTORS ((MAX_FILE_SIZE + 511) / 512)
+#define FS_DATA_SLOTS (MAX_FILES + 1) // +1: перезапись пишет в новый слот до освобождения старого
+
+#define FS_ROOT_INDEX 0 // "/" - its own parent
+
+// Only metadata lives in the table, contents are fetched on first access.
+// Paths are not stored: an entry names its parent directory and its own
+// interned name, full paths are rebuilt with get_file_path().
+//
+// An entry is split in two arrays indexed alike. Lookups and directory
+// scans compare only the key, so they walk the dense file_keys[] (8 bytes
+// per entry, the whole table is 80 KB) and touch file_system[] on a match.
+typedef struct {
+    uint32 parent_id;    // индекс родительской директории
+    uint32 name;         // смещение имени в пуле строк (namepool.h)
+} FileKey;
+
 typedef struct {
-    char name[MAX_FILENAME];
-    char content[MAX_FILE_SIZE];
     uint32 size;
+    uint32 data_slot;    // слот содержимого, 0 - нет данных или одни нули; копии делят слот
+    uint32 data_crc;     // CRC32C of the contents, checked on every read from disk
+    uint16 permissions;  // Unix-like permissions
     uint8 is_directory;
-    char path[MAX_PATH_LENGTH];
-    uint32 permissions;  // Unix-like permissions
+    uint8 flags;         // FS_FLAG_*
 } FileEntry;
 
+// Keys, entries and name pool are adjacent on disk and checkpointed
+// together; metadata sector m is at FS_KEYS_START + m
+#define FS_META_SECTORS (FS_KEY_SECTORS + FS_SECTOR_COUNT + FS_POOL_SECTORS)
+#define FS_META_TABLE FS_KEY_SECTORS                      // first sector of the entries
+#define FS_META_POOL (FS_KEY_SECTORS + FS_SECTOR_COUNT)   // first sector of the pool
+// Metadata is checksummed in blocks of 8 sectors, the CRCs live in the header
+#define FS_CRC_BLOCK_SECTORS 8
+#define FS_META_BLOCKS ((FS_META_SECTORS + FS_CRC_BLOCK_SECTORS - 1) / FS_CRC_BLOCK_SECTORS)
+
+#define FS_MAGIC 0x53464E49 // "INFS"
+#define FS_VERSION 5        // 1-3 were "INF1".."INF3" without checksums
+#define FS_VERSION_OLDEST 4 // still loaded: 4 is 5 without shared or omitted data slots
+
+// Header sector at FS_START_SECTOR, rewritten at every checkpoint. It is
+// the last write of a checkpoint, so its block CRCs describe the table
+// that checkpoint left on disk. Must fit one sector.
+typedef struct {
+    uint32 magic;
+    uint32 version;
+    uint32 file_count;
+    uint32 journal_head; // where journal replay starts
+    uint32 journal_seq;  // sequence number expected there
+    uint32 pool_used;    // bytes of the name pool in use
+    uint32 block_crc[FS_META_BLOCKS]; // CRC32C of each metadata block
+    uint32 crc;          // CRC32C of the header up to this field
+} FsHeader;
+
+// FileEntry.flags
+#define FS_FLAG_COMPRESS 0x01 // сжимать содержимое при записи
+#define FS_FLAG_LZ4      0x02 // слот хранит LZ4-блок: uint16 длина, затем блок
+
+// Data slot traffic since boot, for the "compress" command.
+// Cycles are in units of 1024 (tsc_kcycles()).
+typedef struct {
+    uint32 bytes_written;       // contents handed to write_file_content()
+    uint32 sectors_written;     // data sectors actually written
+    uint32 raw_sectors_written; // what they would have been uncompressed
+    uint32 blocks_compressed;
+    uint32 blocks_bypassed;     // compression tried but saved no sector
+    uint32 write_cycles;        // whole write path, compression and I/O
+    uint32 compress_cycles;
+    uint32 bytes_read;          // contents read from disk (cache misses)
+    uint32 sectors_read;
+    uint32 raw_sectors_read;
+    uint32 read_cycles;         // whole read path, I/O and decompression
+    uint32 decompress_cycles;
+} FsDataStats;
+
 // Global file system variables (declared in filesystem.c)
+extern FileKey file_keys[MAX_FILES];
 extern FileEntry file_system[MAX_FILES];
 extern int file_count;
 extern char current_dir[MAX_PATH_LENGTH];
 extern char home_dir[MAX_PATH_LENGTH];
+extern uint8 fs_compress_default; // FileEntry.flags новых файлов, задаётся при монтировании
+extern FsDataStats fs_data_stats;
+extern uint32 fs_crc_errors; // metadata blocks and contents that failed their CRC since boot
+// commit_file_system() leaves the change to flush_file_system(), called
+// by the flusher (flusher.h); off in the host tools
+extern uint8 fs_deferred_commit;
+
+// fs_check_header() results other than 0
+#define FS_HEADER_NONE -1    // no file system: wrong magic
+#define FS_HEADER_VERSION -2 // another version of the format
+#define FS_HEADER_CORRUPT -3 // bad CRC or counts out of range
+
+// Errors returned by create_file(), rename_file() and remove_file()
+#define FS_ERR_FULL -1
+#define FS_ERR_EXISTS -2
+#define FS_ERR_NO_PARENT -3
+#define FS_ERR_BAD_NAME -4
+#define FS_ERR_NOT_EMPTY -5
+#define FS_ERR_JOURNAL -6 // the change does not fit one journal transaction
 
 // File system functions
 void init_file_system();
 int find_file(const char* path);
+int find_child(int dir_index, const char* name);
 void get_full_path(const char* name, char* full_path);
+void get_file_path(int index, char* path);
+const char* get_file_name(int index);
+int create_file(const char* full_path, uint8 is_directory, uint16 permissions);
+int remove_file(int index);
+int rename_file(int index, const char* new_path);
+void mark_file_dirty(int index);
+void commit_file_system();
+int flush_file_system();
+const char* read_file_content(int index);
+const char* read_entry_content(FileEntry* entry);
+int write_file_content(int index, const char* data, uint32 size);
+void release_file_content(int index);
+int share_file_content(int from, int to);
+int set_file_compression(int index, uint8 enable);
+int fs_check_header(const FsHeader* header);
+int checkpoint_file_system();
 void save_file_system();
 void load_file_system();
 void file_system_startup();
 
+// VFS driver for the table, mounted at "/" (filesystem_vfs.c)
+extern VFS_DRIVER infs_driver;
+// Files whose writes the driver keeps back, and writing them out now
+uint32 open_files_dirty();
+int flush_open_files();
+
+// Dirty tracking without journaling, for namepool.c
+void mark_table_dirty(int index);
+void mark_pool_dirty(uint32 offset, uint32 len);
+
+// Replace the keys and the name pool with the copy written before a
+// compaction, from metadata sector 0 at lba on; for journal.c replay
+int load_name_copy(uint32 lba, uint32 pool_used);
+
+// Entries of the table referring to a data slot, and the slot going back
+// to the free pool once no snapshot refers to it either; for snapshot.c
+uint32 get_slot_refs(uint32 slot);
+int release_snapshot_slot(uint32 slot);
+
 #endif // FILESYSTEM_H
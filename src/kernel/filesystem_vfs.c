@@ -0,0 +1,368 @@
+#include "filesystem.h"
+#include "string.h"
+#include "ide.h" // ATA_SECTOR_SIZE
+#include "fs/vfs.h"
+#include "trigram.h"
+
+// VFS driver for the file table in filesystem.c. There is a single
+// table, so the mount state is just a token and nodes are table indices.
+
+// Writes go to a copy of the contents kept here. The file slot is
+// rewritten and the change committed once: when the file is closed, on
+// sync, or when the buffer is taken for another file.
+#define INFS_DIRTY_FILES 4
+
+typedef struct {
+    uint32 node;
+    uint32 size;
+    uint8 in_use;
+    char data[MAX_FILE_SIZE];
+} DirtyFile;
+
+static DirtyFile dirty_files[INFS_DIRTY_FILES];
+static int dirty_victim; // next buffer to take when all are in use
+
+static int vfs_error(int res) {
+    switch (res) {
+    case FS_ERR_FULL:      return VFS_ERR_NO_SPACE;
+    case FS_ERR_EXISTS:    return VFS_ERR_EXISTS;
+    case FS_ERR_NO_PARENT: return VFS_ERR_NOT_FOUND;
+    case FS_ERR_BAD_NAME:  return VFS_ERR_INVALID;
+    case FS_ERR_NOT_EMPTY: return VFS_ERR_NOT_EMPTY;
+    default:               return VFS_ERR_IO;
+    }
+}
+
+static DirtyFile* find_dirty(uint32 node) {
+    for (int i = 0; i < INFS_DIRTY_FILES; i++) {
+        if (dirty_files[i].in_use && dirty_files[i].node == node) {
+            return &dirty_files[i];
+        }
+    }
+    return NULL;
+}
+
+// Rewrite the file slot from the buffer and give the buffer up; the
+// caller commits. The change is lost if it does not fit.
+static int write_back(DirtyFile* dirty) {
+    dirty->in_use = 0;
+    if (write_file_content(dirty->node, dirty->data, dirty->size) != 0) {
+        return VFS_ERR_NO_SPACE;
+    }
+    return 0;
+}
+
+static int flush_node(uint32 node) {
+    DirtyFile* dirty = find_dirty(node);
+    if (dirty == NULL) {
+        return 0;
+    }
+    int res = write_back(dirty);
+    commit_file_system();
+    return res;
+}
+
+static int flush_all() {
+    int result = 0;
+    for (int i = 0; i < INFS_DIRTY_FILES; i++) {
+        if (dirty_files[i].in_use) {
+            int res = write_back(&dirty_files[i]);
+            if (res != 0) {
+                result = res;
+            }
+        }
+    }
+    commit_file_system();
+    return result;
+}
+
+// The buffer of node, filled with its contents if it had none
+static int get_dirty(uint32 node, DirtyFile** out) {
+    DirtyFile* dirty = find_dirty(node);
+    if (dirty == NULL) {
+        for (int i = 0; i < INFS_DIRTY_FILES && dirty == NULL; i++) {
+            if (!dirty_files[i].in_use) {
+                dirty = &dirty_files[i];
+            }
+        }
+        if (dirty == NULL) {
+            dirty = &dirty_files[dirty_victim];
+            dirty_victim = (dirty_victim + 1) % INFS_DIRTY_FILES;
+            int res = flush_node(dirty->node);
+            if (res != 0) {
+                return res;
+            }
+        }
+        FileEntry* entry = &file_system[node];
+        if (entry->size > 0) {
+            const char* content = read_file_content(node);
+            if (content == NULL) {
+                return VFS_ERR_IO;
+            }
+            memcpy(dirty->data, content, entry->size);
+        }
+        dirty->node = node;
+        dirty->size = entry->size;
+        dirty->in_use = 1;
+    }
+    *out = dirty;
+    return 0;
+}
+
+// Zero-fill or cut the buffered contents to size bytes
+static void resize_dirty(DirtyFile* dirty, uint32 size) {
+    if (size > dirty->size) {
+        memset(dirty->data + dirty->size, 0, size - dirty->size);
+    }
+    dirty->size = size;
+}
+
+static void fill_stat(int index, VFS_STAT* st) {
+    DirtyFile* dirty = find_dirty(index);
+    st->node = index;
+    st->size = dirty != NULL ? dirty->size : file_system[index].size;
+    // a slot is reserved whole whatever the contents compress to
+    st->allocated = file_system[index].data_slot != 0 ? FS_DATA_SECTORS * ATA_SECTOR_SIZE : 0;
+    st->permissions = file_system[index].permissions;
+    st->is_directory = file_system[index].is_directory;
+}
+
+// Options: "compress" stores new files as LZ4 where that saves sectors
+static void* infs_mount(BLOCK_DEVICE* dev, const char* options) {
+    if (options != NULL && strcmp(options, "compress") == 0) {
+        fs_compress_default = FS_FLAG_COMPRESS;
+    }
+    return file_system; // загружена в file_system_startup()
+}
+
+static void infs_unmount(void* fs) {
+    flush_all();
+    save_file_system();
+}
+
+static int infs_sync(void* fs) {
+    int res = flush_all();
+    save_file_system();
+    return res;
+}
+
+static int infs_flush(void* fs, uint32 node) {
+    return flush_node(node);
+}
+
+int flush_open_files() {
+    return flush_all();
+}
+
+uint32 open_files_dirty() {
+    uint32 count = 0;
+    for (int i = 0; i < INFS_DIRTY_FILES; i++) {
+        count += dirty_files[i].in_use;
+    }
+    return count;
+}
+
+static int infs_lookup(void* fs, const char* path, VFS_STAT* st) {
+    int index = find_file(path);
+    if (index == -1) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    fill_stat(index, st);
+    return 0;
+}
+
+static int infs_stat(void* fs, uint32 node, VFS_STAT* st) {
+    if (node >= (uint32)file_count) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    fill_stat(node, st);
+    return 0;
+}
+
+static int infs_read(void* fs, uint32 node, uint32 offset, void* buffer, uint32 length) {
+    if (node >= (uint32)file_count) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    FileEntry* entry = &file_system[node];
+    if (entry->is_directory) {
+        return VFS_ERR_IS_DIR;
+    }
+    DirtyFile* dirty = find_dirty(node);
+    uint32 size = dirty != NULL ? dirty->size : entry->size;
+    if (offset >= size) {
+        return 0;
+    }
+    const char* content = dirty != NULL ? dirty->data : read_file_content(node);
+    if (content == NULL) {
+        return VFS_ERR_IO;
+    }
+    if (length > size - offset) {
+        length = size - offset;
+    }
+    memcpy(buffer, content + offset, length);
+    return length;
+}
+
+static int infs_write(void* fs, uint32 node, uint32 offset, const void* buffer, uint32 length) {
+    if (node >= (uint32)file_count) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    FileEntry* entry = &file_system[node];
+    if (entry->is_directory) {
+        return VFS_ERR_IS_DIR;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    if (offset >= MAX_FILE_SIZE) {
+        return VFS_ERR_TOO_BIG;
+    }
+    if (length > MAX_FILE_SIZE - offset) {
+        length = MAX_FILE_SIZE - offset; // короткая запись, остальное не помещается
+    }
+
+    DirtyFile* dirty;
+    int res = get_dirty(node, &dirty);
+    if (res != 0) {
+        return res;
+    }
+    if (offset + length > dirty->size) {
+        resize_dirty(dirty, offset + length);
+    }
+    memcpy(dirty->data + offset, buffer, length);
+    return length;
+}
+
+static int infs_truncate(void* fs, uint32 node, uint32 size) {
+    if (node >= (uint32)file_count) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (file_system[node].is_directory) {
+        return VFS_ERR_IS_DIR;
+    }
+    if (size > MAX_FILE_SIZE) {
+        return VFS_ERR_TOO_BIG;
+    }
+    DirtyFile* dirty;
+    int res = get_dirty(node, &dirty);
+    if (res != 0) {
+        return res;
+    }
+    resize_dirty(dirty, size);
+    return 0;
+}
+
+static int infs_create(void* fs, const char* path, uint8 is_directory, uint32 permissions, VFS_STAT* st) {
+    int index = create_file(path, is_directory, permissions);
+    if (index < 0) {
+        return vfs_error(index);
+    }
+    commit_file_system();
+    fill_stat(index, st);
+    return index;
+}
+
+static int infs_unlink(void* fs, const char* path) {
+    int index = find_file(path);
+    if (index == -1) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (index == FS_ROOT_INDEX) {
+        return VFS_ERR_BUSY;
+    }
+    // remove_file() moves the last entry into the hole
+    int last = file_count - 1;
+    int res = remove_file(index);
+    if (res != 0) {
+        return vfs_error(res);
+    }
+    commit_file_system(); // Log the change, the table is rewritten at checkpoint
+    DirtyFile* dirty = find_dirty(index);
+    if (dirty != NULL) {
+        dirty->in_use = 0; // unwritten changes go with the file
+    }
+    if (index != last) {
+        dirty = find_dirty(last);
+        if (dirty != NULL) {
+            dirty->node = index;
+        }
+        vfs_node_moved(fs, last, index);
+    }
+    return 0;
+}
+
+static int infs_rename(void* fs, const char* from, const char* to) {
+    int index = find_file(from);
+    if (index == -1) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    int res = rename_file(index, to);
+    if (res != 0) {
+        return vfs_error(res);
+    }
+    commit_file_system();
+    return 0;
+}
+
+static int infs_readdir(void* fs, uint32 node, VFS_DIR_CALLBACK callback, void* arg) {
+    VFS_STAT st;
+    for (int i = FS_ROOT_INDEX + 1; i < file_count; i++) {
+        if (file_keys[i].parent_id != node) {
+            continue;
+        }
+        fill_stat(i, &st);
+        if (callback(get_file_name(i), &st, arg)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Copies share the data slot, see share_file_content()
+static int infs_clone(void* fs, uint32 from, uint32 to) {
+    if (from >= (uint32)file_count || to >= (uint32)file_count) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (file_system[from].is_directory || file_system[to].is_directory) {
+        return VFS_ERR_IS_DIR;
+    }
+    int res = flush_node(from);
+    if (res != 0) {
+        return res;
+    }
+    DirtyFile* dirty = find_dirty(to);
+    if (dirty != NULL) {
+        dirty->in_use = 0; // replaced by the clone
+    }
+    if (share_file_content(from, to) != 0) {
+        return VFS_ERR_IO;
+    }
+    commit_file_system();
+    return 0;
+}
+
+static int infs_might_contain(void* fs, uint32 node, const char* text, uint32 length) {
+    if (node >= (uint32)file_count || file_system[node].is_directory) {
+        return 1;
+    }
+    return trigram_might_contain(node, text, length);
+}
+
+VFS_DRIVER infs_driver = {
+    .name = "infs",
+    .mount = infs_mount,
+    .unmount = infs_unmount,
+    .sync = infs_sync,
+    .flush = infs_flush,
+    .lookup = infs_lookup,
+    .stat = infs_stat,
+    .read = infs_read,
+    .write = infs_write,
+    .truncate = infs_truncate,
+    .create = infs_create,
+    .unlink = infs_unlink,
+    .rename = infs_rename,
+    .readdir = infs_readdir,
+    .clone = infs_clone,
+    .might_contain = infs_might_contain,
+};
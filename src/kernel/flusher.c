@@ -0,0 +1,129 @@
+#include "flusher.h"
+#include "filesystem.h"
+#include "journal.h"
+#include "mmap.h"
+#include "timer.h"
+#include "tsc.h"
+#include "fs/vfs.h"
+#include <stddef.h> // Для NULL
+
+FlusherStats flusher_stats;
+
+static volatile uint8 check_due = 0;
+static uint8 running = 0;
+static uint8 at_prompt = 0;     // flusher_idle() may write
+static uint8 dirty_seen = 0;    // something was dirty at the last check
+static uint32 dirty_since;      // tick of the check that first saw it
+static uint32 volumes_synced;   // tick of the last sync of the other volumes
+
+// In the interrupt: only note the check, the disk may be busy
+static void timer_tick(uint32 ticks) {
+    if (ticks % FLUSHER_PERIOD == 0) {
+        check_due = 1;
+    }
+}
+
+void flusher_init() {
+    fs_deferred_commit = 1;
+    volumes_synced = timer_ticks();
+    timer_add_callback(timer_tick);
+}
+
+static int over_ratio(uint32 used, uint32 capacity) {
+    return used * 100 >= capacity * FLUSHER_DIRTY_RATIO;
+}
+
+// ext2 and FAT write data through and keep little metadata back (free
+// counts, the FAT sector cache); a sync of a clean volume writes nothing.
+// The table is left to flush(): its buffered files and journal.
+static void sync_volumes() {
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VFS_MOUNT* m = vfs_get_mount(i);
+        if (m != NULL && m->driver != &infs_driver && m->driver->sync != NULL) {
+            m->driver->sync(m->fs);
+            flusher_stats.volume_syncs++;
+        }
+    }
+}
+
+// Mapped pages first, their write-back adds changes to the table; then
+// the data the table keeps back for files still open for writing; then
+// everything the commands logged as a single journal write; and a
+// checkpoint once the journal is half used, long before a command
+// would have to make one
+static void flush(int force) {
+    uint32 started = tsc_kcycles();
+    uint32 pages = mmap_dirty_pages();
+    if (pages > 0) {
+        mmap_sync_all();
+        flusher_stats.mmap_pages += pages - mmap_dirty_pages();
+    }
+    if (open_files_dirty() > 0) {
+        flush_open_files();
+    }
+    uint32 records = journal_pending_records();
+    if (records > 0) {
+        if (flush_file_system() == 0) {
+            flusher_stats.transactions++;
+            flusher_stats.records += records;
+        } else if (checkpoint_file_system() >= 0) {
+            // Records the journal could not take: no command is running,
+            // so the table in memory is whole
+            flusher_stats.checkpoints++;
+        }
+    }
+    if (force ? journal_used() > 0 : over_ratio(journal_used(), JOURNAL_SECTORS)) {
+        if (checkpoint_file_system() >= 0) {
+            flusher_stats.checkpoints++;
+        }
+    }
+    flusher_stats.runs++;
+    flusher_stats.kcycles += tsc_kcycles() - started;
+}
+
+void flusher_at_prompt(int waiting) {
+    at_prompt = waiting != 0;
+}
+
+void flusher_idle() {
+    if (!check_due || running || !at_prompt) {
+        return;
+    }
+    running = 1;
+    check_due = 0;
+    uint32 now = timer_ticks();
+
+    int dirty = journal_pending_records() > 0 || mmap_dirty_pages() > 0 || open_files_dirty() > 0;
+    if (dirty && !dirty_seen) {
+        dirty_since = now;
+    }
+    dirty_seen = dirty;
+    int by_age = dirty && now - dirty_since >= FLUSHER_DIRTY_AGE;
+    int by_ratio = over_ratio(journal_pending_bytes(), JOURNAL_TXN_BYTES) ||
+                   over_ratio(journal_used(), JOURNAL_SECTORS) ||
+                   (mmap_stats.resident > 0 && over_ratio(mmap_dirty_pages(), mmap_stats.resident));
+    if (by_age || by_ratio) {
+        flush(0);
+        if (by_age) {
+            flusher_stats.by_age++;
+        }
+        dirty_seen = 0;
+    }
+    if (now - volumes_synced >= FLUSHER_DIRTY_AGE) {
+        sync_volumes();
+        volumes_synced = now;
+    }
+    running = 0;
+}
+
+void flusher_run_now() {
+    if (running) {
+        return;
+    }
+    running = 1;
+    flush(1);
+    sync_volumes();
+    dirty_seen = 0;
+    volumes_synced = timer_ticks();
+    running = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef FLUSHER_H
+#define FLUSHER_H
+
+#include "types.h"
+
+/**
+ * Background write-back.
+ *
+ * Commands only log their changes in memory (fs_deferred_commit), the
+ * flusher writes them out: the journal transaction gathering every
+ * change since the last write, dirty pages of mapped files, the other
+ * volumes' cached metadata and, before the journal fills, a checkpoint
+ * of the table. It runs when something has been dirty for
+ * FLUSHER_DIRTY_AGE or a buffer passes FLUSHER_DIRTY_RATIO percent.
+ *
+ * The timer interrupt only notes that a check is due; the writes happen
+ * in flusher_idle(), which every key wait calls but which only acts
+ * while the shell waits at its prompt (flusher_at_prompt()). Programs
+ * such as the editor wait for keys in the middle of a command, with a
+ * file half written; nothing is flushed there. A command that fills the
+ * transaction buffer still writes it itself.
+ */
+
+#define FLUSHER_PERIOD 50       // ticks between checks (timer.h: TIMER_HZ)
+#define FLUSHER_DIRTY_AGE 300   // ticks a change may stay in memory
+#define FLUSHER_DIRTY_RATIO 50  // percent of a buffer that triggers a flush
+
+typedef struct {
+    uint32 runs;            // checks that wrote something
+    uint32 transactions;    // journal writes, each gathering several commands
+    uint32 records;         // entries they carried
+    uint32 checkpoints;
+    uint32 mmap_pages;      // dirty pages of mapped files written back
+    uint32 volume_syncs;    // other volumes synced
+    uint32 by_age;          // runs started by age, the rest by ratio
+    uint32 kcycles;         // time spent writing, tsc_kcycles()
+} FlusherStats;
+
+extern FlusherStats flusher_stats;
+
+// Switch the root table to deferred commits and start the timer checks
+void flusher_init();
+
+// Flush what is due, called while the system waits for input
+void flusher_idle();
+
+// The shell sets this while it reads a command line, between commands
+void flusher_at_prompt(int waiting);
+
+// Write everything dirty now, regardless of age
+void flusher_run_now();
+
+#endif
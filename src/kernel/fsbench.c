@@ -0,0 +1,304 @@
+#include "fsbench.h"
+#include "console.h"
+#include "string.h"
+#include "tsc.h"
+#include "fs/vfs.h"
+#include "meminfo.h"
+#include <stddef.h> // Для NULL
+
+#define FSBENCH_DIR_NAME "fsbench.tmp"
+#define FSBENCH_MAX_IO (32 * 1024)
+
+static const uint32 io_sizes[] = {512, 4096, FSBENCH_MAX_IO};
+
+// Latency of every operation of the running benchmark, in cycles
+static uint32 samples[FSBENCH_MAX_OPS];
+static uint32 sample_count;
+static uint32 phase_started; // tsc_kcycles()
+static uint32 op_low, op_high;
+
+static uint8 io_buf[FSBENCH_MAX_IO];
+MEMINFO_STATIC(io_buf);
+static char work_dir[VFS_PATH_LENGTH];
+
+static void phase_begin() {
+    sample_count = 0;
+    phase_started = tsc_kcycles();
+}
+
+static void op_begin() {
+    tsc_read(&op_low, &op_high);
+}
+
+static void op_end() {
+    if (sample_count < FSBENCH_MAX_OPS) {
+        samples[sample_count++] = tsc_elapsed(op_low, op_high);
+    }
+}
+
+// Shell sort, the samples are few and the kernel has no qsort
+static void sort_samples() {
+    uint32 gap = 1;
+    while (gap < sample_count / 3) {
+        gap = gap * 3 + 1;
+    }
+    for (; gap > 0; gap /= 3) {
+        for (uint32 i = gap; i < sample_count; i++) {
+            uint32 value = samples[i];
+            uint32 j = i;
+            while (j >= gap && samples[j - gap] > value) {
+                samples[j] = samples[j - gap];
+                j -= gap;
+            }
+            samples[j] = value;
+        }
+    }
+}
+
+static void print_cycles(const char* label, uint32 cycles) {
+    uint32 mhz = tsc_khz() / 1000;
+    if (mhz == 0) {
+        console_printf(" %s %u cyc", label, cycles);
+        return;
+    }
+    console_printf(" %s %u.%u us", label, cycles / mhz, (cycles % mhz) * 10 / mhz);
+}
+
+static uint32 per_second(uint32 count, uint32 us) {
+    if (us == 0) {
+        return 0;
+    }
+    if (count < 0xFFFFFFFF / 1000000) {
+        return count * 1000000 / us;
+    }
+    return count * 1000 / (us / 1000 ? us / 1000 : 1);
+}
+
+// Print ops/s and latency percentiles of the samples taken since phase_begin()
+static void phase_end(const char* name, uint32 errors) {
+    uint32 elapsed = tsc_kcycles() - phase_started;
+    console_printf("%s: %u ops", name, sample_count);
+    if (sample_count == 0) {
+        console_putstr("\n");
+        return;
+    }
+    sort_samples();
+    console_printf(", %u ops/s,", per_second(sample_count, tsc_kcycles_to_us(elapsed)));
+    print_cycles("p50", samples[sample_count / 2]);
+    print_cycles("p90", samples[sample_count * 9 / 10]);
+    print_cycles("p99", samples[sample_count * 99 / 100]);
+    print_cycles("max", samples[sample_count - 1]);
+    if (errors > 0) {
+        console_printf(", %u failed", errors);
+    }
+    console_putstr("\n");
+}
+
+static void make_path(char* path, const char* prefix, uint32 i) {
+    char number[12];
+    sprintf(number, "%d", i);
+    strcpy(path, work_dir);
+    strcat(path, "/");
+    strcat(path, prefix);
+    strcat(path, number);
+}
+
+static int count_entry(const char* name, const VFS_STAT* st, void* arg) {
+    (*(uint32*)arg)++;
+    return 0;
+}
+
+static void print_rate_line(uint32 bytes, uint32 kcycles, uint32 short_ops) {
+    uint32 kbs = tsc_rate_kbs(bytes, kcycles);
+    console_printf("  %u bytes, %u.%u MB/s", bytes, kbs / 1000, (kbs % 1000) / 100);
+    if (short_ops > 0) {
+        console_printf(", %u short (file size limit)", short_ops);
+    }
+    console_putstr("\n");
+}
+
+// Whole-file writes of size bytes over the renamed files, then reads of them
+static void bench_io(uint32 count, uint32 size) {
+    char path[VFS_PATH_LENGTH];
+    char name[32];
+    uint32 bytes = 0;
+    uint32 errors = 0;
+    uint32 short_ops = 0;
+    uint32 ops = count / 10 ? count / 10 : 1;
+
+    phase_begin();
+    for (uint32 i = 0; i < ops; i++) {
+        make_path(path, "r", i % count);
+        op_begin();
+        int fd = vfs_open(path, VFS_O_WRITE | VFS_O_TRUNC);
+        int n = fd < 0 ? fd : vfs_write(fd, io_buf, size);
+        if (fd >= 0) {
+            int closed = vfs_close(fd);
+            if (n >= 0 && closed < 0) {
+                n = closed;
+            }
+        }
+        op_end();
+        if (n < 0) {
+            errors++;
+        } else {
+            bytes += n;
+            short_ops += (uint32)n < size;
+        }
+    }
+    uint32 elapsed = tsc_kcycles() - phase_started;
+    sprintf(name, "write %d", size);
+    phase_end(name, errors);
+    print_rate_line(bytes, elapsed, short_ops);
+
+    bytes = 0;
+    errors = 0;
+    phase_begin();
+    for (uint32 i = 0; i < ops; i++) {
+        make_path(path, "r", i % count);
+        op_begin();
+        int fd = vfs_open(path, VFS_O_READ);
+        int n = fd;
+        if (fd >= 0) {
+            while ((n = vfs_read(fd, io_buf, FSBENCH_MAX_IO)) > 0) {
+                bytes += n;
+            }
+            vfs_close(fd);
+        }
+        op_end();
+        errors += n < 0;
+    }
+    elapsed = tsc_kcycles() - phase_started;
+    sprintf(name, "read %d", size);
+    phase_end(name, errors);
+    print_rate_line(bytes, elapsed, 0);
+}
+
+int fsbench_run(const char* dir, uint32 count) {
+    char path[VFS_PATH_LENGTH];
+    char path2[VFS_PATH_LENGTH];
+    VFS_STAT st;
+    uint32 errors;
+
+    if (count == 0) {
+        count = FSBENCH_DEFAULT_OPS;
+    }
+    if (count > FSBENCH_MAX_OPS) {
+        count = FSBENCH_MAX_OPS;
+    }
+    if (vfs_normalize_path(dir, work_dir) != 0 || strlen(work_dir) + 32 >= VFS_PATH_LENGTH) {
+        return VFS_ERR_INVALID;
+    }
+    if (strcmp(work_dir, "/") != 0) {
+        strcat(work_dir, "/");
+    }
+    strcat(work_dir, FSBENCH_DIR_NAME);
+    int res = vfs_create(work_dir, 1, 0755);
+    if (res != 0) {
+        return res;
+    }
+    if (tsc_khz() == 0) {
+        console_putstr("TSC not calibrated, latencies are in cycles\n");
+    }
+    for (uint32 i = 0; i < FSBENCH_MAX_IO; i++) {
+        io_buf[i] = 'a' + i % 26;
+    }
+    console_printf("fsbench: %u ops in %s\n", count, work_dir);
+
+    errors = 0;
+    phase_begin();
+    for (uint32 i = 0; i < count; i++) {
+        make_path(path, "f", i);
+        op_begin();
+        errors += vfs_create(path, 0, 0644) != 0;
+        op_end();
+    }
+    phase_end("create", errors);
+
+    errors = 0;
+    phase_begin();
+    for (uint32 i = 0; i < count; i++) {
+        make_path(path, "f", i);
+        op_begin();
+        errors += vfs_stat(path, &st) != 0;
+        op_end();
+    }
+    phase_end("lookup hit", errors);
+
+    errors = 0;
+    phase_begin();
+    for (uint32 i = 0; i < count; i++) {
+        make_path(path, "m", i);
+        op_begin();
+        errors += vfs_stat(path, &st) != VFS_ERR_NOT_FOUND;
+        op_end();
+    }
+    phase_end("lookup miss", errors);
+
+    // The directory's own name is known but it is not its own child: a
+    // table that scans for children has to look at every entry to miss
+    errors = 0;
+    strcpy(path, work_dir);
+    strcat(path, "/" FSBENCH_DIR_NAME);
+    phase_begin();
+    for (uint32 i = 0; i < count; i++) {
+        op_begin();
+        errors += vfs_stat(path, &st) != VFS_ERR_NOT_FOUND;
+        op_end();
+    }
+    phase_end("scan miss", errors);
+
+    errors = 0;
+    phase_begin();
+    for (uint32 i = 0; i < (count / 10 ? count / 10 : 1); i++) {
+        uint32 entries = 0;
+        op_begin();
+        vfs_readdir(work_dir, count_entry, &entries);
+        op_end();
+        errors += entries != count;
+    }
+    phase_end("list", errors);
+
+    errors = 0;
+    phase_begin();
+    for (uint32 i = 0; i < count; i++) {
+        make_path(path, "f", i);
+        make_path(path2, "r", i);
+        op_begin();
+        errors += vfs_rename(path, path2) != 0;
+        op_end();
+    }
+    phase_end("rename", errors);
+
+    for (uint32 i = 0; i < sizeof(io_sizes) / sizeof(io_sizes[0]); i++) {
+        bench_io(count, io_sizes[i]);
+    }
+
+    // Each sync has one small change to flush
+    errors = 0;
+    phase_begin();
+    for (uint32 i = 0; i < (count / 10 ? count / 10 : 1) && i < 10; i++) {
+        make_path(path, "r", i % count);
+        int fd = vfs_open(path, VFS_O_WRITE);
+        if (fd >= 0) {
+            vfs_write(fd, "x", 1);
+            vfs_close(fd);
+        }
+        op_begin();
+        errors += vfs_sync() != 0;
+        op_end();
+    }
+    phase_end("sync", errors);
+
+    errors = 0;
+    phase_begin();
+    for (uint32 i = 0; i < count; i++) {
+        make_path(path, "r", i);
+        op_begin();
+        errors += vfs_unlink(path) != 0;
+        op_end();
+    }
+    phase_end("delete", errors);
+
+    return vfs_unlink(work_dir);
+}
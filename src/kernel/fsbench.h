@@ -0,0 +1,21 @@
+#ifndef FSBENCH_H
+#define FSBENCH_H
+
+#include "types.h"
+
+/**
+ * File system micro-benchmark over the VFS.
+ *
+ * Works in a scratch directory below dir, so any mounted volume can be
+ * measured: the root table, tmpfs, or ext2 on a disk or on ram0 to
+ * separate the cost of the file system code from the cost of the disk.
+ * Every operation is timed with the TSC.
+ */
+
+#define FSBENCH_MAX_OPS 2048
+#define FSBENCH_DEFAULT_OPS 100
+
+// Run every benchmark with count operations each, 0 on success
+int fsbench_run(const char* dir, uint32 count);
+
+#endif
@@ -0,0 +1,32 @@
+#include "fsdisk.h"
+#include "filesystem.h"
+#include "ide.h"
+
+#define FS_MAX_IO_SECTORS 255 // ide_*_sectors принимает uint8 в качестве количества секторов
+
+static int transfer(uint8 direction, uint32 lba, uint32 count, uint8* buffer) {
+    while (count > 0) {
+        uint32 chunk = count > FS_MAX_IO_SECTORS ? FS_MAX_IO_SECTORS : count;
+        int res;
+        if (direction == ATA_WRITE) {
+            res = ide_write_sectors(FS_DISK_DRIVE, chunk, lba, (uint32)buffer);
+        } else {
+            res = ide_read_sectors(FS_DISK_DRIVE, chunk, lba, (uint32)buffer);
+        }
+        if (res != 0) {
+            return res;
+        }
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * ATA_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+int fs_disk_read(uint32 lba, uint32 count, void* buffer) {
+    return transfer(ATA_READ, lba, count, (uint8*)buffer);
+}
+
+int fs_disk_write(uint32 lba, uint32 count, const void* buffer) {
+    return transfer(ATA_WRITE, lba, count, (uint8*)buffer);
+}
@@ -0,0 +1,12 @@
+#ifndef FSDISK_H
+#define FSDISK_H
+
+#include "types.h"
+
+// Sector I/O for the file table, its journal and file data. In the
+// kernel it goes to FS_DISK_DRIVE (fsdisk.c), the host tools in tools/
+// provide a version backed by a disk image file. 0 on success.
+int fs_disk_read(uint32 lba, uint32 count, void* buffer);
+int fs_disk_write(uint32 lba, uint32 count, const void* buffer);
+
+#endif
@@ -0,0 +1,180 @@
+#include "grep.h"
+#include "console.h"
+#include "string.h"
+#include "search.h"
+#include "tsc.h"
+#include "fs/vfs.h"
+#include "meminfo.h"
+#include <stddef.h> // Для NULL
+
+// As in copy.c the walk extends one path by a component per level
+static char grep_path[VFS_PATH_LENGTH];
+static uint8 grep_buf[GREP_BUF_SIZE + 1]; // +1: the end of a printed line is cut with '\0'
+MEMINFO_STATIC(grep_buf);
+static const char* grep_pattern;
+static uint32 pattern_len;
+static uint32 grep_flags;
+static GrepStats* grep_stats;
+static int walk_depth;
+static int walk_error;
+
+static int path_push(char* path, const char* name) {
+    int len = strlen(path);
+    int sep = path[len - 1] == '/' ? 0 : 1; // "/" itself
+    if (len + sep + (int)strlen(name) >= VFS_PATH_LENGTH) {
+        return -1;
+    }
+    if (sep) {
+        path[len] = '/';
+    }
+    strcpy(path + len + sep, name);
+    return len;
+}
+
+static void print_line(uint32 line_no, uint8* line, uint32 len) {
+    if (len > GREP_LINE_SHOWN) {
+        len = GREP_LINE_SHOWN;
+    }
+    uint8 saved = line[len];
+    line[len] = '\0';
+    console_printf("%s:%u: %s\n", grep_path, line_no, (const char*)line);
+    line[len] = saved;
+}
+
+// Report the matches in the complete lines text[0, len). line_no is the
+// number of the line text starts with and is advanced past the last
+// line reported; returns the matching lines.
+static uint32 scan_lines(uint8* text, uint32 len, uint32* line_no) {
+    uint32 matched = 0;
+    uint32 counted = 0; // line_no is the number of the line holding text[counted]
+    uint32 pos = 0;
+    while (pos < len) {
+        int found = mem_find(text + pos, len - pos, grep_pattern, pattern_len);
+        if (found < 0) {
+            break;
+        }
+        uint32 at = pos + found;
+        uint32 start = at;
+        while (start > 0 && text[start - 1] != '\n') {
+            start--;
+        }
+        uint32 end = at + pattern_len;
+        while (end < len && text[end] != '\n') {
+            end++;
+        }
+        matched++;
+        if (!(grep_flags & GREP_QUIET)) {
+            *line_no += mem_count(text + counted, start - counted, '\n');
+            counted = start;
+            print_line(*line_no, text + start, end - start);
+        }
+        pos = end + 1; // one report per line
+    }
+    if (!(grep_flags & GREP_QUIET) && counted < len) {
+        *line_no += mem_count(text + counted, len - counted, '\n');
+    }
+    return matched;
+}
+
+// Scan the file at grep_path through grep_buf. Lines are only split
+// where one does not fit the buffer, a match across that split is lost.
+static int grep_file() {
+    int fd = vfs_open(grep_path, VFS_O_READ);
+    if (fd < 0) {
+        return fd;
+    }
+    uint32 kept = 0; // start of a line carried over from the last read
+    uint32 line_no = 1;
+    uint32 matched = 0;
+    int n;
+    while ((n = vfs_read(fd, grep_buf + kept, GREP_BUF_SIZE - kept)) > 0) {
+        uint32 len = kept + n;
+        grep_stats->bytes_read += n;
+        uint32 complete = len;
+        while (complete > 0 && grep_buf[complete - 1] != '\n') {
+            complete--;
+        }
+        if (complete == 0) {
+            complete = len; // one line longer than the buffer
+        }
+        matched += scan_lines(grep_buf, complete, &line_no);
+        kept = len - complete;
+        for (uint32 i = 0; i < kept; i++) {
+            grep_buf[i] = grep_buf[complete + i]; // moves down, overlap is fine
+        }
+    }
+    if (n == 0 && kept > 0) {
+        matched += scan_lines(grep_buf, kept, &line_no);
+    }
+    vfs_close(fd);
+    grep_stats->files_read++;
+    if (matched > 0) {
+        grep_stats->files_matched++;
+        grep_stats->lines += matched;
+    }
+    return n < 0 ? n : 0;
+}
+
+static int grep_dir();
+
+static int grep_child(const char* name, const VFS_STAT* st, void* arg) {
+    int res = 0;
+    // grep_path is still the directory, which names the volume of st->node
+    if (!st->is_directory) {
+        grep_stats->files++;
+        if (!(grep_flags & GREP_NO_INDEX) &&
+            !vfs_might_contain(grep_path, st->node, grep_pattern, pattern_len)) {
+            return 0;
+        }
+    }
+    int cut = path_push(grep_path, name);
+    if (cut < 0) {
+        res = VFS_ERR_INVALID;
+    } else {
+        res = st->is_directory ? grep_dir() : grep_file();
+        grep_path[cut] = '\0';
+    }
+    if (res < 0) {
+        walk_error = res;
+        return 1;
+    }
+    return 0;
+}
+
+static int grep_dir() {
+    if (walk_depth >= GREP_MAX_DEPTH) {
+        return VFS_ERR_INVALID;
+    }
+    walk_depth++;
+    int res = vfs_readdir(grep_path, grep_child, NULL);
+    walk_depth--;
+    return res < 0 ? res : walk_error;
+}
+
+int grep_tree(const char* dir, const char* pattern, uint32 flags, GrepStats* stats) {
+    VFS_STAT st;
+    memset(stats, 0, sizeof(GrepStats));
+    pattern_len = strlen(pattern);
+    if (pattern_len == 0 || pattern_len > GREP_MAX_PATTERN || strlen(dir) >= VFS_PATH_LENGTH) {
+        return VFS_ERR_INVALID;
+    }
+    int res = vfs_stat(dir, &st);
+    if (res != 0) {
+        return res;
+    }
+    uint32 started = tsc_kcycles();
+    strcpy(grep_path, dir);
+    grep_pattern = pattern;
+    grep_flags = flags;
+    grep_stats = stats;
+    walk_depth = 0;
+    walk_error = 0;
+    if (st.is_directory) {
+        res = grep_dir();
+    } else {
+        stats->files = 1;
+        res = grep_file();
+    }
+    stats->kcycles = tsc_kcycles() - started;
+    return res;
+}
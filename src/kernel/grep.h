@@ -0,0 +1,37 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include "types.h"
+
+/**
+ * Text search over the VFS, for grep.
+ *
+ * Every regular file below a directory is searched for a fixed string
+ * with mem_find() (search.h) and each line holding it is printed as
+ * "path:line: text". Before a file is opened its volume is asked whether
+ * the file may hold the text at all (vfs_might_contain(), the trigram
+ * index of the root table), so most files are never read.
+ */
+
+#define GREP_BUF_SIZE (32 * 1024)
+#define GREP_MAX_DEPTH 32  // directory levels below the top, bounds the stack
+#define GREP_MAX_PATTERN 128
+#define GREP_LINE_SHOWN 160 // longer lines are cut when printed
+
+// grep_tree() flags
+#define GREP_NO_INDEX 0x01 // read every file, the index is not asked
+#define GREP_QUIET    0x02 // count only, print no lines
+
+typedef struct {
+    uint32 files;         // regular files walked
+    uint32 files_read;    // opened and scanned
+    uint32 files_matched;
+    uint32 lines;         // matching lines
+    uint32 bytes_read;
+    uint32 kcycles;       // the whole search, tsc_kcycles()
+} GrepStats;
+
+// Search every file below dir (or the file dir) for pattern, 0 on success
+int grep_tree(const char* dir, const char* pattern, uint32 flags, GrepStats* stats);
+
+#endif
@@ -84,14 +84,24 @@ static void print_registers(REGISTERS *reg) {
  * being called in exception.asm
  */
 void isr_exception_handler(REGISTERS reg) {
-    if (reg.int_no < 32) {
-        console_printf("EXCEPTION: %s\n", exception_messages[reg.int_no]);
-        print_registers(&reg);
-        for (;;)
-            ;
-    }
+    // a handled exception (a page fault on a mapped file) returns to
+    // retry the faulting instruction
     if (g_interrupt_handlers[reg.int_no] != NULL) {
         ISR handler = g_interrupt_handlers[reg.int_no];
         handler(&reg);
+        return;
+    }
+    if (reg.int_no < 32) {
+        isr_panic(&reg);
     }
 }
+
+/**
+ * report an exception nobody handles and stop
+ */
+void isr_panic(REGISTERS *reg) {
+    console_printf("EXCEPTION: %s\n", exception_messages[reg->int_no]);
+    print_registers(reg);
+    for (;;)
+        ;
+}
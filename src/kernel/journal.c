@@ -0,0 +1,367 @@
+#include "journal.h"
+#include "filesystem.h"
+#include "console.h"
+#include "string.h"
+#include "ide.h" // ATA_SECTOR_SIZE
+#include "fsdisk.h"
+#include "namepool.h"
+#include "crc32c.h"
+
+#define JOURNAL_MAGIC 0x334E524A // "JRN3": CRC32C и контрольная сумма содержимого в записях
+
+// First bytes of every transaction, records follow immediately
+typedef struct {
+    uint32 magic;
+    uint32 seq;
+    uint32 file_count;   // file_count after the transaction is applied
+    uint16 record_count;
+    uint16 sectors;      // sectors used by the transaction, header included
+    uint32 length;       // bytes of records after the header
+    uint32 checksum;     // CRC32C of the header (with checksum = 0) and records
+} __attribute__((packed)) JournalTxnHeader;
+
+// Names are logged as text: replay interns them into the pool as it was
+// at the last checkpoint, wherever they landed in the pool since then
+typedef struct {
+    uint8 type;
+    uint8 is_directory;
+    uint16 index;
+    uint32 parent_id;
+    uint32 size;
+    uint32 data_slot;
+    uint32 data_crc;
+    uint16 permissions;
+    uint8 flags;
+    uint8 name_len;
+    // followed by name_len bytes of name
+} __attribute__((packed)) JournalRecord;
+
+#define JOURNAL_REC_MAX (sizeof(JournalRecord) + MAX_FILENAME)
+
+static uint8 txn_buf[JOURNAL_TXN_BYTES];
+static uint32 txn_len = sizeof(JournalTxnHeader); // bytes used in txn_buf
+static uint16 txn_records = 0;
+
+static uint32 head = 0;  // next free sector in the journal
+static uint32 used = 0;  // sectors since the last checkpoint, wrap gap included
+static uint32 seq = 1;   // sequence number of the next transaction
+static int replaying = 0;
+static int overflowed = 0; // records were dropped, only a checkpoint covers them
+
+static int replay_compacted = 0; // the name pool was compacted to replay a name
+
+// A zeroed record at the end of the pending transaction, NULL if the
+// caller did not reserve room for it
+static JournalRecord* new_record(uint8 type, int index) {
+    if (replaying || index < 0 || index >= MAX_FILES) {
+        return NULL;
+    }
+    if (txn_len + JOURNAL_REC_MAX > JOURNAL_TXN_BYTES) {
+        // Committing here would split the caller's change in two; it did
+        // not reserve enough, so the next commit is a checkpoint instead
+        if (!overflowed) {
+            console_putstr("[FS] Транзакция журнала переполнена\n");
+        }
+        overflowed = 1;
+        return NULL;
+    }
+
+    JournalRecord* rec = (JournalRecord*)(txn_buf + txn_len);
+    memset(rec, 0, sizeof(JournalRecord));
+    rec->type = type;
+    rec->index = index;
+    txn_len += sizeof(JournalRecord);
+    txn_records++;
+    return rec;
+}
+
+static void append_record(uint8 type, int index) {
+    JournalRecord* rec = new_record(type, index);
+    if (rec == NULL || type != JOURNAL_REC_SET) {
+        return;
+    }
+
+    FileEntry* entry = &file_system[index];
+    const char* name = name_pool_get(file_keys[index].name);
+    rec->is_directory = entry->is_directory;
+    rec->parent_id = file_keys[index].parent_id;
+    rec->size = entry->size;
+    rec->permissions = entry->permissions;
+    rec->data_slot = entry->data_slot;
+    rec->data_crc = entry->data_crc;
+    rec->flags = entry->flags;
+    rec->name_len = strlen(name);
+    memcpy(txn_buf + txn_len, name, rec->name_len);
+    txn_len += rec->name_len;
+}
+
+static void reset_pending() {
+    txn_len = sizeof(JournalTxnHeader);
+    txn_records = 0;
+    overflowed = 0;
+}
+
+// Sectors a transaction of the largest size would take at head, with
+// the end of the journal it skips when it does not fit there
+static uint32 txn_cost() {
+    if (head + JOURNAL_TXN_MAX_SECTORS > JOURNAL_SECTORS) {
+        return JOURNAL_SECTORS - head + JOURNAL_TXN_MAX_SECTORS;
+    }
+    return JOURNAL_TXN_MAX_SECTORS;
+}
+
+int journal_reserve(uint32 records) {
+    if (replaying) {
+        return 0;
+    }
+    if (sizeof(JournalTxnHeader) + records * JOURNAL_REC_MAX > JOURNAL_TXN_BYTES) {
+        return -1;
+    }
+    if (!overflowed && txn_len + records * JOURNAL_REC_MAX > JOURNAL_TXN_BYTES) {
+        if (journal_commit() != 0) {
+            return -1;
+        }
+    }
+    // The transaction this change goes into must fit the journal. The
+    // checkpoint that makes room is taken here, before the change starts,
+    // while the table in memory holds whole changes only.
+    if (overflowed || used + txn_cost() >= JOURNAL_SECTORS) {
+        if (checkpoint_file_system() < 0) {
+            console_putstr("[FS] Ошибка сохранения файловой системы!\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void journal_format() {
+    memset(txn_buf, 0, JOURNAL_TXN_BYTES);
+    for (uint32 pos = 0; pos < JOURNAL_SECTORS; pos += JOURNAL_TXN_MAX_SECTORS) {
+        fs_disk_write(FS_JOURNAL_START + pos, JOURNAL_TXN_MAX_SECTORS, txn_buf);
+    }
+    head = 0;
+    used = 0;
+    seq = 1;
+    reset_pending();
+}
+
+void journal_log_entry(int index) {
+    append_record(JOURNAL_REC_SET, index);
+}
+
+void journal_log_clear(int index) {
+    append_record(JOURNAL_REC_CLEAR, index);
+}
+
+void journal_log_parent(int from, int to) {
+    JournalRecord* rec = new_record(JOURNAL_REC_PARENT, to);
+    if (rec != NULL) {
+        rec->parent_id = from;
+    }
+}
+
+// The copy is found by the sector it starts at, kept in data_slot
+void journal_log_names(uint32 lba, uint32 pool_used) {
+    JournalRecord* rec = new_record(JOURNAL_REC_NAMES, 0);
+    if (rec != NULL) {
+        rec->data_slot = lba;
+        rec->size = pool_used;
+    }
+}
+
+int journal_commit() {
+    if (overflowed) {
+        // Only a checkpoint covers the dropped records, and only between
+        // changes: journal_reserve() or the flusher takes it
+        return -1;
+    }
+    if (txn_records == 0) {
+        return 0;
+    }
+
+    uint32 sectors = (txn_len + ATA_SECTOR_SIZE - 1) / ATA_SECTOR_SIZE;
+    uint32 pos = head;
+    uint32 skip = 0;
+    if (pos + sectors > JOURNAL_SECTORS) {
+        skip = JOURNAL_SECTORS - pos; // transactions never wrap, restart at the beginning
+        pos = 0;
+    }
+    if (used + skip + sectors >= JOURNAL_SECTORS) {
+        // journal_reserve() checkpoints before a change that could get here
+        console_putstr("[FS] Журнал заполнен\n");
+        return -1;
+    }
+
+    JournalTxnHeader* hdr = (JournalTxnHeader*)txn_buf;
+    hdr->magic = JOURNAL_MAGIC;
+    hdr->seq = seq;
+    hdr->file_count = file_count;
+    hdr->record_count = txn_records;
+    hdr->sectors = sectors;
+    hdr->length = txn_len - sizeof(JournalTxnHeader);
+    hdr->checksum = 0;
+    memset(txn_buf + txn_len, 0, sectors * ATA_SECTOR_SIZE - txn_len);
+    hdr->checksum = crc32c(0, txn_buf, txn_len);
+
+    if (fs_disk_write(FS_JOURNAL_START + pos, sectors, txn_buf) != 0) {
+        console_putstr("[FS] Ошибка записи журнала!\n");
+        return -1;
+    }
+
+    head = pos + sectors;
+    used += skip + sectors;
+    seq++;
+    reset_pending();
+    return 0;
+}
+
+void journal_checkpointed() {
+    used = 0;
+    reset_pending();
+}
+
+static void apply_record(JournalRecord* rec) {
+    if (rec->index >= MAX_FILES) {
+        return;
+    }
+    FileKey* key = &file_keys[rec->index];
+    FileEntry* entry = &file_system[rec->index];
+
+    if (rec->type == JOURNAL_REC_NAMES) {
+        if (load_name_copy(rec->data_slot, rec->size) != 0) {
+            console_putstr("[FS] Не удалось прочитать копию имён!\n");
+        }
+        return;
+    }
+    if (rec->type == JOURNAL_REC_PARENT) {
+        // The whole table: entries of the same transaction may lie past file_count
+        for (int i = 0; i < MAX_FILES; i++) {
+            if (file_keys[i].parent_id == rec->parent_id && rec->parent_id != FS_ROOT_INDEX) {
+                file_keys[i].parent_id = rec->index;
+                mark_table_dirty(i);
+            }
+        }
+        return;
+    }
+    if (rec->type == JOURNAL_REC_CLEAR) {
+        name_pool_release(key->name);
+        memset(key, 0, sizeof(FileKey));
+        memset(entry, 0, sizeof(FileEntry));
+    } else if (rec->type == JOURNAL_REC_SET) {
+        char name[MAX_FILENAME];
+        uint32 name_len = rec->name_len < MAX_FILENAME ? rec->name_len : MAX_FILENAME - 1;
+        memcpy(name, (uint8*)rec + sizeof(JournalRecord), name_len);
+        name[name_len] = '\0';
+        name_pool_release(key->name);
+        key->name = name_pool_intern(name);
+        if (key->name == NAME_POOL_NONE && name_pool_compact() > 0) {
+            // Only in memory: written out once replay is done
+            replay_compacted = 1;
+            key->name = name_pool_intern(name);
+        }
+        key->parent_id = rec->parent_id < MAX_FILES ? rec->parent_id : FS_ROOT_INDEX;
+        entry->is_directory = rec->is_directory;
+        entry->size = rec->size;
+        entry->permissions = rec->permissions;
+        entry->data_slot = rec->data_slot <= FS_DATA_SLOTS ? rec->data_slot : 0;
+        entry->data_crc = rec->data_crc;
+        entry->flags = rec->flags;
+    }
+    mark_file_dirty(rec->index);
+}
+
+// Read and verify the transaction at pos, 0 if it is the expected one
+static int read_txn(uint32 pos) {
+    JournalTxnHeader* hdr = (JournalTxnHeader*)txn_buf;
+
+    if (fs_disk_read(FS_JOURNAL_START + pos, 1, txn_buf) != 0) {
+        return -1;
+    }
+    if (hdr->magic != JOURNAL_MAGIC || hdr->seq != seq || hdr->sectors == 0 ||
+        hdr->sectors > JOURNAL_TXN_MAX_SECTORS || pos + hdr->sectors > JOURNAL_SECTORS ||
+        sizeof(JournalTxnHeader) + hdr->length > hdr->sectors * ATA_SECTOR_SIZE) {
+        return -1;
+    }
+    if (hdr->sectors > 1 &&
+        fs_disk_read(FS_JOURNAL_START + pos + 1, hdr->sectors - 1, txn_buf + ATA_SECTOR_SIZE) != 0) {
+        return -1;
+    }
+
+    uint32 checksum = hdr->checksum;
+    hdr->checksum = 0;
+    if (crc32c(0, txn_buf, sizeof(JournalTxnHeader) + hdr->length) != checksum) {
+        return -1;
+    }
+    hdr->checksum = checksum;
+    return 0;
+}
+
+int journal_replay(uint32 start, uint32 start_seq) {
+    int applied = 0;
+
+    head = start < JOURNAL_SECTORS ? start : 0;
+    seq = start_seq;
+    used = 0;
+    reset_pending();
+    replaying = 1;
+    replay_compacted = 0;
+
+    while (used < JOURNAL_SECTORS) {
+        uint32 pos = head;
+        uint32 skip = 0;
+        if (pos >= JOURNAL_SECTORS || read_txn(pos) != 0) {
+            // The writer restarts at sector 0 when a transaction does not fit at the end
+            if (pos == 0 || read_txn(0) != 0) {
+                break;
+            }
+            skip = JOURNAL_SECTORS - pos;
+            pos = 0;
+        }
+
+        JournalTxnHeader* hdr = (JournalTxnHeader*)txn_buf;
+        uint8* rec = txn_buf + sizeof(JournalTxnHeader);
+        uint8* end = rec + hdr->length;
+        for (uint16 i = 0; i < hdr->record_count && rec + sizeof(JournalRecord) <= end; i++) {
+            JournalRecord* r = (JournalRecord*)rec;
+            apply_record(r);
+            rec += sizeof(JournalRecord);
+            if (r->type == JOURNAL_REC_SET) {
+                rec += r->name_len;
+            }
+        }
+        file_count = hdr->file_count;
+
+        head = pos + hdr->sectors;
+        used += skip + hdr->sectors;
+        seq++;
+        applied++;
+    }
+
+    replaying = 0;
+    reset_pending();
+    return applied;
+}
+
+int journal_replay_compacted() {
+    return replay_compacted;
+}
+
+uint32 journal_head() {
+    return head;
+}
+
+uint32 journal_seq() {
+    return seq;
+}
+
+uint32 journal_pending_records() {
+    return txn_records;
+}
+
+uint32 journal_pending_bytes() {
+    return txn_records == 0 ? 0 : txn_len;
+}
+
+uint32 journal_used() {
+    return used;
+}
@@ -0,0 +1,73 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "types.h"
+
+/**
+ * Metadata write-ahead journal for the file table.
+ *
+ * Changes are appended to a circular region after the table as one
+ * transaction per commit: a header sector followed by compact records,
+ * written with a single fs_disk_write() call (which also flushes).
+ * The table itself is only rewritten at checkpoint time.
+ */
+
+#define JOURNAL_SECTORS 64
+#define JOURNAL_TXN_MAX_SECTORS 8
+#define JOURNAL_TXN_BYTES (JOURNAL_TXN_MAX_SECTORS * 512)
+
+// Record types
+#define JOURNAL_REC_SET   0x01 // entry metadata (parent, name, size, flags)
+#define JOURNAL_REC_CLEAR 0x02 // entry slot freed
+#define JOURNAL_REC_NAMES 0x03 // keys and name pool replaced by a copy on disk
+#define JOURNAL_REC_PARENT 0x04 // children of a moved directory follow it
+
+// Start an empty journal, wiping records left by an older file system
+void journal_format();
+
+// Log the current metadata of file_system[index] in the pending transaction
+void journal_log_entry(int index);
+// Log that file_system[index] has been cleared
+void journal_log_clear(int index);
+// Log that every entry under directory from now has parent to, one
+// record however many children it has
+void journal_log_parent(int from, int to);
+// Log that the keys of the table and the first pool_used bytes of the
+// name pool were written to the metadata sectors from lba on, after
+// the pool was compacted. Replay reads them back from there.
+void journal_log_names(uint32 lba, uint32 pool_used);
+
+// Make room in the pending transaction for the records a change is
+// about to log, so the change is committed whole. Commits what is
+// pending if the records would not fit after it, and checkpoints the
+// table if the journal could not take the transaction. -1 if they do
+// not fit an empty transaction or that commit or checkpoint failed: the
+// change must not start.
+int journal_reserve(uint32 records);
+
+// Write the pending transaction to the journal, 0 on success
+int journal_commit();
+
+// The table on disk now reflects everything logged so far,
+// replay will start at what was journal_head() from now on
+void journal_checkpointed();
+
+// Replay committed transactions starting at tail, returns number applied
+int journal_replay(uint32 tail, uint32 seq);
+// Whether that replay had to compact the name pool to fit a name
+int journal_replay_compacted();
+
+// Logged records not written yet, and the bytes they fill of the
+// transaction buffer (JOURNAL_TXN_BYTES)
+uint32 journal_pending_records();
+uint32 journal_pending_bytes();
+// Journal sectors used since the last checkpoint; journal_reserve()
+// checkpoints before they could exceed JOURNAL_SECTORS
+uint32 journal_used();
+
+// Where replay has to start once the table is checkpointed,
+// stored in the file system header
+uint32 journal_head();
+uint32 journal_seq();
+
+#endif
@@ -12,6 +12,30 @@
 #include "filesystem.h"
 #include "vga.h"
 #include "game/snake.h"
+#include "ide.h"
+#include "blockdev.h"
+#include "fs/vfs.h"
+#include "fs/ext2.h"
+#include "fs/fat.h"
+#include "fs/tmpfs.h"
+#include "tsc.h"
+#include "ramdisk.h"
+#include "fsbench.h"
+#include "copy.h"
+#include "grep.h"
+#include "mmap.h"
+#include "paging.h"
+#include "timer.h"
+#include "flusher.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "crc32c.h"
+#include "multiboot.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "arena.h"
+#include "meminfo.h"
+#include "swap.h"
 
 // Global flag to signal program exit
 volatile int g_exit_program = 0;
@@ -67,73 +91,119 @@ void editor_init(Editor* editor, const char* filename) {
 }
 
 void editor_load_file(Editor* editor) {
-    int file_index = find_file(editor->filename);
-    if (file_index == -1) {
+    char full_path[MAX_PATH_LENGTH];
+    get_full_path(editor->filename, full_path);
+    int fd = vfs_open(full_path, VFS_O_READ);
+    if (fd < 0) {
         return; // New file
     }
 
-    // TODO: Implement loading from disk
-    // This will need to read sectors from disk based on file_system[file_index].start_lba and num_sectors
-    // and then parse the content into editor lines.
-    if (file_system[file_index].size > 0) {
-        char file_content_buffer[file_system[file_index].size + 1]; // Temporary buffer
-        memcpy(file_content_buffer, file_system[file_index].content, file_system[file_index].size);
-        file_content_buffer[file_system[file_index].size] = '\0'; // Null-terminate
-
-        int line = 0;
-        int col = 0;
-        int i = 0;
-
-        while (file_content_buffer[i] != '\0' && line < MAX_LINES) {
-            if (file_content_buffer[i] == '\n') {
+    // Stream the file in chunks straight into the editor lines
+    char chunk[128];
+    int line = 0;
+    int col = 0;
+    int n;
+    while (line < MAX_LINES && (n = vfs_read(fd, chunk, sizeof(chunk))) > 0) {
+        for (int i = 0; i < n && line < MAX_LINES; i++) {
+            if (chunk[i] == '\n') {
                 editor->lines[line][col] = '\0';
                 line++;
                 col = 0;
             } else if (col < MAX_LINE_LENGTH - 1) {
-                editor->lines[line][col] = file_content_buffer[i];
+                editor->lines[line][col] = chunk[i];
                 col++;
             }
-            i++;
         }
-        editor->lines[line][col] = '\0';
-        editor->line_count = line + 1;
+    }
+    vfs_close(fd);
+
+    if (line == MAX_LINES) {
+        line--;
+    }
+    editor->lines[line][col] = '\0';
+    editor->line_count = line + 1;
+}
+
+void print_vfs_error(int res) {
+    if (res == VFS_ERR_NOT_FOUND) {
+        console_putstr("Error: File or directory not found\n");
+    } else if (res == VFS_ERR_EXISTS) {
+        console_putstr("Error: File or directory already exists\n");
+    } else if (res == VFS_ERR_NOT_DIR) {
+        console_putstr("Error: Not a directory\n");
+    } else if (res == VFS_ERR_IS_DIR) {
+        console_putstr("Error: Is a directory\n");
+    } else if (res == VFS_ERR_NOT_EMPTY) {
+        console_putstr("Error: Directory not empty\n");
+    } else if (res == VFS_ERR_NO_SPACE) {
+        console_putstr("Error: File system is full\n");
+    } else if (res == VFS_ERR_TOO_BIG) {
+        console_putstr("Error: File too large\n");
+    } else if (res == VFS_ERR_READ_ONLY) {
+        console_putstr("Error: Read-only file system\n");
+    } else if (res == VFS_ERR_BUSY) {
+        console_putstr("Error: Device or resource busy\n");
+    } else if (res == VFS_ERR_INVALID) {
+        console_putstr("Error: Invalid name\n");
+    } else if (res == VFS_ERR_CROSS_DEVICE) {
+        console_putstr("Error: Cannot move between file systems\n");
+    } else if (res == VFS_ERR_NOT_SUPPORTED) {
+        console_putstr("Error: Operation not supported\n");
     } else {
-        // File is empty or directory
-        editor->line_count = 1;
-        editor->lines[0][0] = '\0';
+        console_putstr("Error: I/O error\n");
     }
 }
 
 void editor_save_file(Editor* editor) {
-    int file_index = find_file(editor->filename);
-    if (file_index == -1) {
-        // Create new file
-        if (file_count >= MAX_FILES) {
-            console_putstr("Error: File system is full\n");
-            return;
+    char full_path[MAX_PATH_LENGTH];
+    get_full_path(editor->filename, full_path);
+    int fd = vfs_open(full_path, VFS_O_WRITE | VFS_O_CREAT | VFS_O_TRUNC);
+    if (fd < 0) {
+        console_putstr("\n");
+        print_vfs_error(fd);
+        return;
+    }
+
+    // Write the lines through a small staging buffer
+    char chunk[128];
+    uint32 used = 0;
+    uint32 size = 0;
+    int res = 0;
+    for (int line = 0; line < editor->line_count && res >= 0; line++) {
+        for (int col = 0; res >= 0; col++) {
+            char c = editor->lines[line][col];
+            if (c == '\0') {
+                if (line + 1 == editor->line_count) {
+                    break;
+                }
+                c = '\n';
+            }
+            chunk[used++] = c;
+            if (used == sizeof(chunk)) {
+                res = vfs_write(fd, chunk, used);
+                size += res > 0 ? res : 0;
+                used = 0;
+            }
+            if (c == '\n') {
+                break;
+            }
         }
-        file_index = file_count;
-        strcpy(file_system[file_index].name, editor->filename);
-        file_system[file_index].is_directory = 0;
-        // Set the full path for the new file
-        get_full_path(editor->filename, file_system[file_index].path);
-        file_count++;
+    }
+    if (res >= 0 && used > 0) {
+        res = vfs_write(fd, chunk, used);
+        size += res > 0 ? res : 0;
+    }
+    int closed = vfs_close(fd); // the contents are written out here
+    if (res >= 0) {
+        res = closed;
     }
 
-    // TODO: Implement saving to disk
-    // This will need to allocate sectors on disk, write the content,
-    // and update the file_system entry (size, start_lba, num_sectors).
-    // For now, simulate saving by printing a message.
-    console_putstr("\nSaving file to disk (simulated)...\n");
-    
-    // In a real implementation:
-    // 1. Combine all lines from editor->lines into a single buffer.
-    // 2. Calculate required sectors based on buffer size.
-    // 3. If file already exists, free old sectors.
-    // 4. Find free sectors on disk for the new content.
-    // 5. Write buffer content to disk sectors using write_to_disk.
-    // 6. Update file_system[file_index] with new size, start_lba, num_sectors.
-    // 7. Save the updated file system structure to a known location on disk.
+    if (res < 0) {
+        console_putstr("\n");
+        print_vfs_error(res);
+        return;
+    }
+    console_printf("\nSaved %d bytes\n", size);
 
     editor->modified = 0;
 }
@@ -212,36 +282,41 @@ void cmd_nano(char* args) {
     char full_path[MAX_PATH_LENGTH];
     get_full_path(args, full_path); // Get the full path
 
-    Editor editor;
-    editor_init(&editor, full_path); // Use full path
-    editor_load_file(&editor); // Use full path (editor.filename is already set)
-    editor_draw_content(&editor);
+    // Too large for the stack, lives until the command returns
+    Editor* editor = (Editor*)arena_alloc(&g_scratch_arena, sizeof(Editor));
+    if (editor == NULL) {
+        console_putstr("Error: Not enough memory\n");
+        return;
+    }
+    editor_init(editor, full_path); // Use full path
+    editor_load_file(editor); // Use full path (editor->filename is already set)
+    editor_draw_content(editor);
 
     while (1) {
         char c = term_getchar();
         
         // Handle special keys
         if (c == 0x1B) { // ESC
-            editor_save_file(&editor); // Save automatically on ESC
+            editor_save_file(editor); // Save automatically on ESC
             g_exit_program = 0; // Reset exit flag (in case it was set by handler)
             break; // Exit editor loop immediately
         }
         // Handle control keys
         else if (c == 0x0F) { // Ctrl+O
-            editor_save_file(&editor);
+            editor_save_file(editor);
             console_putstr("\nFile saved\n");
         }
         else if (c == 0x0A) { // Enter
-            editor_new_line(&editor);
+            editor_new_line(editor);
         }
         else if (c == 0x7F) { // Backspace
-            editor_delete_char(&editor);
+            editor_delete_char(editor);
         }
         else if (c >= 32 && c <= 126) { // Printable characters
-            editor_insert_char(&editor, c);
+            editor_insert_char(editor, c);
         }
 
-        editor_draw_content(&editor);
+        editor_draw_content(editor);
     }
 
     console_clear(COLOR_WHITE, COLOR_BLACK);
@@ -275,11 +350,31 @@ void cmd_help() {
     console_putstr("! touch    - Create empty file\n");
     console_putstr("! cat      - Display file contents\n");
     console_putstr("! rm       - Remove file or directory\n");
+    console_putstr("! cp       - Copy files: cp [-r] <source> <destination>\n");
+    console_putstr("! mv       - Move or rename: mv <source> <destination>\n");
+    console_putstr("! grep     - Search files: grep [-s] [-c] <text> [dir]\n");
+    console_putstr("!            -s reads every file instead of asking the index, -c counts only\n");
+    console_putstr("! peek     - Show bytes of a file through a mapping: peek <file> <offset> [count]\n");
+    console_putstr("! poke     - Write text into a file through a mapping: poke <file> <offset> <text>\n");
     console_putstr("! pwd      - Show current directory\n");
     console_putstr("! nano     - Simple text editor\n");
     console_putstr("! snake    - Play the Snake game\n");
     console_putstr("! mouse-test - Run mouse functionality test\n");
-    console_putstr("! ls -l    - List files with permissions\n");
+    console_putstr("! ls -l    - List files with permissions, size and allocated bytes\n");
+    console_putstr("! mount    - Mount a partition: mount <drive> <part> <dir> [type]\n");
+    console_putstr("!            or: mount <device> <dir> [type], mount tmpfs <dir> [size=<KB>]\n");
+    console_putstr("!            type: ext2 (default) or fat (FAT12/16/32)\n");
+    console_putstr("! ramdisk  - Copy a partition to ram0: ramdisk <drive> <part>\n");
+    console_putstr("! fsbench  - File system benchmark: fsbench [dir] [ops]\n");
+    console_putstr("! umount   - Unmount a partition: umount <dir>\n");
+    console_putstr("! compress - LZ4 stats, or: compress on|off [file]\n");
+    console_putstr("! crcbench - CRC32C throughput and checksum errors\n");
+    console_putstr("! flusher  - Background write-back stats, or: flusher now\n");
+    console_putstr("! snapshot - List snapshots, or: snapshot create|delete <name>\n");
+    console_putstr("!            mount snapshot <name> <dir> shows one read-only\n");
+    console_putstr("! meminfo  - Memory use, or: meminfo track on|off, meminfo sites\n");
+    console_putstr("! swap     - Swap stats, or: swap on <drive> <part>|<device>, swap off,\n");
+    console_putstr("!            swap limit <KB>, swap test <KB>\n");
     console_putstr("\n");
 
     // Draw bottom border of the box in green
@@ -327,7 +422,8 @@ void cmd_clear() {
 }
 
 void cmd_exit() {
-    save_file_system(); // Сохраняем файловую систему перед завершением
+    mmap_sync_all();
+    vfs_sync(); // Сохраняем файловые системы перед завершением
     console_putstr("Shutting down...\n");
     
     // Try to use ACPI shutdown
@@ -343,7 +439,8 @@ void cmd_exit() {
 }
 
 void cmd_reboot() {
-    save_file_system(); // Сохраняем файловую систему перед перезагрузкой
+    mmap_sync_all();
+    vfs_sync(); // Сохраняем файловые системы перед перезагрузкой
     console_putstr("Rebooting...\n");
     
     // Try keyboard controller reset
@@ -382,65 +479,247 @@ void draw_pseudo_gui() {
     console_putstr("[ PSEUDO GUI WINDOW ]");
 }
 
-void cmd_ls() {
-    console_printf("Contents of %s:\n", current_dir);
-    for (int i = 0; i < file_count; i++) {
-        // Check if file is in current directory
-        char* last_slash = strrchr(file_system[i].path, '/');
-        char dir_path[MAX_PATH_LENGTH];
-        
-        if (last_slash) {
-            strncpy(dir_path, file_system[i].path, last_slash - file_system[i].path);
-            dir_path[last_slash - file_system[i].path] = '\0';
-        } else {
-            // Handle root directory case
-            dir_path[0] = '\0';
-        }
+static uint32 parse_number(const char** str) {
+    uint32 value = 0;
+    while (**str == ' ') {
+        (*str)++;
+    }
+    while (**str >= '0' && **str <= '9') {
+        value = value * 10 + (**str - '0');
+        (*str)++;
+    }
+    return value;
+}
 
-        // Special case for root directory listing
-        if (strcmp(current_dir, "/") == 0 && last_slash == NULL) {
-             if (file_system[i].is_directory) {
-                console_printf("[DIR] %s\n", file_system[i].name);
-            } else {
-                console_printf("%s (%d bytes)\n", file_system[i].name, file_system[i].size);
-            }
-        } else if (strcmp(dir_path, current_dir) == 0 && last_slash != NULL) {
-            if (file_system[i].is_directory) {
-                console_printf("[DIR] %s\n", last_slash + 1);
-            } else {
-                console_printf("%s (%d bytes)\n", last_slash + 1, file_system[i].size);
+// Copy the next space separated word of *str into out
+static void parse_word(const char** str, char* out, int size) {
+    int len = 0;
+    while (**str == ' ') {
+        (*str)++;
+    }
+    while (**str != '\0' && **str != ' ' && len < size - 1) {
+        out[len++] = *(*str)++;
+    }
+    out[len] = '\0';
+}
+
+static void cmd_mount_tmpfs(const char* args) {
+    char dir[MAX_PATH_LENGTH];
+    char options[32];
+    parse_word(&args, dir, sizeof(dir));
+    parse_word(&args, options, sizeof(options));
+    if (dir[0] == '\0') {
+        console_putstr("Usage: mount tmpfs <directory> [size=<KB>]\n");
+        return;
+    }
+
+    char full_path[MAX_PATH_LENGTH];
+    get_full_path(dir, full_path);
+    int res = vfs_mount("tmpfs", NULL, full_path, options[0] != '\0' ? options : NULL);
+    if (res == VFS_ERR_IO) {
+        console_putstr("Error: Bad options or too many tmpfs volumes\n");
+    } else if (res < 0) {
+        print_vfs_error(res);
+    } else {
+        console_printf("Mounted tmpfs on %s\n", full_path);
+    }
+}
+
+static void cmd_mount_snapshot(const char* args) {
+    char name[SNAPSHOT_NAME_LENGTH];
+    char dir[MAX_PATH_LENGTH];
+    parse_word(&args, name, sizeof(name));
+    parse_word(&args, dir, sizeof(dir));
+    if (dir[0] == '\0') {
+        console_putstr("Usage: mount snapshot <name> <directory>\n");
+        return;
+    }
+
+    char full_path[MAX_PATH_LENGTH];
+    get_full_path(dir, full_path);
+    int res = vfs_mount("snapshot", NULL, full_path, name);
+    if (res == VFS_ERR_IO) {
+        console_putstr("Error: No such snapshot, or it is damaged or already mounted\n");
+    } else if (res < 0) {
+        print_vfs_error(res);
+    } else {
+        console_printf("Mounted snapshot %s on %s (read-only)\n", name, full_path);
+    }
+}
+
+void cmd_mount(char* args) {
+    if (args[0] == '\0') {
+        for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+            VFS_MOUNT* m = vfs_get_mount(i);
+            if (m != NULL) {
+                console_printf("%s on %s type %s\n", m->dev != NULL ? m->dev->name : "none",
+                               m->path, m->driver->name);
             }
         }
+        return;
+    }
+
+    // mount tmpfs <directory> [size=<KB>]
+    if (memcmp((uint8*)args, (uint8*)"tmpfs ", 6)) {
+        cmd_mount_tmpfs(args + 6);
+        return;
+    }
+    // mount snapshot <name> <directory>
+    if (memcmp((uint8*)args, (uint8*)"snapshot ", 9)) {
+        cmd_mount_snapshot(args + 9);
+        return;
+    }
+
+    // mount <drive> <partition> <directory> [type]
+    // mount <device> <directory> [type]
+    const char* p = args;
+    BLOCK_DEVICE* dev;
+    if (args[0] >= '0' && args[0] <= '9') {
+        uint8 drive = parse_number(&p);
+        uint8 partition = parse_number(&p);
+        dev = blockdev_open_ide(drive, partition);
+    } else {
+        char name[BLOCKDEV_NAME_LENGTH];
+        parse_word(&p, name, sizeof(name));
+        dev = blockdev_find(name);
+    }
+    while (*p == ' ') {
+        p++;
+    }
+    char dir[MAX_PATH_LENGTH];
+    int len = 0;
+    while (p[len] != '\0' && p[len] != ' ' && len < MAX_PATH_LENGTH - 1) {
+        dir[len] = p[len];
+        len++;
+    }
+    dir[len] = '\0';
+    p += len;
+    while (*p == ' ') {
+        p++;
+    }
+    if (dir[0] == '\0') {
+        console_putstr("Usage: mount <drive> <partition> <directory> [type]\n");
+        return;
+    }
+
+    if (dev == NULL) {
+        console_putstr("Error: No such drive or partition\n");
+        return;
+    }
+    char full_path[MAX_PATH_LENGTH];
+    get_full_path(dir, full_path);
+    int res = vfs_mount(*p != '\0' ? p : "ext2", dev, full_path, NULL);
+    if (res == VFS_ERR_NO_DRIVER) {
+        console_putstr("Error: Unknown file system type\n");
+    } else if (res == VFS_ERR_IO) {
+        console_putstr("Error: Cannot mount volume\n");
+    } else if (res < 0) {
+        print_vfs_error(res);
+    } else {
+        console_printf("Mounted %s on %s\n", dev->name, full_path);
     }
 }
 
-void cmd_mkdir(char* args) {
+// ram0 as a copy of a disk or partition, to benchmark a file system without the disk
+void cmd_ramdisk(char* args) {
+    const char* p = args;
+    if (args[0] < '0' || args[0] > '9') {
+        console_putstr("Usage: ramdisk <drive> <partition>\n");
+        return;
+    }
+    uint8 drive = parse_number(&p);
+    uint8 partition = parse_number(&p);
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VFS_MOUNT* m = vfs_get_mount(i);
+        if (m != NULL && m->dev != NULL && strcmp(m->dev->name, RAMDISK_NAME) == 0) {
+            print_vfs_error(VFS_ERR_BUSY);
+            return;
+        }
+    }
+    BLOCK_DEVICE* src = blockdev_open_ide(drive, partition);
+    if (src == NULL) {
+        console_putstr("Error: No such drive or partition\n");
+        return;
+    }
+    BLOCK_DEVICE* dev = ramdisk_load(src);
+    if (dev == NULL) {
+        console_printf("Error: %s does not fit in %d sectors\n", src->name, RAMDISK_MAX_SECTORS);
+        return;
+    }
+    console_printf("%s: copy of %s, %u sectors\n", dev->name, src->name, dev->sector_count);
+}
+
+void cmd_fsbench(char* args) {
+    char dir[MAX_PATH_LENGTH];
+    char full_path[MAX_PATH_LENGTH];
+    const char* p = args;
+    parse_word(&p, dir, sizeof(dir));
+    uint32 count = parse_number(&p);
+    get_full_path(dir[0] != '\0' ? dir : ".", full_path);
+    int res = fsbench_run(full_path, count);
+    if (res < 0) {
+        print_vfs_error(res);
+    }
+}
+
+void cmd_umount(char* args) {
     if (args[0] == '\0') {
-        console_putstr("Usage: mkdir <directory_name>\n");
+        console_putstr("Usage: umount <directory>\n");
+        return;
+    }
+    char full_path[MAX_PATH_LENGTH];
+    char mount_point[MAX_PATH_LENGTH];
+    get_full_path(args, full_path);
+    if (vfs_normalize_path(full_path, mount_point) != 0) {
+        print_vfs_error(VFS_ERR_INVALID);
         return;
     }
 
-    if (file_count >= MAX_FILES) {
-        console_putstr("Error: File system is full\n");
+    int res = vfs_umount(mount_point);
+    if (res < 0) {
+        print_vfs_error(res);
+        return;
+    }
+    // Leave the volume if the shell was inside it
+    int len = strlen(mount_point);
+    if (memcmp((uint8*)current_dir, (uint8*)mount_point, len) &&
+        (current_dir[len] == '\0' || current_dir[len] == '/')) {
+        strcpy(current_dir, home_dir);
+    }
+    console_printf("Unmounted %s\n", mount_point);
+}
+
+static int ls_print_entry(const char* name, const VFS_STAT* st, void* arg) {
+    if (st->is_directory) {
+        console_printf("[DIR] %s\n", name);
+    } else {
+        console_printf("%s (%d bytes)\n", name, st->size);
+    }
+    return 0;
+}
+
+void cmd_ls() {
+    console_printf("Contents of %s:\n", current_dir);
+    int res = vfs_readdir(current_dir, ls_print_entry, NULL);
+    if (res < 0) {
+        print_vfs_error(res);
+    }
+}
+
+void cmd_mkdir(char* args) {
+    if (args[0] == '\0') {
+        console_putstr("Usage: mkdir <directory_name>\n");
         return;
     }
 
     char full_path[MAX_PATH_LENGTH];
     get_full_path(args, full_path);
 
-    if (find_file(full_path) != -1) {
-        console_putstr("Error: File or directory already exists\n");
+    int res = vfs_create(full_path, 1, 0755);
+    if (res < 0) {
+        print_vfs_error(res);
         return;
     }
-
-    strcpy(file_system[file_count].name, args);
-    file_system[file_count].is_directory = 1;
-    file_system[file_count].size = 0;
-    strcpy(file_system[file_count].path, full_path);
-    file_system[file_count].permissions = 0755;
-    // Для директорий и новых файлов просто очищаем content
-    file_system[file_count].content[0] = '\0';
-    file_count++;
     console_printf("Directory '%s' created\n", args);
 }
 
@@ -451,20 +730,25 @@ void cmd_cd(char* args) {
     }
 
     char full_path[MAX_PATH_LENGTH];
+    char normalized[MAX_PATH_LENGTH];
     get_full_path(args, full_path);
+    if (vfs_normalize_path(full_path, normalized) != 0) {
+        console_putstr("Error: Directory not found\n");
+        return;
+    }
 
-    int file_index = find_file(full_path);
-    if (file_index == -1) {
+    VFS_STAT st;
+    if (vfs_stat(normalized, &st) != 0) {
         console_putstr("Error: Directory not found\n");
         return;
     }
 
-    if (!file_system[file_index].is_directory) {
+    if (!st.is_directory) {
         console_putstr("Error: Not a directory\n");
         return;
     }
 
-    strcpy(current_dir, full_path);
+    strcpy(current_dir, normalized); // "." и ".." уже разрешены
     console_printf("Changed directory to %s\n", current_dir);
 }
 
@@ -474,27 +758,14 @@ void cmd_touch(char* args) {
         return;
     }
 
-    if (file_count >= MAX_FILES) {
-        console_putstr("Error: File system is full\n");
-        return;
-    }
-
     char full_path[MAX_PATH_LENGTH];
     get_full_path(args, full_path);
 
-    if (find_file(full_path) != -1) {
-        console_putstr("Error: File already exists\n");
+    int res = vfs_create(full_path, 0, 0644); // New files are empty, no content allocated yet
+    if (res < 0) {
+        print_vfs_error(res);
         return;
     }
-
-    strcpy(file_system[file_count].name, args);
-    file_system[file_count].is_directory = 0;
-    file_system[file_count].size = 0;
-    strcpy(file_system[file_count].path, full_path);
-    file_system[file_count].permissions = 0644;
-    // Для директорий и новых файлов просто очищаем content
-    file_system[file_count].content[0] = '\0'; // New files are empty, no content allocated yet
-    file_count++;
     console_printf("File '%s' created\n", args);
 }
 
@@ -507,29 +778,39 @@ void cmd_cat(char* args) {
     char full_path[MAX_PATH_LENGTH];
     get_full_path(args, full_path);
 
-    int file_index = find_file(full_path);
-    if (file_index == -1) {
+    VFS_STAT st;
+    int res = vfs_stat(full_path, &st);
+    if (res < 0) {
         console_putstr("Error: File not found\n");
         return;
     }
-
-    if (file_system[file_index].is_directory) {
+    if (st.is_directory) {
         console_putstr("Error: Cannot display directory contents\n");
         return;
     }
-
-    if (file_system[file_index].size == 0) {
+    if (st.size == 0) {
         console_putstr("File is empty\n");
         return;
     }
 
-    // TODO: Implement reading file content from disk
-    // For now, simulate reading by printing a message and size
-    console_printf("Reading file '%s' (%d bytes) from disk (simulated)...\n", file_system[file_index].name, file_system[file_index].size);
-    // In a real implementation:
-    // 1. Allocate a buffer for the file content.
-    // 2. Read sectors from disk based on file_system[file_index].start_lba and num_sectors using read_from_disk.
-    // 3. Print the content of the buffer.
+    // Stream the file in fixed-size chunks, whatever its size
+    int fd = vfs_open(full_path, VFS_O_READ);
+    if (fd < 0) {
+        print_vfs_error(fd);
+        return;
+    }
+    char chunk[512];
+    int n;
+    while ((n = vfs_read(fd, chunk, sizeof(chunk))) > 0) {
+        for (int i = 0; i < n; i++) {
+            console_putchar(chunk[i]);
+        }
+    }
+    vfs_close(fd);
+    console_putchar('\n');
+    if (n < 0) {
+        print_vfs_error(n);
+    }
 }
 
 void cmd_rm(char* args) {
@@ -539,89 +820,697 @@ void cmd_rm(char* args) {
     }
 
     char full_path[MAX_PATH_LENGTH];
+    char normalized[MAX_PATH_LENGTH];
     get_full_path(args, full_path);
-
-    int file_index = find_file(full_path);
-    if (file_index == -1) {
+    if (vfs_normalize_path(full_path, normalized) != 0) {
         console_putstr("Error: File or directory not found\n");
         return;
     }
 
     // Don't allow removing root or home directories
-    if (strcmp(full_path, "/") == 0 || strcmp(full_path, "/home") == 0) {
+    if (strcmp(normalized, "/") == 0 || strcmp(normalized, HOME_DIR) == 0) {
         console_putstr("Error: Cannot remove system directories\n");
         return;
     }
 
-    // TODO: Implement freeing disk sectors
-    // For now, just remove the entry from the in-memory representation
-    // In a real implementation:
-    // 1. Free the disk sectors allocated to the file/directory.
-    // 2. Update the file system structure on disk.
+    int res = vfs_unlink(normalized);
+    if (res < 0) {
+        print_vfs_error(res);
+        return;
+    }
+    console_printf("Removed '%s'\n", args);
+}
 
-    // Move the last file to the deleted position
-    file_count--;
-    if (file_index != file_count) {
-        memcpy(&file_system[file_index], &file_system[file_count], sizeof(FileEntry));
+// Source and destination of cp and mv as normalized absolute paths.
+// A destination that is a directory receives the source under its name.
+static int parse_copy_args(const char* args, char* from, char* to, int* recursive) {
+    char word[MAX_PATH_LENGTH];
+    char full_path[MAX_PATH_LENGTH];
+    const char* p = args;
+    parse_word(&p, word, sizeof(word));
+    *recursive = strcmp(word, "-r") == 0;
+    if (*recursive) {
+        parse_word(&p, word, sizeof(word));
+    }
+    get_full_path(word, full_path);
+    if (word[0] == '\0' || vfs_normalize_path(full_path, from) != 0) {
+        return VFS_ERR_INVALID;
+    }
+    parse_word(&p, word, sizeof(word));
+    get_full_path(word, full_path);
+    if (word[0] == '\0' || vfs_normalize_path(full_path, to) != 0) {
+        return VFS_ERR_INVALID;
+    }
+    if (strcmp(from, "/") == 0 || strcmp(from, HOME_DIR) == 0) {
+        return VFS_ERR_BUSY;
     }
 
-    console_printf("Removed '%s'\n", args);
-    save_file_system(); // Save changes to disk
+    VFS_STAT st;
+    if (vfs_stat(to, &st) == 0 && st.is_directory) {
+        const char* name = strrchr(from, '/') + 1;
+        int len = strlen(to);
+        int sep = to[len - 1] == '/' ? 0 : 1;
+        if (len + sep + strlen(name) >= MAX_PATH_LENGTH) {
+            return VFS_ERR_INVALID;
+        }
+        if (sep) {
+            to[len] = '/';
+        }
+        strcpy(to + len + sep, name);
+    }
+    return 0;
+}
+
+static void print_copy_stats(const CopyStats* stats) {
+    console_printf("%u files, %u directories: %u bytes copied, %u bytes shared\n",
+                   stats->files, stats->dirs, stats->bytes_copied, stats->bytes_shared);
+}
+
+void cmd_cp(char* args) {
+    char from[MAX_PATH_LENGTH];
+    char to[MAX_PATH_LENGTH];
+    int recursive;
+    int res = parse_copy_args(args, from, to, &recursive);
+    if (res == VFS_ERR_INVALID) {
+        console_putstr("Usage: cp [-r] <source> <destination>\n");
+        return;
+    }
+    CopyStats stats;
+    if (res == 0) {
+        res = copy_tree(from, to, recursive, &stats);
+    }
+    if (res == VFS_ERR_IS_DIR && !recursive) {
+        console_putstr("Error: Is a directory, use cp -r\n");
+        return;
+    }
+    if (res < 0) {
+        print_vfs_error(res);
+        return;
+    }
+    console_printf("Copied %s to %s: ", from, to);
+    print_copy_stats(&stats);
+}
+
+void cmd_mv(char* args) {
+    char from[MAX_PATH_LENGTH];
+    char to[MAX_PATH_LENGTH];
+    int recursive;
+    int res = parse_copy_args(args, from, to, &recursive);
+    if (res == VFS_ERR_INVALID || recursive) {
+        console_putstr("Usage: mv <source> <destination>\n");
+        return;
+    }
+    CopyStats stats;
+    if (res == 0) {
+        res = move_tree(from, to, &stats);
+    }
+    if (res < 0) {
+        print_vfs_error(res);
+        return;
+    }
+    console_printf("Moved %s to %s\n", from, to);
+    if (stats.files + stats.dirs > 0) {
+        console_putstr("Copied between file systems: ");
+        print_copy_stats(&stats);
+    }
+}
+
+void cmd_grep(char* args) {
+    char word[MAX_PATH_LENGTH];
+    char pattern[GREP_MAX_PATTERN + 1];
+    char full_path[MAX_PATH_LENGTH];
+    char dir[MAX_PATH_LENGTH];
+    uint32 flags = 0;
+    const char* p = args;
+    parse_word(&p, word, sizeof(word));
+    while (strcmp(word, "-s") == 0 || strcmp(word, "-c") == 0) {
+        flags |= word[1] == 's' ? GREP_NO_INDEX : GREP_QUIET;
+        parse_word(&p, word, sizeof(word));
+    }
+    if (word[0] == '\0' || strlen(word) > GREP_MAX_PATTERN) {
+        console_putstr("Usage: grep [-s] [-c] <text> [dir]\n");
+        return;
+    }
+    strcpy(pattern, word);
+    parse_word(&p, word, sizeof(word));
+    get_full_path(word[0] != '\0' ? word : ".", full_path);
+    if (vfs_normalize_path(full_path, dir) != 0) {
+        print_vfs_error(VFS_ERR_INVALID);
+        return;
+    }
+    GrepStats stats;
+    int res = grep_tree(dir, pattern, flags, &stats);
+    if (res < 0) {
+        print_vfs_error(res);
+    }
+    console_printf("%u lines in %u files; read %u of %u files, %u bytes, %u us\n",
+                   stats.lines, stats.files_matched, stats.files_read, stats.files,
+                   stats.bytes_read, tsc_kcycles_to_us(stats.kcycles));
+}
+
+#define PEEK_MAX 512
+
+static void print_mmap_stats(const MmapStats* before) {
+    console_printf("Faults %u, %u bytes read, %u pages written back\n",
+                   mmap_stats.faults - before->faults, mmap_stats.bytes_read - before->bytes_read,
+                   mmap_stats.pages_written - before->pages_written);
+}
+
+// File and offset arguments of peek and poke, the offset past the end is refused
+static int parse_map_args(const char** p, char* full_path, uint32* offset, uint32* size) {
+    char name[MAX_PATH_LENGTH];
+    VFS_STAT st;
+    parse_word(p, name, sizeof(name));
+    if (name[0] == '\0') {
+        return VFS_ERR_INVALID;
+    }
+    get_full_path(name, full_path);
+    *offset = parse_number(p);
+    int res = vfs_stat(full_path, &st);
+    if (res == 0 && *offset >= st.size) {
+        res = VFS_ERR_INVALID;
+    }
+    *size = st.size;
+    return res;
+}
+
+void cmd_peek(char* args) {
+    char full_path[MAX_PATH_LENGTH];
+    uint32 offset, size;
+    const char* p = args;
+    int res = parse_map_args(&p, full_path, &offset, &size);
+    uint32 count = parse_number(&p);
+    if (res == VFS_ERR_INVALID) {
+        console_putstr("Usage: peek <file> <offset> [count], offset below the file size\n");
+        return;
+    }
+    if (count == 0 || count > PEEK_MAX) {
+        count = count == 0 ? 64 : PEEK_MAX;
+    }
+    if (count > size - offset) {
+        count = size - offset;
+    }
+    MmapStats before = mmap_stats;
+    void* map;
+    if (res == 0) {
+        res = mmap_file(full_path, 0, 0, MMAP_READ, &map);
+    }
+    if (res != 0) {
+        print_vfs_error(res);
+        return;
+    }
+    const uint8* bytes = (const uint8*)map + offset;
+    for (uint32 i = 0; i < count; i++) {
+        uint8 c = bytes[i]; // the first touch of each page reads it
+        console_putchar((c >= ' ' && c < 127) || c == '\n' ? c : '.');
+    }
+    console_putchar('\n');
+    mmap_unmap(map);
+    console_printf("%u bytes at %u of %u: ", count, offset, size);
+    print_mmap_stats(&before);
+}
+
+void cmd_poke(char* args) {
+    char full_path[MAX_PATH_LENGTH];
+    uint32 offset, size;
+    const char* p = args;
+    int res = parse_map_args(&p, full_path, &offset, &size);
+    while (*p == ' ') {
+        p++;
+    }
+    uint32 length = strlen(p);
+    if (res == VFS_ERR_INVALID || length == 0) {
+        console_putstr("Usage: poke <file> <offset> <text>, the file does not grow\n");
+        return;
+    }
+    if (length > size - offset) {
+        length = size - offset;
+    }
+    MmapStats before = mmap_stats;
+    void* map;
+    if (res == 0) {
+        res = mmap_file(full_path, 0, 0, MMAP_READ | MMAP_WRITE, &map);
+    }
+    if (res != 0) {
+        print_vfs_error(res);
+        return;
+    }
+    memcpy((uint8*)map + offset, p, length);
+    res = mmap_unmap(map); // writes the dirty pages back
+    if (res != 0) {
+        print_vfs_error(res);
+        return;
+    }
+    console_printf("%u bytes written at %u: ", length, offset);
+    print_mmap_stats(&before);
+}
+
+// Print a KB/s figure as MB/s with one decimal
+static void print_rate(const char* label, uint32 bytes, uint32 kcycles) {
+    uint32 kbs = tsc_rate_kbs(bytes, kcycles);
+    console_printf("%s%u.%u MB/s", label, kbs / 1000, (kbs % 1000) / 100);
+}
+
+static void print_compress_stats() {
+    const FsDataStats* st = &fs_data_stats;
+    console_printf("New files: %s\n", (fs_compress_default & FS_FLAG_COMPRESS) ? "compressed" : "plain");
+    if (tsc_khz() == 0) {
+        console_putstr("TSC not calibrated, rates unavailable\n");
+    }
+
+    uint32 sectors = st->sectors_written ? st->sectors_written : 1;
+    uint32 ratio = st->raw_sectors_written * 100 / sectors;
+    console_printf("Written: %u bytes, %u sectors of %u (ratio %u.%u%u), LZ4 %u, bypassed %u\n",
+                   st->bytes_written, st->sectors_written, st->raw_sectors_written,
+                   ratio / 100, ratio / 10 % 10, ratio % 10, st->blocks_compressed, st->blocks_bypassed);
+    print_rate("  effective ", st->bytes_written, st->write_cycles);
+    console_printf(", compressing %u us\n", tsc_kcycles_to_us(st->compress_cycles));
+
+    console_printf("Read: %u bytes, %u sectors of %u\n",
+                   st->bytes_read, st->sectors_read, st->raw_sectors_read);
+    print_rate("  effective ", st->bytes_read, st->read_cycles);
+    // What the sectors saved would have cost at the measured disk speed
+    uint32 io_us = tsc_kcycles_to_us(st->read_cycles - st->decompress_cycles);
+    uint32 saved = st->raw_sectors_read - st->sectors_read;
+    uint32 saved_us = st->sectors_read ? io_us / st->sectors_read * saved : 0;
+    console_printf(", decompressing %u us, %u sectors saved (~%u us of I/O)\n",
+                   tsc_kcycles_to_us(st->decompress_cycles), saved, saved_us);
+}
+
+// Compression only exists on the root volume: is path on it?
+static int on_root_volume(const char* path) {
+    int best = 0;
+    int on_root = 1;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VFS_MOUNT* mount = vfs_get_mount(i);
+        if (mount == NULL) {
+            continue;
+        }
+        int len = strlen(mount->path);
+        if (len > best && memcmp((uint8*)path, (uint8*)mount->path, len) &&
+            (path[len] == '\0' || path[len] == '/' || len == 1)) {
+            best = len;
+            on_root = mount->driver == &infs_driver;
+        }
+    }
+    return on_root;
+}
+
+void cmd_compress(char* args) {
+    if (args[0] == '\0') {
+        print_compress_stats();
+        return;
+    }
+
+    uint8 enable;
+    char* name;
+    if (memcmp((uint8*)args, (uint8*)"on", 2) && (args[2] == '\0' || args[2] == ' ')) {
+        enable = 1;
+        name = args + 2;
+    } else if (memcmp((uint8*)args, (uint8*)"off", 3) && (args[3] == '\0' || args[3] == ' ')) {
+        enable = 0;
+        name = args + 3;
+    } else {
+        console_putstr("Usage: compress [on|off [file]]\n");
+        return;
+    }
+    while (*name == ' ') {
+        name++;
+    }
+
+    if (*name == '\0') {
+        fs_compress_default = enable ? FS_FLAG_COMPRESS : 0;
+        console_printf("New files will be stored %s\n", enable ? "compressed" : "plain");
+        return;
+    }
+
+    char full_path[MAX_PATH_LENGTH];
+    char normalized[MAX_PATH_LENGTH];
+    get_full_path(name, full_path);
+    if (vfs_normalize_path(full_path, normalized) != 0) {
+        print_vfs_error(VFS_ERR_NOT_FOUND);
+        return;
+    }
+    if (!on_root_volume(normalized)) {
+        console_putstr("Error: Compression is only supported on the root file system\n");
+        return;
+    }
+    int index = find_file(normalized);
+    if (index == -1) {
+        print_vfs_error(VFS_ERR_NOT_FOUND);
+        return;
+    }
+    if (file_system[index].is_directory) {
+        print_vfs_error(VFS_ERR_IS_DIR);
+        return;
+    }
+    int res = set_file_compression(index, enable);
+    commit_file_system();
+    if (res != 0) {
+        print_vfs_error(VFS_ERR_IO);
+        return;
+    }
+    console_printf("'%s' is stored %s\n", name,
+                   (file_system[index].flags & FS_FLAG_LZ4) ? "as LZ4" : "uncompressed");
+}
+
+#define CRC_BENCH_BYTES (4 * 1024 * 1024) // per block size and implementation
+
+static uint8 crc_bench_buf[32768];
+MEMINFO_STATIC(crc_bench_buf);
+
+// Checksum CRC_BENCH_BYTES in blocks of size, returns the elapsed kcycles
+static uint32 crc_bench(uint32 (*crc)(uint32, const void*, uint32), uint32 size, uint32* result) {
+    uint32 started = tsc_kcycles();
+    uint32 acc = 0;
+    for (uint32 done = 0; done < CRC_BENCH_BYTES; done += size) {
+        acc ^= crc(0, crc_bench_buf, size);
+    }
+    *result = acc;
+    return tsc_kcycles() - started;
+}
+
+void cmd_crcbench() {
+    static const uint32 sizes[] = {512, 4096, 32768};
+    uint32 a, b;
+
+    if (tsc_khz() == 0) {
+        console_putstr("TSC not calibrated, rates unavailable\n");
+    }
+    for (uint32 i = 0; i < sizeof(crc_bench_buf); i++) {
+        crc_bench_buf[i] = i * 7 + (i >> 8);
+    }
+    console_printf("CRC32C: %s\n", crc32c_hw() ? "SSE4.2 crc32" : "slice-by-8 (no SSE4.2)");
+    for (uint32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        console_printf("%u bytes:", sizes[i]);
+        print_rate(" slice-by-8 ", CRC_BENCH_BYTES, crc_bench(crc32c_slice8, sizes[i], &a));
+        if (crc32c_hw()) {
+            print_rate(", SSE4.2 ", CRC_BENCH_BYTES, crc_bench(crc32c_sse42, sizes[i], &b));
+            if (a != b) {
+                console_putstr(" MISMATCH");
+            }
+        }
+        console_putstr("\n");
+    }
+    console_printf("Checksum errors since boot: %u\n", fs_crc_errors);
+}
+
+void cmd_flusher(char* args) {
+    if (strcmp(args, "now") == 0) {
+        flusher_run_now();
+    } else if (args[0] != '\0') {
+        console_putstr("Usage: flusher [now]\n");
+        return;
+    }
+    const FlusherStats* st = &flusher_stats;
+    console_printf("Pending: %u journal records, %u mapped pages; journal %u of %u sectors used\n",
+                   journal_pending_records(), mmap_dirty_pages(), journal_used(), JOURNAL_SECTORS);
+    console_printf("Runs %u (%u by age), %u transactions of %u records, %u checkpoints\n",
+                   st->runs, st->by_age, st->transactions, st->records, st->checkpoints);
+    console_printf("Mapped pages written %u, volume syncs %u, %u us writing\n",
+                   st->mmap_pages, st->volume_syncs, tsc_kcycles_to_us(st->kcycles));
+}
+
+#define MEMINFO_STATIC_LINES 6
+
+static uint32 section_kb(const uint8* start, const uint8* end) {
+    return (end - start + 1023) / 1024;
+}
+
+// Largest registered static tables first, count of them
+static void print_static_tables(int count) {
+    const MEMINFO_STATIC_ENTRY* last = NULL;
+    for (int n = 0; n < count; n++) {
+        const MEMINFO_STATIC_ENTRY* best = NULL;
+        for (const MEMINFO_STATIC_ENTRY* e = __meminfo_statics_start; e < __meminfo_statics_end; e++) {
+            int after_last = last == NULL || e->size < last->size || (e->size == last->size && e > last);
+            if (after_last && (best == NULL || e->size > best->size)) {
+                best = e;
+            }
+        }
+        if (best == NULL) {
+            break;
+        }
+        console_printf("  %s: %u KB\n", best->name, best->size / 1024);
+        last = best;
+    }
+}
+
+// Callsites recorded by the tracking mode
+static void print_alloc_sites() {
+    const KMALLOC_SITE* site;
+    if (kmalloc_site_get(0) == NULL) {
+        console_putstr("No allocations recorded\n");
+    }
+    for (int i = 0; (site = kmalloc_site_get(i)) != NULL; i++) {
+        console_printf("0x%x: %u bytes live in %u, %u allocations\n",
+                       site->site, site->live_bytes, site->live_count, site->allocations);
+    }
+    if (kmalloc_stats.untracked != 0) {
+        console_printf("%u allocations not recorded, the tables were full\n", kmalloc_stats.untracked);
+    }
+    console_putstr("Addresses are return addresses: addr2line -e kernel.bin <address>\n");
+}
+
+void cmd_meminfo(char* args) {
+    if (strcmp(args, "track on") == 0 || strcmp(args, "track off") == 0) {
+        kmalloc_track(args[7] == 'n');
+        console_printf("Allocation tracking %s\n", kmalloc_tracking() ? "on" : "off");
+        return;
+    }
+    if (strcmp(args, "sites") == 0) {
+        print_alloc_sites();
+        return;
+    }
+    if (args[0] != '\0') {
+        console_putstr("Usage: meminfo [track on|off|sites]\n");
+        return;
+    }
+
+    console_printf("Physical: %u KB, used %u KB, free %u KB (%u KB taken at boot)\n",
+                   pmm_stats.total_frames * 4, (pmm_stats.total_frames - pmm_stats.free_frames) * 4,
+                   pmm_stats.free_frames * 4, pmm_stats.reserved_frames * 4);
+    console_printf("Kernel image: %u KB: text %u, rodata %u, data %u, bss %u (stack %u) KB\n",
+                   section_kb(&__kernel_section_start, &__kernel_section_end),
+                   section_kb(&__kernel_text_section_start, &__kernel_text_section_end),
+                   section_kb(&__kernel_rodata_section_start, &__kernel_rodata_section_end),
+                   section_kb(&__kernel_data_section_start, &__kernel_data_section_end),
+                   section_kb(&__kernel_bss_section_start, &__kernel_bss_section_end),
+                   section_kb(&__kernel_stack_start, &__kernel_stack_end));
+
+    uint32 slab_kb = 0;
+    KMEM_CACHE* cache;
+    for (int i = 0; (cache = kmem_cache_get(i)) != NULL; i++) {
+        slab_kb += cache->slabs * (PMM_FRAME_SIZE / 1024 << cache->order);
+    }
+    console_printf("Heap: slabs %u KB, large blocks %u KB, %u failed allocations%s\n", slab_kb,
+                   kmalloc_stats.large_frames * 4, kmalloc_stats.failures,
+                   kmalloc_tracking() ? ", tracking on" : "");
+    for (int i = 0; (cache = kmem_cache_get(i)) != NULL; i++) {
+        if (cache->slabs == 0 && cache->allocations == 0) {
+            continue;
+        }
+        console_printf("  %s: %u objects of %u bytes, %u slabs (%u KB), %u allocations\n",
+                       cache->name, cache->in_use, cache->object_size, cache->slabs,
+                       cache->slabs * (PMM_FRAME_SIZE / 1024 << cache->order), cache->allocations);
+    }
+    console_printf("Anonymous: %u KB resident, %u KB in swap\n",
+                   swap_stats.resident * 4, swap_stats.slots_used * 4);
+    console_printf("Scratch arena: at most %u of %u KB used, %u failed allocations\n",
+                   (g_scratch_arena.peak + 1023) / 1024, g_scratch_arena.size / 1024, g_scratch_arena.failures);
+    console_putstr("Largest static tables:\n");
+    print_static_tables(MEMINFO_STATIC_LINES);
+}
+
+// Fill kb KB of anonymous memory with a pattern and check it back
+static void swap_test(uint32 kb) {
+    uint32* data;
+    int res = swap_alloc(kb * 1024, (void**)&data);
+    if (res != 0) {
+        print_vfs_error(res);
+        return;
+    }
+    SwapStats before = swap_stats;
+    uint32 words = kb * 1024 / sizeof(uint32);
+    uint32 bad = 0;
+    for (uint32 i = 0; i < words; i++) {
+        data[i] = i * 2654435761u;
+    }
+    for (uint32 i = 0; i < words; i++) {
+        if (data[i] != i * 2654435761u) {
+            bad++;
+        }
+    }
+    console_printf("%u KB: %u minor and %u major faults, %u pages written, %u bad words\n", kb,
+                   swap_stats.minor_faults - before.minor_faults, swap_stats.major_faults - before.major_faults,
+                   swap_stats.pages_out - before.pages_out, bad);
+    swap_free(data);
+}
+
+void cmd_swap(char* args) {
+    const char* p = args;
+    char action[8];
+    parse_word(&p, action, sizeof(action));
+
+    if (strcmp(action, "on") == 0) {
+        // swap on <drive> <partition>
+        // swap on <device>
+        BLOCK_DEVICE* dev;
+        while (*p == ' ') {
+            p++;
+        }
+        if (*p >= '0' && *p <= '9') {
+            uint8 drive = parse_number(&p);
+            uint8 partition = parse_number(&p);
+            dev = blockdev_open_ide(drive, partition);
+        } else {
+            char name[BLOCKDEV_NAME_LENGTH];
+            parse_word(&p, name, sizeof(name));
+            dev = blockdev_find(name);
+        }
+        if (dev == NULL) {
+            console_putstr("Error: No such drive or partition\n");
+            return;
+        }
+        int res = swap_on(dev);
+        if (res < 0) {
+            print_vfs_error(res);
+            return;
+        }
+        console_printf("Swapping to %s, %u KB\n", dev->name, swap_stats.slots * 4);
+        return;
+    }
+    if (strcmp(action, "off") == 0) {
+        int res = swap_off();
+        if (res < 0) {
+            print_vfs_error(res);
+        }
+        return;
+    }
+    if (strcmp(action, "limit") == 0) {
+        uint32 kb = parse_number(&p);
+        if (kb != 0 && kb < PAGE_SIZE / 1024) {
+            console_putstr("Error: The limit is at least 4 KB, 0 for none\n");
+            return;
+        }
+        int res = swap_set_limit(kb / 4);
+        if (res < 0) {
+            print_vfs_error(res);
+        }
+        return;
+    }
+    if (strcmp(action, "test") == 0) {
+        uint32 kb = parse_number(&p);
+        if (kb == 0) {
+            console_putstr("Usage: swap test <KB>\n");
+            return;
+        }
+        if (kb > PAGING_ANON_SIZE / 1024) {
+            print_vfs_error(VFS_ERR_TOO_BIG); // kb * 1024 would not fit either
+            return;
+        }
+        swap_test(kb);
+        return;
+    }
+    if (action[0] != '\0') {
+        console_putstr("Usage: swap [on <drive> <partition>|on <device>|off|limit <KB>|test <KB>]\n");
+        return;
+    }
+
+    const SwapStats* st = &swap_stats;
+    BLOCK_DEVICE* dev = swap_device();
+    if (dev != NULL) {
+        console_printf("Swap: %s, %u of %u KB used\n", dev->name, st->slots_used * 4, st->slots * 4);
+    } else {
+        console_putstr("Swap: off\n");
+    }
+    if (swap_limit() != 0) {
+        console_printf("Resident: %u KB, limit %u KB\n", st->resident * 4, swap_limit() * 4);
+    } else {
+        console_printf("Resident: %u KB, no limit\n", st->resident * 4);
+    }
+    console_printf("Faults: %u minor, %u major; %u pages written, %u evictions\n",
+                   st->minor_faults, st->major_faults, st->pages_out, st->evictions);
+}
+
+void cmd_snapshot(char* args) {
+    const char* p = args;
+    char action[8];
+    char name[SNAPSHOT_NAME_LENGTH + 1];
+    parse_word(&p, action, sizeof(action));
+    parse_word(&p, name, sizeof(name));
+
+    if (action[0] == '\0') {
+        int shown = 0;
+        for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+            const SnapshotDesc* desc = &snapshots[i];
+            if (!desc->in_use) {
+                continue;
+            }
+            console_printf("%s: generation %u, %u files, %u metadata blocks copied, %u slots only it holds\n",
+                           desc->name, desc->generation, desc->file_count, snapshot_preserved_blocks(i),
+                           snapshot_unique_slots(i));
+            shown++;
+        }
+        if (shown == 0) {
+            console_putstr("No snapshots\n");
+        }
+        return;
+    }
+    if (name[0] == '\0' || (strcmp(action, "create") != 0 && strcmp(action, "delete") != 0)) {
+        console_putstr("Usage: snapshot [create|delete <name>]\n");
+        return;
+    }
+
+    if (strcmp(action, "create") == 0) {
+        // Everything written so far goes into the snapshot
+        mmap_sync_all();
+        vfs_sync();
+        uint32 started = tsc_kcycles();
+        int res = snapshot_create(name);
+        if (res == VFS_ERR_NO_SPACE) {
+            console_printf("Error: At most %d snapshots\n", FS_MAX_SNAPSHOTS);
+        } else if (res < 0) {
+            print_vfs_error(res);
+        } else {
+            console_printf("Snapshot %s is generation %u (%u us)\n", name, snapshots[res].generation,
+                           tsc_kcycles_to_us(tsc_kcycles() - started));
+        }
+        return;
+    }
+    int res = snapshot_delete(name);
+    if (res < 0) {
+        print_vfs_error(res);
+    } else {
+        console_printf("Deleted snapshot %s, %d data slots freed\n", name, res);
+    }
 }
 
 void cmd_pwd() {
     console_printf("Current directory: %s\n", current_dir);
 }
 
+static int ls_l_print_entry(const char* name, const VFS_STAT* st, void* arg) {
+    // Convert permissions to string
+    char perms[11];
+    const char* bits = "rwxrwxrwx";
+    perms[0] = st->is_directory ? 'd' : '-';
+    for (int b = 0; b < 9; b++) {
+        perms[b + 1] = (st->permissions & (0400 >> b)) ? bits[b] : '-';
+    }
+    perms[10] = '\0';
+
+    // logical size, then what is allocated for it: less for sparse files
+    console_printf("%s %u %u %s\n", perms, st->size, st->allocated, name);
+    return 0;
+}
+
 // Add new command to show file permissions
 void cmd_ls_l() {
     console_printf("Contents of %s:\n", current_dir);
-    for (int i = 0; i < file_count; i++) {
-        char* last_slash = strrchr(file_system[i].path, '/');
-        char dir_path[MAX_PATH_LENGTH];
-
-        if (last_slash) {
-            strncpy(dir_path, file_system[i].path, last_slash - file_system[i].path);
-            dir_path[last_slash - file_system[i].path] = '\0';
-        } else {
-            // Handle root directory case
-            dir_path[0] = '\0';
-        }
-
-        // Special case for root directory listing
-        if (strcmp(current_dir, "/") == 0 && last_slash == NULL) {
-            // Convert permissions to string
-            char perms[10];
-            sprintf(perms, "%c%c%c%c%c%c%c%c%c",
-                file_system[i].is_directory ? 'd' : '-',
-                (file_system[i].permissions & 0400) ? 'r' : '-',
-                (file_system[i].permissions & 0200) ? 'w' : '-',
-                (file_system[i].permissions & 0100) ? 'x' : '-',
-                (file_system[i].permissions & 0040) ? 'r' : '-',
-                (file_system[i].permissions & 0020) ? 'w' : '-',
-                (file_system[i].permissions & 0010) ? 'x' : '-',
-                (file_system[i].permissions & 0004) ? 'r' : '-',
-                (file_system[i].permissions & 0002) ? 'w' : '-',
-                (file_system[i].permissions & 0001) ? 'x' : '-');
-            
-            console_printf("%s %d %s\n", perms, file_system[i].size, file_system[i].name);
-        } else if (strcmp(dir_path, current_dir) == 0 && last_slash != NULL) {
-            // Convert permissions to string
-            char perms[10];
-            sprintf(perms, "%c%c%c%c%c%c%c%c%c",
-                file_system[i].is_directory ? 'd' : '-',
-                (file_system[i].permissions & 0400) ? 'r' : '-',
-                (file_system[i].permissions & 0200) ? 'w' : '-',
-                (file_system[i].permissions & 0100) ? 'x' : '-',
-                (file_system[i].permissions & 0040) ? 'r' : '-',
-                (file_system[i].permissions & 0020) ? 'w' : '-',
-                (file_system[i].permissions & 0010) ? 'x' : '-',
-                (file_system[i].permissions & 0004) ? 'r' : '-',
-                (file_system[i].permissions & 0002) ? 'w' : '-',
-                (file_system[i].permissions & 0001) ? 'x' : '-');
-            
-            console_printf("%s %d %s\n", perms, file_system[i].size, last_slash + 1);
-        }
+    int res = vfs_readdir(current_dir, ls_l_print_entry, NULL);
+    if (res < 0) {
+        print_vfs_error(res);
     }
 }
 
@@ -638,8 +1527,10 @@ typedef struct {
     uint8 is_movement;
 } MouseEvent;
 
+#define MOUSE_TEST_EVENTS 1000
+
 typedef struct {
-    MouseEvent events[1000];  // Store last 1000 events
+    MouseEvent* events;  // first MOUSE_TEST_EVENTS events, taken from the heap per test
     int event_count;
     int movement_count;
     int button_press_count;
@@ -652,7 +1543,7 @@ MouseTest mouse_test;
 
 // USB storage structures
 #define USB_SECTOR_SIZE 512
-#define USB_STORAGE_START 0x100000  // 1MB offset in memory
+#define USB_STORAGE_PAGES 16 // room for the header and 1000 events
 
 typedef struct {
     char magic[4];  // "MOUS"
@@ -666,7 +1557,9 @@ typedef struct {
 
 // Mouse test functions
 void init_mouse_test() {
+    kfree(mouse_test.events);
     memset(&mouse_test, 0, sizeof(MouseTest));
+    mouse_test.events = (MouseEvent*)kmalloc(MOUSE_TEST_EVENTS * sizeof(MouseEvent));
     mouse_test.test_running = 0;
 }
 
@@ -676,7 +1569,7 @@ void record_mouse_event(int x, int y, uint8 buttons, uint8 is_movement) {
     uint32 current_time = 0; // TODO: Implement proper time function
     
     // Record event
-    if (mouse_test.event_count < 1000) {
+    if (mouse_test.events != NULL && mouse_test.event_count < MOUSE_TEST_EVENTS) {
         mouse_test.events[mouse_test.event_count].timestamp = current_time;
         mouse_test.events[mouse_test.event_count].x = x;
         mouse_test.events[mouse_test.event_count].y = y;
@@ -716,10 +1609,25 @@ uint8 check_mouse_test() {
 }
 
 // USB storage functions
+// Stand-in until there is a USB driver: frames taken on first use
+static uint8* usb_storage = NULL;
+static uint32 usb_storage_used = 0;
+
 void write_to_usb(void* data, uint32 size) {
     // TODO: Implement proper USB storage write
-    // For now, just write to memory
-    memcpy((void*)USB_STORAGE_START, data, size);
+    // For now, just append to memory
+    if (usb_storage == NULL) {
+        uint32 frames = pmm_alloc_pages(USB_STORAGE_PAGES);
+        if (frames == 0) {
+            return;
+        }
+        usb_storage = (uint8*)PHYS_TO_VIRT(frames);
+    }
+    if (size > USB_STORAGE_PAGES * PMM_FRAME_SIZE - usb_storage_used) {
+        size = USB_STORAGE_PAGES * PMM_FRAME_SIZE - usb_storage_used;
+    }
+    memcpy(usb_storage + usb_storage_used, data, size);
+    usb_storage_used += size;
 }
 
 void save_mouse_test_results() {
@@ -733,10 +1641,13 @@ void save_mouse_test_results() {
     header.test_result = (mouse_test.movement_count >= MOUSE_TEST_THRESHOLD * MOUSE_TEST_DURATION);
 
     // Write header
+    usb_storage_used = 0;
     write_to_usb(&header, sizeof(MouseTestHeader));
 
     // Write events
-    write_to_usb(mouse_test.events, mouse_test.event_count * sizeof(MouseEvent));
+    if (mouse_test.events != NULL) {
+        write_to_usb(mouse_test.events, mouse_test.event_count * sizeof(MouseEvent));
+    }
 }
 
 // Add mouse test command
@@ -774,7 +1685,7 @@ extern uint8 g_back_color;
 // Global variable for mouse status (defined in mouse.c)
 extern MOUSE_STATUS g_status;
 
-void kmain() {
+void kmain(uint32 multiboot_magic, MULTIBOOT_INFO* multiboot_info) {
     gdt_init();
     idt_init();
     
@@ -796,12 +1707,33 @@ void kmain() {
     asm volatile("sti");
     
     console_init(COLOR_WHITE, COLOR_BLACK); // Initial console setup
+    paging_init(); // the kernel's page directory, before anything is mapped into it
+    if (pmm_init(multiboot_magic, (MULTIBOOT_INFO*)PHYS_TO_VIRT(multiboot_info)) != 0) {
+        console_putstr("[MM] Нет карты памяти от загрузчика: физическая память недоступна\n");
+    } else {
+        console_printf("[MM] Память: %u КБ, свободно %u КБ\n", pmm_stats.total_frames * 4,
+                       pmm_stats.free_frames * 4);
+        kmalloc_init();
+    }
     vga_disable_cursor();
     keyboard_init();
     mouse_init();
+    tsc_calibrate();
+    timer_init();
     ata_init(); // Initialize the ATA driver
-    file_system_startup(); // Загрузка файловой системы с диска
-    init_file_system(); // Инициализация структуры, если загрузка не удалась
+    file_system_startup(); // Загрузка файловой системы с диска (новая ФС, если её нет)
+    vfs_register_driver(&infs_driver);
+    vfs_register_driver(&ext2_driver);
+    vfs_register_driver(&fat_driver);
+    vfs_register_driver(&tmpfs_driver);
+    vfs_register_driver(&snapshot_driver);
+    vfs_mount("infs", NULL, "/", "compress");
+    // Scratch files stay in memory
+    vfs_create("/tmp", 1, 0777);
+    if (vfs_mount("tmpfs", NULL, "/tmp", NULL) != 0) {
+        console_putstr("[FS] Не удалось смонтировать tmpfs в /tmp\n");
+    }
+    flusher_init(); // from here on changes are written back in the background
 
     console_putstr("Welcome to IntrenOS!\n");
     console_putstr("Type 'help' for available commands.\n\n");
@@ -813,7 +1745,9 @@ void kmain() {
         g_fore_color = COLOR_WHITE;
         g_back_color = COLOR_BLACK; // Ensure background is black
         console_putstr("IntrenOS> ");
+        flusher_at_prompt(1); // between commands, the flusher may write
         getstr(command);
+        flusher_at_prompt(0);
         
         // Reset foreground color to white for output
         g_fore_color = COLOR_WHITE;
@@ -847,6 +1781,8 @@ void kmain() {
             cmd_exit();
         } else if (strcmp(command, "reboot") == 0) {
             cmd_reboot();
+        } else if (strcmp(command, "ls") == 0 && strcmp(args, "-l") == 0) {
+            cmd_ls_l();
         } else if (strcmp(command, "ls") == 0) {
             cmd_ls();
         } else if (strcmp(command, "mkdir") == 0) {
@@ -859,21 +1795,50 @@ void kmain() {
             cmd_cat(args);
         } else if (strcmp(command, "rm") == 0) {
             cmd_rm(args);
+        } else if (strcmp(command, "cp") == 0) {
+            cmd_cp(args);
+        } else if (strcmp(command, "mv") == 0) {
+            cmd_mv(args);
+        } else if (strcmp(command, "grep") == 0) {
+            cmd_grep(args);
+        } else if (strcmp(command, "peek") == 0) {
+            cmd_peek(args);
+        } else if (strcmp(command, "poke") == 0) {
+            cmd_poke(args);
         } else if (strcmp(command, "pwd") == 0) {
             cmd_pwd();
         } else if (strcmp(command, "nano") == 0) {
             cmd_nano(args);
         } else if (strcmp(command, "snake") == 0) { // Добавлена команда snake
             cmd_snake();
+        } else if (strcmp(command, "mount") == 0) {
+            cmd_mount(args);
+        } else if (strcmp(command, "umount") == 0) {
+            cmd_umount(args);
+        } else if (strcmp(command, "ramdisk") == 0) {
+            cmd_ramdisk(args);
+        } else if (strcmp(command, "fsbench") == 0) {
+            cmd_fsbench(args);
+        } else if (strcmp(command, "compress") == 0) {
+            cmd_compress(args);
+        } else if (strcmp(command, "crcbench") == 0) {
+            cmd_crcbench();
+        } else if (strcmp(command, "meminfo") == 0) {
+            cmd_meminfo(args);
+        } else if (strcmp(command, "swap") == 0) {
+            cmd_swap(args);
+        } else if (strcmp(command, "flusher") == 0) {
+            cmd_flusher(args);
+        } else if (strcmp(command, "snapshot") == 0) {
+            cmd_snapshot(args);
         } else if (strcmp(command, "mouse-test") == 0) {
             cmd_mouse_test();
-        } else if (strcmp(command, "ls") == 0 && strcmp(args, "-l") == 0) {
-            cmd_ls_l();
         } else {
             console_putstr("Unknown command: ");
             console_putstr(command);
             console_putstr("\nType 'help' for available commands.\n");
         }
+        arena_reset(&g_scratch_arena); // scratch memory of the command
     }
 }
 
@@ -6,6 +6,7 @@
 #include "isr.h"
 #include "types.h"
 #include "string.h"
+#include "flusher.h"
 
 // Declare the global exit flag (defined in kernel.c)
 extern volatile int g_exit_program;
@@ -142,7 +143,11 @@ void keyboard_init() {
 char kb_getchar() {
     char c;
 
-    while(g_ch == 0);
+    // the flusher only writes here while the shell waits at its prompt,
+    // a program reading keys mid-command is left alone
+    while(g_ch == 0) {
+        flusher_idle();
+    }
     c = g_ch;
     g_ch = 0;
     return c;
@@ -0,0 +1,398 @@
+#include "kmalloc.h"
+#include "pmm.h"
+#include "string.h"
+#include "io_ports.h"
+#include "paging.h"
+#include <stddef.h> // Для NULL
+
+#define SLAB_MAGIC 0x42414C53 // "SLAB"
+#define SLAB_MAX_ORDER 3
+#define SLAB_MIN_OBJECTS 8     // a slab grows to this many objects, up to SLAB_MAX_ORDER
+#define SIZE_CLASSES 8         // 16 .. 2048
+#define LIVE_SHIFT 11          // KMALLOC_TRACK_LIVE = 1 << LIVE_SHIFT
+#define CALLER() ((uint32)__builtin_return_address(0))
+
+// Header at the start of a slab. The block is aligned to its size, so
+// the slab of an object is its address rounded down.
+typedef struct KMEM_SLAB {
+    uint32 magic;
+    KMEM_CACHE *cache;
+    struct KMEM_SLAB *next;
+    struct KMEM_SLAB *prev;
+    void *free;        // first free object, each holds the next
+    uint32 in_use;
+} KMEM_SLAB;
+
+#define SLAB_HEADER ((sizeof(KMEM_SLAB) + 7) & ~7u)
+
+// An allocation followed by the tracking mode
+typedef struct {
+    void *ptr; // NULL - free entry
+    uint32 size;
+    KMALLOC_SITE *site;
+} LIVE_ALLOCATION;
+
+KMALLOC_STATS kmalloc_stats;
+
+static KMEM_CACHE g_caches[KMEM_MAX_CACHES];
+static int g_cache_count = 0;
+static KMEM_CACHE *g_size_classes[SIZE_CLASSES];
+
+static int g_tracking = 0;
+static KMALLOC_SITE g_sites[KMALLOC_TRACK_SITES];
+static int g_site_count = 0;
+static LIVE_ALLOCATION g_live[KMALLOC_TRACK_LIVE]; // open addressing by ptr
+
+static void slab_unlink(KMEM_SLAB **list, KMEM_SLAB *slab) {
+    if (slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+static void slab_push(KMEM_SLAB **list, KMEM_SLAB *slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+static uint32 slab_bytes(KMEM_CACHE *cache) {
+    return PMM_FRAME_SIZE << cache->order;
+}
+
+// A fresh slab with every object on its free list, NULL without memory
+static KMEM_SLAB *slab_create(KMEM_CACHE *cache) {
+    uint32 frames = pmm_alloc_order(cache->order);
+    KMEM_SLAB *slab = (KMEM_SLAB *)PHYS_TO_VIRT(frames);
+    uint8 *object;
+    uint32 i;
+
+    if (frames == 0) {
+        return NULL;
+    }
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free = NULL;
+    // Linked back to front, so objects are handed out in address order
+    object = (uint8 *)slab + SLAB_HEADER + (cache->per_slab - 1) * cache->object_size;
+    for (i = 0; i < cache->per_slab; i++, object -= cache->object_size) {
+        *(void **)object = slab->free;
+        slab->free = object;
+    }
+    cache->slabs++;
+    return slab;
+}
+
+KMEM_CACHE *kmem_cache_create(const char *name, uint32 size) {
+    KMEM_CACHE *cache;
+
+    if (size == 0 || size > KMALLOC_MAX_SLAB_SIZE || g_cache_count == KMEM_MAX_CACHES) {
+        return NULL;
+    }
+    cache = &g_caches[g_cache_count++];
+    memset(cache, 0, sizeof(KMEM_CACHE));
+    strncpy(cache->name, name, KMEM_NAME_LENGTH - 1);
+    cache->object_size = (size + 7) & ~7u;
+    while (cache->order < SLAB_MAX_ORDER &&
+           (slab_bytes(cache) - SLAB_HEADER) / cache->object_size < SLAB_MIN_OBJECTS) {
+        cache->order++;
+    }
+    cache->per_slab = (slab_bytes(cache) - SLAB_HEADER) / cache->object_size;
+    return cache;
+}
+
+KMEM_CACHE *kmem_cache_get(int index) {
+    return index >= 0 && index < g_cache_count ? &g_caches[index] : NULL;
+}
+
+/*
+ allocation tracking
+*/
+
+static uint32 live_index(void *ptr) {
+    return ((uint32)ptr * 2654435761u) >> (32 - LIVE_SHIFT);
+}
+
+static KMALLOC_SITE *find_site(uint32 caller) {
+    int i;
+
+    for (i = 0; i < g_site_count; i++) {
+        if (g_sites[i].site == caller) {
+            return &g_sites[i];
+        }
+    }
+    if (g_site_count == KMALLOC_TRACK_SITES) {
+        return NULL;
+    }
+    memset(&g_sites[g_site_count], 0, sizeof(KMALLOC_SITE));
+    g_sites[g_site_count].site = caller;
+    return &g_sites[g_site_count++];
+}
+
+static void track_alloc(void *ptr, uint32 size, uint32 caller) {
+    uint32 flags = irq_save();
+    KMALLOC_SITE *site = find_site(caller);
+    uint32 i = live_index(ptr), probes;
+
+    for (probes = 0; probes < KMALLOC_TRACK_LIVE && g_live[i].ptr != NULL; probes++) {
+        i = (i + 1) & (KMALLOC_TRACK_LIVE - 1);
+    }
+    if (site == NULL || probes == KMALLOC_TRACK_LIVE) {
+        kmalloc_stats.untracked++;
+    } else {
+        g_live[i].ptr = ptr;
+        g_live[i].size = size;
+        g_live[i].site = site;
+        site->live_bytes += size;
+        site->live_count++;
+        site->allocations++;
+    }
+    irq_restore(flags);
+}
+
+// Pointers allocated while tracking was off are not found and ignored
+static void track_free(void *ptr) {
+    uint32 flags = irq_save();
+    uint32 i = live_index(ptr), probes;
+
+    for (probes = 0; probes < KMALLOC_TRACK_LIVE && g_live[i].ptr != NULL; probes++) {
+        if (g_live[i].ptr == ptr) {
+            break;
+        }
+        i = (i + 1) & (KMALLOC_TRACK_LIVE - 1);
+    }
+    if (probes == KMALLOC_TRACK_LIVE || g_live[i].ptr == NULL) {
+        irq_restore(flags);
+        return;
+    }
+    g_live[i].site->live_bytes -= g_live[i].size;
+    g_live[i].site->live_count--;
+    g_live[i].ptr = NULL;
+
+    // Move later entries of the run back, so lookups never stop at the hole
+    uint32 hole = i;
+    for (i = (i + 1) & (KMALLOC_TRACK_LIVE - 1); g_live[i].ptr != NULL; i = (i + 1) & (KMALLOC_TRACK_LIVE - 1)) {
+        uint32 home = live_index(g_live[i].ptr);
+        if (((i - home) & (KMALLOC_TRACK_LIVE - 1)) >= ((i - hole) & (KMALLOC_TRACK_LIVE - 1))) {
+            g_live[hole] = g_live[i];
+            g_live[i].ptr = NULL;
+            hole = i;
+        }
+    }
+    irq_restore(flags);
+}
+
+void kmalloc_track(int on) {
+    uint32 flags = irq_save();
+    if (on && !g_tracking) {
+        memset(g_live, 0, sizeof(g_live));
+        g_site_count = 0;
+        kmalloc_stats.untracked = 0;
+    }
+    g_tracking = on;
+    irq_restore(flags);
+}
+
+int kmalloc_tracking() {
+    return g_tracking;
+}
+
+const KMALLOC_SITE *kmalloc_site_get(int index) {
+    return index >= 0 && index < g_site_count ? &g_sites[index] : NULL;
+}
+
+/*
+ caches
+*/
+
+static void *cache_alloc(KMEM_CACHE *cache) {
+    uint32 flags = irq_save();
+    KMEM_SLAB *slab = cache->partial;
+    void *object;
+
+    if (slab == NULL) {
+        slab = cache->empty;
+        if (slab != NULL) {
+            slab_unlink(&cache->empty, slab);
+        } else {
+            slab = slab_create(cache);
+        }
+        if (slab == NULL) {
+            kmalloc_stats.failures++;
+            irq_restore(flags);
+            return NULL;
+        }
+        slab_push(&cache->partial, slab);
+    }
+
+    object = slab->free;
+    slab->free = *(void **)object;
+    if (++slab->in_use == cache->per_slab) {
+        slab_unlink(&cache->partial, slab);
+        slab_push(&cache->full, slab);
+    }
+    cache->in_use++;
+    cache->allocations++;
+    irq_restore(flags);
+    return object;
+}
+
+void *kmem_cache_alloc(KMEM_CACHE *cache) {
+    void *object = cache_alloc(cache);
+    if (g_tracking && object != NULL) {
+        track_alloc(object, cache->object_size, CALLER());
+    }
+    return object;
+}
+
+static void cache_free(KMEM_CACHE *cache, void *object) {
+    KMEM_SLAB *slab;
+    uint32 flags;
+
+    if (object == NULL) {
+        return;
+    }
+    slab = (KMEM_SLAB *)((uint32)object & ~(slab_bytes(cache) - 1));
+    flags = irq_save();
+    if (slab->in_use-- == cache->per_slab) {
+        slab_unlink(&cache->full, slab);
+        slab_push(&cache->partial, slab);
+    }
+    *(void **)object = slab->free;
+    slab->free = object;
+    cache->in_use--;
+    cache->frees++;
+
+    if (slab->in_use == 0) {
+        slab_unlink(&cache->partial, slab);
+        // One empty slab absorbs alloc/free churn at the boundary
+        if (cache->empty == NULL) {
+            slab_push(&cache->empty, slab);
+        } else {
+            slab->magic = 0;
+            cache->slabs--;
+            pmm_free(VIRT_TO_PHYS(slab));
+        }
+    }
+    irq_restore(flags);
+}
+
+void kmem_cache_free(KMEM_CACHE *cache, void *object) {
+    if (g_tracking && object != NULL) {
+        track_free(object);
+    }
+    cache_free(cache, object);
+}
+
+void kmalloc_init() {
+    static const char *names[SIZE_CLASSES] = {
+        "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+        "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+    };
+    int i;
+
+    memset(&kmalloc_stats, 0, sizeof(kmalloc_stats));
+    for (i = 0; i < SIZE_CLASSES; i++) {
+        g_size_classes[i] = kmem_cache_create(names[i], KMALLOC_MIN_SIZE << i);
+    }
+}
+
+// kmalloc() on behalf of the call at caller
+static void *alloc_at(uint32 size, uint32 caller) {
+    uint32 frames, flags, addr;
+    void *ptr = NULL;
+    int i;
+
+    if (size == 0) {
+        return NULL;
+    }
+    if (size <= KMALLOC_MAX_SLAB_SIZE) {
+        i = 0;
+        while (((uint32)KMALLOC_MIN_SIZE << i) < size) {
+            i++;
+        }
+        if (g_size_classes[i] != NULL) {
+            ptr = cache_alloc(g_size_classes[i]);
+        }
+    } else {
+        frames = (size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+        flags = irq_save();
+        addr = pmm_alloc_pages(frames);
+        if (addr != 0) {
+            kmalloc_stats.large_allocations++;
+            kmalloc_stats.large_frames += pmm_block_frames(addr);
+            ptr = PHYS_TO_VIRT(addr);
+        } else {
+            kmalloc_stats.failures++;
+        }
+        irq_restore(flags);
+    }
+    if (g_tracking && ptr != NULL) {
+        track_alloc(ptr, size, caller);
+    }
+    return ptr;
+}
+
+void *kmalloc(uint32 size) {
+    return alloc_at(size, CALLER());
+}
+
+void *kzalloc(uint32 size) {
+    void *ptr = alloc_at(size, CALLER());
+    if (ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+// The slab holding ptr: the smallest aligned block around it that the
+// frame allocator handed out and that starts with a slab header
+static KMEM_SLAB *slab_of(void *ptr) {
+    uint32 phys = VIRT_TO_PHYS(ptr);
+    uint32 order;
+
+    for (order = 0; order <= SLAB_MAX_ORDER; order++) {
+        uint32 base = phys & ~((PMM_FRAME_SIZE << order) - 1);
+        uint32 frames = pmm_block_frames(base);
+        if (frames == 0) {
+            continue;
+        }
+        if (phys - base < frames * PMM_FRAME_SIZE && ((KMEM_SLAB *)PHYS_TO_VIRT(base))->magic == SLAB_MAGIC) {
+            return (KMEM_SLAB *)PHYS_TO_VIRT(base);
+        }
+        return NULL;
+    }
+    return NULL;
+}
+
+void kfree(void *ptr) {
+    uint32 flags;
+    KMEM_SLAB *slab;
+
+    if (ptr == NULL) {
+        return;
+    }
+    if (g_tracking) {
+        track_free(ptr);
+    }
+    // A slab never hands out its first bytes, so a block start is a large allocation
+    if (((uint32)ptr & (PMM_FRAME_SIZE - 1)) == 0 && pmm_block_frames(VIRT_TO_PHYS(ptr)) != 0) {
+        flags = irq_save();
+        kmalloc_stats.large_frames -= pmm_block_frames(VIRT_TO_PHYS(ptr));
+        pmm_free(VIRT_TO_PHYS(ptr));
+        irq_restore(flags);
+        return;
+    }
+    slab = slab_of(ptr);
+    if (slab != NULL) {
+        cache_free(slab->cache, ptr);
+    }
+}
@@ -0,0 +1,345 @@
+#include "mmap.h"
+#include "paging.h"
+#include "pmm.h"
+#include "console.h"
+#include "string.h"
+#include "fs/vfs.h"
+#include <stddef.h> // Для NULL
+
+#define WINDOW_END (PAGING_WINDOW_BASE + PAGING_WINDOW_SIZE)
+
+typedef struct {
+    uint32 base;   // first address, 0 - slot unused
+    uint32 pages;
+    uint32 offset; // file offset of the first page
+    uint32 flags;
+    int fd;        // private descriptor, keeps the volume from being unmounted
+} MmapRegion;
+
+MmapStats mmap_stats;
+
+static MmapRegion regions[MMAP_MAX_REGIONS];
+static uint32 clock_region = 0; // the hand: a page of a region
+static uint32 clock_page = 0;
+static int handler_registered = 0;
+
+static MmapRegion* find_region(uint32 addr) {
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        MmapRegion* r = &regions[i];
+        if (r->base != 0 && addr >= r->base && addr - r->base < r->pages * PAGE_SIZE) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+// Lowest free range of the window for pages, 0 if there is none
+static uint32 find_range(uint32 pages) {
+    uint32 base = PAGING_WINDOW_BASE;
+    while (base + pages * PAGE_SIZE <= WINDOW_END && base + pages * PAGE_SIZE > base) {
+        uint32 end = base + pages * PAGE_SIZE;
+        MmapRegion* overlap = NULL;
+        for (int i = 0; i < MMAP_MAX_REGIONS && overlap == NULL; i++) {
+            MmapRegion* r = &regions[i];
+            if (r->base != 0 && r->base < end && base < r->base + r->pages * PAGE_SIZE) {
+                overlap = r;
+            }
+        }
+        if (overlap == NULL) {
+            return base;
+        }
+        base = overlap->base + overlap->pages * PAGE_SIZE;
+    }
+    return 0;
+}
+
+static int page_dirty(uint32 virt) {
+    return (*paging_pte(virt) & (PAGE_PRESENT | PAGE_DIRTY)) == (PAGE_PRESENT | PAGE_DIRTY);
+}
+
+// Write the page at virt to the file if the CPU marked it dirty, leaving
+// it dirty: the driver may still hold the data (vfs_fsync()). The data
+// is taken through the frame's own address, which never faults.
+static int write_page(MmapRegion* r, uint32 virt) {
+    if (!page_dirty(virt)) {
+        return 0;
+    }
+    int size = vfs_lseek(r->fd, 0, VFS_SEEK_END);
+    if (size < 0) {
+        return size;
+    }
+    uint32 file_offset = r->offset + (virt - r->base);
+    if (file_offset >= (uint32)size) {
+        return 0; // the file never grows: past its end the page only holds zeros
+    }
+    uint32 length = (uint32)size - file_offset < PAGE_SIZE ? (uint32)size - file_offset : PAGE_SIZE;
+    const uint8* data = (const uint8*)PHYS_TO_VIRT(*paging_pte(virt) & PAGE_FRAME);
+    int res = vfs_lseek(r->fd, file_offset, VFS_SEEK_SET);
+    uint32 done = 0;
+    while (res >= 0 && done < length) {
+        res = vfs_write(r->fd, data + done, length - done);
+        if (res == 0) {
+            res = VFS_ERR_NO_SPACE;
+        }
+        if (res > 0) {
+            done += res;
+        }
+    }
+    return res < 0 ? res : 1;
+}
+
+static void clean_page(uint32 virt) {
+    *paging_pte(virt) &= ~PAGE_DIRTY;
+    paging_invalidate(virt);
+}
+
+// Write one dirty page all the way to disk before its frame is taken
+static int write_back(MmapRegion* r, uint32 virt) {
+    int res = write_page(r, virt);
+    if (res > 0) {
+        res = vfs_fsync(r->fd);
+        if (res == 0) {
+            mmap_stats.pages_written++;
+        }
+    }
+    if (res < 0) {
+        return res; // stays dirty
+    }
+    if (page_dirty(virt)) {
+        clean_page(virt);
+    }
+    return 0;
+}
+
+// The frame of the first mapped page the clock finds not accessed since
+// it last passed, 0 if none can be had. Pages that cannot be written
+// back are skipped.
+static uint32 evict_one() {
+    uint32 total = 0;
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        total += regions[i].base != 0 ? regions[i].pages : 0;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (uint32 passed = 0; passed < 2 * total + 1;) {
+        MmapRegion* r = &regions[clock_region];
+        if (r->base == 0 || clock_page >= r->pages) {
+            clock_region = (clock_region + 1) % MMAP_MAX_REGIONS;
+            clock_page = 0;
+            continue;
+        }
+        uint32 virt = r->base + clock_page * PAGE_SIZE;
+        clock_page++;
+        passed++;
+        uint32* pte = paging_pte(virt);
+        if (!(*pte & PAGE_PRESENT)) {
+            continue;
+        }
+        if (*pte & PAGE_ACCESSED) {
+            *pte &= ~PAGE_ACCESSED; // second chance
+            paging_invalidate(virt);
+            continue;
+        }
+        if (write_back(r, virt) != 0) {
+            continue;
+        }
+        uint32 frame = *pte & PAGE_FRAME;
+        *pte = 0;
+        paging_invalidate(virt);
+        mmap_stats.resident--;
+        mmap_stats.evictions++;
+        return frame;
+    }
+    return 0;
+}
+
+// A frame for a page: from pmm while it has more than MMAP_RESERVE_FRAMES
+// free, else from another mapped page, else from the reserve
+static uint32 take_frame() {
+    uint32 frame = 0;
+    if (pmm_stats.free_frames > MMAP_RESERVE_FRAMES) {
+        frame = pmm_alloc_frame();
+    }
+    if (frame == 0) {
+        frame = evict_one();
+    }
+    if (frame == 0) {
+        frame = pmm_alloc_frame();
+    }
+    return frame;
+}
+
+static void free_frame(uint32 pte) {
+    pmm_free(pte & PAGE_FRAME);
+    mmap_stats.resident--;
+}
+
+// Read the page at virt of region r into frame, zeros past the end of the file
+static int fill_page(MmapRegion* r, uint32 virt, uint8* frame) {
+    int res = vfs_lseek(r->fd, r->offset + (virt - r->base), VFS_SEEK_SET);
+    uint32 done = 0;
+    while (res >= 0 && done < PAGE_SIZE) {
+        res = vfs_read(r->fd, frame + done, PAGE_SIZE - done);
+        if (res <= 0) {
+            break;
+        }
+        done += res;
+    }
+    if (res < 0) {
+        return res;
+    }
+    memset(frame + done, 0, PAGE_SIZE - done);
+    mmap_stats.bytes_read += done;
+    return 0;
+}
+
+static void page_fault(REGISTERS* reg, uint32 addr) {
+    MmapRegion* r = find_region(addr);
+    if (r == NULL || (reg->err_code & PAGE_FAULT_PRESENT) ||
+        ((reg->err_code & PAGE_FAULT_WRITE) && !(r->flags & MMAP_WRITE))) {
+        console_printf("[MMAP] Недопустимое обращение к 0x%x\n", addr);
+        isr_panic(reg);
+    }
+    uint32 virt = addr & PAGE_FRAME;
+    uint32 frame = take_frame();
+    if (frame == 0 || fill_page(r, virt, (uint8*)PHYS_TO_VIRT(frame)) != 0) {
+        console_printf("[MMAP] Не удалось прочитать страницу 0x%x\n", addr);
+        isr_panic(reg);
+    }
+    // A missing page is never cached by the TLB, no invalidation needed
+    *paging_pte(virt) = frame | PAGE_PRESENT | ((r->flags & MMAP_WRITE) ? PAGE_WRITE : 0);
+    mmap_stats.resident++;
+    mmap_stats.faults++;
+}
+
+int mmap_file(const char* path, uint32 offset, uint32 length, uint32 flags, void** addr) {
+    VFS_STAT st;
+    if (!paging_enabled()) {
+        return VFS_ERR_NOT_SUPPORTED;
+    }
+    if (offset % PAGE_SIZE != 0 || !(flags & (MMAP_READ | MMAP_WRITE))) {
+        return VFS_ERR_INVALID;
+    }
+    int res = vfs_stat(path, &st);
+    if (res != 0) {
+        return res;
+    }
+    if (st.is_directory) {
+        return VFS_ERR_IS_DIR;
+    }
+    if (length == 0) {
+        length = offset < st.size ? st.size - offset : 0;
+    }
+    if (length == 0 || length > PAGING_WINDOW_SIZE) {
+        return length == 0 ? VFS_ERR_INVALID : VFS_ERR_TOO_BIG;
+    }
+
+    MmapRegion* r = NULL;
+    for (int i = 0; i < MMAP_MAX_REGIONS && r == NULL; i++) {
+        if (regions[i].base == 0) {
+            r = &regions[i];
+        }
+    }
+    uint32 pages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32 base = find_range(pages);
+    if (r == NULL || base == 0) {
+        return VFS_ERR_TOO_MANY;
+    }
+    int fd = vfs_open(path, VFS_O_READ | ((flags & MMAP_WRITE) ? VFS_O_WRITE : 0));
+    if (fd < 0) {
+        return fd;
+    }
+    if (!handler_registered) {
+        paging_set_fault_handler(PAGING_WINDOW_BASE, WINDOW_END, page_fault);
+        handler_registered = 1;
+    }
+    r->base = base;
+    r->pages = pages;
+    r->offset = offset;
+    r->flags = flags;
+    r->fd = fd;
+    *addr = (void*)base;
+    return 0;
+}
+
+// Every dirty page is written, then the file is flushed once; the pages
+// are only marked clean when that worked, so a failure costs a rewrite
+// at the next sync rather than the data
+int mmap_sync(void* addr) {
+    MmapRegion* r = find_region((uint32)addr);
+    if (r == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    uint32 written = 0;
+    for (uint32 p = 0; p < r->pages; p++) {
+        int res = write_page(r, r->base + p * PAGE_SIZE);
+        if (res < 0) {
+            return res;
+        }
+        written += res;
+    }
+    if (written > 0) {
+        int res = vfs_fsync(r->fd);
+        if (res != 0) {
+            return res;
+        }
+    }
+    for (uint32 p = 0; p < r->pages; p++) {
+        uint32 virt = r->base + p * PAGE_SIZE;
+        if (page_dirty(virt)) {
+            clean_page(virt);
+        }
+    }
+    mmap_stats.pages_written += written;
+    return 0;
+}
+
+int mmap_unmap(void* addr) {
+    MmapRegion* r = find_region((uint32)addr);
+    if (r == NULL || (uint32)addr != r->base) {
+        return VFS_ERR_INVALID;
+    }
+    int res = mmap_sync(addr);
+    if (res != 0) {
+        return res; // nothing is dropped that could not be written
+    }
+    for (uint32 p = 0; p < r->pages; p++) {
+        uint32 virt = r->base + p * PAGE_SIZE;
+        uint32* pte = paging_pte(virt);
+        if (*pte & PAGE_PRESENT) {
+            free_frame(*pte);
+            *pte = 0;
+            paging_invalidate(virt);
+        }
+    }
+    r->base = 0;
+    return vfs_close(r->fd);
+}
+
+int mmap_sync_all() {
+    int first_error = 0;
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        if (regions[i].base != 0) {
+            int res = mmap_sync((void*)regions[i].base);
+            if (res != 0 && first_error == 0) {
+                first_error = res;
+            }
+        }
+    }
+    return first_error;
+}
+
+uint32 mmap_dirty_pages() {
+    uint32 count = 0;
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        MmapRegion* r = &regions[i];
+        for (uint32 p = 0; r->base != 0 && p < r->pages; p++) {
+            uint32 pte = *paging_pte(r->base + p * PAGE_SIZE);
+            if ((pte & (PAGE_PRESENT | PAGE_DIRTY)) == (PAGE_PRESENT | PAGE_DIRTY)) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
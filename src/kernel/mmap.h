@@ -0,0 +1,55 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include "types.h"
+
+/**
+ * Files mapped into the kernel address space.
+ *
+ * A mapping takes addresses in the paging window (paging.h) but no
+ * memory: the first touch of a page raises a page fault, the handler
+ * reads that page of the file through the VFS into a frame from pmm and
+ * maps it. Once pmm is down to MMAP_RESERVE_FRAMES, frames are taken
+ * from other mapped pages second-chance (clock); dirty pages are written
+ * back first, on mmap_sync() and on mmap_unmap(). The CPU marks written pages dirty, so a write costs
+ * no fault of its own.
+ *
+ * The fault handler calls into the file system. Mapped memory must not
+ * be handed to VFS calls directly, the driver would be entered again
+ * from inside itself: copy it to a buffer first.
+ */
+
+#define MMAP_MAX_REGIONS 8
+#define MMAP_RESERVE_FRAMES 1024 // left free for the kernel heap, 4 MiB
+
+// mmap_file() flags
+#define MMAP_READ  0x01
+#define MMAP_WRITE 0x02 // written pages go back to the file, which never grows
+
+typedef struct {
+    uint32 faults;        // pages read on first touch
+    uint32 bytes_read;
+    uint32 pages_written; // dirty pages written back
+    uint32 evictions;     // frames taken from another page
+    uint32 resident;      // pages in RAM now
+} MmapStats;
+
+extern MmapStats mmap_stats;
+
+// Map length bytes of path from offset (a multiple of PAGE_SIZE) on,
+// length 0 for the rest of the file. *addr receives the address.
+int mmap_file(const char* path, uint32 offset, uint32 length, uint32 flags, void** addr);
+
+// Write back the dirty pages of the mapping at addr
+int mmap_sync(void* addr);
+
+// Write back and drop the mapping at addr
+int mmap_unmap(void* addr);
+
+// mmap_sync() every mapping, first error or 0
+int mmap_sync_all();
+
+// Pages written since they were last written back
+uint32 mmap_dirty_pages();
+
+#endif
@@ -0,0 +1,204 @@
+#include "namepool.h"
+#include "filesystem.h"
+#include "string.h"
+#include "meminfo.h"
+
+#define NAME_POOL_HASH 1024
+#define NAME_POOL_FIRST 4 // offset 0 stays NAME_POOL_NONE
+
+// One record per distinct name, text follows the header
+typedef struct {
+    uint32 next; // next record in the same hash chain
+    uint16 refs; // entries using this name, 0 - hole
+    uint8 len;
+    // followed by len bytes of text and a terminating zero
+} __attribute__((packed)) NameRecord;
+
+static uint8 pool[FS_NAME_POOL_BYTES];
+MEMINFO_STATIC(pool);
+static uint32 pool_used = NAME_POOL_FIRST;
+static uint32 hash_heads[NAME_POOL_HASH];
+
+static NameRecord* record_at(uint32 offset) {
+    return (NameRecord*)(pool + offset);
+}
+
+static uint32 record_size(NameRecord* rec) {
+    return sizeof(NameRecord) + rec->len + 1;
+}
+
+static char* record_text(NameRecord* rec) {
+    return (char*)rec + sizeof(NameRecord);
+}
+
+static uint32 name_hash(const char* name, uint32 len) {
+    uint32 hash = 2166136261u; // FNV-1a
+    for (uint32 i = 0; i < len; i++) {
+        hash ^= (uint8)name[i];
+        hash *= 16777619u;
+    }
+    return hash % NAME_POOL_HASH;
+}
+
+static void hash_insert(uint32 offset) {
+    NameRecord* rec = record_at(offset);
+    uint32 bucket = name_hash(record_text(rec), rec->len);
+    rec->next = hash_heads[bucket];
+    hash_heads[bucket] = offset;
+}
+
+static void rehash() {
+    memset(hash_heads, 0, sizeof(hash_heads));
+    for (uint32 offset = NAME_POOL_FIRST; offset < pool_used; offset += record_size(record_at(offset))) {
+        hash_insert(offset);
+    }
+}
+
+static uint32 lookup(const char* name, uint32 len) {
+    uint32 offset = hash_heads[name_hash(name, len)];
+    while (offset != NAME_POOL_NONE) {
+        NameRecord* rec = record_at(offset);
+        if (rec->len == len && memcmp((uint8*)record_text(rec), (uint8*)name, len)) {
+            return offset;
+        }
+        offset = rec->next;
+    }
+    return NAME_POOL_NONE;
+}
+
+uint32 name_pool_compact() {
+    uint32 offset, to = NAME_POOL_FIRST;
+
+    // New offset of each live record, parked in its chain link
+    for (offset = NAME_POOL_FIRST; offset < pool_used; offset += record_size(record_at(offset))) {
+        NameRecord* rec = record_at(offset);
+        rec->next = rec->refs ? to : NAME_POOL_NONE;
+        if (rec->refs) {
+            to += record_size(rec);
+        }
+    }
+    if (to == pool_used) {
+        rehash();
+        return 0;
+    }
+    for (int i = 0; i < file_count; i++) {
+        if (file_keys[i].name != NAME_POOL_NONE) {
+            file_keys[i].name = record_at(file_keys[i].name)->next;
+            mark_table_dirty(i);
+        }
+    }
+    // Records only move down, so a forward copy is safe
+    for (offset = NAME_POOL_FIRST; offset < pool_used;) {
+        NameRecord* rec = record_at(offset);
+        uint32 size = record_size(rec);
+        if (rec->refs) {
+            memcpy(pool + rec->next, rec, size);
+        }
+        offset += size;
+    }
+
+    uint32 freed = pool_used - to;
+    pool_used = to;
+    rehash();
+    mark_pool_dirty(0, pool_used);
+    return freed;
+}
+
+void name_pool_reset() {
+    memset(pool, 0, NAME_POOL_FIRST);
+    memset(hash_heads, 0, sizeof(hash_heads));
+    pool_used = NAME_POOL_FIRST;
+}
+
+void name_pool_rebuild(uint32 used) {
+    pool_used = NAME_POOL_FIRST;
+    // Stop at the first record that does not fit, whatever follows is lost
+    while (pool_used < used && pool_used + sizeof(NameRecord) <= FS_NAME_POOL_BYTES) {
+        NameRecord* rec = record_at(pool_used);
+        if (rec->len == 0 || pool_used + record_size(rec) > used) {
+            break;
+        }
+        rec->refs = 0;
+        pool_used += record_size(rec);
+    }
+    rehash();
+
+    for (int i = 0; i < file_count; i++) {
+        uint32 name = file_keys[i].name;
+        if (name >= pool_used) {
+            file_keys[i].name = NAME_POOL_NONE;
+        } else if (name != NAME_POOL_NONE) {
+            record_at(name)->refs++;
+        }
+    }
+}
+
+uint32 name_pool_intern(const char* name) {
+    uint32 len = strlen(name);
+    if (len == 0 || len >= MAX_FILENAME) {
+        return NAME_POOL_NONE;
+    }
+
+    uint32 offset = lookup(name, len);
+    if (offset != NAME_POOL_NONE) {
+        record_at(offset)->refs++;
+        return offset;
+    }
+
+    uint32 size = sizeof(NameRecord) + len + 1;
+    if (pool_used + size > FS_NAME_POOL_BYTES) {
+        return NAME_POOL_NONE;
+    }
+
+    offset = pool_used;
+    NameRecord* rec = record_at(offset);
+    rec->refs = 1;
+    rec->len = len;
+    memcpy(record_text(rec), name, len);
+    record_text(rec)[len] = '\0';
+    hash_insert(offset);
+    pool_used += size;
+    mark_pool_dirty(offset, size);
+    return offset;
+}
+
+uint32 name_pool_find(const char* name) {
+    uint32 len = strlen(name);
+    if (len == 0 || len >= MAX_FILENAME) {
+        return NAME_POOL_NONE;
+    }
+    return lookup(name, len);
+}
+
+void name_pool_release(uint32 name) {
+    if (name != NAME_POOL_NONE && name < pool_used && record_at(name)->refs > 0) {
+        record_at(name)->refs--;
+    }
+}
+
+const char* name_pool_get(uint32 name) {
+    if (name == NAME_POOL_NONE || name >= pool_used) {
+        return "";
+    }
+    return record_text(record_at(name));
+}
+
+const char* name_pool_text(const uint8* arena, uint32 used, uint32 name) {
+    if (name == NAME_POOL_NONE || name + sizeof(NameRecord) >= used) {
+        return "";
+    }
+    return (const char*)arena + name + sizeof(NameRecord);
+}
+
+uint32 name_pool_next(uint32 name) {
+    uint32 next = name == NAME_POOL_NONE ? NAME_POOL_FIRST : name + record_size(record_at(name));
+    return next < pool_used ? next : NAME_POOL_NONE;
+}
+
+uint8* name_pool_data() {
+    return pool;
+}
+
+uint32 name_pool_used() {
+    return pool_used;
+}
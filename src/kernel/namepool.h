@@ -0,0 +1,51 @@
+#ifndef NAMEPOOL_H
+#define NAMEPOOL_H
+
+#include "types.h"
+
+/**
+ * Interned file names for the file table.
+ *
+ * Entries refer to their name by offset into a byte arena that is
+ * checkpointed next to the table. Equal names share one record, so
+ * comparing names is comparing offsets. Records are appended; the
+ * holes left by released names are squeezed out only when the arena
+ * fills up, which renumbers the name of every entry. The journal does
+ * not see that, so the caller decides when (see compact_names() in
+ * filesystem.c).
+ * Offset 0 is never a record and means "no name".
+ */
+
+#define NAME_POOL_NONE 0
+
+// Empty pool, nothing referenced
+void name_pool_reset();
+
+// Rebuild the lookup hash and reference counts from the bytes in use
+// and the entries of the table, after the pool has been read from disk
+void name_pool_rebuild(uint32 used);
+
+// Offset of name, adding a reference (and the record if it is new).
+// Returns NAME_POOL_NONE if the name is invalid or the pool is full.
+uint32 name_pool_intern(const char* name);
+// Squeeze out the holes in memory, giving every entry its new name
+// offset and marking the table and pool dirty. Returns the bytes freed.
+uint32 name_pool_compact();
+// Offset of name if it is in the pool, NAME_POOL_NONE otherwise
+uint32 name_pool_find(const char* name);
+// Drop one reference taken by name_pool_intern()
+void name_pool_release(uint32 name);
+
+const char* name_pool_get(uint32 name);
+// The same for an arena read from disk, e.g. a snapshot's (snapshot.h)
+const char* name_pool_text(const uint8* arena, uint32 used, uint32 name);
+
+// Walk the records, used or not: the first one follows NAME_POOL_NONE,
+// NAME_POOL_NONE follows the last. For checking the pool offline.
+uint32 name_pool_next(uint32 name);
+
+// The arena itself, for checkpointing
+uint8* name_pool_data();
+uint32 name_pool_used();
+
+#endif
@@ -0,0 +1,211 @@
+#include "paging.h"
+#include "pmm.h"
+#include "string.h"
+#include "console.h"
+#include "meminfo.h"
+#include <stddef.h> // Для NULL
+
+#define PAGE_TABLE_ENTRIES 1024
+#define WINDOW_TABLES (PAGING_WINDOW_SIZE / LARGE_PAGE_SIZE)
+#define PDE_INDEX(virt) ((virt) >> 22)
+#define PTE_INDEX(virt) (((virt) >> 12) & (PAGE_TABLE_ENTRIES - 1))
+
+#define PAGE_FAULT_VECTOR 14
+#define FAULT_RANGES 4
+
+#define CPUID_EDX_PGE (1 << 13)
+#define CR4_PGE (1 << 7)
+
+static uint32 g_page_directory[PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static uint32 g_window_tables[WINDOW_TABLES][PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+MEMINFO_STATIC(g_window_tables);
+static int g_paging_enabled = 0;
+static uint32 g_global = 0; // PAGE_GLOBAL if the CPU has it
+
+typedef struct {
+    uint32 start;
+    uint32 end;
+    PAGE_FAULT_HANDLER handler; // NULL - slot unused
+} FAULT_RANGE;
+
+static FAULT_RANGE g_fault_ranges[FAULT_RANGES];
+static int g_fault_registered = 0;
+
+static int cpu_has_pge() {
+    uint32 eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx & CPUID_EDX_PGE) != 0;
+}
+
+void paging_init() {
+    uint32 i;
+
+    if (cpu_has_pge()) {
+        uint32 reg;
+        asm volatile("mov %%cr4, %0" : "=r"(reg));
+        asm volatile("mov %0, %%cr4" : : "r"(reg | CR4_PGE));
+        g_global = PAGE_GLOBAL;
+    }
+
+    memset(g_page_directory, 0, sizeof(g_page_directory));
+    memset(g_window_tables, 0, sizeof(g_window_tables));
+    // The BIOS call code is copied to 0x7C00 and turns paging off there
+    g_page_directory[0] = PAGE_LARGE | PAGE_PRESENT | PAGE_WRITE;
+    for (i = 0; i < PAGING_DIRECT_SIZE / LARGE_PAGE_SIZE; i++) {
+        g_page_directory[PDE_INDEX(KERNEL_VIRTUAL_BASE) + i] =
+            i * LARGE_PAGE_SIZE | g_global | PAGE_LARGE | PAGE_PRESENT | PAGE_WRITE;
+    }
+    for (i = 0; i < WINDOW_TABLES; i++) {
+        g_page_directory[PDE_INDEX(PAGING_WINDOW_BASE) + i] =
+            VIRT_TO_PHYS(g_window_tables[i]) | PAGE_PRESENT | PAGE_WRITE;
+    }
+    asm volatile("mov %0, %%cr3" : : "r"(VIRT_TO_PHYS(g_page_directory)) : "memory");
+    g_paging_enabled = 1;
+}
+
+int paging_enabled() {
+    return g_paging_enabled;
+}
+
+uint32 *paging_pte(uint32 virt) {
+    uint32 pde = g_page_directory[PDE_INDEX(virt)];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return NULL;
+    }
+    return (uint32 *)PHYS_TO_VIRT(pde & PAGE_FRAME) + PTE_INDEX(virt);
+}
+
+int paging_map(uint32 virt, uint32 phys, uint32 flags) {
+    uint32 *pde = &g_page_directory[PDE_INDEX(virt)];
+    if (*pde & PAGE_LARGE) {
+        return -1;
+    }
+    if (!(*pde & PAGE_PRESENT)) {
+        uint32 table = pmm_alloc_frame();
+        if (table == 0) {
+            return -1;
+        }
+        memset(PHYS_TO_VIRT(table), 0, PAGE_SIZE);
+        *pde = table | PAGE_PRESENT | PAGE_WRITE;
+    }
+    // The page entry decides the access, the directory entry only allows it
+    *pde |= flags & PAGE_USER;
+
+    uint32 *pte = paging_pte(virt);
+    uint32 old = *pte;
+    *pte = (phys & PAGE_FRAME) | (flags & ~PAGE_FRAME & ~PAGE_LARGE) | PAGE_PRESENT;
+    if (old & PAGE_PRESENT) {
+        paging_invalidate(virt);
+    }
+    return 0;
+}
+
+void paging_unmap(uint32 virt) {
+    uint32 *pte = paging_pte(virt);
+    if (pte != NULL && (*pte & PAGE_PRESENT)) {
+        *pte = 0;
+        paging_invalidate(virt);
+    }
+}
+
+uint32 paging_translate(uint32 virt) {
+    uint32 pde = g_page_directory[PDE_INDEX(virt)];
+    if (!(pde & PAGE_PRESENT)) {
+        return 0;
+    }
+    if (pde & PAGE_LARGE) {
+        return (pde & ~(LARGE_PAGE_SIZE - 1)) | (virt & (LARGE_PAGE_SIZE - 1));
+    }
+    uint32 pte = *paging_pte(virt);
+    if (!(pte & PAGE_PRESENT)) {
+        return 0;
+    }
+    return (pte & PAGE_FRAME) | (virt & (PAGE_SIZE - 1));
+}
+
+uint32 paging_map_mmio(uint32 phys, uint32 size, uint32 flags) {
+    uint32 first = PDE_INDEX(PAGING_MMIO_BASE), end = PDE_INDEX(PAGING_MMIO_END);
+    uint32 base = phys & ~(LARGE_PAGE_SIZE - 1);
+    uint32 count, i, j;
+
+    if (size == 0) {
+        return 0;
+    }
+    count = (phys - base + size - 1) / LARGE_PAGE_SIZE + 1;
+
+    // Reuse a run that already maps the range, else take the first free one
+    for (i = first; i + count <= end; i++) {
+        for (j = 0; j < count; j++) {
+            uint32 pde = g_page_directory[i + j];
+            if (!(pde & PAGE_PRESENT) || (pde & ~(LARGE_PAGE_SIZE - 1)) != base + j * LARGE_PAGE_SIZE) {
+                break;
+            }
+        }
+        if (j == count) {
+            return (i << 22) + (phys - base);
+        }
+    }
+    for (i = first; i + count <= end; i++) {
+        for (j = 0; j < count && !(g_page_directory[i + j] & PAGE_PRESENT); j++) {
+        }
+        if (j < count) {
+            i += j; // the next run starts past the mapped entry
+            continue;
+        }
+        for (j = 0; j < count; j++) {
+            g_page_directory[i + j] = (base + j * LARGE_PAGE_SIZE) | g_global |
+                                      (flags & (PAGE_WRITE | PAGE_WRITE_THROUGH | PAGE_CACHE_DISABLE)) |
+                                      PAGE_LARGE | PAGE_PRESENT;
+        }
+        return (i << 22) + (phys - base);
+    }
+    return 0;
+}
+
+void paging_invalidate(uint32 virt) {
+    asm volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+uint32 paging_fault_address() {
+    uint32 addr;
+    asm volatile("mov %%cr2, %0" : "=r"(addr));
+    return addr;
+}
+
+static void page_fault(REGISTERS *reg) {
+    uint32 addr = paging_fault_address();
+    for (int i = 0; i < FAULT_RANGES; i++) {
+        FAULT_RANGE *r = &g_fault_ranges[i];
+        if (r->handler != NULL && addr >= r->start && addr < r->end) {
+            r->handler(reg, addr);
+            return;
+        }
+    }
+    console_printf("[PAGING] Обращение к неотображённому адресу 0x%x\n", addr);
+    isr_panic(reg);
+}
+
+int paging_set_fault_handler(uint32 start, uint32 end, PAGE_FAULT_HANDLER handler) {
+    int free = -1;
+    for (int i = 0; i < FAULT_RANGES; i++) {
+        if (g_fault_ranges[i].handler == NULL) {
+            if (free < 0) {
+                free = i;
+            }
+        } else if (g_fault_ranges[i].start == start && g_fault_ranges[i].end == end) {
+            free = i; // replaces the handler of the same range
+            break;
+        }
+    }
+    if (free < 0) {
+        return -1;
+    }
+    if (!g_fault_registered) {
+        isr_register_interrupt_handler(PAGE_FAULT_VECTOR, page_fault);
+        g_fault_registered = 1;
+    }
+    g_fault_ranges[free].start = start;
+    g_fault_ranges[free].end = end;
+    g_fault_ranges[free].handler = handler;
+    return 0;
+}
@@ -0,0 +1,344 @@
+#include "pmm.h"
+#include "kernel.h"
+#include "paging.h"
+#include "string.h"
+#include "io_ports.h"
+
+#define FRAME_SHIFT 12
+#define FRAMES_4G 0x100000       // frame numbers stop at 4 GiB
+#define DIRECT_FRAMES (PAGING_DIRECT_SIZE / PMM_FRAME_SIZE) // RAM the kernel can reach
+#define LOW_MEMORY_FRAMES 256    // below 1 MiB: BIOS data, VGA memory, ROMs
+#define FRAME_NONE 0xFFFFFFFF
+#define MAX_RANGES 32       // from the memory map
+#define FIXED_RESERVED 3    // low memory, kernel image, frame table
+
+// FRAME.state of the first frame of a block; 0 for every other frame
+#define FRAME_FREE      0x80
+#define FRAME_ALLOCATED 0x40
+#define FRAME_ORDER     0x0F
+
+// One per frame below the top of usable RAM, the table itself sits in
+// RAM found at boot. A free block is linked into the list of its order
+// through its first frame.
+typedef struct {
+    uint32 next; // frame numbers, FRAME_NONE ends a list
+    uint32 prev;
+    uint8 state;
+    uint16 shares; // owners beyond the first of an allocated block, pmm_share()
+} FRAME;
+
+// Frame numbers [start, end)
+typedef struct {
+    uint32 start;
+    uint32 end;
+} FRAME_RANGE;
+
+PMM_STATS pmm_stats;
+
+static FRAME *g_frames = 0;
+static uint32 g_frame_count = 0;
+static uint32 g_free_lists[PMM_MAX_ORDER + 1];
+
+static FRAME_RANGE g_usable[MAX_RANGES];
+static int g_usable_count = 0;
+static FRAME_RANGE g_reserved[FIXED_RESERVED + MAX_RANGES];
+static int g_reserved_count = 0;
+
+static void list_push(uint32 frame, uint32 order) {
+    FRAME *f = &g_frames[frame];
+    f->state = FRAME_FREE | order;
+    f->prev = FRAME_NONE;
+    f->next = g_free_lists[order];
+    if (f->next != FRAME_NONE) {
+        g_frames[f->next].prev = frame;
+    }
+    g_free_lists[order] = frame;
+    pmm_stats.free_blocks[order]++;
+}
+
+static void list_remove(uint32 frame) {
+    FRAME *f = &g_frames[frame];
+    uint32 order = f->state & FRAME_ORDER;
+    if (f->prev != FRAME_NONE) {
+        g_frames[f->prev].next = f->next;
+    } else {
+        g_free_lists[order] = f->next;
+    }
+    if (f->next != FRAME_NONE) {
+        g_frames[f->next].prev = f->prev;
+    }
+    f->state = 0;
+    pmm_stats.free_blocks[order]--;
+}
+
+// Put a block on the free lists, merged with its buddy for as long as
+// the buddy is a free block of the same order
+static void free_block(uint32 frame, uint32 order) {
+    while (order < PMM_MAX_ORDER) {
+        uint32 buddy = frame ^ (1u << order);
+        if (buddy >= g_frame_count || g_frames[buddy].state != (FRAME_FREE | order)) {
+            break;
+        }
+        list_remove(buddy);
+        frame &= ~(1u << order);
+        order++;
+    }
+    list_push(frame, order);
+}
+
+uint32 pmm_alloc_order(uint32 order) {
+    if (order > PMM_MAX_ORDER) {
+        return 0;
+    }
+    // The lists are shared with interrupt handlers that allocate
+    uint32 flags = irq_save();
+    uint32 k = order;
+    while (k <= PMM_MAX_ORDER && g_free_lists[k] == FRAME_NONE) {
+        k++;
+    }
+    if (k > PMM_MAX_ORDER) {
+        irq_restore(flags);
+        return 0;
+    }
+
+    uint32 frame = g_free_lists[k];
+    list_remove(frame);
+    // Hand the upper halves back until the block has the size asked for
+    while (k > order) {
+        k--;
+        list_push(frame + (1u << k), k);
+    }
+    g_frames[frame].state = FRAME_ALLOCATED | order;
+    g_frames[frame].shares = 0;
+    pmm_stats.free_frames -= 1u << order;
+    pmm_stats.allocations++;
+    irq_restore(flags);
+    return frame << FRAME_SHIFT;
+}
+
+uint32 pmm_alloc_pages(uint32 count) {
+    uint32 order = 0;
+    if (count == 0) {
+        return 0;
+    }
+    while (order <= PMM_MAX_ORDER && (1u << order) < count) {
+        order++;
+    }
+    return pmm_alloc_order(order);
+}
+
+uint32 pmm_alloc_frame() {
+    return pmm_alloc_order(0);
+}
+
+void pmm_free(uint32 addr) {
+    uint32 frame = addr >> FRAME_SHIFT;
+    if ((addr & (PMM_FRAME_SIZE - 1)) != 0 || frame >= g_frame_count ||
+        !(g_frames[frame].state & FRAME_ALLOCATED)) {
+        return;
+    }
+    uint32 flags = irq_save();
+    if (g_frames[frame].shares > 0) {
+        g_frames[frame].shares--;
+        irq_restore(flags);
+        return;
+    }
+    uint32 order = g_frames[frame].state & FRAME_ORDER;
+    g_frames[frame].state = 0;
+    pmm_stats.free_frames += 1u << order;
+    pmm_stats.frees++;
+    free_block(frame, order);
+    irq_restore(flags);
+}
+
+int pmm_share(uint32 addr) {
+    uint32 frame = addr >> FRAME_SHIFT;
+    if ((addr & (PMM_FRAME_SIZE - 1)) != 0 || frame >= g_frame_count ||
+        !(g_frames[frame].state & FRAME_ALLOCATED) || g_frames[frame].shares == 0xFFFF) {
+        return -1;
+    }
+    uint32 flags = irq_save();
+    g_frames[frame].shares++;
+    irq_restore(flags);
+    return 0;
+}
+
+int pmm_shared(uint32 addr) {
+    uint32 frame = addr >> FRAME_SHIFT;
+    if ((addr & (PMM_FRAME_SIZE - 1)) != 0 || frame >= g_frame_count ||
+        !(g_frames[frame].state & FRAME_ALLOCATED)) {
+        return 0;
+    }
+    return g_frames[frame].shares > 0;
+}
+
+uint32 pmm_block_frames(uint32 addr) {
+    uint32 frame = addr >> FRAME_SHIFT;
+    if ((addr & (PMM_FRAME_SIZE - 1)) != 0 || frame >= g_frame_count ||
+        !(g_frames[frame].state & FRAME_ALLOCATED)) {
+        return 0;
+    }
+    return 1u << (g_frames[frame].state & FRAME_ORDER);
+}
+
+// Frames of [addr, addr + len) below 4 GiB: whole frames of the direct
+// map only for RAM, every frame touched (outward) for reserved areas
+static int to_frames(const MULTIBOOT_MMAP_ENTRY *e, int outward, FRAME_RANGE *r) {
+    if (e->addr_high != 0) {
+        return 0;
+    }
+    uint32 end = e->addr_low + e->len_low;
+    r->start = e->addr_low / PMM_FRAME_SIZE;
+    r->end = end / PMM_FRAME_SIZE;
+    if (e->len_high != 0 || end < e->addr_low) {
+        r->end = FRAMES_4G;
+    } else if (outward && (end & (PMM_FRAME_SIZE - 1)) != 0) {
+        r->end++;
+    }
+    if (!outward && (e->addr_low & (PMM_FRAME_SIZE - 1)) != 0) {
+        r->start++;
+    }
+    // RAM above the direct map cannot be reached by the kernel (paging.h)
+    if (!outward && r->end > DIRECT_FRAMES) {
+        r->end = DIRECT_FRAMES;
+    }
+    return r->start < r->end;
+}
+
+static void add_range(FRAME_RANGE *list, int *count, int limit, uint32 start, uint32 end) {
+    if (start >= end || *count == limit) {
+        return;
+    }
+    list[*count].start = start;
+    list[*count].end = end;
+    (*count)++;
+}
+
+// Sort the usable ranges and merge those that overlap or touch, so no
+// frame is freed twice when a map lists it twice
+static void merge_usable() {
+    for (int i = 1; i < g_usable_count; i++) {
+        FRAME_RANGE r = g_usable[i];
+        int j = i;
+        for (; j > 0 && g_usable[j - 1].start > r.start; j--) {
+            g_usable[j] = g_usable[j - 1];
+        }
+        g_usable[j] = r;
+    }
+    int n = 0;
+    for (int i = 0; i < g_usable_count; i++) {
+        if (n > 0 && g_usable[i].start <= g_usable[n - 1].end) {
+            if (g_usable[i].end > g_usable[n - 1].end) {
+                g_usable[n - 1].end = g_usable[i].end;
+            }
+        } else {
+            g_usable[n++] = g_usable[i];
+        }
+    }
+    g_usable_count = n;
+}
+
+// First count frames of usable RAM clear of every reserved range
+static uint32 find_room(uint32 count) {
+    for (int i = 0; i < g_usable_count; i++) {
+        uint32 start = g_usable[i].start;
+        int moved = 1;
+        while (moved && start + count <= g_usable[i].end) {
+            moved = 0;
+            for (int j = 0; j < g_reserved_count; j++) {
+                if (start < g_reserved[j].end && start + count > g_reserved[j].start) {
+                    start = g_reserved[j].end;
+                    moved = 1;
+                }
+            }
+        }
+        if (!moved) {
+            return start;
+        }
+    }
+    return FRAME_NONE;
+}
+
+// Free the frames of [start, end) that no reserved range from index
+// first on covers, in the largest aligned blocks that fit
+static void free_range(uint32 start, uint32 end, int first) {
+    for (int i = first; i < g_reserved_count && start < end; i++) {
+        FRAME_RANGE *r = &g_reserved[i];
+        if (r->end <= start || r->start >= end) {
+            continue;
+        }
+        free_range(start, r->start > start ? r->start : start, i + 1);
+        start = r->end;
+    }
+    while (start < end) {
+        uint32 order = 0;
+        while (order < PMM_MAX_ORDER && (start & ((2u << order) - 1)) == 0 && start + (2u << order) <= end) {
+            order++;
+        }
+        free_block(start, order);
+        pmm_stats.free_frames += 1u << order;
+        start += 1u << order;
+    }
+}
+
+int pmm_init(uint32 magic, const MULTIBOOT_INFO *mbi) {
+    memset(&pmm_stats, 0, sizeof(pmm_stats));
+    for (int i = 0; i <= PMM_MAX_ORDER; i++) {
+        g_free_lists[i] = FRAME_NONE;
+    }
+    g_usable_count = 0;
+    g_reserved_count = 0;
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || mbi == 0) {
+        return -1;
+    }
+
+    // Fixed reservations go first, so a long memory map cannot crowd them out
+    add_range(g_reserved, &g_reserved_count, FIXED_RESERVED, 0, LOW_MEMORY_FRAMES);
+    add_range(g_reserved, &g_reserved_count, FIXED_RESERVED, VIRT_TO_PHYS(&__kernel_section_start) / PMM_FRAME_SIZE,
+              (VIRT_TO_PHYS(&__kernel_section_end) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE);
+
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        uint32 addr = mbi->mmap_addr;
+        while (addr + sizeof(MULTIBOOT_MMAP_ENTRY) <= mbi->mmap_addr + mbi->mmap_length) {
+            const MULTIBOOT_MMAP_ENTRY *e = (const MULTIBOOT_MMAP_ENTRY *)PHYS_TO_VIRT(addr);
+            FRAME_RANGE r;
+            if (e->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                if (to_frames(e, 0, &r)) {
+                    add_range(g_usable, &g_usable_count, MAX_RANGES, r.start, r.end);
+                }
+            } else if (to_frames(e, 1, &r)) {
+                add_range(g_reserved, &g_reserved_count, FIXED_RESERVED - 1 + MAX_RANGES, r.start, r.end);
+            }
+            addr += e->size + sizeof(e->size);
+        }
+    } else if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+        uint32 end = LOW_MEMORY_FRAMES + mbi->mem_upper / 4;
+        add_range(g_usable, &g_usable_count, MAX_RANGES, LOW_MEMORY_FRAMES, end < DIRECT_FRAMES ? end : DIRECT_FRAMES);
+    }
+    merge_usable();
+    if (g_usable_count == 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < g_usable_count; i++) {
+        pmm_stats.total_frames += g_usable[i].end - g_usable[i].start;
+        if (g_usable[i].end > g_frame_count) {
+            g_frame_count = g_usable[i].end;
+        }
+    }
+    uint32 table_frames = (g_frame_count * sizeof(FRAME) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint32 table = find_room(table_frames);
+    if (table == FRAME_NONE) {
+        g_frame_count = 0;
+        return -1;
+    }
+    add_range(g_reserved, &g_reserved_count, FIXED_RESERVED + MAX_RANGES, table, table + table_frames);
+    g_frames = (FRAME *)PHYS_TO_VIRT(table << FRAME_SHIFT);
+    memset(g_frames, 0, g_frame_count * sizeof(FRAME));
+
+    for (int i = 0; i < g_usable_count; i++) {
+        free_range(g_usable[i].start, g_usable[i].end, 0);
+    }
+    pmm_stats.reserved_frames = pmm_stats.total_frames - pmm_stats.free_frames;
+    return pmm_stats.free_frames != 0 ? 0 : -1;
+}
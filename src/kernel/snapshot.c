@@ -0,0 +1,342 @@
+#include "snapshot.h"
+#include "console.h"
+#include "string.h"
+#include "ide.h" // ATA_SECTOR_SIZE
+#include "fsdisk.h"
+#include "crc32c.h"
+#include <stddef.h> // offsetof
+
+#define SLOT_WORDS ((FS_DATA_SLOTS + 31) / 32)
+
+SnapshotDesc snapshots[FS_MAX_SNAPSHOTS];
+
+// Data slots each snapshot refers to, bit (slot - 1) as in used_slots
+static uint32 snapshot_slots[FS_MAX_SNAPSHOTS][SLOT_WORDS];
+static uint8 snapshot_busy[FS_MAX_SNAPSHOTS]; // mounted
+static uint32 next_generation = 1;
+
+static uint8 desc_buf[ATA_SECTOR_SIZE];
+static uint8 block_buf[FS_CRC_BLOCK_SECTORS * ATA_SECTOR_SIZE];
+
+static int test_bit(const uint32* map, uint32 n) {
+    return (map[n / 32] >> (n % 32)) & 1;
+}
+
+static uint32 desc_lba(int index) {
+    return SNAPSHOT_START + index * SNAPSHOT_SECTORS;
+}
+
+// Where the snapshot keeps its copy of metadata sector m
+static uint32 copy_lba(int index, uint32 m) {
+    return desc_lba(index) + 1 + m;
+}
+
+static uint32 block_sectors(uint32 block) {
+    uint32 m = block * FS_CRC_BLOCK_SECTORS;
+    return m + FS_CRC_BLOCK_SECTORS < FS_META_SECTORS ? FS_CRC_BLOCK_SECTORS : FS_META_SECTORS - m;
+}
+
+static int write_desc(int index) {
+    SnapshotDesc* desc = &snapshots[index];
+    desc->magic = SNAPSHOT_MAGIC;
+    desc->crc = crc32c(0, desc, offsetof(SnapshotDesc, crc));
+    memset(desc_buf, 0, ATA_SECTOR_SIZE);
+    memcpy(desc_buf, desc, sizeof(SnapshotDesc));
+    return fs_disk_write(desc_lba(index), 1, desc_buf);
+}
+
+// Metadata block as of the snapshot: its copy once the table moved on,
+// until then the block of the table itself
+static int read_block(int index, uint32 block, uint8* out) {
+    SnapshotDesc* desc = &snapshots[index];
+    uint32 m = block * FS_CRC_BLOCK_SECTORS;
+    uint32 n = block_sectors(block);
+    uint32 lba = test_bit(desc->preserved, block) ? copy_lba(index, m) : FS_KEYS_START + m;
+    if (fs_disk_read(lba, n, out) != 0) {
+        return -1;
+    }
+    if (crc32c(0, out, n * ATA_SECTOR_SIZE) != desc->block_crc[block]) {
+        fs_crc_errors++;
+        return -1;
+    }
+    return 0;
+}
+
+int snapshot_read_meta(int index, uint8* image, uint32 start, uint32 count) {
+    if (count == 0) {
+        return 0;
+    }
+    uint32 last = (start + count - 1) / FS_CRC_BLOCK_SECTORS;
+    for (uint32 b = start / FS_CRC_BLOCK_SECTORS; b <= last; b++) {
+        if (read_block(index, b, image + b * FS_CRC_BLOCK_SECTORS * ATA_SECTOR_SIZE) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Collect the data slots of the snapshot's entries, a block at a time.
+// Entries do not straddle sectors: 512 is a multiple of sizeof(FileEntry).
+static int scan_slots(int index) {
+    uint32* slots = snapshot_slots[index];
+    uint32 count = snapshots[index].file_count;
+    uint32 per_sector = ATA_SECTOR_SIZE / sizeof(FileEntry);
+    uint32 first = FS_META_TABLE;
+    uint32 end = FS_META_TABLE + (count + per_sector - 1) / per_sector;
+
+    memset(slots, 0, sizeof(snapshot_slots[index]));
+    for (uint32 b = first / FS_CRC_BLOCK_SECTORS; b * FS_CRC_BLOCK_SECTORS < end; b++) {
+        if (read_block(index, b, block_buf) != 0) {
+            return -1;
+        }
+        for (uint32 m = b * FS_CRC_BLOCK_SECTORS; m < (b + 1) * FS_CRC_BLOCK_SECTORS && m < end; m++) {
+            if (m < first) {
+                continue;
+            }
+            FileEntry* entries = (FileEntry*)(block_buf + (m - b * FS_CRC_BLOCK_SECTORS) * ATA_SECTOR_SIZE);
+            uint32 base = (m - first) * per_sector;
+            for (uint32 i = 0; i < per_sector && base + i < count; i++) {
+                uint32 slot = entries[i].data_slot;
+                if (slot != 0 && slot <= FS_DATA_SLOTS) {
+                    slots[(slot - 1) / 32] |= 1u << ((slot - 1) % 32);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+void snapshot_format() {
+    memset(snapshots, 0, sizeof(snapshots));
+    memset(snapshot_slots, 0, sizeof(snapshot_slots));
+    memset(desc_buf, 0, ATA_SECTOR_SIZE);
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        fs_disk_write(desc_lba(i), 1, desc_buf);
+    }
+    next_generation = 1;
+}
+
+void snapshot_load() {
+    memset(snapshots, 0, sizeof(snapshots));
+    memset(snapshot_slots, 0, sizeof(snapshot_slots));
+    next_generation = 1;
+
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        SnapshotDesc* desc = (SnapshotDesc*)desc_buf;
+        if (fs_disk_read(desc_lba(i), 1, desc_buf) != 0 || desc->magic != SNAPSHOT_MAGIC ||
+            crc32c(0, desc, offsetof(SnapshotDesc, crc)) != desc->crc) {
+            continue; // never written, or by an older file system
+        }
+        if (desc->generation >= next_generation) {
+            next_generation = desc->generation + 1;
+        }
+        if (!desc->in_use || desc->file_count == 0 || desc->file_count > MAX_FILES ||
+            desc->pool_used > FS_NAME_POOL_BYTES) {
+            continue;
+        }
+        memcpy(&snapshots[i], desc, sizeof(SnapshotDesc));
+        snapshots[i].name[SNAPSHOT_NAME_LENGTH - 1] = '\0';
+        if (scan_slots(i) != 0) {
+            // Without its slots the snapshot cannot be kept safe from reuse
+            console_printf("[FS] Снимок %s повреждён и пропущен.\n", snapshots[i].name);
+            memset(&snapshots[i], 0, sizeof(SnapshotDesc));
+            memset(snapshot_slots[i], 0, sizeof(snapshot_slots[i]));
+        }
+    }
+}
+
+int snapshot_find(const char* name) {
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        if (snapshots[i].in_use && strcmp(snapshots[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int snapshot_create(const char* name) {
+    if (name[0] == '\0' || strlen(name) >= SNAPSHOT_NAME_LENGTH) {
+        return VFS_ERR_INVALID;
+    }
+    if (snapshot_find(name) != -1) {
+        return VFS_ERR_EXISTS;
+    }
+    int index = 0;
+    while (index < FS_MAX_SNAPSHOTS && snapshots[index].in_use) {
+        index++;
+    }
+    if (index == FS_MAX_SNAPSHOTS) {
+        return VFS_ERR_NO_SPACE;
+    }
+
+    // The snapshot is the table the checkpoint leaves on disk, described
+    // by the header it writes last
+    if (checkpoint_file_system() < 0) {
+        return VFS_ERR_IO;
+    }
+    FsHeader* header = (FsHeader*)desc_buf;
+    if (fs_disk_read(FS_START_SECTOR, 1, desc_buf) != 0 || fs_check_header(header) != 0) {
+        return VFS_ERR_IO;
+    }
+    SnapshotDesc* desc = &snapshots[index];
+    memset(desc, 0, sizeof(SnapshotDesc));
+    desc->file_count = header->file_count;
+    desc->pool_used = header->pool_used;
+    memcpy(desc->block_crc, header->block_crc, sizeof(desc->block_crc));
+    desc->in_use = 1;
+    desc->generation = next_generation;
+    strcpy(desc->name, name);
+    if (write_desc(index) != 0) {
+        memset(desc, 0, sizeof(SnapshotDesc));
+        return VFS_ERR_IO;
+    }
+    next_generation++;
+
+    // Every slot the table refers to right after a checkpoint is one the
+    // snapshot refers to
+    uint32* slots = snapshot_slots[index];
+    memset(slots, 0, sizeof(snapshot_slots[index]));
+    for (uint32 slot = 1; slot <= FS_DATA_SLOTS; slot++) {
+        if (get_slot_refs(slot) != 0) {
+            slots[(slot - 1) / 32] |= 1u << ((slot - 1) % 32);
+        }
+    }
+    return index;
+}
+
+int snapshot_delete(const char* name) {
+    int index = snapshot_find(name);
+    if (index == -1) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (snapshot_busy[index]) {
+        return VFS_ERR_BUSY;
+    }
+    snapshots[index].in_use = 0;
+    if (write_desc(index) != 0) {
+        snapshots[index].in_use = 1;
+        return VFS_ERR_IO;
+    }
+
+    // Each word is cleared before its slots are offered back, so that
+    // release_snapshot_slot() only sees the other snapshots
+    int freed = 0;
+    for (uint32 w = 0; w < SLOT_WORDS; w++) {
+        uint32 bits = snapshot_slots[index][w];
+        snapshot_slots[index][w] = 0;
+        while (bits != 0) {
+            uint32 bit = __builtin_ctz(bits);
+            bits &= bits - 1;
+            freed += release_snapshot_slot(w * 32 + bit + 1);
+        }
+    }
+    return freed;
+}
+
+int snapshot_open(const char* name) {
+    int index = snapshot_find(name);
+    if (index == -1) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (snapshot_busy[index]) {
+        return VFS_ERR_BUSY;
+    }
+    snapshot_busy[index] = 1;
+    return index;
+}
+
+void snapshot_close(int index) {
+    if (index >= 0 && index < FS_MAX_SNAPSHOTS) {
+        snapshot_busy[index] = 0;
+    }
+}
+
+uint32 snapshot_unique_slots(int index) {
+    uint32 count = 0;
+    for (uint32 w = 0; w < SLOT_WORDS; w++) {
+        uint32 bits = snapshot_slots[index][w];
+        for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+            if (i != index && snapshots[i].in_use) {
+                bits &= ~snapshot_slots[i][w];
+            }
+        }
+        while (bits != 0) {
+            uint32 bit = __builtin_ctz(bits);
+            bits &= bits - 1;
+            count += get_slot_refs(w * 32 + bit + 1) == 0;
+        }
+    }
+    return count;
+}
+
+uint32 snapshot_scratch_lba() {
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        if (!snapshots[i].in_use) {
+            return copy_lba(i, 0);
+        }
+    }
+    return 0;
+}
+
+uint32 snapshot_preserved_blocks(int index) {
+    uint32 count = 0;
+    for (uint32 b = 0; b < FS_META_BLOCKS; b++) {
+        count += test_bit(snapshots[index].preserved, b);
+    }
+    return count;
+}
+
+int snapshot_holds_slot(uint32 slot) {
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        if (snapshots[i].in_use && test_bit(snapshot_slots[i], slot - 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void snapshot_add_slots(uint32* used) {
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        if (!snapshots[i].in_use) {
+            continue;
+        }
+        for (uint32 w = 0; w < SLOT_WORDS; w++) {
+            used[w] |= snapshot_slots[i][w];
+        }
+    }
+}
+
+// A block still shared with a snapshot is on disk as it was when the
+// snapshot was taken: copy it out before the table overwrites it. The
+// descriptor that says so is written before the caller goes on.
+int snapshot_preserve(uint32 first, uint32 end) {
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        SnapshotDesc* desc = &snapshots[i];
+        if (!desc->in_use) {
+            continue;
+        }
+        uint32 before[(FS_META_BLOCKS + 31) / 32];
+        memcpy(before, desc->preserved, sizeof(before));
+        for (uint32 b = first; b < end; b++) {
+            if (test_bit(desc->preserved, b)) {
+                continue;
+            }
+            uint32 m = b * FS_CRC_BLOCK_SECTORS;
+            uint32 n = block_sectors(b);
+            if (fs_disk_read(FS_KEYS_START + m, n, block_buf) != 0 ||
+                fs_disk_write(copy_lba(i, m), n, block_buf) != 0) {
+                memcpy(desc->preserved, before, sizeof(before));
+                return -1;
+            }
+            desc->preserved[b / 32] |= 1u << (b % 32);
+        }
+        if (memcmp((uint8*)before, (uint8*)desc->preserved, sizeof(before))) {
+            continue; // nothing was copied
+        }
+        if (write_desc(i) != 0) {
+            memcpy(desc->preserved, before, sizeof(before));
+            return -1;
+        }
+    }
+    return 0;
+}
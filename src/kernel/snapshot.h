@@ -0,0 +1,91 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "types.h"
+#include "filesystem.h"
+#include "trigram.h"
+
+/**
+ * Read-only point-in-time copies of the file table.
+ *
+ * Taking a snapshot checkpoints the table and records the header that
+ * checkpoint wrote, under the next generation number: nothing is copied.
+ * From then on both sides are copy-on-write. Contents already are, a
+ * data slot is never rewritten in place; a slot the snapshot refers to
+ * just stays allocated when the live table lets go of it. Metadata is
+ * rewritten in place at the checkpoint, so before a block is overwritten
+ * for the first time since the snapshot, its old version is copied to
+ * the snapshot's own area on disk.
+ *
+ * A snapshot is mounted read-only through snapshot_driver (snapshot_vfs.c).
+ * Deleting it frees the data slots that neither the live table nor
+ * another snapshot refers to.
+ */
+
+#define FS_MAX_SNAPSHOTS 4
+#define SNAPSHOT_NAME_LENGTH 16
+#define SNAPSHOT_MAGIC 0x50414E53 // "SNAP"
+// After the trigram index, per snapshot: its descriptor sector, then room
+// for a copy of every metadata sector at the same offset as in the table
+#define SNAPSHOT_SECTORS (1 + FS_META_SECTORS)
+#define SNAPSHOT_START (TRIGRAM_START + TRIGRAM_SECTORS)
+#define SNAPSHOT_END (SNAPSHOT_START + FS_MAX_SNAPSHOTS * SNAPSHOT_SECTORS)
+
+// Descriptor sector. A deleted snapshot keeps its descriptor with in_use
+// cleared, so generation numbers are never handed out twice.
+typedef struct {
+    uint32 magic;
+    uint32 in_use;
+    uint32 generation;
+    char name[SNAPSHOT_NAME_LENGTH];
+    uint32 file_count;   // FsHeader fields at the time of the snapshot
+    uint32 pool_used;
+    uint32 preserved[(FS_META_BLOCKS + 31) / 32]; // blocks copied to the snapshot's area
+    uint32 block_crc[FS_META_BLOCKS];
+    uint32 crc;          // CRC32C of the descriptor up to this field
+} SnapshotDesc;
+
+extern SnapshotDesc snapshots[FS_MAX_SNAPSHOTS]; // in_use == 0 - свободен
+
+// Forget every snapshot, for a new file system
+void snapshot_format();
+// Read the descriptors and the data slots each snapshot refers to, at load
+void snapshot_load();
+
+// Freeze the table as it is now, returns the snapshot index or VFS_ERR_*
+int snapshot_create(const char* name);
+// Drop a snapshot that is not mounted, returns the data slots freed or VFS_ERR_*
+int snapshot_delete(const char* name);
+// Index of the snapshot called name, -1 if there is none
+int snapshot_find(const char* name);
+
+// Keep a mounted snapshot from being deleted, VFS_ERR_* if it cannot be opened
+int snapshot_open(const char* name);
+void snapshot_close(int index);
+
+// Read the whole blocks covering metadata sectors [start, start + count)
+// of snapshot index into image, metadata sector m at image + m * 512.
+// Returns 0, or -1 on I/O errors and blocks that fail their CRC.
+int snapshot_read_meta(int index, uint8* image, uint32 start, uint32 count);
+
+// Data slots the snapshot holds that nothing else refers to, what
+// deleting it would free
+uint32 snapshot_unique_slots(int index);
+// Metadata blocks copied to the snapshot's area so far
+uint32 snapshot_preserved_blocks(int index);
+
+// For filesystem.c: whether any snapshot refers to slot, the slots of
+// all snapshots added to used, and the copy-on-write of metadata blocks
+// [first, end) before the checkpoint overwrites them (0 on success)
+int snapshot_holds_slot(uint32 slot);
+void snapshot_add_slots(uint32* used);
+int snapshot_preserve(uint32 first, uint32 end);
+// The area of a free snapshot as scratch space for a copy of the
+// metadata, metadata sector m at the returned sector + m; 0 if every
+// snapshot is taken. Valid until the next snapshot_create().
+uint32 snapshot_scratch_lba();
+
+// VFS driver, mount options are the snapshot name (snapshot_vfs.c)
+extern VFS_DRIVER snapshot_driver;
+
+#endif
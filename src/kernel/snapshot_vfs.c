@@ -0,0 +1,208 @@
+#include "snapshot.h"
+#include "namepool.h"
+#include "string.h"
+#include "ide.h" // ATA_SECTOR_SIZE
+#include "fs/vfs.h"
+#include "meminfo.h"
+
+// Read-only VFS driver for a snapshot (snapshot.h). The snapshot's keys,
+// entries and name pool are read into one image laid out like the
+// metadata on disk; contents come from the data slots they name, through
+// the same cache as the live table. One snapshot is mounted at a time.
+
+typedef struct {
+    int index; // in snapshots[], -1 - не смонтирован
+    uint32 file_count;
+    uint32 pool_used;
+    FileKey* keys;
+    FileEntry* entries;
+    const uint8* pool;
+} SnapshotView;
+
+static uint8 view_image[FS_META_SECTORS * ATA_SECTOR_SIZE];
+MEMINFO_STATIC(view_image);
+static SnapshotView view = {.index = -1};
+
+static uint32 sectors_for(uint32 bytes) {
+    return (bytes + ATA_SECTOR_SIZE - 1) / ATA_SECTOR_SIZE;
+}
+
+static const char* view_name(uint32 node) {
+    return name_pool_text(view.pool, view.pool_used, view.keys[node].name);
+}
+
+static int view_find_child(uint32 dir, const char* name) {
+    for (uint32 i = FS_ROOT_INDEX + 1; i < view.file_count; i++) {
+        if (view.keys[i].parent_id == dir && strcmp(view_name(i), name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// find_file() over the snapshot
+static int view_find(const char* path) {
+    char component[MAX_FILENAME];
+    int index = FS_ROOT_INDEX;
+
+    while (*path != '\0') {
+        while (*path == '/') {
+            path++;
+        }
+        int len = 0;
+        while (path[len] != '\0' && path[len] != '/') {
+            len++;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (len >= MAX_FILENAME || !view.entries[index].is_directory) {
+            return -1;
+        }
+        memcpy(component, path, len);
+        component[len] = '\0';
+        path += len;
+
+        if (strcmp(component, "..") == 0) {
+            index = view.keys[index].parent_id;
+            if (index >= (int)view.file_count) {
+                return -1;
+            }
+        } else if (strcmp(component, ".") != 0) {
+            index = view_find_child(index, component);
+            if (index == -1) {
+                return -1;
+            }
+        }
+    }
+    return index;
+}
+
+static void fill_stat(uint32 node, VFS_STAT* st) {
+    FileEntry* entry = &view.entries[node];
+    st->node = node;
+    st->size = entry->size;
+    st->allocated = entry->data_slot != 0 ? FS_DATA_SECTORS * ATA_SECTOR_SIZE : 0;
+    st->permissions = entry->permissions;
+    st->is_directory = entry->is_directory;
+}
+
+// Options: the name of the snapshot
+static void* snapshot_mount(BLOCK_DEVICE* dev, const char* options) {
+    if (options == NULL || view.index != -1) {
+        return NULL;
+    }
+    int index = snapshot_open(options);
+    if (index < 0) {
+        return NULL;
+    }
+    SnapshotDesc* desc = &snapshots[index];
+    memset(view_image, 0, sizeof(view_image));
+    if (snapshot_read_meta(index, view_image, 0, sectors_for(desc->file_count * sizeof(FileKey))) != 0 ||
+        snapshot_read_meta(index, view_image, FS_META_TABLE,
+                           sectors_for(desc->file_count * sizeof(FileEntry))) != 0 ||
+        snapshot_read_meta(index, view_image, FS_META_POOL, sectors_for(desc->pool_used)) != 0) {
+        snapshot_close(index);
+        return NULL;
+    }
+    view.index = index;
+    view.file_count = desc->file_count;
+    view.pool_used = desc->pool_used;
+    view.keys = (FileKey*)view_image;
+    view.entries = (FileEntry*)(view_image + FS_META_TABLE * ATA_SECTOR_SIZE);
+    view.pool = view_image + FS_META_POOL * ATA_SECTOR_SIZE;
+    return &view;
+}
+
+static void snapshot_unmount(void* fs) {
+    snapshot_close(view.index);
+    view.index = -1;
+}
+
+static int snapshot_lookup(void* fs, const char* path, VFS_STAT* st) {
+    int index = view_find(path);
+    if (index == -1) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    fill_stat(index, st);
+    return 0;
+}
+
+static int snapshot_stat(void* fs, uint32 node, VFS_STAT* st) {
+    if (node >= view.file_count) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    fill_stat(node, st);
+    return 0;
+}
+
+static int snapshot_read(void* fs, uint32 node, uint32 offset, void* buffer, uint32 length) {
+    if (node >= view.file_count) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    FileEntry* entry = &view.entries[node];
+    if (entry->is_directory) {
+        return VFS_ERR_IS_DIR;
+    }
+    if (offset >= entry->size) {
+        return 0;
+    }
+    const char* content = read_entry_content(entry);
+    if (content == NULL) {
+        return VFS_ERR_IO;
+    }
+    if (length > entry->size - offset) {
+        length = entry->size - offset;
+    }
+    memcpy(buffer, content + offset, length);
+    return length;
+}
+
+static int snapshot_write(void* fs, uint32 node, uint32 offset, const void* buffer, uint32 length) {
+    return VFS_ERR_READ_ONLY;
+}
+
+static int snapshot_truncate(void* fs, uint32 node, uint32 size) {
+    return VFS_ERR_READ_ONLY;
+}
+
+static int snapshot_create_file(void* fs, const char* path, uint8 is_directory, uint32 permissions, VFS_STAT* st) {
+    return VFS_ERR_READ_ONLY;
+}
+
+static int snapshot_unlink(void* fs, const char* path) {
+    return VFS_ERR_READ_ONLY;
+}
+
+static int snapshot_rename(void* fs, const char* from, const char* to) {
+    return VFS_ERR_READ_ONLY;
+}
+
+static int snapshot_readdir(void* fs, uint32 node, VFS_DIR_CALLBACK callback, void* arg) {
+    VFS_STAT st;
+    for (uint32 i = FS_ROOT_INDEX + 1; i < view.file_count; i++) {
+        if (view.keys[i].parent_id != node) {
+            continue;
+        }
+        fill_stat(i, &st);
+        if (callback(view_name(i), &st, arg)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+VFS_DRIVER snapshot_driver = {
+    .name = "snapshot",
+    .mount = snapshot_mount,
+    .unmount = snapshot_unmount,
+    .lookup = snapshot_lookup,
+    .stat = snapshot_stat,
+    .read = snapshot_read,
+    .write = snapshot_write,
+    .truncate = snapshot_truncate,
+    .create = snapshot_create_file,
+    .unlink = snapshot_unlink,
+    .rename = snapshot_rename,
+    .readdir = snapshot_readdir,
+};
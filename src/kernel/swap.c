@@ -0,0 +1,391 @@
+#include "swap.h"
+#include "paging.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "console.h"
+#include "string.h"
+#include "fs/vfs.h"
+#include "snapshot.h"
+#include <stddef.h> // Для NULL
+
+#define ANON_END (PAGING_ANON_BASE + PAGING_ANON_SIZE)
+#define SLOT_SECTORS (PAGE_SIZE / BLOCKDEV_SECTOR_SIZE)
+#define SLOT_NONE 0
+
+typedef struct {
+    uint32 base;    // first address, 0 - slot unused
+    uint32 pages;
+    uint32* slots;  // swap slot + 1 of each page, SLOT_NONE - no copy in swap
+} SwapRegion;
+
+SwapStats swap_stats;
+
+static SwapRegion regions[SWAP_MAX_REGIONS];
+static BLOCK_DEVICE* swap_dev = NULL;
+static uint32* slot_map = NULL; // a bit per slot, set - in use
+static uint32 slot_hint = 0;    // the search for a free slot starts here
+static uint32 resident_limit = 0;
+static uint32 clock_region = 0; // the hand: a page of a region
+static uint32 clock_page = 0;
+static int handler_registered = 0;
+
+static SwapRegion* find_region(uint32 addr) {
+    for (int i = 0; i < SWAP_MAX_REGIONS; i++) {
+        SwapRegion* r = &regions[i];
+        if (r->base != 0 && addr >= r->base && addr - r->base < r->pages * PAGE_SIZE) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+// Lowest free range of the anonymous area for pages, 0 if there is none
+static uint32 find_range(uint32 pages) {
+    uint32 base = PAGING_ANON_BASE;
+    while (base + pages * PAGE_SIZE <= ANON_END && base + pages * PAGE_SIZE > base) {
+        uint32 end = base + pages * PAGE_SIZE;
+        SwapRegion* overlap = NULL;
+        for (int i = 0; i < SWAP_MAX_REGIONS && overlap == NULL; i++) {
+            SwapRegion* r = &regions[i];
+            if (r->base != 0 && r->base < end && base < r->base + r->pages * PAGE_SIZE) {
+                overlap = r;
+            }
+        }
+        if (overlap == NULL) {
+            return base;
+        }
+        base = overlap->base + overlap->pages * PAGE_SIZE;
+    }
+    return 0;
+}
+
+// A free slot + 1, SLOT_NONE if swap is off or full
+static uint32 slot_alloc() {
+    for (uint32 n = 0; n < swap_stats.slots; n++) {
+        uint32 i = (slot_hint + n) % swap_stats.slots;
+        if (!(slot_map[i / 32] & (1u << (i % 32)))) {
+            slot_map[i / 32] |= 1u << (i % 32);
+            slot_hint = i + 1;
+            swap_stats.slots_used++;
+            return i + 1;
+        }
+    }
+    return SLOT_NONE;
+}
+
+static void slot_free(uint32 slot) {
+    uint32 i = slot - 1;
+    slot_map[i / 32] &= ~(1u << (i % 32));
+    swap_stats.slots_used--;
+}
+
+static int slot_write(uint32 slot, uint32 frame) {
+    return blockdev_write(swap_dev, (slot - 1) * SLOT_SECTORS, SLOT_SECTORS, PHYS_TO_VIRT(frame));
+}
+
+static int slot_read(uint32 slot, uint32 frame) {
+    return blockdev_read(swap_dev, (slot - 1) * SLOT_SECTORS, SLOT_SECTORS, PHYS_TO_VIRT(frame));
+}
+
+// Take the frame of the page at virt of region r, writing the page to
+// swap first if it changed. 0 if it has to stay.
+static uint32 evict(SwapRegion* r, uint32 virt) {
+    uint32* pte = paging_pte(virt);
+    uint32* slot = &r->slots[(virt - r->base) / PAGE_SIZE];
+    uint32 frame = *pte & PAGE_FRAME;
+
+    // A clean page matches its slot, or holds the zeros it was made with
+    if (*pte & PAGE_DIRTY) {
+        int new_slot = *slot == SLOT_NONE;
+        if (new_slot) {
+            *slot = slot_alloc();
+        }
+        if (*slot == SLOT_NONE) {
+            return 0;
+        }
+        if (slot_write(*slot, frame) != 0) {
+            if (new_slot) {
+                slot_free(*slot);
+                *slot = SLOT_NONE;
+            }
+            return 0;
+        }
+        swap_stats.pages_out++;
+    }
+    *pte = 0;
+    paging_invalidate(virt);
+    swap_stats.resident--;
+    swap_stats.evictions++;
+    return frame;
+}
+
+// The frame of the first resident page the clock finds not accessed
+// since it last passed, 0 if every page has to stay
+static uint32 evict_one() {
+    uint32 total = 0;
+    for (int i = 0; i < SWAP_MAX_REGIONS; i++) {
+        total += regions[i].base != 0 ? regions[i].pages : 0;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    // Twice round: the first pass may only clear accessed bits
+    for (uint32 passed = 0; passed < 2 * total + 1;) {
+        SwapRegion* r = &regions[clock_region];
+        if (r->base == 0 || clock_page >= r->pages) {
+            clock_region = (clock_region + 1) % SWAP_MAX_REGIONS;
+            clock_page = 0;
+            continue;
+        }
+        uint32 virt = r->base + clock_page * PAGE_SIZE;
+        clock_page++;
+        passed++;
+        uint32* pte = paging_pte(virt);
+        if (pte == NULL || !(*pte & PAGE_PRESENT)) {
+            continue;
+        }
+        if (*pte & PAGE_ACCESSED) {
+            *pte &= ~PAGE_ACCESSED; // second chance
+            paging_invalidate(virt);
+            continue;
+        }
+        uint32 frame = evict(r, virt);
+        if (frame != 0) {
+            return frame;
+        }
+    }
+    return 0;
+}
+
+// A frame for a page: from pmm while under the limit and pmm has more
+// than the heap's reserve, else from another page. When every page has
+// to stay, the limit and the reserve give way rather than the fault.
+static uint32 take_frame() {
+    int below_limit = resident_limit == 0 || swap_stats.resident < resident_limit;
+    uint32 frame = 0;
+    if (below_limit && pmm_stats.free_frames > SWAP_RESERVE_FRAMES) {
+        frame = pmm_alloc_frame();
+    }
+    if (frame == 0) {
+        frame = evict_one();
+    }
+    if (frame == 0) {
+        frame = pmm_alloc_frame();
+    }
+    return frame;
+}
+
+static void page_fault(REGISTERS* reg, uint32 addr) {
+    SwapRegion* r = find_region(addr);
+    if (r == NULL || (reg->err_code & PAGE_FAULT_PRESENT)) {
+        console_printf("[SWAP] Недопустимое обращение к 0x%x\n", addr);
+        isr_panic(reg);
+    }
+    uint32 virt = addr & PAGE_FRAME;
+    uint32 slot = r->slots[(virt - r->base) / PAGE_SIZE];
+    uint32 frame = take_frame();
+    if (frame == 0) {
+        console_printf("[SWAP] Нет памяти для страницы 0x%x\n", addr);
+        isr_panic(reg);
+    }
+    if (slot != SLOT_NONE) {
+        if (slot_read(slot, frame) != 0) {
+            console_printf("[SWAP] Не удалось прочитать страницу 0x%x\n", addr);
+            isr_panic(reg);
+        }
+        swap_stats.major_faults++;
+    } else {
+        memset(PHYS_TO_VIRT(frame), 0, PAGE_SIZE);
+        swap_stats.minor_faults++;
+    }
+    if (paging_map(virt, frame, PAGE_WRITE) != 0) {
+        console_printf("[SWAP] Нет таблицы страниц для 0x%x\n", addr);
+        isr_panic(reg);
+    }
+    swap_stats.resident++;
+}
+
+int swap_alloc(uint32 size, void** addr) {
+    if (!paging_enabled()) {
+        return VFS_ERR_NOT_SUPPORTED;
+    }
+    if (size == 0) {
+        return VFS_ERR_INVALID;
+    }
+    if (size > PAGING_ANON_SIZE) {
+        return VFS_ERR_TOO_BIG;
+    }
+    SwapRegion* r = NULL;
+    for (int i = 0; i < SWAP_MAX_REGIONS && r == NULL; i++) {
+        if (regions[i].base == 0) {
+            r = &regions[i];
+        }
+    }
+    uint32 pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32 base = find_range(pages);
+    if (r == NULL || base == 0) {
+        return VFS_ERR_TOO_MANY;
+    }
+    uint32* slots = kzalloc(pages * sizeof(uint32));
+    if (slots == NULL) {
+        return VFS_ERR_NO_SPACE;
+    }
+    if (!handler_registered) {
+        if (paging_set_fault_handler(PAGING_ANON_BASE, ANON_END, page_fault) != 0) {
+            kfree(slots);
+            return VFS_ERR_TOO_MANY;
+        }
+        handler_registered = 1;
+    }
+    r->base = base;
+    r->pages = pages;
+    r->slots = slots;
+    *addr = (void*)base;
+    return 0;
+}
+
+int swap_free(void* addr) {
+    SwapRegion* r = find_region((uint32)addr);
+    if (r == NULL || (uint32)addr != r->base) {
+        return VFS_ERR_INVALID;
+    }
+    for (uint32 p = 0; p < r->pages; p++) {
+        uint32 virt = r->base + p * PAGE_SIZE;
+        uint32* pte = paging_pte(virt);
+        if (pte != NULL && (*pte & PAGE_PRESENT)) {
+            pmm_free(*pte & PAGE_FRAME);
+            *pte = 0;
+            paging_invalidate(virt);
+            swap_stats.resident--;
+        }
+        if (r->slots[p] != SLOT_NONE) {
+            slot_free(r->slots[p]);
+        }
+    }
+    kfree(r->slots);
+    r->base = 0;
+    r->slots = NULL;
+    return 0;
+}
+
+// 1 if the sectors of dev share any with [start, start + count) of
+// the ide drive
+static int overlaps_ide(const BLOCK_DEVICE* dev, uint8 drive, uint32 start, uint32 count) {
+    return blockdev_is_ide(dev) && dev->drive == drive &&
+           dev->start_lba < start + count && start < dev->start_lba + dev->sector_count;
+}
+
+// 1 if swapping would overwrite a volume: a mounted one, or the file
+// table, journal, data slots and snapshots of FS_DISK_DRIVE, which are
+// mounted without a device
+static int in_use(const BLOCK_DEVICE* dev) {
+    if (overlaps_ide(dev, FS_DISK_DRIVE, 0, SNAPSHOT_END)) {
+        return 1;
+    }
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VFS_MOUNT* m = vfs_get_mount(i);
+        if (m == NULL || m->dev == NULL) {
+            continue;
+        }
+        if (m->dev == dev || (blockdev_is_ide(m->dev) &&
+                              overlaps_ide(dev, m->dev->drive, m->dev->start_lba, m->dev->sector_count))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int swap_on(BLOCK_DEVICE* dev) {
+    if (swap_dev != NULL || in_use(dev)) {
+        return VFS_ERR_BUSY;
+    }
+    uint32 slots = dev->sector_count / SLOT_SECTORS;
+    if (slots == 0) {
+        return VFS_ERR_INVALID;
+    }
+    slot_map = kzalloc((slots + 31) / 32 * sizeof(uint32));
+    if (slot_map == NULL) {
+        return VFS_ERR_NO_SPACE;
+    }
+    swap_dev = dev;
+    slot_hint = 0;
+    swap_stats.slots = slots;
+    swap_stats.slots_used = 0;
+    return 0;
+}
+
+int swap_off() {
+    if (swap_dev == NULL) {
+        return VFS_ERR_INVALID;
+    }
+    // Pages come back only while the heap keeps its reserve
+    uint32 swapped = swap_stats.slots_used;
+    for (int i = 0; i < SWAP_MAX_REGIONS; i++) {
+        SwapRegion* r = &regions[i];
+        for (uint32 p = 0; r->base != 0 && p < r->pages; p++) {
+            uint32* pte = paging_pte(r->base + p * PAGE_SIZE);
+            if (r->slots[p] != SLOT_NONE && pte != NULL && (*pte & PAGE_PRESENT)) {
+                swapped--;
+            }
+        }
+    }
+    if (swapped + SWAP_RESERVE_FRAMES > pmm_stats.free_frames) {
+        return VFS_ERR_NO_SPACE;
+    }
+    for (int i = 0; i < SWAP_MAX_REGIONS; i++) {
+        SwapRegion* r = &regions[i];
+        for (uint32 p = 0; r->base != 0 && p < r->pages; p++) {
+            uint32 virt = r->base + p * PAGE_SIZE;
+            uint32* pte = paging_pte(virt);
+            if (r->slots[p] == SLOT_NONE) {
+                continue;
+            }
+            if (pte == NULL || !(*pte & PAGE_PRESENT)) {
+                // Evicting would need the swap being taken away
+                uint32 frame = pmm_alloc_frame();
+                if (frame == 0) {
+                    return VFS_ERR_NO_SPACE;
+                }
+                if (slot_read(r->slots[p], frame) != 0) {
+                    pmm_free(frame);
+                    return VFS_ERR_IO;
+                }
+                if (paging_map(virt, frame, PAGE_WRITE | PAGE_DIRTY) != 0) {
+                    pmm_free(frame);
+                    return VFS_ERR_NO_SPACE;
+                }
+                swap_stats.resident++;
+            } else {
+                // The page is its only copy now, a later swap_on() must write it
+                *pte |= PAGE_DIRTY;
+            }
+            slot_free(r->slots[p]);
+            r->slots[p] = SLOT_NONE;
+        }
+    }
+    kfree(slot_map);
+    slot_map = NULL;
+    swap_dev = NULL;
+    swap_stats.slots = 0;
+    return 0;
+}
+
+BLOCK_DEVICE* swap_device() {
+    return swap_dev;
+}
+
+int swap_set_limit(uint32 pages) {
+    resident_limit = pages;
+    while (resident_limit != 0 && swap_stats.resident > resident_limit) {
+        uint32 frame = evict_one();
+        if (frame == 0) {
+            return VFS_ERR_NO_SPACE; // the rest cannot leave RAM yet
+        }
+        pmm_free(frame);
+    }
+    return 0;
+}
+
+uint32 swap_limit() {
+    return resident_limit;
+}
@@ -0,0 +1,66 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "types.h"
+#include "blockdev.h"
+
+/**
+ * Anonymous memory that can outgrow physical RAM.
+ *
+ * swap_alloc() only reserves addresses in the anonymous area (paging.h).
+ * The first touch of a page raises a page fault and the handler maps a
+ * zeroed frame (a minor fault). Once the resident pages reach the limit,
+ * or the frame allocator runs low, a clock over the pages' accessed bits
+ * picks one that was not used since the hand last passed: a dirty page
+ * is written to a slot of the swap device first, a clean one already
+ * has a copy there or only holds zeros. Touching a page in swap reads
+ * it back (a major fault); it keeps its slot, so it costs no write when
+ * it is evicted again unchanged.
+ *
+ * Without a swap device only pages that hold zeros can be evicted; when
+ * no page can leave, RAM past the limit is used rather than failing.
+ * Swap I/O runs in the fault handler: like mapped files (mmap.h),
+ * anonymous memory must not be handed to a driver directly.
+ */
+
+#define SWAP_MAX_REGIONS 16
+#define SWAP_RESERVE_FRAMES 1024 // left free for the kernel heap, 4 MiB
+
+typedef struct {
+    uint32 minor_faults; // pages filled with zeros on first touch
+    uint32 major_faults; // pages read back from swap
+    uint32 pages_out;    // pages written to swap
+    uint32 evictions;    // frames taken from another page
+    uint32 resident;     // pages in RAM now
+    uint32 slots_used;   // pages with a copy in swap
+    uint32 slots;        // size of the swap device in pages, 0 - none
+} SwapStats;
+
+extern SwapStats swap_stats;
+
+// Reserve size bytes of anonymous memory, *addr receives the address
+int swap_alloc(uint32 size, void** addr);
+
+// Give back the memory at addr from swap_alloc(), its frames and slots
+int swap_free(void* addr);
+
+// Swap to dev, which must hold at least one page. Its contents are
+// overwritten: VFS_ERR_BUSY if swap is on already, if dev holds a
+// mounted volume, or if it overlaps the file system area of FS_DISK_DRIVE
+// (the whole boot drive, say).
+int swap_on(BLOCK_DEVICE* dev);
+
+// Read every page back from swap and stop using the device
+int swap_off();
+
+// The device swap_on() took, NULL if none
+BLOCK_DEVICE* swap_device();
+
+// Keep at most pages pages in RAM, 0 for as many as RAM allows. Pages
+// above a lower limit are evicted at once; VFS_ERR_NO_SPACE if some of
+// them cannot leave.
+int swap_set_limit(uint32 pages);
+
+uint32 swap_limit();
+
+#endif
@@ -0,0 +1,123 @@
+#include "trigram.h"
+#include "string.h"
+#include "ide.h" // ATA_SECTOR_SIZE
+#include "fsdisk.h"
+#include "meminfo.h"
+
+#define TRIGRAM_READ_AHEAD 64 // sectors read at once while a search walks the table
+
+static TrigramRecord records[TRIGRAM_SECTORS * TRIGRAM_RECORDS_PER_SECTOR];
+MEMINFO_STATIC(records);
+// Per sector of records: read from disk (or known to be fresh), changed since trigram_save()
+static uint32 loaded[(TRIGRAM_SECTORS + 31) / 32];
+static uint32 dirty[(TRIGRAM_SECTORS + 31) / 32];
+
+static int test_bit(const uint32* map, uint32 n) {
+    return (map[n / 32] >> (n % 32)) & 1;
+}
+
+static void set_bit(uint32* map, uint32 n) {
+    map[n / 32] |= 1u << (n % 32);
+}
+
+static uint32 trigram_bit(const uint8* p) {
+    uint32 h = (p[0] | (p[1] << 8) | (p[2] << 16)) * 0x9E3779B1;
+    return (h >> 8) % TRIGRAM_BITS;
+}
+
+// Read sector s of the records and up to count - 1 unread ones after it.
+// A sector that cannot be read holds empty records, which never match
+// a file that has contents.
+static void load_sectors(uint32 s, uint32 count) {
+    uint32 n = 0;
+    while (n < count && s + n < TRIGRAM_SECTORS && !test_bit(loaded, s + n)) {
+        n++;
+    }
+    if (n == 0) {
+        return;
+    }
+    uint8* base = (uint8*)records + s * ATA_SECTOR_SIZE;
+    if (fs_disk_read(TRIGRAM_START + s, n, base) != 0) {
+        memset(base, 0, n * ATA_SECTOR_SIZE);
+    }
+    for (uint32 i = 0; i < n; i++) {
+        set_bit(loaded, s + i);
+    }
+}
+
+void trigram_reset() {
+    memset(loaded, 0, sizeof(loaded));
+    memset(dirty, 0, sizeof(dirty));
+}
+
+// The record of an entry that is about to change, its sector is read
+// first because it is written back whole
+static TrigramRecord* record_for_update(int index) {
+    uint32 s = index / TRIGRAM_RECORDS_PER_SECTOR;
+    load_sectors(s, 1);
+    set_bit(dirty, s);
+    return &records[index];
+}
+
+void trigram_update(int index, const char* data, uint32 size) {
+    if (index < 0 || index >= MAX_FILES) {
+        return;
+    }
+    TrigramRecord* rec = record_for_update(index);
+    memset(rec->bits, 0, sizeof(rec->bits));
+    for (uint32 i = 0; i + 3 <= size; i++) {
+        set_bit(rec->bits, trigram_bit((const uint8*)data + i));
+    }
+    rec->size = size;
+    rec->data_crc = file_system[index].data_crc;
+}
+
+void trigram_copy(int from, int to) {
+    if (from < 0 || from >= MAX_FILES || to < 0 || to >= MAX_FILES || from == to) {
+        return;
+    }
+    load_sectors(from / TRIGRAM_RECORDS_PER_SECTOR, 1);
+    TrigramRecord* rec = record_for_update(to);
+    memcpy(rec, &records[from], sizeof(TrigramRecord));
+}
+
+int trigram_might_contain(int index, const char* text, uint32 length) {
+    if (index < 0 || index >= file_count || length < 3) {
+        return 1;
+    }
+    load_sectors(index / TRIGRAM_RECORDS_PER_SECTOR, TRIGRAM_READ_AHEAD);
+    TrigramRecord* rec = &records[index];
+    FileEntry* entry = &file_system[index];
+    if (rec->size != entry->size || rec->data_crc != entry->data_crc) {
+        return 1; // not indexed
+    }
+    for (uint32 i = 0; i + 3 <= length; i++) {
+        if (!test_bit(rec->bits, trigram_bit((const uint8*)text + i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int trigram_save() {
+    int res = 0;
+    uint32 s = 0;
+    while (s < TRIGRAM_SECTORS) {
+        if (!test_bit(dirty, s)) {
+            s++;
+            continue;
+        }
+        uint32 first = s;
+        while (s < TRIGRAM_SECTORS && test_bit(dirty, s)) {
+            s++;
+        }
+        if (fs_disk_write(TRIGRAM_START + first, s - first, (uint8*)records + first * ATA_SECTOR_SIZE) != 0) {
+            res = -1; // stays dirty, the next save retries it
+            continue;
+        }
+        for (uint32 i = first; i < s; i++) {
+            dirty[i / 32] &= ~(1u << (i % 32));
+        }
+    }
+    return res;
+}
@@ -0,0 +1,51 @@
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include "types.h"
+#include "filesystem.h"
+#include "journal.h"
+
+/**
+ * Trigram index of file contents, for grep.
+ *
+ * Every file has a record with a 960-bit signature: each run of three
+ * bytes of its contents sets one bit. A file can only contain a pattern
+ * if all the bits of the pattern's trigrams are set, so a search reads
+ * the contents of the files that pass this test and skips the rest.
+ *
+ * Records are kept up to date by write_file_content() and written back
+ * with the table at the checkpoint, without going through the journal.
+ * A record names the size and CRC of the contents it was built from and
+ * is ignored when they do not match the entry, so a record left stale by
+ * a crash or by an older file system only costs a read.
+ */
+
+#define TRIGRAM_BITS 960
+#define TRIGRAM_RECORDS_PER_SECTOR 4
+// After the data slots, one record per table entry
+#define TRIGRAM_START (FS_JOURNAL_START + JOURNAL_SECTORS + FS_DATA_SLOTS * FS_DATA_SECTORS)
+#define TRIGRAM_SECTORS ((MAX_FILES + TRIGRAM_RECORDS_PER_SECTOR - 1) / TRIGRAM_RECORDS_PER_SECTOR)
+
+typedef struct {
+    uint32 size;     // FileEntry.size and .data_crc of the contents indexed
+    uint32 data_crc;
+    uint32 bits[TRIGRAM_BITS / 32];
+} TrigramRecord;
+
+// Forget the records in memory, they are read again as needed (at load)
+void trigram_reset();
+
+// Index data as the contents of file_system[index]
+void trigram_update(int index, const char* data, uint32 size);
+
+// file_system[to] has taken over the contents of file_system[from]
+void trigram_copy(int from, int to);
+
+// 0 if file_system[index] certainly does not contain the text, 1 if it
+// may. Texts shorter than a trigram always may.
+int trigram_might_contain(int index, const char* text, uint32 length);
+
+// Write the records changed since the last call, 0 on success
+int trigram_save();
+
+#endif
@@ -0,0 +1,104 @@
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78
+#define CPUID_ECX_SSE42 (1 << 20)
+
+// table[0] is the classic byte table, table[k][b] is the CRC of byte b
+// followed by k zero bytes, which lets 8 input bytes be folded per step
+static uint32 table[8][256];
+static int probed = 0;
+static int have_sse42 = 0;
+
+static void crc32c_setup() {
+    uint32 eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+    have_sse42 = (ecx & CPUID_ECX_SSE42) != 0;
+
+    for (uint32 i = 0; i < 256; i++) {
+        uint32 c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        table[0][i] = c;
+    }
+    for (uint32 i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+        }
+    }
+    probed = 1;
+}
+
+static uint32 slice8(uint32 c, const uint8 *p, uint32 len) {
+    while (len > 0 && ((unsigned long)p & 3)) {
+        c = table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint32 lo = *(const uint32 *)p ^ c;
+        uint32 hi = *(const uint32 *)(p + 4);
+        c = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^
+            table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+            table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^
+            table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        c = table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+        len--;
+    }
+    return c;
+}
+
+// crc32 works on general purpose registers, no SSE state to enable.
+// Only the 32-bit form exists in protected mode: 4 bytes per instruction.
+static uint32 sse42(uint32 c, const uint8 *p, uint32 len) {
+    while (len > 0 && ((unsigned long)p & 3)) {
+        asm("crc32b %1, %0" : "+r"(c) : "rm"(*p));
+        p++;
+        len--;
+    }
+    while (len >= 8) {
+        asm("crc32l %1, %0" : "+r"(c) : "rm"(*(const uint32 *)p));
+        asm("crc32l %1, %0" : "+r"(c) : "rm"(*(const uint32 *)(p + 4)));
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        asm("crc32l %1, %0" : "+r"(c) : "rm"(*(const uint32 *)p));
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        asm("crc32b %1, %0" : "+r"(c) : "rm"(*p));
+        p++;
+        len--;
+    }
+    return c;
+}
+
+uint32 crc32c_slice8(uint32 crc, const void *data, uint32 len) {
+    if (!probed) {
+        crc32c_setup();
+    }
+    return ~slice8(~crc, data, len);
+}
+
+uint32 crc32c_sse42(uint32 crc, const void *data, uint32 len) {
+    return ~sse42(~crc, data, len);
+}
+
+uint32 crc32c(uint32 crc, const void *data, uint32 len) {
+    if (!probed) {
+        crc32c_setup();
+    }
+    return have_sse42 ? ~sse42(~crc, data, len) : ~slice8(~crc, data, len);
+}
+
+int crc32c_hw() {
+    if (!probed) {
+        crc32c_setup();
+    }
+    return have_sse42;
+}
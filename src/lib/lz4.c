@@ -0,0 +1,165 @@
+#include "lz4.h"
+#include "string.h"
+
+#define LZ4_MIN_MATCH   4
+#define LZ4_LAST_LITERALS 5  // the block always ends with literals
+#define LZ4_MF_LIMIT    12   // no match may start in the last 12 bytes
+#define LZ4_HASH_LOG    12
+
+static uint16 g_hash_table[1 << LZ4_HASH_LOG];
+
+static uint32 read32(const uint8 *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+static uint32 hash4(const uint8 *p, uint32 hash_log) {
+    return (read32(p) * 2654435761u) >> (32 - hash_log);
+}
+
+// 15 in the token, then 255s until the rest fits in a byte
+static uint8 *write_length(uint8 *op, uint32 length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8)length;
+    return op;
+}
+
+uint32 lz4_compress(const uint8 *src, uint32 len, uint8 *dst, uint32 capacity) {
+    const uint8 *ip = src;
+    const uint8 *anchor = src;            // first literal not yet emitted
+    const uint8 *end = src + len;
+    const uint8 *match_limit = end - LZ4_MF_LIMIT;
+    uint8 *op = dst;
+    uint8 *op_end = dst + capacity;
+
+    if (len > LZ4_MAX_INPUT)
+        return 0;
+    // small blocks get a smaller table, clearing it dominates otherwise
+    uint32 hash_log = LZ4_HASH_LOG;
+    while (hash_log > 8 && (1u << (hash_log + 1)) > len)
+        hash_log--;
+    memset(g_hash_table, 0, sizeof(uint16) << hash_log);
+
+    if (len >= LZ4_MF_LIMIT + 1) {
+        ip++;
+        while (ip < match_limit) {
+            uint32 h = hash4(ip, hash_log);
+            const uint8 *ref = src + g_hash_table[h];
+            g_hash_table[h] = (uint16)(ip - src);
+            if (ref >= ip || read32(ref) != read32(ip)) {
+                ip++;
+                continue;
+            }
+
+            // extend the match, leaving the last literals alone
+            const uint8 *match_end = ip + LZ4_MIN_MATCH;
+            const uint8 *ref_end = ref + LZ4_MIN_MATCH;
+            while (match_end < end - LZ4_LAST_LITERALS && *match_end == *ref_end) {
+                match_end++;
+                ref_end++;
+            }
+            // and backwards over literals that also match
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            uint32 literals = ip - anchor;
+            uint32 match_len = match_end - ip - LZ4_MIN_MATCH;
+            // token + literal length bytes + literals + offset + match length bytes
+            if (op + 1 + literals / 255 + 1 + literals + 2 + match_len / 255 + 1 > op_end)
+                return 0;
+
+            uint8 *token = op++;
+            *token = (literals >= 15 ? 15 : literals) << 4;
+            if (literals >= 15)
+                op = write_length(op, literals - 15);
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            uint32 offset = ip - ref;
+            *op++ = (uint8)offset;
+            *op++ = (uint8)(offset >> 8);
+            *token |= match_len >= 15 ? 15 : match_len;
+            if (match_len >= 15)
+                op = write_length(op, match_len - 15);
+
+            ip = match_end;
+            anchor = ip;
+            if (ip < match_limit) {
+                // position inside the match, helps the next search
+                g_hash_table[hash4(ip - 2, hash_log)] = (uint16)(ip - 2 - src);
+            }
+        }
+    }
+
+    // last literals
+    uint32 literals = end - anchor;
+    if (op + 1 + literals / 255 + 1 + literals > op_end)
+        return 0;
+    uint8 *token = op++;
+    *token = (literals >= 15 ? 15 : literals) << 4;
+    if (literals >= 15)
+        op = write_length(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+    return op - dst;
+}
+
+int lz4_decompress(const uint8 *src, uint32 len, uint8 *dst, uint32 capacity) {
+    const uint8 *ip = src;
+    const uint8 *ip_end = src + len;
+    uint8 *op = dst;
+    uint8 *op_end = dst + capacity;
+
+    while (ip < ip_end) {
+        uint8 token = *ip++;
+
+        uint32 literals = token >> 4;
+        if (literals == 15) {
+            uint8 b;
+            do {
+                if (ip >= ip_end)
+                    return -1;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (uint32)(ip_end - ip) || literals > (uint32)(op_end - op))
+            return -1;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == ip_end)
+            break; // the last sequence has no match
+
+        if (ip_end - ip < 2)
+            return -1;
+        uint32 offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32)(op - dst))
+            return -1;
+
+        uint32 match_len = token & 15;
+        if (match_len == 15) {
+            uint8 b;
+            do {
+                if (ip >= ip_end)
+                    return -1;
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (match_len > (uint32)(op_end - op))
+            return -1;
+
+        // byte by byte, the match may overlap what it produces
+        const uint8 *ref = op - offset;
+        while (match_len--)
+            *op++ = *ref++;
+    }
+    return op - dst;
+}
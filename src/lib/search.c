@@ -0,0 +1,90 @@
+#include "search.h"
+
+#define ONES  0x01010101
+#define HIGHS 0x80808080
+
+// x86 loads words at any address
+typedef uint32 __attribute__((aligned(1), may_alias)) unaligned_uint32;
+
+// high bit set in every zero byte of v. A byte above a zero one may be
+// flagged as well when the subtraction borrows, the caller verifies.
+static inline uint32 zero_bytes(uint32 v) {
+    return (v - ONES) & ~v & HIGHS;
+}
+
+// high bit set in exactly the zero bytes of v
+static inline uint32 zero_bytes_exact(uint32 v) {
+    return ~(((v & ~HIGHS) + ~HIGHS) | v | ~HIGHS);
+}
+
+static int matches_at(const uint8 *text, const uint8 *pattern, uint32 pattern_len) {
+    for (uint32 i = 0; i < pattern_len; i++) {
+        if (text[i] != pattern[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int mem_find(const void *text, uint32 len, const void *pattern, uint32 pattern_len) {
+    const uint8 *t = text;
+    const uint8 *p = pattern;
+    if (pattern_len == 0) {
+        return 0;
+    }
+    if (pattern_len > len) {
+        return -1;
+    }
+    uint32 last_start = len - pattern_len;
+    uint32 first = p[0] * ONES;
+    uint32 last = p[pattern_len - 1] * ONES;
+    uint32 i = 0;
+
+    // four starts i .. i + 3 per step, the loads stay inside the text
+    for (; i + 3 <= last_start; i += 4) {
+        uint32 head = *(const unaligned_uint32 *)(t + i);
+        uint32 tail = *(const unaligned_uint32 *)(t + i + pattern_len - 1);
+        uint32 hits = zero_bytes(head ^ first) & zero_bytes(tail ^ last);
+        while (hits != 0) {
+            uint32 k = __builtin_ctz(hits) / 8; // little endian: byte k is start i + k
+            if (matches_at(t + i + k, p, pattern_len)) {
+                return i + k;
+            }
+            hits &= hits - 1;
+        }
+    }
+    for (; i <= last_start; i++) {
+        if (t[i] == p[0] && matches_at(t + i, p, pattern_len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int mem_find_bytewise(const void *text, uint32 len, const void *pattern, uint32 pattern_len) {
+    const uint8 *t = text;
+    if (pattern_len > len) {
+        return -1;
+    }
+    for (uint32 i = 0; i + pattern_len <= len; i++) {
+        if (matches_at(t + i, pattern, pattern_len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint32 mem_count(const void *text, uint32 len, uint8 c) {
+    const uint8 *t = text;
+    uint32 pattern = c * ONES;
+    uint32 count = 0;
+    uint32 i = 0;
+    for (; i + 4 <= len; i += 4) {
+        uint32 hits = zero_bytes_exact(*(const unaligned_uint32 *)(t + i) ^ pattern);
+        count += ((hits >> 7) * ONES) >> 24; // sum of the four flags
+    }
+    for (; i < len; i++) {
+        count += t[i] == c;
+    }
+    return count;
+}
@@ -3,6 +3,7 @@
 #include "console.h"
 #include "string.h"
 #include "types.h"
+#include "paging.h"
 
 // Declare the global exit flag (defined in kernel.c)
 extern volatile int g_exit_program;
@@ -30,7 +31,7 @@ void console_clear(VGA_COLOR_TYPE fore_color, VGA_COLOR_TYPE back_color) {
 }
 
 void console_init(VGA_COLOR_TYPE fore_color, VGA_COLOR_TYPE back_color) {
-    g_vga_buffer = (uint16 *)VGA_ADDRESS;
+    g_vga_buffer = (uint16 *)PHYS_TO_VIRT(VGA_ADDRESS);
     g_fore_color = fore_color;
     g_back_color = back_color;
     cursor_pos_x = 0;
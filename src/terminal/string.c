@@ -30,6 +30,31 @@ int memcmp(uint8 *s1, uint8 *s2, uint32 n) {
     return 1;
 }
 
+// A word at a time once buf is aligned, four words per test
+int mem_is_zero(const void *buf, uint32 n) {
+    const uint8 *p = buf;
+    while (n > 0 && ((unsigned long)p & 3)) {
+        if (*p++)
+            return 0;
+        n--;
+    }
+    const uint32 *w = (const uint32 *)p;
+    for (; n >= 16; n -= 16, w += 4) {
+        if (w[0] | w[1] | w[2] | w[3])
+            return 0;
+    }
+    for (; n >= 4; n -= 4) {
+        if (*w++)
+            return 0;
+    }
+    p = (const uint8 *)w;
+    while (n--) {
+        if (*p++)
+            return 0;
+    }
+    return 1;
+}
+
 int strlen(const char *s) {
     int len = 0;
     while (*s++)
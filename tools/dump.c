@@ -0,0 +1,123 @@
+// dump.infs: show what is in a disk image.
+//
+//   dump.infs [-v] <image> [path]
+//
+// Lists the tree below path (default "/") with permissions, size and
+// flags, or writes the contents to stdout when path is a file.
+// The image is only read, the journal is replayed in memory.
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filesystem.h"
+#include "fsdisk.h"
+#include "host.h"
+
+static void print_perms(const FileEntry* entry) {
+    static const char bits[] = "rwxrwxrwx";
+    putchar(entry->is_directory ? 'd' : '-');
+    for (int i = 0; i < 9; i++) {
+        putchar(entry->permissions & (0400 >> i) ? bits[i] : '-');
+    }
+}
+
+static void print_entry(int index) {
+    FileEntry* entry = &file_system[index];
+    char path[MAX_PATH_LENGTH];
+    get_file_path(index, path);
+    print_perms(entry);
+    printf(" %6u %c%c %s%s\n", entry->size,
+           entry->flags & FS_FLAG_COMPRESS ? 'c' : '-',
+           entry->flags & FS_FLAG_LZ4 ? 'z' : '-',
+           path, entry->is_directory && index != FS_ROOT_INDEX ? "/" : "");
+}
+
+// Children of every directory as linked lists, built in one pass over the table
+static int first_child[MAX_FILES];
+static int next_sibling[MAX_FILES];
+
+static void link_children() {
+    for (int i = 0; i < file_count; i++) {
+        first_child[i] = -1;
+    }
+    for (int i = file_count - 1; i > FS_ROOT_INDEX; i--) {
+        uint32 parent = file_keys[i].parent_id;
+        if (parent < (uint32)file_count) {
+            next_sibling[i] = first_child[parent];
+            first_child[parent] = i;
+        }
+    }
+}
+
+// Depth first, children in table order. The depth limit keeps a
+// corrupted table with a parent loop from recursing forever.
+static void print_tree(int dir, int depth) {
+    print_entry(dir);
+    if (depth >= MAX_PATH_LENGTH / 2) {
+        return;
+    }
+    for (int i = first_child[dir]; i != -1; i = next_sibling[i]) {
+        if (file_system[i].is_directory) {
+            print_tree(i, depth + 1);
+        } else {
+            print_entry(i);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* image = NULL;
+    const char* path = "/";
+    int args = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            host_verbose = 1;
+        } else if (args == 0) {
+            image = argv[i];
+            args++;
+        } else if (args == 1) {
+            path = argv[i];
+            args++;
+        } else {
+            image = NULL;
+            break;
+        }
+    }
+    if (image == NULL) {
+        fprintf(stderr, "usage: dump.infs [-v] <image> [path]\n");
+        return 2;
+    }
+    if (host_open_image(image, 0) != 0) {
+        perror(image);
+        return 2;
+    }
+    // load_file_system() starts an empty table when there is none, say so instead
+    static uint8 sector[512];
+    if (fs_disk_read(FS_START_SECTOR, 1, sector) != 0 || fs_check_header((FsHeader*)sector) != 0) {
+        fprintf(stderr, "dump.infs: %s: no file table\n", image);
+        return 1;
+    }
+    load_file_system();
+
+    int index = find_file(path);
+    if (index == -1) {
+        fprintf(stderr, "dump.infs: %s: not found\n", path);
+        return 1;
+    }
+    if (file_system[index].is_directory) {
+        link_children();
+        print_tree(index, 0);
+        return 0;
+    }
+    if (file_system[index].size > 0) {
+        const char* content = read_file_content(index);
+        if (content == NULL) {
+            fprintf(stderr, "dump.infs: %s: contents unreadable\n", path);
+            return 1;
+        }
+        fwrite(content, 1, file_system[index].size, stdout);
+    }
+    return 0;
+}
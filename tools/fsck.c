@@ -0,0 +1,250 @@
+// fsck.infs: check the file table in a disk image without changing it.
+//
+//   fsck.infs [-v] <image>
+//
+// The header and metadata block CRCs are verified and the journal is
+// replayed in memory the same way the kernel does at boot, so what is
+// checked is the tree the kernel would see. Exit status is 0
+// when the image is clean, 1 when problems were found, 2 on usage errors.
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filesystem.h"
+#include "namepool.h"
+#include "crc32c.h"
+#include "fsdisk.h"
+#include "host.h"
+
+static unsigned problems;
+static int names_ok = 1; // paths can be printed only when every name is readable
+static uint32 slot_owner[FS_DATA_SLOTS + 1]; // entry index + 1, 0 - свободен
+
+static void report(int index, const char* what) {
+    char path[MAX_PATH_LENGTH];
+    if (names_ok) {
+        get_file_path(index, path);
+        printf("%s (entry %d): %s\n", path, index, what);
+    } else {
+        printf("entry %d: %s\n", index, what);
+    }
+    problems++;
+}
+
+static int check_header() {
+    static uint8 sector[512];
+    FsHeader* header = (FsHeader*)sector;
+    if (fs_disk_read(FS_START_SECTOR, 1, sector) != 0) {
+        printf("cannot read the header sector\n");
+        return -1;
+    }
+    switch (fs_check_header(header)) {
+    case FS_HEADER_NONE:
+        printf("no file table: bad magic %08x\n", header->magic);
+        return -1;
+    case FS_HEADER_VERSION:
+        printf("unsupported version %u, this fsck knows %u to %u\n", header->version, FS_VERSION_OLDEST,
+               FS_VERSION);
+        return -1;
+    case FS_HEADER_CORRUPT:
+        printf("header corrupt: bad CRC or counts (%u entries, %u pool bytes)\n", header->file_count,
+               header->pool_used);
+        return -1;
+    }
+    return 0;
+}
+
+static uint8 is_record[FS_NAME_POOL_BYTES]; // name pool offsets where a record starts
+
+// Every record ends inside the pool with its terminating zero, and every
+// entry names the start of a record holding a non-empty name without '/'
+static void check_names() {
+    uint32 used = name_pool_used();
+    const char* end = (const char*)name_pool_data() + used;
+    uint32 name = name_pool_next(NAME_POOL_NONE);
+    while (name != NAME_POOL_NONE) {
+        const char* text = name_pool_get(name);
+        if (text >= end || strnlen(text, end - text) == (size_t)(end - text)) {
+            printf("name pool: record at %u runs past the end of the pool\n", name);
+            problems++;
+            break;
+        }
+        is_record[name] = 1;
+        name = name_pool_next(name);
+    }
+
+    for (int i = 0; i < file_count; i++) {
+        name = file_keys[i].name;
+        if (name == NAME_POOL_NONE || name >= used || !is_record[name]) {
+            names_ok = 0;
+            report(i, "name is not a name pool record");
+            continue;
+        }
+        const char* text = name_pool_get(name);
+        size_t len = strnlen(text, MAX_FILENAME);
+        if (len == 0 || len >= MAX_FILENAME) {
+            names_ok = 0;
+            report(i, "bad name length");
+        } else if (i != FS_ROOT_INDEX && strchr(text, '/') != NULL) {
+            names_ok = 0;
+            report(i, "'/' in name");
+        }
+    }
+}
+
+static void check_tree() {
+    if (!file_system[FS_ROOT_INDEX].is_directory || file_keys[FS_ROOT_INDEX].parent_id != FS_ROOT_INDEX) {
+        report(FS_ROOT_INDEX, "root is not a directory that is its own parent");
+    }
+    for (int i = 1; i < file_count; i++) {
+        uint32 parent = file_keys[i].parent_id;
+        if (parent >= (uint32)file_count) {
+            report(i, "parent outside the table");
+            continue;
+        }
+        if (!file_system[parent].is_directory) {
+            report(i, "parent is not a directory");
+            continue;
+        }
+        // Walk up to the root, a chain longer than the table is a loop
+        int at = i;
+        int steps = 0;
+        while (at != FS_ROOT_INDEX && steps <= file_count && file_keys[at].parent_id < (uint32)file_count) {
+            at = file_keys[at].parent_id;
+            steps++;
+        }
+        if (at != FS_ROOT_INDEX) {
+            report(i, "not reachable from the root");
+        }
+    }
+}
+
+static int compare_names(const void* a, const void* b) {
+    const FileKey* x = &file_keys[*(const int*)a];
+    const FileKey* y = &file_keys[*(const int*)b];
+    if (x->parent_id != y->parent_id) {
+        return x->parent_id < y->parent_id ? -1 : 1;
+    }
+    if (x->name != y->name) {
+        return x->name < y->name ? -1 : 1;
+    }
+    return 0;
+}
+
+// Names are interned, so equal names in one directory are equal (parent, name) pairs
+static void check_duplicates() {
+    static int order[MAX_FILES];
+    int count = 0;
+    for (int i = 1; i < file_count; i++) {
+        order[count++] = i;
+    }
+    qsort(order, count, sizeof(int), compare_names);
+    for (int i = 1; i < count; i++) {
+        if (compare_names(&order[i - 1], &order[i]) == 0) {
+            report(order[i], "duplicate name in directory");
+        }
+    }
+}
+
+static void check_data() {
+    for (int i = 0; i < file_count; i++) {
+        FileEntry* entry = &file_system[i];
+        uint32 slot = entry->data_slot;
+        if (entry->flags & ~(FS_FLAG_COMPRESS | FS_FLAG_LZ4)) {
+            report(i, "unknown flags");
+        }
+        if (entry->is_directory) {
+            if (entry->size != 0 || slot != 0) {
+                report(i, "directory with contents");
+            }
+            continue;
+        }
+        if (entry->size > MAX_FILE_SIZE) {
+            report(i, "larger than MAX_FILE_SIZE");
+            continue;
+        }
+        if (entry->size == 0 && slot != 0) {
+            report(i, "data slot for an empty file");
+            continue;
+        }
+        // Contents of nothing but zeros are not stored
+        if (slot == 0) {
+            static const char zeros[MAX_FILE_SIZE];
+            if (entry->size != 0 && crc32c(0, zeros, entry->size) != entry->data_crc) {
+                report(i, "no data slot for a file that is not all zeros");
+            }
+            continue;
+        }
+        if (slot > FS_DATA_SLOTS) {
+            report(i, "data slot out of range");
+            continue;
+        }
+        // Copies share a slot, they must agree on what is in it
+        if (slot_owner[slot] != 0) {
+            FileEntry* owner = &file_system[slot_owner[slot] - 1];
+            if (owner->size != entry->size || owner->data_crc != entry->data_crc ||
+                (owner->flags & FS_FLAG_LZ4) != (entry->flags & FS_FLAG_LZ4)) {
+                char what[64];
+                snprintf(what, sizeof(what), "data slot %u shared with entry %u", slot, slot_owner[slot] - 1);
+                report(i, what);
+            }
+            continue;
+        }
+        slot_owner[slot] = i + 1;
+        if (read_file_content(i) == NULL) {
+            report(i, "contents unreadable, corrupt or failing their CRC");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* image = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            host_verbose = 1;
+        } else if (image == NULL && argv[i][0] != '-') {
+            image = argv[i];
+        } else {
+            image = NULL;
+            break;
+        }
+    }
+    if (image == NULL) {
+        fprintf(stderr, "usage: fsck.infs [-v] <image>\n");
+        return 2;
+    }
+    if (host_open_image(image, 0) != 0) {
+        perror(image);
+        return 2;
+    }
+    if (check_header() != 0) {
+        return 1;
+    }
+    load_file_system();
+    if (fs_crc_errors > 0) {
+        printf("%u metadata blocks fail their CRC\n", fs_crc_errors);
+        problems += fs_crc_errors;
+    }
+
+    check_names();
+    check_tree();
+    check_duplicates();
+    check_data();
+    host_close_image();
+
+    unsigned files = 0;
+    unsigned dirs = 0;
+    unsigned long bytes = 0;
+    for (int i = 0; i < file_count; i++) {
+        if (file_system[i].is_directory) {
+            dirs++;
+        } else {
+            files++;
+            bytes += file_system[i].size;
+        }
+    }
+    printf("%s: %u files, %u directories, %lu bytes, %u problem%s\n", image, files, dirs, bytes,
+           problems, problems == 1 ? "" : "s");
+    return problems > 0 ? 1 : 0;
+}
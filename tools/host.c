@@ -0,0 +1,129 @@
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "filesystem.h"
+#include "fsdisk.h"
+#include "journal.h"
+#include "trigram.h"
+#include "snapshot.h"
+#include "host.h"
+
+#define SECTOR_SIZE 512
+
+int host_verbose = 0;
+unsigned host_io_errors = 0;
+
+static int image_fd = -1;
+static int image_writable = 0;
+
+int host_open_image(const char* path, int writable) {
+    image_fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (image_fd < 0) {
+        return -1;
+    }
+    image_writable = writable;
+    if (!writable) {
+        return 0;
+    }
+    struct stat st;
+    off_t need = (off_t)HOST_IMAGE_SECTORS * SECTOR_SIZE;
+    if (fstat(image_fd, &st) != 0 || (st.st_size < need && ftruncate(image_fd, need) != 0)) {
+        close(image_fd);
+        image_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int host_close_image() {
+    int res = 0;
+    if (image_fd < 0) {
+        return 0;
+    }
+    if (image_writable) {
+        res = fsync(image_fd);
+    }
+    if (close(image_fd) != 0) {
+        res = -1;
+    }
+    image_fd = -1;
+    return res;
+}
+
+int fs_disk_read(uint32 lba, uint32 count, void* buffer) {
+    char* out = buffer;
+    size_t left = (size_t)count * SECTOR_SIZE;
+    off_t pos = (off_t)lba * SECTOR_SIZE;
+    while (left > 0) {
+        ssize_t n = pread(image_fd, out, left, pos);
+        if (n < 0) {
+            host_io_errors++;
+            return -1;
+        }
+        if (n == 0) {
+            // Past the end of the image: never written, reads as zeros
+            for (size_t i = 0; i < left; i++) {
+                out[i] = 0;
+            }
+            break;
+        }
+        out += n;
+        pos += n;
+        left -= n;
+    }
+    return 0;
+}
+
+int fs_disk_write(uint32 lba, uint32 count, const void* buffer) {
+    const char* in = buffer;
+    size_t left = (size_t)count * SECTOR_SIZE;
+    off_t pos = (off_t)lba * SECTOR_SIZE;
+    if (!image_writable) {
+        host_io_errors++;
+        return -1;
+    }
+    while (left > 0) {
+        ssize_t n = pwrite(image_fd, in, left, pos);
+        if (n <= 0) {
+            host_io_errors++;
+            return -1;
+        }
+        in += n;
+        pos += n;
+        left -= n;
+    }
+    return 0;
+}
+
+// console.h, the kernel's format subset is a subset of printf's
+void console_putstr(const char* str) {
+    if (host_verbose) {
+        fputs(str, stderr);
+    }
+}
+
+void console_printf(const char* format, ...) {
+    if (host_verbose) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+}
+
+// tsc.h, only used for the load time in the log
+uint32 tsc_kcycles() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000); // микросекунды, не такты
+}
+
+// string.c refers to the keyboard for term_getchar()
+char kb_getchar() {
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef TOOLS_HOST_H
+#define TOOLS_HOST_H
+
+/**
+ * Host side of the file table code for the tools in this directory.
+ *
+ * filesystem.c, journal.c and namepool.c are compiled unchanged; the
+ * disk they see (fsdisk.h) is an image file, sector 0 of the image is
+ * sector 0 of the kernel's FS_DISK_DRIVE. Console output of the file
+ * system goes to stderr when host_verbose is set.
+ *
+ * The kernel's string.c is linked in as well, so memcmp() here returns
+ * 1 for equal buffers and sprintf() only knows %d and %s: the tools use
+ * snprintf() and compare with strcmp().
+ */
+
+// Sectors an image needs to hold the header, table, pool, journal, every
+// data slot, the trigram index and the snapshots
+#define HOST_IMAGE_SECTORS SNAPSHOT_END
+
+extern int host_verbose;
+// Failed fs_disk_read()/fs_disk_write() calls. save_file_system() only
+// logs its errors, the tools check this instead.
+extern unsigned host_io_errors;
+
+// Open the image for fs_disk_read()/fs_disk_write(), 0 on success.
+// A writable image is created if missing and grown to HOST_IMAGE_SECTORS,
+// sectors past the end of a read-only image read as zeros.
+int host_open_image(const char* path, int writable);
+// Flush and close, 0 on success
+int host_close_image();
+
+#endif
@@ -0,0 +1,191 @@
+// mkfs.infs: format a disk image with the file table, optionally filled
+// with the contents of a host directory.
+//
+//   mkfs.infs [-c] [-v] <image> [dir]
+//
+// -c stores new files LZ4-compressed where that saves sectors (like the
+// "compress" mount option), -v shows the file system log. The image can
+// be handed to QEMU as is: qemu-system-i386 -cdrom IntrenOS.iso -hda <image>
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "filesystem.h"
+#include "host.h"
+
+typedef struct {
+    unsigned files;
+    unsigned dirs;
+    unsigned long bytes;
+    unsigned skipped;
+} MkfsStats;
+
+static MkfsStats stats;
+
+static int join(char* out, size_t size, const char* dir, const char* name) {
+    int n = snprintf(out, size, strcmp(dir, "/") == 0 ? "%s%s" : "%s/%s", dir, name);
+    return n > 0 && (size_t)n < size ? 0 : -1;
+}
+
+static void skip(const char* host_path, const char* why) {
+    fprintf(stderr, "mkfs.infs: skipping %s: %s\n", host_path, why);
+    stats.skipped++;
+}
+
+static const char* fs_error(int res) {
+    switch (res) {
+    case FS_ERR_FULL:      return "file system full";
+    case FS_ERR_EXISTS:    return "already exists";
+    case FS_ERR_NO_PARENT: return "no parent directory";
+    case FS_ERR_BAD_NAME:  return "bad name";
+    default:               return "error";
+    }
+}
+
+static int add_file(const char* host_path, const char* path, const struct stat* st) {
+    static char data[MAX_FILE_SIZE];
+    if (st->st_size > MAX_FILE_SIZE) {
+        skip(host_path, "larger than MAX_FILE_SIZE");
+        return 0;
+    }
+    int fd = open(host_path, O_RDONLY);
+    if (fd < 0) {
+        skip(host_path, "cannot open");
+        return 0;
+    }
+    ssize_t size = read(fd, data, sizeof(data));
+    close(fd);
+    if (size < 0) {
+        skip(host_path, "read error");
+        return 0;
+    }
+
+    int index = create_file(path, 0, st->st_mode & 0777);
+    if (index < 0) {
+        fprintf(stderr, "mkfs.infs: %s: %s\n", path, fs_error(index));
+        return index == FS_ERR_FULL ? -1 : 0;
+    }
+    if (size > 0 && write_file_content(index, data, size) != 0) {
+        fprintf(stderr, "mkfs.infs: %s: cannot write contents\n", path);
+        return -1;
+    }
+    stats.files++;
+    stats.bytes += size;
+    return 0;
+}
+
+// Copy the entries of host_dir below path, in name order so that the
+// same tree always gives the same image
+static int add_tree(const char* host_dir, const char* path) {
+    struct dirent** names;
+    int count = scandir(host_dir, &names, NULL, alphasort);
+    int res = 0;
+    if (count < 0) {
+        skip(host_dir, "cannot list");
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        const char* name = names[i]->d_name;
+        char host_path[4096];
+        char child[MAX_PATH_LENGTH];
+        struct stat st;
+
+        if (res != 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        if (snprintf(host_path, sizeof(host_path), "%s/%s", host_dir, name) >= (int)sizeof(host_path) ||
+            lstat(host_path, &st) != 0) {
+            skip(host_path, "cannot stat");
+            continue;
+        }
+        if (strnlen(name, MAX_FILENAME) >= MAX_FILENAME || join(child, sizeof(child), path, name) != 0) {
+            skip(host_path, "name or path too long");
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            int index = create_file(child, 1, st.st_mode & 0777);
+            if (index == FS_ERR_EXISTS) {
+                index = find_file(child); // /home is made by init_file_system()
+            }
+            if (index < 0 || !file_system[index].is_directory) {
+                fprintf(stderr, "mkfs.infs: %s: %s\n", child, fs_error(index));
+                res = index == FS_ERR_FULL ? -1 : 0;
+                continue;
+            }
+            stats.dirs++;
+            res = add_tree(host_path, child);
+        } else if (S_ISREG(st.st_mode)) {
+            res = add_file(host_path, child, &st);
+        } else {
+            skip(host_path, "not a regular file or directory");
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return res;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: mkfs.infs [-c] [-v] <image> [dir]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    const char* image = NULL;
+    const char* source = NULL;
+    int compress = 0;
+    struct timespec started, finished;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            compress = 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            host_verbose = 1;
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else if (image == NULL) {
+            image = argv[i];
+        } else if (source == NULL) {
+            source = argv[i];
+        } else {
+            usage();
+        }
+    }
+    if (image == NULL) {
+        usage();
+    }
+    if (host_open_image(image, 1) != 0) {
+        perror(image);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    init_file_system();
+    fs_compress_default = compress ? FS_FLAG_COMPRESS : 0;
+    int res = source != NULL ? add_tree(source, "/") : 0;
+    // The journal checkpoints by itself when it fills, one save at the end is enough
+    commit_file_system();
+    save_file_system();
+    if (host_close_image() != 0 || host_io_errors > 0) {
+        fprintf(stderr, "mkfs.infs: %s: write error\n", image);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    long us = (finished.tv_sec - started.tv_sec) * 1000000L + (finished.tv_nsec - started.tv_nsec) / 1000;
+    printf("%s: %d entries (%u files, %u directories), %lu bytes", image, file_count,
+           stats.files, stats.dirs, stats.bytes);
+    if (stats.skipped > 0) {
+        printf(", %u skipped", stats.skipped);
+    }
+    printf(", %ld.%03ld ms\n", us / 1000, us % 1000);
+    return res != 0 ? 1 : 0;
+}